@@ -0,0 +1,492 @@
+/*
+ * Library: libfins
+ * File:    examples/fins_bench.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file examples/fins_bench.c contains a benchmark which runs a fixed
+ * mix of FINS commands against a PLC and reports the throughput. Without an
+ * address a stand-in PLC is started in a separate thread on the loopback
+ * interface, so that the benchmark can run on any build host. The workload is
+ * also used as the training run for the profile guided build of the library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ! defined(_WIN32)
+#include <unistd.h>
+#include <netinet/in.h>
+#endif  /* ! defined(_WIN32) */
+
+#include "fins.h"
+
+#define BENCH_DEFAULT_LOOPS	20000
+#define BENCH_DEFAULT_PORT	9660
+#define BENCH_ADDRESS_LOOPS	50
+
+#define SIM_WORDS		4096
+#define SIM_BUFLEN		2048
+
+static unsigned char		sim_buffer[SIM_BUFLEN];
+static unsigned char		sim_reply[SIM_BUFLEN];
+static uint16_t			sim_memory[256][SIM_WORDS];
+
+static const char * volatile	bench_address[] = {
+	"DM100", "DM2000", "CIO10", "CIO10.05", "W20", "W20.15", "H5", "H5.01", "A400", "TIM5", "CNT10", "DR3", "IR1", NULL
+};
+
+static int			run_address( int loops );
+static int			run_commands( struct fins_sys_tp *sys, int loops );
+static size_t			sim_process( const unsigned char *cmd, size_t cmdlen, unsigned char *body );
+static SOCKET			sim_start( uint16_t port );
+
+#if defined(_WIN32)
+static DWORD WINAPI		sim_thread( LPVOID arg );
+#else  /* defined(_WIN32) */
+static void *			sim_thread( void *arg );
+#endif  /* defined(_WIN32) */
+
+/*
+ * int main( int argc, char *argv[] );
+ *
+ * The benchmark is called as fins_bench [-n loops] [-t] [address [port]].
+ * Without an address the built-in stand-in PLC is used over UDP. With an
+ * address a real PLC is used over UDP, or over TCP with the option -t.
+ */
+
+int main( int argc, char *argv[] ) {
+
+	struct fins_sys_tp *sys;
+	struct fins_cpudata_tp cpudata;
+	const char *address;
+	uint16_t port;
+	uint64_t start;
+	uint64_t usec;
+	int loops;
+	int argn;
+	int error_val;
+	int num_cmd;
+	bool use_tcp;
+	char buffer[128];
+#if defined(_WIN32)
+	WSADATA wsa_data;
+
+	WSAStartup( MAKEWORD( 2, 2 ), & wsa_data );
+#endif  /* defined(_WIN32) */
+
+	loops   = BENCH_DEFAULT_LOOPS;
+	use_tcp = false;
+	address = NULL;
+	port    = 0;
+	argn    = 1;
+
+	while ( argn < argc  &&  argv[argn][0] == '-' ) {
+
+		if      ( strcmp( argv[argn], "-t" ) == 0                   ) { use_tcp = true;                 argn += 1; }
+		else if ( strcmp( argv[argn], "-n" ) == 0  &&  argn+1 < argc ) { loops   = atoi( argv[argn+1] ); argn += 2; }
+		else break;
+	}
+
+	if ( argn < argc ) address = argv[argn++];
+	if ( argn < argc ) port    = (uint16_t) atoi( argv[argn++] );
+
+	if ( argn < argc  ||  loops <= 0  ||  ( use_tcp  &&  address == NULL ) ) {
+
+		fprintf( stderr, "Usage: %s [-n loops] [-t] [address [port]]\n", argv[0] );
+		return 1;
+	}
+
+	if ( address == NULL ) {
+
+		address = "127.0.0.1";
+		port    = BENCH_DEFAULT_PORT;
+
+		if ( sim_start( port ) == INVALID_SOCKET ) {
+
+			fprintf( stderr, "%s: cannot start the stand-in PLC on UDP port %u\n", argv[0], (unsigned int) port );
+			return 1;
+		}
+	}
+
+	if ( port == 0 ) port = FINS_DEFAULT_PORT;
+
+	if ( use_tcp ) sys = finslib_tcp_connect( NULL, address, port, 0, 10, 0, 0, 0, 0, & error_val, 0 );
+	else           sys = finslib_udp_connect( NULL, address, port, 0, 10, 0, 0, 0, 0, & error_val, 0 );
+
+	if ( sys == NULL ) {
+
+		fprintf( stderr, "%s: %s\n", address, finslib_errmsg( error_val, buffer, sizeof(buffer) ) );
+		return 1;
+	}
+
+	error_val = finslib_cpu_unit_data_read( sys, & cpudata );
+
+	if ( error_val != FINS_RETVAL_SUCCESS ) {
+
+		fprintf( stderr, "%s: %s\n", address, finslib_errmsg( error_val, buffer, sizeof(buffer) ) );
+		finslib_disconnect( sys );
+		return 1;
+	}
+
+	start   = finslib_monotonic_usec_timer();
+	num_cmd = run_commands( sys, loops );
+	usec    = finslib_monotonic_usec_timer() - start;
+
+	if ( num_cmd < 0 ) {
+
+		fprintf( stderr, "%s: %s\n", address, finslib_errmsg( -num_cmd, buffer, sizeof(buffer) ) );
+		finslib_disconnect( sys );
+		return 1;
+	}
+
+	if ( usec == 0 ) usec = 1;
+
+	printf( "commands: %d in %.3f s, %.0f commands/s, %.2f us/command\n", num_cmd, (double) usec / 1e6, (double) num_cmd * 1e6 / (double) usec, (double) usec / (double) num_cmd );
+
+	start   = finslib_monotonic_usec_timer();
+	num_cmd = run_address( loops );
+	usec    = finslib_monotonic_usec_timer() - start;
+
+	if ( usec == 0 ) usec = 1;
+
+	printf( "addresses: %d in %.3f s, %.1f ns/address\n", num_cmd, (double) usec / 1e6, (double) usec * 1e3 / (double) num_cmd );
+
+	finslib_disconnect( sys );
+
+	return 0;
+
+}  /* main */
+
+/*
+ * static int run_commands( struct fins_sys_tp *sys, int loops );
+ *
+ * The function run_commands() runs the command mix of the benchmark. Each loop
+ * writes and reads back words, integers and bits and does a multiple memory
+ * area read, like a typical poll cycle. The function returns the number of
+ * commands sent, or a negated FINS_RETVAL_... error code.
+ */
+
+static int run_commands( struct fins_sys_tp *sys, int loops ) {
+
+	struct fins_multidata_tp item[8];
+	unsigned char word[64];
+	int16_t int16[32];
+	int32_t int32[16];
+	bool bit[16];
+	int retval;
+	int loop;
+	int a;
+
+	for (a=0; a<8; a++) {
+
+		snprintf( item[a].address, sizeof(item[a].address), ( a & 1 ) ? "CIO%d.%02d" : "DM%d", 100+a, a );
+		item[a].type = ( a & 1 ) ? FINS_DATA_TYPE_BIT : FINS_DATA_TYPE_INT16;
+	}
+
+	for (loop=0; loop<loops; loop++) {
+
+		for (a=0; a<64; a++) word[a]  = (unsigned char) ( loop + a );
+		for (a=0; a<32; a++) int16[a] = (int16_t) ( loop - a );
+		for (a=0; a<16; a++) int32[a] = (int32_t) loop * a;
+		for (a=0; a<16; a++) bit[a]   = ( ( loop >> ( a & 7 ) ) & 1 ) != 0;
+
+		if ( ( retval = finslib_memory_area_write_word(  sys, "DM100",    word,  32 ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+		if ( ( retval = finslib_memory_area_read_word(   sys, "DM100",    word,  32 ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+		if ( ( retval = finslib_memory_area_write_int16( sys, "DM200",    int16, 32 ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+		if ( ( retval = finslib_memory_area_read_int16(  sys, "DM200",    int16, 32 ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+		if ( ( retval = finslib_memory_area_write_int32( sys, "DM300",    int32, 16 ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+		if ( ( retval = finslib_memory_area_read_int32(  sys, "DM300",    int32, 16 ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+		if ( ( retval = finslib_memory_area_write_bit(   sys, "CIO10.00", bit,   16 ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+		if ( ( retval = finslib_memory_area_read_bit(    sys, "CIO10.00", bit,   16 ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+		if ( ( retval = finslib_multiple_memory_area_read( sys, item, 8           ) ) != FINS_RETVAL_SUCCESS ) return -retval;
+	}
+
+	return loops * 9;
+
+}  /* run_commands */
+
+/*
+ * static int run_address( int loops );
+ *
+ * The function run_address() decodes a set of address strings and looks up
+ * their memory areas without any communication. This is the local work done
+ * for every command. The function returns the number of addresses found.
+ */
+
+static int run_address( int loops ) {
+
+	struct fins_sys_tp sys;
+	struct fins_address_tp address;
+	const struct fins_area_tp *area;
+	const char *str;
+	int count;
+	int loop;
+	int a;
+
+	memset( & sys, 0, sizeof(sys) );
+	sys.plc_mode = FINS_MODE_CS;
+	count        = 0;
+
+	for (loop=0; loop<loops*BENCH_ADDRESS_LOOPS; loop++) {
+
+		for (a=0; ( str = bench_address[a] ) != NULL; a++) {
+
+			if ( XX_finslib_decode_address( str, & address ) ) continue;
+
+			area = XX_finslib_search_area( & sys, & address, 16, FI_RD, false );
+			if ( area != NULL ) count++;
+		}
+	}
+
+	return count;
+
+}  /* run_address */
+
+/*
+ * static SOCKET sim_start( uint16_t port );
+ *
+ * The function sim_start() opens the UDP socket of the stand-in PLC on the
+ * loopback interface and starts the thread which answers the commands. The
+ * function returns the socket, or INVALID_SOCKET if an error occured.
+ */
+
+static SOCKET sim_start( uint16_t port ) {
+
+	struct sockaddr_in addr;
+	SOCKET fd;
+#if defined(_WIN32)
+	HANDLE thread;
+#else  /* defined(_WIN32) */
+	pthread_t thread;
+#endif  /* defined(_WIN32) */
+
+	fd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( fd == INVALID_SOCKET ) return INVALID_SOCKET;
+
+	memset( & addr, 0, sizeof(addr) );
+
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	addr.sin_port        = htons( port );
+
+	if ( bind( fd, (struct sockaddr *) & addr, sizeof(addr) ) < 0 ) { closesocket( fd ); return INVALID_SOCKET; }
+
+#if defined(_WIN32)
+	thread = CreateThread( NULL, 0, sim_thread, (LPVOID) fd, 0, NULL );
+	if ( thread == NULL ) { closesocket( fd ); return INVALID_SOCKET; }
+	CloseHandle( thread );
+#else  /* defined(_WIN32) */
+	if ( pthread_create( & thread, NULL, sim_thread, (void *) (intptr_t) fd ) != 0 ) { closesocket( fd ); return INVALID_SOCKET; }
+	pthread_detach( thread );
+#endif  /* defined(_WIN32) */
+
+	return fd;
+
+}  /* sim_start */
+
+/*
+ * static DWORD WINAPI sim_thread( LPVOID arg );
+ * static void *sim_thread( void *arg );
+ *
+ * The function sim_thread() answers the commands which arrive on the socket of
+ * the stand-in PLC. It runs until the benchmark exits.
+ */
+
+#if defined(_WIN32)
+static DWORD WINAPI sim_thread( LPVOID arg ) {
+#else  /* defined(_WIN32) */
+static void *sim_thread( void *arg ) {
+#endif  /* defined(_WIN32) */
+
+	struct sockaddr_in from;
+	socklen_t fromlen;
+	SOCKET fd;
+	int recvlen;
+	size_t bodylen;
+
+	fd = (SOCKET) (intptr_t) arg;
+
+	for (;;) {
+
+		fromlen = sizeof(from);
+		recvlen = recvfrom( fd, (char *) sim_buffer, SIM_BUFLEN, 0, (struct sockaddr *) & from, & fromlen );
+
+		if ( recvlen < FINS_HEADER_LEN ) continue;
+
+		sim_reply[FINS_ICF] = sim_buffer[FINS_ICF] | 0x40;
+		sim_reply[FINS_RSV] = 0x00;
+		sim_reply[FINS_GCT] = 0x02;
+		sim_reply[FINS_DNA] = sim_buffer[FINS_SNA];
+		sim_reply[FINS_DA1] = sim_buffer[FINS_SA1];
+		sim_reply[FINS_DA2] = sim_buffer[FINS_SA2];
+		sim_reply[FINS_SNA] = sim_buffer[FINS_DNA];
+		sim_reply[FINS_SA1] = sim_buffer[FINS_DA1];
+		sim_reply[FINS_SA2] = sim_buffer[FINS_DA2];
+		sim_reply[FINS_SID] = sim_buffer[FINS_SID];
+		sim_reply[FINS_MRC] = sim_buffer[FINS_MRC];
+		sim_reply[FINS_SRC] = sim_buffer[FINS_SRC];
+
+		bodylen = sim_process( sim_buffer, (size_t) recvlen, sim_reply + FINS_HEADER_LEN );
+
+		sendto( fd, (const char *) sim_reply, (int) ( FINS_HEADER_LEN + bodylen ), 0, (struct sockaddr *) & from, fromlen );
+	}
+
+#if defined(_WIN32)
+	return 0;
+#else  /* defined(_WIN32) */
+	return NULL;
+#endif  /* defined(_WIN32) */
+
+}  /* sim_thread */
+
+/*
+ * static size_t sim_process( const unsigned char *cmd, size_t cmdlen, unsigned char *body );
+ *
+ * The function sim_process() executes one command on the memory of the
+ * stand-in PLC and writes the response body, starting with the end code. Word
+ * areas have their bit 7 set in the area code, the bits of a word area are
+ * accessed with the same area code without bit 7. Only the commands used by
+ * the benchmark are supported.
+ */
+
+static size_t sim_process( const unsigned char *cmd, size_t cmdlen, unsigned char *body ) {
+
+	const unsigned char *req;
+	unsigned int area;
+	unsigned int word;
+	unsigned int bit;
+	unsigned int num;
+	unsigned int pos;
+	unsigned int a;
+	size_t len;
+	size_t reqlen;
+	uint16_t *mem;
+
+	req    = cmd + FINS_HEADER_LEN;
+	reqlen = cmdlen - FINS_HEADER_LEN;
+	len    = 2;
+
+	body[0] = 0x00;
+	body[1] = 0x00;
+
+	if ( cmd[FINS_MRC] == 0x05  &&  cmd[FINS_SRC] == 0x01 ) {
+
+		memset( body + 2, 0, 158 );
+		memcpy( body + 2,  "CJ2M-CPU33          ", 20 );
+		memcpy( body + 22, "STAND-IN            ", 20 );
+
+		return 160;
+	}
+
+	if ( cmd[FINS_MRC] != 0x01  ||  reqlen < 4 ) {
+
+		body[0] = 0x04;
+		body[1] = 0x01;
+
+		return 2;
+	}
+
+	if ( cmd[FINS_SRC] == 0x04 ) {
+
+		for (a=0; a+4<=reqlen; a+=4) {
+
+			area = req[a];
+			word = ( (unsigned int) req[a+1] << 8 ) | req[a+2];
+			bit  = req[a+3] & 0x0f;
+			mem  = sim_memory[area|0x80];
+
+			body[len++] = (unsigned char) area;
+
+			if ( area & 0x80 ) {
+
+				body[len++] = (unsigned char) ( mem[word%SIM_WORDS] >> 8 );
+				body[len++] = (unsigned char) ( mem[word%SIM_WORDS]      );
+			}
+
+			else body[len++] = (unsigned char) ( ( mem[word%SIM_WORDS] >> bit ) & 1 );
+		}
+
+		return len;
+	}
+
+	if ( reqlen < 6  ||  ( cmd[FINS_SRC] != 0x01  &&  cmd[FINS_SRC] != 0x02 ) ) {
+
+		body[0] = 0x04;
+		body[1] = 0x01;
+
+		return 2;
+	}
+
+	area = req[0];
+	word = ( (unsigned int) req[1] << 8 ) | req[2];
+	bit  = req[3];
+	num  = ( (unsigned int) req[4] << 8 ) | req[5];
+	mem  = sim_memory[area|0x80];
+
+	if ( ( area & 0x80 )  &&  word + num > SIM_WORDS ) {
+
+		body[0] = 0x11;
+		body[1] = 0x03;
+
+		return 2;
+	}
+
+	if ( ! ( area & 0x80 )  &&  word * 16 + bit + num > SIM_WORDS * 16 ) {
+
+		body[0] = 0x11;
+		body[1] = 0x03;
+
+		return 2;
+	}
+
+	for (a=0; a<num; a++) {
+
+		if ( area & 0x80 ) {
+
+			if ( cmd[FINS_SRC] == 0x01 ) {
+
+				body[len++] = (unsigned char) ( mem[word+a] >> 8 );
+				body[len++] = (unsigned char) ( mem[word+a]      );
+			}
+
+			else if ( 6 + 2*a + 1 < reqlen ) mem[word+a] = (uint16_t) ( ( req[6+2*a] << 8 ) | req[6+2*a+1] );
+		}
+
+		else {
+			pos = word * 16 + bit + a;
+
+			if      ( cmd[FINS_SRC] == 0x01 ) body[len++] = (unsigned char) ( ( mem[pos/16] >> ( pos % 16 ) ) & 1 );
+			else if ( 6 + a >= reqlen       ) break;
+			else if ( req[6+a] & 1          ) mem[pos/16] |= (uint16_t)  ( 1u << ( pos % 16 ) );
+			else                              mem[pos/16] &= (uint16_t) ~( 1u << ( pos % 16 ) );
+		}
+	}
+
+	return len;
+
+}  /* sim_process */
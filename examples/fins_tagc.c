@@ -0,0 +1,81 @@
+/*
+ * Library: libfins
+ * File:    examples/fins_tagc.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file examples/fins_tagc.c contains a command line tool which
+ * compiles a list of tags to a binary tag database which can be opened with
+ * finslib_tagdb_open().
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include "fins.h"
+
+/*
+ * int main( int argc, char *argv[] );
+ *
+ * The tool is called as fins_tagc [-cv] list_file db_file. The addresses are
+ * resolved for CS/CJ PLCs, unless the option -cv is given for CV PLCs.
+ */
+
+int main( int argc, char *argv[] ) {
+
+	int plc_mode;
+	int argn;
+	int retval;
+	size_t num_tags;
+	size_t error_line;
+	char buffer[128];
+
+	plc_mode = FINS_MODE_CS;
+	argn     = 1;
+
+	if ( argn < argc  &&  strcmp( argv[argn], "-cv" ) == 0 ) { plc_mode = FINS_MODE_CV; argn++; }
+
+	if ( argc - argn != 2 ) {
+
+		fprintf( stderr, "Usage: %s [-cv] list_file db_file\n", argv[0] );
+		return 1;
+	}
+
+	retval = finslib_tagdb_compile( argv[argn], argv[argn+1], plc_mode, & num_tags, & error_line );
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		if ( error_line > 0 ) fprintf( stderr, "%s:%lu: %s\n", argv[argn], (unsigned long) error_line, finslib_errmsg( retval, buffer, sizeof(buffer) ) );
+		else                  fprintf( stderr, "%s: %s\n", argv[argn], finslib_errmsg( retval, buffer, sizeof(buffer) ) );
+
+		return 1;
+	}
+
+	printf( "%lu tags written to %s\n", (unsigned long) num_tags, argv[argn+1] );
+
+	return 0;
+
+}  /* main */
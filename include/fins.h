@@ -46,6 +46,7 @@
 #else  /* defined(_WIN32) */
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <pthread.h>
 
 #define INVALID_SOCKET				(-1)
 typedef int					SOCKET;
@@ -128,6 +129,9 @@ typedef int					SOCKET;
 #define FINS_MAX_WRITE_WORDS_SYSMAC_LINK	267			/* Max number of write words writing over Sysmac Link	*/
 #define FINS_MAX_WRITE_WORDS_DEVICENET		267			/* Max number of write words writing over DeviceNet	*/
 									/*							*/
+#define FINS_MULTI_READ_ITEMS			24			/* Max number of items in one multiple area read	*/
+#define FINS_MULTI_READ_ITEM_LEN		16			/* Max length of one item in a multiple area read	*/
+									/*							*/
 									/********************************************************/
 
 									/********************************************************/
@@ -209,6 +213,138 @@ typedef int					SOCKET;
 									/*							*/
 									/********************************************************/
 
+									/********************************************************/
+									/*							*/
+#define FINS_MAILBOX_TO_PLC			1			/* Mailbox streams blocks from the host to the PLC	*/
+#define FINS_MAILBOX_FROM_PLC			2			/* Mailbox streams blocks from the PLC to the host	*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_FORCEMAP_CIO_WORDS			6144			/* Number of CIO words in a force map			*/
+#define FINS_FORCEMAP_W_WORDS			512			/* Number of W words in a force map			*/
+#define FINS_FORCEMAP_H_WORDS			512			/* Number of H words in a force map			*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_LEASE_FORCE_NEVER			0x00			/* Never take the access right by force			*/
+#define FINS_LEASE_FORCE_OWN_NODE		0x01			/* Force when a stale right of our own node blocks us	*/
+#define FINS_LEASE_FORCE_ON_TIMEOUT		0x02			/* Force when waiting for the right timed out		*/
+#define FINS_LEASE_RELEASE_AFTER_RUN		0x04			/* Give the right back when a batch has finished	*/
+									/*							*/
+#define FINS_LEASE_WINDOW			4			/* Max number of pipelined commands in a lease batch	*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_CAPTURE_TRIGGER_RISING		1			/* Trigger when the bit changes from off to on		*/
+#define FINS_CAPTURE_TRIGGER_FALLING		2			/* Trigger when the bit changes from on to off		*/
+#define FINS_CAPTURE_TRIGGER_ABOVE		3			/* Trigger when the value rises above the level		*/
+#define FINS_CAPTURE_TRIGGER_BELOW		4			/* Trigger when the value drops below the level		*/
+									/*							*/
+#define FINS_CAPTURE_STATE_ARMED		1			/* Waiting for the trigger condition			*/
+#define FINS_CAPTURE_STATE_TRIGGERED		2			/* Collecting the post trigger samples			*/
+#define FINS_CAPTURE_STATE_COMPLETE		3			/* All samples collected, the buffer is frozen		*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_MULTICAST_MAX_WORDS		700			/* Max number of data words in one multicast datagram	*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_TUNNEL_DEFAULT_PORT		9610			/* Default TCP port of the tunnel link			*/
+#define FINS_TUNNEL_MAX_CLIENTS			16			/* Max number of FINS clients of a tunnel endpoint	*/
+#define FINS_TUNNEL_MAX_DELAYED			64			/* Max number of frames held back by an injected delay	*/
+#define FINS_TUNNEL_MAX_FRAME			65536			/* Max payload length of a frame on the tunnel link	*/
+#define FINS_TUNNEL_TIMEOUT			5000			/* Default timeout in msec for forwarded commands	*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_SEGMENT_NAME_LEN			64			/* Max length of a network segment name plus one	*/
+#define FINS_SEGMENT_BURST_MSEC			100			/* Budget which may be used in one burst in msec	*/
+#define FINS_SEGMENT_BULK_WORDS			256			/* Words from which an auto class transfer is bulk	*/
+									/*							*/
+#define FINS_TRAFFIC_CONTROL			0			/* Control traffic, counted but never delayed		*/
+#define FINS_TRAFFIC_BULK			1			/* Bulk traffic, scheduled within the segment budget	*/
+#define FINS_TRAFFIC_AUTO			2			/* Class derived from each command			*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_EVENTLOG_NAME_LEN			64			/* Max length of an event log name plus one		*/
+#define FINS_EVENTLOG_OLDEST			0			/* Seek to the oldest retained event			*/
+#define FINS_EVENTLOG_NEWEST			UINT64_MAX		/* Seek past the newest event to read only new events	*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_ENGINE_MAX_WORKERS			256			/* Max number of worker threads in an engine		*/
+#define FINS_ENGINE_IDLE_USEC			1000			/* Longest sleep of an idle worker in usec		*/
+#define FINS_ENGINE_STEAL_USEC			2000			/* Default lateness before a poll may be stolen		*/
+#define FINS_ENGINE_WINDOW			32			/* Max number of polls a worker has in flight		*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_TIMESTAMP_OFF			0			/* No kernel timestamps of frames			*/
+#define FINS_TIMESTAMP_SOFTWARE			1			/* Software timestamps from the kernel network stack	*/
+#define FINS_TIMESTAMP_HARDWARE			2			/* Hardware timestamps from the NIC where available	*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_RING_SPSC				1			/* One producer and one consumer thread			*/
+#define FINS_RING_MPMC				2			/* Any number of producer and consumer threads		*/
+									/*							*/
+#define FINS_RING_DROP_OLDEST			1			/* A full ring discards its oldest record		*/
+#define FINS_RING_DROP_NEWEST			2			/* A full ring discards the new record			*/
+#define FINS_RING_BLOCK				3			/* A full ring makes the producer wait			*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_STATUS_EVENT_MODE_CHANGE		1			/* The operating mode of the CPU changed		*/
+#define FINS_STATUS_EVENT_RUN_CHANGE		2			/* The program started or stopped running		*/
+#define FINS_STATUS_EVENT_FATAL_ERROR		3			/* One or more new fatal errors occured			*/
+#define FINS_STATUS_EVENT_FATAL_CLEARED		4			/* One or more fatal errors were cleared		*/
+#define FINS_STATUS_EVENT_NON_FATAL_ERROR	5			/* One or more new non-fatal errors occured		*/
+#define FINS_STATUS_EVENT_NON_FATAL_CLEARED	6			/* One or more non-fatal errors were cleared		*/
+#define FINS_STATUS_EVENT_BATTERY_ERROR		7			/* The battery error flag was set			*/
+#define FINS_STATUS_EVENT_BATTERY_CLEARED	8			/* The battery error flag was cleared			*/
+#define FINS_STATUS_EVENT_ERROR_CODE		9			/* The error code of the CPU changed			*/
+#define FINS_STATUS_EVENT_MESSAGE		10			/* The set of stored user messages changed		*/
+#define FINS_STATUS_EVENT_COMM_LOST		11			/* The status could no longer be read			*/
+#define FINS_STATUS_EVENT_COMM_RESTORED		12			/* The status can be read again				*/
+									/*							*/
+#define FINS_STATUS_MAX_EVENTS			12			/* Max number of events from one PLC in one poll	*/
+#define FINS_CPUSTATUS_RAW_LEN			26			/* Number of data bytes in a CPU unit status response	*/
+									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+									/*							*/
+#define FINS_STATS_BUCKETS			14			/* Number of buckets in the latency histogram		*/
+#define FINS_STATS_SENT				16			/* Number of send times kept per connection by SID	*/
+#define FINS_METRICS_DEFAULT_PORT		9464			/* Default TCP port of the metrics exporter		*/
+#define FINS_METRICS_NAME_LEN			64			/* Max length of a metrics source name plus one		*/
+									/*							*/
+									/********************************************************/
+
 									/********************************************************/
 									/*							*/
 #define FINS_RETVAL_ERRNO_BASE			0xC000			/* All higher error numbers are errno.h values		*/
@@ -400,6 +536,23 @@ typedef int					SOCKET;
 #define FINS_RETVAL_WSA_E_TIMED_OUT		0x8A1F			/* Windows WSA The connection timed out			*/
 #define FINS_RETVAL_WSA_E_WOULD_BLOCK		0x8A20			/* Windows WSA Non-blocking connection would block	*/
 									/*							*/
+#define FINS_RETVAL_INVALID_LAYOUT		0x8B01			/* The requested size or layout is not valid		*/
+#define FINS_RETVAL_MAILBOX_CORRUPT		0x8B02			/* The mailbox index words in the PLC are invalid	*/
+#define FINS_RETVAL_SNAPSHOT_TORN		0x8B03			/* The region changed during every snapshot attempt	*/
+#define FINS_RETVAL_VERIFY_FAILED		0x8B04			/* Data read back differs from the data written		*/
+#define FINS_RETVAL_LOCAL_FILE_ERROR		0x8B05			/* A local file could not be read or written		*/
+#define FINS_RETVAL_TIMED_OUT			0x8B06			/* The operation did not complete within the timeout	*/
+#define FINS_RETVAL_PARTIAL_READ		0x8B07			/* One or more items could not be read			*/
+#define FINS_RETVAL_INVALID_DATA_TYPE		0x8B08			/* The data type of an item is not valid		*/
+#define FINS_RETVAL_NOT_SUPPORTED		0x8B09			/* The function is not supported on this platform	*/
+#define FINS_RETVAL_RING_FULL			0x8B0A			/* The ring is full and the record was dropped		*/
+#define FINS_RETVAL_DUPLICATE_TAG		0x8B0B			/* A tag name is defined more than once			*/
+#define FINS_RETVAL_TAG_SYNTAX_ERROR		0x8B0C			/* A line in a tag list could not be parsed		*/
+#define FINS_RETVAL_DUPLICATE_NAME		0x8B0D			/* The name is already in use				*/
+#define FINS_RETVAL_INVALID_TRAFFIC_CLASS	0x8B0E			/* The traffic class is not valid			*/
+#define FINS_RETVAL_EVENTS_LOST			0x8B0F			/* Events were overwritten before they were read	*/
+#define FINS_RETVAL_DUPLICATE_CONNECTION	0x8B10			/* The connection is already in use			*/
+									/*							*/
 									/********************************************************/
 #pragma pack(push,1)
 									/********************************************************/
@@ -434,6 +587,40 @@ struct fins_mcap_tp {							/*							*/
 };									/*							*/
 									/********************************************************/
 
+									/********************************************************/
+struct fins_latency_tp {						/*							*/
+	int		mode;						/* Timestamp mode FINS_TIMESTAMP_...			*/
+	bool		pending;					/* A response to a timestamped frame is expected	*/
+	bool		overlapped;					/* Several frames were in flight, no measurement	*/
+	uint8_t		sid;						/* SID of the measured frame				*/
+	uint64_t	app_send;					/* Last frame handed to the kernel in nsec		*/
+	uint64_t	tx;						/* Last frame transmitted, system clock in nsec		*/
+	uint64_t	rx;						/* Last response received, system clock in nsec		*/
+	uint64_t	tx_hw;						/* Last frame transmitted, NIC clock or 0		*/
+	uint64_t	rx_hw;						/* Last response received, NIC clock or 0		*/
+	uint64_t	app_recv;					/* Last response delivered to the library in nsec	*/
+	uint32_t	frames;						/* Number of measured request/response pairs		*/
+	uint64_t	host_send_nsec;					/* Total time from send call to transmission		*/
+	uint64_t	wire_nsec;					/* Total time on the network and in the PLC		*/
+	uint64_t	host_recv_nsec;					/* Total time from reception to delivery		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_stats_tp {							/*							*/
+	uint64_t	requests;					/* Number of commands sent				*/
+	uint64_t	responses;					/* Number of responses received				*/
+	uint64_t	errors;						/* Number of commands which ended with an error		*/
+	uint64_t	connects;					/* Number of successful connects			*/
+	uint32_t	in_flight;					/* Number of commands waiting for a response		*/
+	uint64_t	send_usec[FINS_STATS_SENT];			/* Monotonic send time per SID slot, 0 if unused	*/
+	uint64_t	latency_count;					/* Number of measured round trips			*/
+	uint64_t	latency_sum_usec;				/* Sum of all round trip times in usec			*/
+	uint64_t	latency_max_usec;				/* Longest round trip time in usec			*/
+	uint64_t	latency_bucket[FINS_STATS_BUCKETS];		/* Round trips per latency bucket			*/
+};									/*							*/
+									/********************************************************/
+
 struct fins_sys_tp {
 	char		address[128];
 	uint16_t	port;
@@ -443,6 +630,7 @@ struct fins_sys_tp {
 	int		error_max;
 	int		last_error;
 	bool		error_changed;
+	bool		error_probe;
 	uint8_t		local_net;
 	uint8_t		local_node;
 	uint8_t		local_unit;
@@ -454,6 +642,14 @@ struct fins_sys_tp {
 	char		model[21];
 	char		version[21];
 	int		plc_mode;
+	uint32_t	busy_poll_usec;
+	uint32_t	busy_poll_hits;
+	uint32_t	busy_poll_sleeps;
+	uint64_t	busy_poll_spin_usec;
+	struct fins_latency_tp	latency;
+	struct fins_stats_tp	stats;
+	struct fins_segment_tp *	segment;
+	int		traffic_class;
 };
 									/********************************************************/
 struct fins_datetime_tp {						/* 							*/
@@ -609,6 +805,144 @@ struct fins_forcebit_tp {
 	uint16_t	force_command;
 };
 
+									/********************************************************/
+struct fins_result_tp {							/*							*/
+	uint32_t	tag_id;						/* ID of the tag the value belongs to			*/
+	int32_t		status;						/* Result code FINS_RETVAL_... of the read		*/
+	uint64_t	timestamp;					/* Time of the read in microseconds			*/
+	double		value;						/* Value of the tag					*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_ringslot_tp {						/*							*/
+	uint64_t	sequence;					/* Sequence number which guards the slot		*/
+	struct fins_result_tp	result;					/* Record stored in the slot				*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_ring_tp {							/*							*/
+	struct fins_ringslot_tp *	slot;				/* Preallocated array of slots				*/
+	uint64_t	mask;						/* Number of slots minus one				*/
+	bool		multi_producer;					/* Producers must claim slots with an atomic operation	*/
+	bool		multi_consumer;					/* Consumers must claim slots with an atomic operation	*/
+	int		policy;						/* Overflow policy FINS_RING_...			*/
+	uint64_t	dropped;					/* Number of records discarded on overflow		*/
+	unsigned char	pad_head[64];					/* Keeps the producer index in its own cache line	*/
+	uint64_t	head;						/* Index of the next slot to write			*/
+	unsigned char	pad_tail[64];					/* Keeps the consumer index in its own cache line	*/
+	uint64_t	tail;						/* Index of the next slot to read			*/
+	unsigned char	pad_end[64];					/* Separates the consumer index from other data		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_event_tp {							/*							*/
+	uint64_t	sequence;					/* Sequence number of the event, starting at 1		*/
+	uint64_t	timestamp;					/* Time of the read in microseconds			*/
+	uint32_t	tag_id;						/* ID of the tag which changed				*/
+	int32_t		status;						/* Result code FINS_RETVAL_... of the read		*/
+	double		value;						/* New value of the tag					*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_eventlast_tp {						/*							*/
+	uint32_t	tag_id;						/* ID of the tag					*/
+	int32_t		status;						/* Last logged result code				*/
+	double		value;						/* Last logged value					*/
+	bool		used;						/* The hash slot contains a tag				*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_eventlog_tp {						/*							*/
+	void *		map;						/* Start of the mapped shared memory			*/
+	size_t		map_size;					/* Size of the mapped shared memory			*/
+	char		name[FINS_EVENTLOG_NAME_LEN+1];			/* Name of the shared memory object			*/
+	uint64_t	mask;						/* Number of slots minus one				*/
+	uint64_t	head;						/* Sequence number of the next event			*/
+	struct fins_eventlast_tp *	last;				/* Hash table with the last logged value per tag	*/
+	size_t		num_last;					/* Number of tags in the hash table			*/
+	size_t		max_last;					/* Number of slots in the hash table			*/
+	uint64_t	appended;					/* Number of events appended				*/
+	uint64_t	unchanged;					/* Number of results skipped because nothing changed	*/
+#if defined(_WIN32)
+	HANDLE		mapping;					/* Handle of the file mapping				*/
+#endif  /* defined(_WIN32) */
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_eventreader_tp {						/*							*/
+	const void *	map;						/* Start of the mapped shared memory			*/
+	size_t		map_size;					/* Size of the mapped shared memory			*/
+	uint64_t	mask;						/* Number of slots minus one				*/
+	uint64_t	next;						/* Sequence number of the next event to read		*/
+	uint64_t	lost;						/* Number of events overwritten before they were read	*/
+#if defined(_WIN32)
+	HANDLE		mapping;					/* Handle of the file mapping				*/
+#endif  /* defined(_WIN32) */
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_enginejob_tp {						/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the PLC which is polled		*/
+	struct fins_multidata_tp *	item;				/* Items read in each poll				*/
+	size_t		num_item;					/* Number of items					*/
+	uint32_t	first_tag_id;					/* Tag ID of the first item				*/
+	uint64_t	interval_usec;					/* Time between the polls in usec			*/
+	uint64_t	next_usec;					/* Monotonic time the next poll is due			*/
+	uint32_t	busy;						/* A worker has claimed the poll			*/
+	size_t		home;						/* Worker which owns the connection			*/
+	int		retval;						/* Result of the last poll				*/
+	uint64_t	polls;						/* Number of polls					*/
+	uint64_t	stolen;						/* Number of polls run by another worker		*/
+	uint64_t	skipped;					/* Number of polls skipped because they were too late	*/
+	uint64_t	max_late_usec;					/* Longest time a poll started after it was due		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_engineworker_tp {						/*							*/
+	struct fins_engine_tp *	engine;					/* Engine the worker belongs to				*/
+	size_t		index;						/* Number of the worker					*/
+	struct fins_enginejob_tp **	job;				/* Polls of the connections owned by the worker		*/
+	size_t		num_job;					/* Number of owned polls				*/
+	double		load;						/* Owned polls per second				*/
+	uint64_t	polls;						/* Number of polls run					*/
+	uint64_t	steals;						/* Number of polls stolen from other workers		*/
+	uint64_t	ring_full;					/* Number of polls with results dropped by the ring	*/
+	uint64_t	idle_usec;					/* Time spent sleeping or waiting in usec		*/
+	struct fins_engineslot_tp *	slot;				/* Polls which wait for a response			*/
+	size_t		num_slot;					/* Number of polls which wait for a response		*/
+	int		retval;						/* Result of applying the CPU binding			*/
+	bool		started;					/* The thread of the worker is running			*/
+#if defined(_WIN32)
+	HANDLE		thread;						/* Thread of the worker					*/
+#else  /* defined(_WIN32) */
+	pthread_t	thread;						/* Thread of the worker					*/
+#endif  /* defined(_WIN32) */
+	unsigned char	pad_end[64];					/* Keeps the counters of workers in own cache lines	*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_engine_tp {							/*							*/
+	struct fins_engineworker_tp *	worker;				/* Array with the workers				*/
+	size_t		num_workers;					/* Number of workers					*/
+	struct fins_enginejob_tp *	job;				/* Preallocated array with the polls			*/
+	size_t		num_jobs;					/* Number of polls in use				*/
+	size_t		max_jobs;					/* Number of preallocated polls				*/
+	struct fins_ring_tp *	ring;					/* MPMC ring which receives the results			*/
+	bool		bind_cpu;					/* Worker n is bound to CPU core n			*/
+	uint32_t	steal_usec;					/* Lateness before another worker may steal a poll	*/
+	uint32_t	running;					/* The workers must keep running			*/
+};									/*							*/
+									/********************************************************/
+
 struct fins_multidata_tp {
     char		address[12];
     int			type;
@@ -628,8 +962,504 @@ struct fins_multidata_tp {
 	    uint16_t	w_force;
 	};
     };
+    int			status;
 };
 
+									/********************************************************/
+struct fins_multiencoded_tp {						/*							*/
+	size_t		index;						/* Index of the item in the item list			*/
+	size_t		bodylen;					/* Length of the item in the command body		*/
+	size_t		recvlen;					/* Length of the item in the response body		*/
+	unsigned char	body[FINS_MULTI_READ_ITEM_LEN];			/* Item as it appears in the command body		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_multiread_tp {						/*							*/
+	struct fins_command_tp	command;				/* Command which waits for a response			*/
+	struct fins_multiencoded_tp	encoded[FINS_MULTI_READ_ITEMS];	/* Items in the command					*/
+	size_t		num_encoded;					/* Number of items in the command			*/
+	size_t		next;						/* First item which has not been sent yet		*/
+	bool		partial;					/* One or more items could not be read			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_engineslot_tp {						/*							*/
+	struct fins_enginejob_tp *	job;				/* Poll which waits for a response			*/
+	uint64_t	send_usec;					/* Monotonic time the last frame was sent		*/
+	struct fins_multiread_tp	read;				/* State of the multiple memory area read		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_bridgerule_tp {						/*							*/
+	struct fins_sys_tp *	src_sys;				/* Connection with the PLC where data is read		*/
+	char		src_address[12];				/* Start address of the data in the source PLC		*/
+	struct fins_sys_tp *	dst_sys;				/* Connection with the PLC where data is written	*/
+	char		dst_address[12];				/* Start address of the data in the target PLC		*/
+	size_t		num_words;					/* Number of words to forward				*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_bridgelink_tp {						/*							*/
+	struct fins_bridgerule_tp	rule;				/* Copy of the mapping rule				*/
+	uint8_t		src_area;					/* Resolved area code in the source PLC			*/
+	uint32_t	src_start;					/* Resolved word address in the source PLC		*/
+	uint8_t		dst_area;					/* Resolved area code in the target PLC			*/
+	uint32_t	dst_start;					/* Resolved word address in the target PLC		*/
+	unsigned char *	image;						/* Last payload written to the target PLC		*/
+	bool		image_valid;					/* The image reflects the target PLC contents		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_bridge_tp {							/*							*/
+	struct fins_bridgelink_tp *	link;				/* Array with the resolved mapping rules		*/
+	size_t		num_link;					/* Number of mapping rules				*/
+	uint32_t	frames_read;					/* Number of read frames sent to source PLCs		*/
+	uint32_t	frames_written;					/* Number of write frames sent to target PLCs		*/
+	uint32_t	frames_skipped;					/* Number of unchanged blocks not written		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_gatedblock_tp {						/*							*/
+	char		address[12];					/* Start address of the block in the PLC		*/
+	char		version[12];					/* Address of the version word of the block		*/
+	size_t		num_words;					/* Number of words in the block				*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_gatedlink_tp {						/*							*/
+	struct fins_gatedblock_tp	block;				/* Copy of the block definition				*/
+	uint8_t		area;						/* Resolved area code of the block			*/
+	uint32_t	start;						/* Resolved word address of the block			*/
+	uint8_t		version_area;					/* Resolved area code of the version word		*/
+	uint32_t	version_start;					/* Resolved word address of the version word		*/
+	uint16_t	version;					/* Version word when the local copy was read		*/
+	uint16_t	next_version;					/* Version word read during the last poll		*/
+	uint16_t *	data;						/* Local copy of the block contents			*/
+	bool		data_valid;					/* The local copy reflects the block in the PLC		*/
+	bool		changed;					/* The block was read during the last poll		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_gated_tp {							/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the PLC with the blocks		*/
+	struct fins_gatedlink_tp *	link;				/* Array with the resolved blocks			*/
+	size_t		num_link;					/* Number of blocks					*/
+	uint32_t	frames_read;					/* Number of read frames sent to the PLC		*/
+	uint32_t	blocks_skipped;					/* Number of unchanged blocks not read			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_mcastblock_tp {						/*							*/
+	char		address[12];					/* Start address of the block in the PLC		*/
+	size_t		num_words;					/* Number of words in the block				*/
+	uint16_t	id;						/* Unique ID of the block on the multicast group	*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_mcastlink_tp {						/*							*/
+	struct fins_mcastblock_tp	block;				/* Copy of the block definition				*/
+	uint8_t		area;						/* Resolved area code of the block			*/
+	uint32_t	start;						/* Resolved word address of the block			*/
+	uint16_t *	data;						/* Published or received contents of the block		*/
+	uint16_t *	next;						/* Publisher buffer for the freshly read contents	*/
+	uint32_t	version;					/* Version of the contents, incremented on change	*/
+	bool		data_valid;					/* The contents are complete and up to date		*/
+	bool		changed;					/* The block changed during the last call		*/
+	uint64_t	last_full;					/* Time the block was last sent completely in usec	*/
+	uint32_t	full_version;					/* Version of the complete copy being received		*/
+	size_t		full_received;					/* Number of words received of the complete copy	*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_publisher_tp {						/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the PLC which is polled		*/
+	SOCKET		sockfd;						/* Socket used to send the datagrams			*/
+	struct sockaddr_in	group;					/* Address and port of the multicast group		*/
+	struct fins_mcastlink_tp *	link;				/* Array with the published blocks			*/
+	size_t		num_link;					/* Number of published blocks				*/
+	uint64_t	refresh_usec;					/* Max time between two complete copies of a block	*/
+	uint32_t	sequence;					/* Sequence number of the next datagram			*/
+	unsigned char *	buffer;						/* Buffer used to build a datagram			*/
+	uint32_t	frames_read;					/* Number of read frames sent to the PLC		*/
+	uint32_t	datagrams_sent;					/* Number of datagrams sent to the group		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_subscriber_tp {						/*							*/
+	SOCKET		sockfd;						/* Socket which joined the multicast group		*/
+	struct fins_mcastlink_tp *	link;				/* Array with the local copies of the blocks		*/
+	size_t		num_link;					/* Number of blocks					*/
+	uint32_t	sequence;					/* Expected sequence number of the next datagram	*/
+	bool		sequence_valid;					/* A datagram has been received before			*/
+	unsigned char *	buffer;						/* Buffer used to receive a datagram			*/
+	uint32_t	datagrams_received;				/* Number of valid datagrams received			*/
+	uint32_t	gaps;						/* Number of times a datagram was lost			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_tunnellink_tp {						/*							*/
+	SOCKET		sockfd;						/* Socket of the link, or INVALID_SOCKET		*/
+	unsigned char *	in;						/* Buffer with received bytes of incomplete frames	*/
+	size_t		in_len;						/* Number of bytes in the receive buffer		*/
+	unsigned char *	out;						/* Buffer with frames waiting to be sent		*/
+	size_t		out_len;					/* Number of bytes in the send buffer			*/
+	size_t		out_sent;					/* Number of bytes of the send buffer already sent	*/
+	size_t		out_size;					/* Allocated size of the send buffer			*/
+	size_t		due_end[FINS_TUNNEL_MAX_DELAYED];		/* End of each frame held back in the send buffer	*/
+	uint64_t	due_usec[FINS_TUNNEL_MAX_DELAYED];		/* Time each held back frame may be sent		*/
+	size_t		num_due;					/* Number of frames held back				*/
+	uint32_t	delay_msec;					/* Injected one way delay for testing, or 0		*/
+	uint64_t	bytes_sent;					/* Number of bytes sent over the link			*/
+	uint64_t	bytes_received;					/* Number of bytes received over the link		*/
+	uint32_t	frames_sent;					/* Number of frames sent over the link			*/
+	uint32_t	frames_received;				/* Number of frames received over the link		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_tunnelclient_tp {						/*							*/
+	SOCKET		sockfd;						/* Socket of the client, or INVALID_SOCKET		*/
+	unsigned char	in[16+FINS_HEADER_LEN+FINS_BODY_LEN];		/* Buffer with the partly received FINS/TCP frame	*/
+	size_t		in_len;						/* Number of bytes in the receive buffer		*/
+	unsigned char	header[FINS_HEADER_LEN];			/* FINS header of the forwarded command			*/
+	uint32_t	tag;						/* Tag of the forwarded command				*/
+	bool		pending;					/* A forwarded command waits for its response		*/
+	uint64_t	pending_usec;					/* Time the command was forwarded			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_tunnelagent_tp {						/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the local PLC			*/
+	char		address[128];					/* Address of the far side endpoint			*/
+	uint16_t	port;						/* Port of the far side endpoint			*/
+	struct fins_tunnellink_tp	link;				/* Link with the far side endpoint			*/
+	struct fins_mcastlink_tp *	block;				/* Array with the polled blocks				*/
+	size_t		num_block;					/* Number of polled blocks				*/
+	bool *		resync;						/* Per block flag to send the block completely		*/
+	bool		synced;						/* The endpoint reported the state of its copy		*/
+	uint32_t	sequence;					/* Sequence number of the next batch			*/
+	uint64_t	next_connect;					/* Earliest time for the next connect attempt in usec	*/
+	uint32_t	frames_read;					/* Number of read frames sent to the PLC		*/
+	uint32_t	batches_sent;					/* Number of batches sent to the endpoint		*/
+	uint32_t	forwarded;					/* Number of forwarded commands executed		*/
+	uint32_t	connects;					/* Number of times the link was established		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_tunnelendpoint_tp {						/*							*/
+	SOCKET		link_listen;					/* Socket accepting the link from the agent		*/
+	SOCKET		fins_listen;					/* Socket accepting FINS/TCP clients			*/
+	struct fins_tunnellink_tp	link;				/* Link with the agent					*/
+	struct fins_mcastlink_tp *	block;				/* Array with the local copies of the blocks		*/
+	size_t		num_block;					/* Number of blocks					*/
+	struct fins_tunnelclient_tp	client[FINS_TUNNEL_MAX_CLIENTS];	/* FINS/TCP clients				*/
+	uint32_t	sequence;					/* Expected sequence number of the next batch		*/
+	bool		sequence_valid;					/* The agent answered the last HELLO frame		*/
+	uint32_t	next_tag;					/* Tag of the next forwarded command			*/
+	uint32_t	timeout_msec;					/* Timeout for forwarded commands			*/
+	uint32_t	served_local;					/* Number of commands answered from the local copy	*/
+	uint32_t	forwarded;					/* Number of commands forwarded to the agent		*/
+	uint32_t	gaps;						/* Number of times a resync was needed			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_segment_tp {						/*							*/
+	char		name[FINS_SEGMENT_NAME_LEN];			/* Name of the network segment				*/
+	uint32_t	bytes_per_sec;					/* Byte budget per second, or 0 for no byte limit	*/
+	uint32_t	frames_per_sec;					/* Frame budget per second, or 0 for no frame limit	*/
+	double		byte_tokens;					/* Bytes available, negative when in debt		*/
+	double		frame_tokens;					/* Frames available, negative when in debt		*/
+	uint64_t	refill_usec;					/* Monotonic time the tokens were last refilled		*/
+	uint64_t	next_ticket;					/* Ticket of the next bulk request that must wait	*/
+	uint64_t	serving_ticket;					/* Ticket of the bulk request allowed to go next	*/
+	size_t		num_members;					/* Number of connections in the segment			*/
+	uint64_t	control_requests;				/* Number of control requests sent			*/
+	uint64_t	bulk_requests;					/* Number of bulk requests sent				*/
+	uint64_t	bytes;						/* Number of bytes sent and received on the segment	*/
+	uint64_t	frames;						/* Number of frames sent and received on the segment	*/
+	uint64_t	bulk_delayed;					/* Number of bulk requests which had to wait		*/
+	uint64_t	wait_usec;					/* Total time bulk requests waited in usec		*/
+	uint64_t	max_wait_usec;					/* Longest time a bulk request waited in usec		*/
+#if defined(_WIN32)
+	CRITICAL_SECTION	lock;					/* Protects the tokens and counters			*/
+	CONDITION_VARIABLE	turn;					/* Signals waiting bulk requests			*/
+#else  /* defined(_WIN32) */
+	pthread_mutex_t	lock;						/* Protects the tokens and counters			*/
+	pthread_cond_t	turn;						/* Signals waiting bulk requests			*/
+#endif  /* defined(_WIN32) */
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_rtprofile_tp {						/*							*/
+	int		cpu;						/* CPU core to run on, or -1 for any core		*/
+	int		priority;					/* SCHED_FIFO priority, or 0 for normal scheduling	*/
+	bool		lock_memory;					/* Lock all current and future memory in RAM		*/
+	size_t		stack_prefault;					/* Number of stack bytes to fault in advance		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_rtclock_tp {						/*							*/
+	uint32_t	period_usec;					/* Cycle period in microseconds				*/
+	uint64_t	next_usec;					/* Monotonic time of the next cycle start		*/
+	uint32_t	cycles;						/* Number of completed cycles				*/
+	uint32_t	deadline_misses;				/* Number of cycle starts which were missed		*/
+	uint32_t	max_wakeup_usec;				/* Worst case wakeup latency in microseconds		*/
+	uint64_t	total_wakeup_usec;				/* Sum of all wakeup latencies in microseconds		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_mailbox_tp {						/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the PLC hosting the mailbox		*/
+	uint8_t		area;						/* Area code of the mailbox memory			*/
+	uint32_t	start;						/* Word address of the head index word			*/
+	size_t		num_slots;					/* Number of slots in the ring buffer			*/
+	size_t		slot_words;					/* Number of words in each slot				*/
+	int		direction;					/* FINS_MAILBOX_TO_PLC or FINS_MAILBOX_FROM_PLC		*/
+	uint16_t	head;						/* Cached slot index where the producer writes next	*/
+	uint16_t	tail;						/* Cached slot index where the consumer reads next	*/
+	bool		synced;						/* The cached indexes have been read from the PLC	*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_aggregate_tp {						/*							*/
+	size_t		num_tags;					/* Number of tags in each sample			*/
+	uint64_t	pane_usec;					/* Length of one pane in microseconds			*/
+	size_t		num_panes;					/* Number of panes in one window			*/
+	size_t		pane;						/* Index of the pane collecting samples			*/
+	uint64_t	pane_start;					/* Start time of the current pane in usec		*/
+	bool		started;					/* The current pane has received a sample		*/
+	double *	min;						/* Minimum per pane and tag				*/
+	double *	max;						/* Maximum per pane and tag				*/
+	double *	sum;						/* Sum of the values per pane and tag			*/
+	double *	last;						/* Last value per pane and tag				*/
+	uint32_t *	count;						/* Number of samples per pane and tag			*/
+	double *	out_min;					/* Minimum per tag of the last window			*/
+	double *	out_max;					/* Maximum per tag of the last window			*/
+	double *	out_avg;					/* Average per tag of the last window			*/
+	double *	out_last;					/* Last value per tag of the last window		*/
+	uint32_t *	out_count;					/* Number of samples per tag of the last window		*/
+	uint64_t	out_start;					/* Start time of the last window in usec		*/
+	uint64_t	out_end;					/* End time of the last window in usec			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_alarmblock_tp {						/*							*/
+	char		address[12];					/* Start address of the alarm words in the PLC		*/
+	size_t		num_words;					/* Number of words with alarm bits			*/
+	uint32_t	first_tag;					/* Tag ID of bit 0 of the first word			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_alarmlink_tp {						/*							*/
+	struct fins_alarmblock_tp	block;				/* Copy of the alarm block definition			*/
+	uint8_t		area;						/* Resolved area code in the PLC			*/
+	uint32_t	start;						/* Resolved word address in the PLC			*/
+	unsigned char *	image;						/* Packed bit image of the previous scan		*/
+	bool		image_valid;					/* The image contains the result of a previous scan	*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_alarm_tp {							/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the PLC with the alarm bits		*/
+	struct fins_alarmlink_tp *	link;				/* Array with the resolved alarm blocks			*/
+	size_t		num_link;					/* Number of alarm blocks				*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_alarmevent_tp {						/*							*/
+	uint32_t	tag;						/* Tag ID of the bit which changed			*/
+	bool		rising;						/* The bit changed from off to on			*/
+	uint64_t	timestamp;					/* Time the edge was seen in usec since the epoch	*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_capturetrigger_tp {						/*							*/
+	int		type;						/* One of the FINS_CAPTURE_TRIGGER_... values		*/
+	size_t		word;						/* Offset of the trigger word in the sample		*/
+	uint8_t		bit;						/* Bit number for edge triggers				*/
+	int16_t		level;						/* Signed threshold for level triggers			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_capture_tp {						/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the PLC which is sampled		*/
+	uint8_t		area;						/* Resolved area code of the sampled block		*/
+	uint32_t	start;						/* Resolved word address of the sampled block		*/
+	size_t		num_words;					/* Number of words in each sample			*/
+	size_t		pre_samples;					/* Number of samples kept before the trigger		*/
+	size_t		post_samples;					/* Number of samples taken from the trigger on		*/
+	size_t		ring_size;					/* Number of samples in the ring buffer			*/
+	struct fins_capturetrigger_tp	trigger;			/* Copy of the trigger condition			*/
+	int		state;						/* One of the FINS_CAPTURE_STATE_... values		*/
+	uint16_t *	ring;						/* Ring buffer with the sampled words			*/
+	uint64_t *	timestamp;					/* Time of each sample in usec since the epoch		*/
+	size_t		head;						/* Ring index where the next sample is stored		*/
+	size_t		num_filled;					/* Number of valid samples in the ring			*/
+	size_t		num_pre;					/* Number of samples before the trigger			*/
+	size_t		post_todo;					/* Number of post trigger samples still to take		*/
+	uint64_t	trigger_time;					/* Time of the trigger sample in usec			*/
+	uint16_t	prev_word;					/* Trigger word of the previous sample			*/
+	bool		prev_valid;					/* The previous trigger word is known			*/
+	unsigned char *	file_buffer;					/* Preallocated buffer for one sample in the file	*/
+	char *		file_name;					/* Name of the file being written			*/
+	int		write_retval;					/* Result of the last file write			*/
+#if defined(_WIN32)
+	HANDLE		writer;						/* Background thread writing the file			*/
+#else  /* defined(_WIN32) */
+	pthread_t	writer;						/* Background thread writing the file			*/
+#endif  /* defined(_WIN32) */
+	bool		writing;					/* The background thread is running			*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_forcemap_tp {						/*							*/
+	uint16_t	cio_forced[FINS_FORCEMAP_CIO_WORDS];		/* Forced status of each CIO bit			*/
+	uint16_t	cio_value[FINS_FORCEMAP_CIO_WORDS];		/* Current value of each CIO bit			*/
+	uint16_t	w_forced[FINS_FORCEMAP_W_WORDS];		/* Forced status of each W bit				*/
+	uint16_t	w_value[FINS_FORCEMAP_W_WORDS];			/* Current value of each W bit				*/
+	uint16_t	h_forced[FINS_FORCEMAP_H_WORDS];		/* Forced status of each H bit				*/
+	uint16_t	h_value[FINS_FORCEMAP_H_WORDS];			/* Current value of each H bit				*/
+	size_t		num_forced;					/* Total number of forced bits				*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_lease_tp {							/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the PLC				*/
+	int		policy;						/* Combination of FINS_LEASE_... policy flags		*/
+	int		timeout;					/* Seconds to wait for the access right			*/
+	bool		held;						/* The access right is currently held			*/
+	struct fins_nodedata_tp	holder;					/* Node which last blocked the access right		*/
+	uint32_t	num_forced;					/* Number of times the right was taken by force		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_leaseop_tp {						/*							*/
+	uint16_t	command;					/* FINS command code with MRC and SRC			*/
+	const unsigned char *	send_buffer;				/* Body of the command to send				*/
+	size_t		send_len;					/* Length of the command body				*/
+	unsigned char *	recv_buffer;					/* Buffer for the response body or NULL			*/
+	size_t		recv_len;					/* Size of the buffer and length of the response	*/
+	int		retval;						/* Result of the command				*/
+};									/*							*/
+
+									/********************************************************/
+struct fins_statusevent_tp {						/*							*/
+	struct fins_statuswatch_tp *	watch;				/* Status watch of the PLC which caused the event	*/
+	int		type;						/* One of the FINS_STATUS_EVENT_... values		*/
+	uint16_t	flags;						/* Raw error or message bits which were set or cleared	*/
+	uint8_t		run_mode;					/* Operating mode after the change			*/
+	uint16_t	error_code;					/* Error code after the change				*/
+	int		retval;						/* Result of the read for communication events		*/
+	uint64_t	timestamp;					/* Time of the poll in usec since the epoch		*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_statuswatch_tp {						/*							*/
+	struct fins_sys_tp *	sys;					/* Connection with the watched PLC			*/
+	unsigned char	raw[FINS_CPUSTATUS_RAW_LEN];			/* Raw status data of the last successful read		*/
+	struct fins_cpustatus_tp	status;				/* Decoded status of the last successful read		*/
+	bool		valid;						/* The raw status data has been read at least once	*/
+	bool		comm_lost;					/* The last attempt to read the status failed		*/
+	int		retval;						/* Result of the last attempt to read the status	*/
+	uint64_t	polls;						/* Number of status reads				*/
+	uint64_t	decodes;					/* Number of reads where the status had changed		*/
+	unsigned char	next_raw[FINS_CPUSTATUS_RAW_LEN];		/* Raw status data waiting to be committed		*/
+	size_t		num_pending;					/* Number of events waiting to be delivered		*/
+	struct fins_statusevent_tp	pending[FINS_STATUS_MAX_EVENTS];	/* Events waiting to be delivered		*/
+};									/*							*/
+
+									/********************************************************/
+struct fins_tag_tp {							/*							*/
+	uint32_t	name;						/* Offset of the name in the name table			*/
+	uint32_t	hash;						/* Hash value of the name				*/
+	uint32_t	address;					/* Resolved word address in the memory area		*/
+	uint16_t	poll_group;					/* Poll group the tag is assigned to			*/
+	uint8_t		area;						/* Resolved FINS memory area code			*/
+	uint8_t		bit;						/* Bit number for bit tags				*/
+	uint8_t		data_type;					/* One of the FINS_DATA_TYPE_... values			*/
+	uint8_t		num_words;					/* Number of words occupied by the value		*/
+	uint16_t	reserved;					/* Always zero, keeps the record size a multiple of 4	*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_tagdb_tp {							/*							*/
+	void *		map;						/* Start of the mapped database file			*/
+	size_t		map_size;					/* Size of the mapped database file			*/
+	int		plc_mode;					/* PLC mode the addresses were resolved for		*/
+	size_t		num_tags;					/* Number of tags in the database			*/
+	const struct fins_tag_tp *	tag;				/* Tags sorted on poll group and address		*/
+	size_t		num_groups;					/* Number of poll groups				*/
+	const uint32_t *	group;					/* Group number, first tag and count per poll group	*/
+	const uint32_t *	hash;					/* Hash index with tag number plus one per slot		*/
+	uint32_t	hash_mask;					/* Number of hash slots minus one			*/
+	const char *	names;						/* Table with the tag names				*/
+#if defined(_WIN32)
+	HANDLE		file;						/* Handle of the database file				*/
+	HANDLE		mapping;					/* Handle of the file mapping				*/
+#endif  /* defined(_WIN32) */
+};									/*							*/
+
+									/********************************************************/
+struct fins_metricssrc_tp {						/*							*/
+	struct fins_sys_tp *	sys;					/* Connection to report, or NULL			*/
+	struct fins_rtclock_tp *	rtclock;			/* Periodic clock to report, or NULL			*/
+	char		name[FINS_METRICS_NAME_LEN];			/* Name used as label value				*/
+};									/*							*/
+									/********************************************************/
+
+									/********************************************************/
+struct fins_metrics_tp {						/*							*/
+	SOCKET		sockfd;						/* Listening socket of the exporter			*/
+	char		path[108];					/* Path of the Unix socket, or empty for TCP		*/
+	struct fins_metricssrc_tp *	source;				/* Array with the registered sources			*/
+	size_t		num_source;					/* Number of registered sources				*/
+	size_t		max_source;					/* Number of allocated sources				*/
+	uint64_t	scrapes;					/* Number of served requests				*/
+	bool		stop;						/* The exporter thread must stop			*/
+#if defined(_WIN32)
+	HANDLE		thread;						/* Thread serving the requests				*/
+	CRITICAL_SECTION	lock;					/* Protects the source list				*/
+#else  /* defined(_WIN32) */
+	pthread_t	thread;						/* Thread serving the requests				*/
+	pthread_mutex_t	lock;						/* Protects the source list				*/
+#endif  /* defined(_WIN32) */
+};									/*							*/
+									/********************************************************/
+									/********************************************************/
+									/********************************************************/
+									/********************************************************/
+
 
 
 
@@ -637,9 +1467,28 @@ int				finslib_access_log_read( struct fins_sys_tp *sys, struct fins_accessdata_
 int				finslib_access_right_acquire( struct fins_sys_tp *sys, struct fins_nodedata_tp *nodedata );
 int				finslib_access_right_forced_acquire( struct fins_sys_tp* sys );
 int				finslib_access_right_release( struct fins_sys_tp *sys );
+struct fins_aggregate_tp *	finslib_aggregate_create( size_t num_tags, uint64_t pane_usec, size_t num_panes, int *error_val );
+int				finslib_aggregate_flush( struct fins_aggregate_tp *agg, bool *window_ready );
+void				finslib_aggregate_free( struct fins_aggregate_tp *agg );
+int				finslib_aggregate_update( struct fins_aggregate_tp *agg, const double *value, const bool *valid, uint64_t timestamp, bool *window_ready );
+struct fins_alarm_tp *		finslib_alarm_create( struct fins_sys_tp *sys, const struct fins_alarmblock_tp *block, size_t num_block, int *error_val );
+void				finslib_alarm_free( struct fins_alarm_tp *alarm );
+int				finslib_alarm_scan( struct fins_alarm_tp *alarm, struct fins_alarmevent_tp *event, size_t max_events, size_t *num_events );
 int				finslib_area_file_compare( struct fins_sys_tp *sys, const char *start, uint16_t disk, const char *path, const char *file, size_t *num_records );
 int				finslib_area_to_file_transfer( struct fins_sys_tp *sys, const char *start, uint16_t disk, const char *path, const char *file, size_t *num_records );
 int32_t				finslib_bcd_to_int( uint32_t value, int type );
+int				finslib_busy_poll( struct fins_sys_tp *sys, uint32_t spin_usec );
+struct fins_bridge_tp *		finslib_bridge_create( const struct fins_bridgerule_tp *rule, size_t num_rule, int *error_val );
+void				finslib_bridge_free( struct fins_bridge_tp *bridge );
+int				finslib_bridge_invalidate( struct fins_bridge_tp *bridge );
+int				finslib_bridge_run( struct fins_bridge_tp *bridge );
+int				finslib_capture_arm( struct fins_capture_tp *capture );
+struct fins_capture_tp *	finslib_capture_create( struct fins_sys_tp *sys, const char *start, size_t num_words, size_t pre_samples, size_t post_samples, const struct fins_capturetrigger_tp *trigger, int *error_val );
+void				finslib_capture_free( struct fins_capture_tp *capture );
+int				finslib_capture_run( struct fins_capture_tp *capture, uint32_t period_usec, int timeout );
+int				finslib_capture_sample( struct fins_capture_tp *capture );
+int				finslib_capture_save( struct fins_capture_tp *capture, const char *file_name );
+int				finslib_capture_wait( struct fins_capture_tp *capture );
 int				finslib_clock_read( struct fins_sys_tp* sys, struct fins_datetime_tp *datetime );
 int				finslib_clock_write( struct fins_sys_tp *sys, const struct fins_datetime_tp *datetime, bool do_sec, bool do_day_of_week );
 int				finslib_connection_data_read( struct fins_sys_tp *sys, struct fins_unitdata_tp *unitdata, uint8_t start_unit, size_t *num_units );
@@ -648,6 +1497,12 @@ int				finslib_cpu_unit_status_read( struct fins_sys_tp *sys, struct fins_cpusta
 int				finslib_cycle_time_init( struct fins_sys_tp *sys );
 int				finslib_cycle_time_read( struct fins_sys_tp *sys, struct fins_cycletime_tp *ctime );
 void				finslib_disconnect( struct fins_sys_tp* sys );
+int				finslib_engine_add( struct fins_engine_tp *engine, struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, uint32_t first_tag_id, uint32_t interval_msec );
+struct fins_engine_tp *		finslib_engine_create( size_t num_workers, size_t max_jobs, struct fins_ring_tp *ring, bool bind_cpu, int *error_val );
+void				finslib_engine_free( struct fins_engine_tp *engine );
+int				finslib_engine_start( struct fins_engine_tp *engine );
+void				finslib_engine_stop( struct fins_engine_tp *engine );
+uint64_t			finslib_epoch_usec_timer( void );
 const char *			finslib_errmsg( int error_code, char *buffer, size_t buffer_len );
 int				finslib_error_clear( struct fins_sys_tp *sys, uint16_t error_code );
 int				finslib_error_clear_all( struct fins_sys_tp *sys );
@@ -656,21 +1511,44 @@ int				finslib_error_clear_fal( struct fins_sys_tp *sys, uint16_t fal_number );
 int				finslib_error_clear_fals( struct fins_sys_tp *sys, uint16_t fals_number );
 int				finslib_error_log_clear( struct fins_sys_tp *sys );
 int				finslib_error_log_read( struct fins_sys_tp *sys, struct fins_errordata_tp *errordata, uint16_t start_record, size_t *num_records, size_t *stored_records );
+int				finslib_eventlog_append( struct fins_eventlog_tp *log, const struct fins_result_tp *result, size_t num_result, bool changes_only, size_t *num_appended );
+struct fins_eventlog_tp *	finslib_eventlog_create( const char *name, size_t capacity, int *error_val );
+void				finslib_eventlog_free( struct fins_eventlog_tp *log );
+int				finslib_eventlog_remove( const char *name );
+void				finslib_eventreader_close( struct fins_eventreader_tp *reader );
+struct fins_eventreader_tp *	finslib_eventreader_open( const char *name, int *error_val );
+int				finslib_eventreader_read( struct fins_eventreader_tp *reader, struct fins_event_tp *event, size_t max_events, size_t *num_events );
+int				finslib_eventreader_seek( struct fins_eventreader_tp *reader, uint64_t sequence );
 int				finslib_filename_to_83( const char *infile, char *outfile );
 int				finslib_file_memory_format( struct fins_sys_tp *sys, uint16_t disk );
 int				finslib_file_name_read( struct fins_sys_tp *sys, struct fins_diskinfo_tp *diskinfo, struct fins_fileinfo_tp *fileinfo, uint16_t disk, const char *path, uint16_t start_file, size_t *num_files );
 int				finslib_file_read( struct fins_sys_tp *sys, uint16_t disk, const char *path, const char *filename, unsigned char *data, size_t file_position, size_t *num_bytes );
 int				finslib_file_to_area_transfer( struct fins_sys_tp *sys, const char *start, uint16_t disk, const char *path, const char *file, size_t *num_records );
 int				finslib_file_write( struct fins_sys_tp *sys, uint16_t disk, const char *path, const char *filename, const unsigned char *data, size_t file_position, size_t num_bytes, uint16_t open_mode );
+int				finslib_forced_map_read( struct fins_sys_tp *sys, struct fins_forcemap_tp *map );
 int				finslib_forced_set_reset_cancel( struct fins_sys_tp *sys );
+struct fins_gated_tp *		finslib_gated_create( struct fins_sys_tp *sys, const struct fins_gatedblock_tp *block, size_t num_block, int *error_val );
+void				finslib_gated_free( struct fins_gated_tp *gated );
+int				finslib_gated_invalidate( struct fins_gated_tp *gated );
+int				finslib_gated_poll( struct fins_gated_tp *gated, size_t *num_changed );
 const char *			finslib_inet_ntop( int af, const void *src, char *dst, socklen_t size );
 int				finslib_inet_pton( int af, const char *src, void *dst );
 uint32_t			finslib_int_to_bcd( int32_t value, int type );
+int				finslib_lease_acquire( struct fins_sys_tp *sys, struct fins_lease_tp *lease, int policy, int timeout );
+int				finslib_lease_init( struct fins_lease_tp *lease, struct fins_sys_tp *sys, int policy, int timeout );
+int				finslib_lease_release( struct fins_lease_tp *lease );
+int				finslib_lease_run( struct fins_lease_tp *lease, struct fins_leaseop_tp *op, size_t num_op );
 int				finslib_link_unit_reset( struct fins_sys_tp *sys );
+struct fins_mailbox_tp *	finslib_mailbox_create( struct fins_sys_tp *sys, const char *start, size_t num_slots, size_t slot_words, int direction, int *error_val );
+void				finslib_mailbox_free( struct fins_mailbox_tp *mailbox );
+int				finslib_mailbox_receive( struct fins_mailbox_tp *mailbox, uint16_t *data, size_t max_blocks, size_t *num_blocks );
+int				finslib_mailbox_reset( struct fins_mailbox_tp *mailbox );
+int				finslib_mailbox_send( struct fins_mailbox_tp *mailbox, const uint16_t *data, size_t num_blocks, size_t *num_sent );
 int				finslib_memory_area_fill( struct fins_sys_tp *sys, const char *start, uint16_t fill_data, size_t num_word );
 int				finslib_memory_area_read_bcd16( struct fins_sys_tp *sys, const char *start, uint16_t *data, size_t num_bcd16 );
 int				finslib_memory_area_read_bcd32( struct fins_sys_tp *sys, const char *start, uint32_t *data, size_t num_bcd32 );
 int				finslib_memory_area_read_bit( struct fins_sys_tp *sys, const char *start, bool *data, size_t num_bits );
+int				finslib_memory_area_read_forced( struct fins_sys_tp *sys, const char *start, uint16_t *forced, uint16_t *value, size_t num_word );
 int				finslib_memory_area_read_int16( struct fins_sys_tp *sys, const char *start, int16_t *data, size_t num_int16 );
 int				finslib_memory_area_read_int32( struct fins_sys_tp *sys, const char *start, int32_t *data, size_t num_int32 );
 int				finslib_memory_area_read_sbcd16( struct fins_sys_tp *sys, const char *start, int16_t *data, size_t num_sbcd16, int type );
@@ -692,8 +1570,14 @@ int				finslib_memory_area_write_word( struct fins_sys_tp *sys, const char *star
 int				finslib_message_clear( struct fins_sys_tp *sys, uint8_t msg_mask );
 int				finslib_message_read( struct fins_sys_tp *sys, struct fins_msgdata_tp *msgdata, uint8_t msg_mask );
 int				finslib_message_fal_fals_read( struct fins_sys_tp *sys, char *faldata, uint16_t fal_number );
+int				finslib_metrics_add_clock( struct fins_metrics_tp *metrics, struct fins_rtclock_tp *rtclock, const char *name );
+int				finslib_metrics_add_connection( struct fins_metrics_tp *metrics, struct fins_sys_tp *sys, const char *name );
+struct fins_metrics_tp *	finslib_metrics_create( const char *address, uint16_t port, int *error_val );
+void				finslib_metrics_free( struct fins_metrics_tp *metrics );
+int				finslib_metrics_remove( struct fins_metrics_tp *metrics, const char *name );
 void				finslib_milli_second_sleep( int msec );
 time_t				finslib_monotonic_sec_timer( void );
+uint64_t			finslib_monotonic_usec_timer( void );
 int				finslib_multiple_memory_area_read( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item );
 int				finslib_name_delete( struct fins_sys_tp *sys );
 int				finslib_name_read( struct fins_sys_tp *sys, char *name_buffer, size_t name_buffer_len );
@@ -704,19 +1588,77 @@ int				finslib_parameter_area_write( struct fins_sys_tp *sys, uint16_t area_code
 int				finslib_program_area_clear( struct fins_sys_tp *sys, bool do_interrupt_tasks );
 int				finslib_program_area_read( struct fins_sys_tp *sys, unsigned char *data, uint32_t start_word, size_t *num_bytes );
 int				finslib_program_area_write( struct fins_sys_tp *sys, const unsigned char *data, uint32_t start_word, size_t num_bytes );
+struct fins_publisher_tp *	finslib_publisher_create( struct fins_sys_tp *sys, const char *group, uint16_t port, const char *interface_address, int ttl, uint32_t refresh_msec, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val );
+void				finslib_publisher_free( struct fins_publisher_tp *pub );
+int				finslib_publisher_poll( struct fins_publisher_tp *pub );
 int				finslib_raw( struct fins_sys_tp *sys, uint16_t command, unsigned char *buffer, size_t send_len, size_t *recv_len );
+struct fins_ring_tp *		finslib_ring_create( size_t capacity, int type, int policy, int *error_val );
+void				finslib_ring_free( struct fins_ring_tp *ring );
+int				finslib_ring_pop( struct fins_ring_tp *ring, struct fins_result_tp *result, size_t max_results, size_t *num_results );
+int				finslib_ring_push( struct fins_ring_tp *ring, const struct fins_result_tp *result );
+int				finslib_ring_push_multidata( struct fins_ring_tp *ring, const struct fins_multidata_tp *item, size_t num_item, uint32_t first_tag_id, uint64_t timestamp );
+int				finslib_rtclock_init( struct fins_rtclock_tp *rtclock, uint32_t period_usec );
+int				finslib_rtclock_wait( struct fins_rtclock_tp *rtclock );
+int				finslib_rtprofile_apply( const struct fins_rtprofile_tp *profile );
+struct fins_segment_tp *	finslib_segment_create( const char *name, uint32_t bytes_per_sec, uint32_t frames_per_sec, int *error_val );
+void				finslib_segment_free( struct fins_segment_tp *segment );
+int				finslib_segment_join( struct fins_segment_tp *segment, struct fins_sys_tp *sys, int traffic_class );
+void				finslib_segment_leave( struct fins_sys_tp *sys );
+int				finslib_segment_set_budget( struct fins_segment_tp *segment, uint32_t bytes_per_sec, uint32_t frames_per_sec );
 int				finslib_set_cpu_run( struct fins_sys_tp *sys, bool do_monitor );
 int				finslib_set_cpu_stop( struct fins_sys_tp *sys );
 int				finslib_set_plc_name( struct fins_sys_tp *sys, const char *name );
+int				finslib_shadow_write( struct fins_sys_tp *sys, const char *bank_a, const char *bank_b, const char *selector, const uint16_t *data, size_t num_words, bool verify );
+int				finslib_snapshot_read( struct fins_sys_tp *sys, const char *start, const char *scratch, uint16_t *data, size_t num_words );
+int				finslib_snapshot_read_sequenced( struct fins_sys_tp *sys, const char *start, const char *sequence, uint16_t *data, size_t num_words, int max_retries );
+struct fins_statuswatch_tp *	finslib_statuswatch_create( struct fins_sys_tp *sys, int *error_val );
+void				finslib_statuswatch_free( struct fins_statuswatch_tp *watch );
+int				finslib_statuswatch_poll( struct fins_statuswatch_tp *watch, struct fins_statusevent_tp *event, size_t max_events, size_t *num_events );
+int				finslib_statuswatch_poll_fleet( struct fins_statuswatch_tp **watch, size_t num_watch, size_t max_concurrent, struct fins_statusevent_tp *event, size_t max_events, size_t *num_events );
+struct fins_subscriber_tp *	finslib_subscriber_create( const char *group, uint16_t port, const char *interface_address, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val );
+void				finslib_subscriber_free( struct fins_subscriber_tp *sub );
+int				finslib_subscriber_receive( struct fins_subscriber_tp *sub, int timeout_msec, size_t *num_changed );
+void				finslib_tagdb_close( struct fins_tagdb_tp *db );
+int				finslib_tagdb_compile( const char *list_file, const char *db_file, int plc_mode, size_t *num_tags, size_t *error_line );
+const struct fins_tag_tp *	finslib_tagdb_find( const struct fins_tagdb_tp *db, const char *name );
+const struct fins_tag_tp *	finslib_tagdb_group( const struct fins_tagdb_tp *db, uint16_t poll_group, size_t *num_tags );
+const char *			finslib_tagdb_name( const struct fins_tagdb_tp *db, const struct fins_tag_tp *tag );
+struct fins_tagdb_tp *		finslib_tagdb_open( const char *db_file, int *error_val );
 struct fins_sys_tp *		finslib_tcp_connect( struct fins_sys_tp *sys, const char *address, uint16_t port, uint8_t local_net, uint8_t local_node, uint8_t local_unit, uint8_t remote_net, uint8_t remote_node, uint8_t remote_unit, int *error_val, int error_max );
+int				finslib_timer_counter_read( struct fins_sys_tp *sys, const char *start, bool *completed, uint16_t *pv, size_t num_elements, int type );
+int				finslib_timestamping( struct fins_sys_tp *sys, int mode );
+struct fins_tunnelagent_tp *	finslib_tunnel_agent_create( struct fins_sys_tp *sys, const char *address, uint16_t port, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val );
+void				finslib_tunnel_agent_free( struct fins_tunnelagent_tp *agent );
+int				finslib_tunnel_agent_poll( struct fins_tunnelagent_tp *agent, int timeout_msec );
+struct fins_tunnelendpoint_tp *	finslib_tunnel_endpoint_create( const char *link_address, uint16_t link_port, const char *fins_address, uint16_t fins_port, int *error_val );
+void				finslib_tunnel_endpoint_free( struct fins_tunnelendpoint_tp *ep );
+int				finslib_tunnel_endpoint_poll( struct fins_tunnelendpoint_tp *ep, int timeout_msec );
 struct fins_sys_tp *		finslib_udp_connect( struct fins_sys_tp *sys, const char *address, uint16_t port, uint8_t local_net, uint8_t local_node, uint8_t local_unit, uint8_t remote_net, uint8_t remote_node, uint8_t remote_unit, int *error_val, int error_max );
 bool				finslib_valid_directory( const char *path );
 bool				finslib_valid_filename( const char *filename );
 int				finslib_write_access_log_clear( struct fins_sys_tp *sys );
+int				XX_finslib_busy_poll_apply( struct fins_sys_tp *sys );
+int				XX_finslib_busy_recv( struct fins_sys_tp *sys, void *buf, int len, struct sockaddr *from, socklen_t *fromlen );
 int				XX_finslib_communicate( struct fins_sys_tp *sys, struct fins_command_tp *command, size_t *bodylen, bool wait_response );
+void				XX_finslib_decode_cpu_status( const unsigned char *data, struct fins_cpustatus_tp *status );
 bool				XX_finslib_decode_address( const char *str, struct fins_address_tp *address );
 void				XX_finslib_init_command( struct fins_sys_tp *sys, struct fins_command_tp *command, uint8_t mrc, uint8_t src );
+struct fins_mcastlink_tp *	XX_finslib_mcast_create_links( const struct fins_mcastblock_tp *block, size_t num_block, bool publisher, int *error_val );
+void				XX_finslib_mcast_free_links( struct fins_mcastlink_tp *link, size_t num_link );
+int				XX_finslib_mcast_read_block( struct fins_sys_tp *sys, struct fins_mcastlink_tp *link, uint32_t *frames_read );
+int				XX_finslib_mcast_resolve_links( struct fins_sys_tp *sys, struct fins_mcastlink_tp *link, size_t num_link );
+int				XX_finslib_multiple_read_receive( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, struct fins_multiread_tp *read );
+int				XX_finslib_multiple_read_send( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, struct fins_multiread_tp *read );
+int				XX_finslib_pipeline( struct fins_sys_tp *sys, size_t first, size_t last, size_t window, int (*prepare)( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen ), int (*complete)( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval ), void *context, size_t *failed );
+int				XX_finslib_receive( struct fins_sys_tp *sys, struct fins_command_tp *command, size_t *bodylen );
 const struct fins_area_tp *	XX_finslib_search_area( struct fins_sys_tp *sys, const struct fins_address_tp *address, int bits, uint32_t access, bool force );
+void				XX_finslib_segment_request( struct fins_sys_tp *sys, const struct fins_command_tp *command, size_t bodylen );
+void				XX_finslib_segment_response( struct fins_sys_tp *sys, size_t len );
+void				XX_finslib_stats_response( struct fins_sys_tp *sys, uint8_t sid );
+int				XX_finslib_timestamp_apply( struct fins_sys_tp *sys );
+void				XX_finslib_timestamp_done( struct fins_sys_tp *sys, uint8_t sid );
+int				XX_finslib_timestamp_recv( struct fins_sys_tp *sys, void *buf, int len, int flags, struct sockaddr *from, socklen_t *fromlen );
+void				XX_finslib_timestamp_send( struct fins_sys_tp *sys, uint8_t sid );
 int				XX_finslib_wsa_errorcode_to_fins_retval( int errorcode );
 
 
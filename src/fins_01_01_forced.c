@@ -0,0 +1,176 @@
+/*
+ * Library: libfins
+ * File:    src/fins_01_01_forced.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_01_01_forced.c contains routines to read the
+ * forced status of bits together with their values from memory areas of a
+ * remote PLC, one complete word of sixteen bits per element.
+ */
+
+#include "fins.h"
+
+#define FORCED_CHUNK		((2*FINS_MAX_READ_WORDS_SYSWAY)/4)
+
+static size_t		count_bits( const uint16_t *data, size_t num_word );
+
+/*
+ * int finslib_memory_area_read_forced( struct fins_sys_tp *sys, const char *start, uint16_t *forced, uint16_t *value, size_t num_word );
+ *
+ * The function finslib_memory_area_read_forced() reads a block of words from
+ * an area with forced status in a remote PLC. For each word the forced status
+ * of all sixteen bits is stored in forced and the value of the bits is stored
+ * in value. Each element in the response is four bytes long, which is why
+ * fewer words fit in one frame than with a normal word read.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_memory_area_read_forced( struct fins_sys_tp *sys, const char *start, uint16_t *forced, uint16_t *value, size_t num_word ) {
+
+	size_t chunk_start;
+	size_t chunk_length;
+	size_t offset;
+	size_t a;
+	size_t todo;
+	size_t bodylen;
+	struct fins_command_tp fins_cmnd;
+	const struct fins_area_tp *area_ptr;
+	struct fins_address_tp address;
+	int retval;
+
+	if ( num_word    == 0                              ) return FINS_RETVAL_SUCCESS;
+	if ( sys         == NULL                           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( start       == NULL                           ) return FINS_RETVAL_NO_READ_ADDRESS;
+	if ( forced      == NULL  ||  value == NULL        ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( sys->sockfd == INVALID_SOCKET                 ) return FINS_RETVAL_NOT_CONNECTED;
+	if ( XX_finslib_decode_address( start, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+
+	area_ptr = XX_finslib_search_area( sys, & address, 16, FI_RD, true );
+	if ( area_ptr == NULL  ||  area_ptr->length != 4 ) return FINS_RETVAL_INVALID_READ_AREA;
+
+	offset       = 0;
+	todo         = num_word;
+	chunk_start  = address.main_address;
+	chunk_start += area_ptr->low_addr >> 8;
+	chunk_start -= area_ptr->low_id;
+
+	do {
+		chunk_length = FORCED_CHUNK;
+		if ( chunk_length > todo ) chunk_length = todo;
+
+		XX_finslib_init_command( sys, & fins_cmnd, 0x01, 0x01 );
+
+		bodylen = 0;
+
+		fins_cmnd.body[bodylen++] = area_ptr->area;
+		fins_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+		fins_cmnd.body[bodylen++] = 0x00;
+		fins_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+		if ( ( retval = XX_finslib_communicate( sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		if ( bodylen != 2+4*chunk_length ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+		bodylen = 2;
+
+		for (a=0; a<chunk_length; a++) {
+
+			forced[offset+a]   = fins_cmnd.body[bodylen++];
+			forced[offset+a] <<= 8;
+			forced[offset+a]  += fins_cmnd.body[bodylen++];
+
+			value[offset+a]    = fins_cmnd.body[bodylen++];
+			value[offset+a]  <<= 8;
+			value[offset+a]   += fins_cmnd.body[bodylen++];
+		}
+
+		todo        -= chunk_length;
+		offset      += chunk_length;
+		chunk_start += chunk_length;
+
+	} while ( todo > 0 );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_memory_area_read_forced */
+
+/*
+ * int finslib_forced_map_read( struct fins_sys_tp *sys, struct fins_forcemap_tp *map );
+ *
+ * The function finslib_forced_map_read() reads the forced status and value
+ * of all bits in the CIO, W and H areas of a remote PLC in a force map. The
+ * total number of forced bits is counted afterwards.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_forced_map_read( struct fins_sys_tp *sys, struct fins_forcemap_tp *map ) {
+
+	int retval;
+
+	if ( map == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	map->num_forced = 0;
+
+	if ( ( retval = finslib_memory_area_read_forced( sys, "CIO0", map->cio_forced, map->cio_value, FINS_FORCEMAP_CIO_WORDS ) ) != FINS_RETVAL_SUCCESS ) return retval;
+	if ( ( retval = finslib_memory_area_read_forced( sys, "W0",   map->w_forced,   map->w_value,   FINS_FORCEMAP_W_WORDS   ) ) != FINS_RETVAL_SUCCESS ) return retval;
+	if ( ( retval = finslib_memory_area_read_forced( sys, "H0",   map->h_forced,   map->h_value,   FINS_FORCEMAP_H_WORDS   ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	map->num_forced += count_bits( map->cio_forced, FINS_FORCEMAP_CIO_WORDS );
+	map->num_forced += count_bits( map->w_forced,   FINS_FORCEMAP_W_WORDS   );
+	map->num_forced += count_bits( map->h_forced,   FINS_FORCEMAP_H_WORDS   );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_forced_map_read */
+
+/*
+ * static size_t count_bits( const uint16_t *data, size_t num_word );
+ *
+ * The function count_bits() returns the number of set bits in a block of
+ * words.
+ */
+
+static size_t count_bits( const uint16_t *data, size_t num_word ) {
+
+	size_t a;
+	size_t count;
+	uint16_t bits;
+
+	count = 0;
+
+	for (a=0; a<num_word; a++) {
+
+		for (bits=data[a]; bits != 0; bits &= bits - 1) count++;
+	}
+
+	return count;
+
+}  /* count_bits */
@@ -0,0 +1,175 @@
+/*
+ * Library: libfins
+ * File:    src/fins_01_01_timer.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_01_01_timer.c contains routines to read the
+ * completion flags and present values of a range of timers or counters from
+ * a remote PLC with as few frames as possible.
+ */
+
+#include "fins.h"
+
+#define FLAG_CHUNK		(2*FINS_MAX_READ_WORDS_SYSWAY)
+
+/*
+ * int finslib_timer_counter_read( struct fins_sys_tp *sys, const char *start, bool *completed, uint16_t *pv, size_t num_elements, int type );
+ *
+ * The function finslib_timer_counter_read() reads both the completion flags
+ * and the present values of a range of consecutive timers or counters. The
+ * results are stored in two parallel arrays. The present values are read as
+ * one contiguous word block. The completion flags are read as a contiguous
+ * block of one byte per flag, of which twice as many fit in one frame. The
+ * present values are decoded as BCD or binary depending on the type
+ * parameter which must be FINS_DATA_TYPE_BCD16 or FINS_DATA_TYPE_UINT16.
+ * Either array may be NULL if that information is not needed.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_timer_counter_read( struct fins_sys_tp *sys, const char *start, bool *completed, uint16_t *pv, size_t num_elements, int type ) {
+
+	size_t pv_start;
+	size_t flag_start;
+	size_t chunk_start;
+	size_t chunk_length;
+	size_t offset;
+	size_t a;
+	size_t todo;
+	size_t bodylen;
+	uint16_t value;
+	struct fins_command_tp fins_cmnd;
+	const struct fins_area_tp *pv_area;
+	const struct fins_area_tp *flag_area;
+	struct fins_address_tp address;
+	int retval;
+
+	if ( num_elements == 0                                  ) return FINS_RETVAL_SUCCESS;
+	if ( sys          == NULL                               ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( start        == NULL                               ) return FINS_RETVAL_NO_READ_ADDRESS;
+	if ( completed    == NULL  &&  pv == NULL               ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( sys->sockfd  == INVALID_SOCKET                     ) return FINS_RETVAL_NOT_CONNECTED;
+	if ( XX_finslib_decode_address( start, & address )      ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+	if ( type != FINS_DATA_TYPE_BCD16  &&
+	     type != FINS_DATA_TYPE_UINT16                      ) return FINS_RETVAL_INVALID_DATA_TYPE;
+
+	pv_area   = XX_finslib_search_area( sys, & address, 16, FI_RD, false );
+	flag_area = XX_finslib_search_area( sys, & address, 1,  FI_RD, false );
+
+	if ( pv_area == NULL  ||  flag_area == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+
+	pv_start    = address.main_address;
+	pv_start   += pv_area->low_addr >> 8;
+	pv_start   -= pv_area->low_id;
+
+	flag_start  = address.main_address;
+	flag_start += flag_area->low_addr >> 8;
+	flag_start -= flag_area->low_id;
+
+	offset      = 0;
+	todo        = num_elements;
+	chunk_start = pv_start;
+
+	while ( pv != NULL  &&  todo > 0 ) {
+
+		chunk_length = FINS_MAX_READ_WORDS_SYSWAY;
+		if ( chunk_length > todo ) chunk_length = todo;
+
+		XX_finslib_init_command( sys, & fins_cmnd, 0x01, 0x01 );
+
+		bodylen = 0;
+
+		fins_cmnd.body[bodylen++] = pv_area->area;
+		fins_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+		fins_cmnd.body[bodylen++] = 0x00;
+		fins_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+		if ( ( retval = XX_finslib_communicate( sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		if ( bodylen != 2+2*chunk_length ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+		bodylen = 2;
+
+		for (a=0; a<chunk_length; a++) {
+
+			value   = fins_cmnd.body[bodylen++];
+			value <<= 8;
+			value  += fins_cmnd.body[bodylen++];
+
+			if ( type == FINS_DATA_TYPE_BCD16 ) pv[offset+a] = (uint16_t) finslib_bcd_to_int( value, type );
+			else                                pv[offset+a] = value;
+		}
+
+		todo        -= chunk_length;
+		offset      += chunk_length;
+		chunk_start += chunk_length;
+	}
+
+	/*
+	 * Completion flags are addressed by timer or counter number with bit
+	 * number 0. Each next element in a read is the flag of the next timer
+	 * or counter and not the next bit in the same word.
+	 */
+
+	offset      = 0;
+	todo        = num_elements;
+	chunk_start = flag_start;
+
+	while ( completed != NULL  &&  todo > 0 ) {
+
+		chunk_length = FLAG_CHUNK;
+		if ( chunk_length > todo ) chunk_length = todo;
+
+		XX_finslib_init_command( sys, & fins_cmnd, 0x01, 0x01 );
+
+		bodylen = 0;
+
+		fins_cmnd.body[bodylen++] = flag_area->area;
+		fins_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+		fins_cmnd.body[bodylen++] = 0x00;
+		fins_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+		if ( ( retval = XX_finslib_communicate( sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		if ( bodylen != 2+chunk_length ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+		bodylen = 2;
+
+		for (a=0; a<chunk_length; a++) completed[offset+a] = fins_cmnd.body[bodylen++] & 0x01;
+
+		todo        -= chunk_length;
+		offset      += chunk_length;
+		chunk_start += chunk_length;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_timer_counter_read */
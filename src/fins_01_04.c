@@ -31,8 +31,16 @@
  * types in one batch from a remote PLC over the FINS protocol.
  */
 
+#include <string.h>
 #include "fins.h"
 
+static int	decode_chunk( struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded, const unsigned char *body, size_t bodylen );
+static int	encode_item( struct fins_sys_tp *sys, const struct fins_multidata_tp *item, struct fins_multiencoded_tp *encoded );
+static bool	is_item_error( int retval );
+static int	read_chunk( struct fins_sys_tp *sys, struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded );
+static int	read_range( struct fins_sys_tp *sys, struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded );
+static size_t	decode_item( struct fins_multidata_tp *item, const unsigned char *body, size_t pos );
+
 /*
  * int finslib_multiple_memory_area_read( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item );
  *
@@ -41,30 +49,23 @@
  * If more data is requested than can be handled, the request is split over
  * multiple sub requests.
  *
+ * Each item gets its own status code. Items with an invalid address or type
+ * are excluded while the sub requests are filled, so that the remaining items
+ * are still packed in full sub requests. When the PLC rejects a sub request
+ * with an error which can be caused by a single item, the sub request is split
+ * in two halves until the offending items are isolated. The rejections of
+ * these probes do not count against the maximum error count of the
+ * connection, only the final rejection of each single item does. The data of
+ * all other items is still returned. Communication errors abort the whole
+ * call.
+ *
  * The function returns a success or error code from the list FINS_RETVAL_...
+ * FINS_RETVAL_PARTIAL_READ is returned if one or more items could not be read.
  */
 
 int finslib_multiple_memory_area_read( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item ) {
 
-	uint32_t bcd_val;
-	size_t a;
-	size_t bodylen;
-	size_t recvlen;
-	size_t chunk_start;
-	size_t chunk_length;
-	size_t offset;
-	size_t todo;
-	struct fins_command_tp fins_cmnd;
-	struct fins_address_tp address;
-	const struct fins_area_tp *area_ptr;
-	union {
-		unsigned char val_raw[4];
-		float val_float;
-	} sfloat;
-	union {
-		unsigned char val_raw[8];
-		double val_double;
-	} dfloat;
+	struct fins_multiread_tp read;
 	int retval;
 
 	if ( num_item    == 0              ) return FINS_RETVAL_SUCCESS;
@@ -72,408 +73,576 @@ int finslib_multiple_memory_area_read( struct fins_sys_tp *sys, struct fins_mult
 	if ( item        == NULL           ) return FINS_RETVAL_NO_DATA_BLOCK;
 	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
 
-	offset = 0;
-	todo   = num_item;
+	read.next = 0;
 
 	do {
-		chunk_length = 24;
-		if ( chunk_length > todo ) chunk_length = todo;
+		if ( ( retval = XX_finslib_multiple_read_send( sys, item, num_item, & read ) ) != FINS_RETVAL_SUCCESS ) return retval;
 
-		XX_finslib_init_command( sys, & fins_cmnd, 0x01, 0x04 );
+		if ( read.num_encoded == 0 ) break;
 
-		bodylen = 0;
-		recvlen = 2;
+		if ( ( retval = XX_finslib_multiple_read_receive( sys, item, num_item, & read ) ) != FINS_RETVAL_SUCCESS ) return retval;
 
-		for (a=0; a<chunk_length; a++) {
+	} while ( read.next < num_item );
 
-			switch( item[offset+a].type ) {
+	return ( read.partial ) ? FINS_RETVAL_PARTIAL_READ : FINS_RETVAL_SUCCESS;
 
-				case FINS_DATA_TYPE_INT16    :
-				case FINS_DATA_TYPE_UINT16   :
-				case FINS_DATA_TYPE_BCD16    :
-				case FINS_DATA_TYPE_SBCD16_0 :
-				case FINS_DATA_TYPE_SBCD16_1 :
-				case FINS_DATA_TYPE_SBCD16_2 :
-				case FINS_DATA_TYPE_SBCD16_3 :
+}  /* finslib_multiple_memory_area_read */
 
-					if ( XX_finslib_decode_address( item[offset+a].address, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+/*
+ * int XX_finslib_multiple_read_send( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, struct fins_multiread_tp *read );
+ *
+ * The function XX_finslib_multiple_read_send() fills the next sub request of
+ * a multiple memory area read with the items starting at read->next and sends
+ * it without waiting for the response. A read starts with read->next set to
+ * 0. The response must be collected with XX_finslib_multiple_read_receive()
+ * before the next sub request is sent. When no items are left to send,
+ * read->num_encoded is set to 0 and nothing is sent. Splitting sending and
+ * receiving makes it possible to have reads outstanding on multiple
+ * connections at the same time.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ * If the sub request cannot be sent, the status of all items which have not
+ * been read yet is set to that error code.
+ */
+
+int XX_finslib_multiple_read_send( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, struct fins_multiread_tp *read ) {
+
+	size_t a;
+	size_t bodylen;
+	int retval;
 
-					area_ptr = XX_finslib_search_area( sys, & address, 16, FI_MRD, false );
-					if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+	if ( read->next == 0 ) read->partial = false;
 
-					chunk_start  = address.main_address;
-					chunk_start += area_ptr->low_addr >> 8;
-					chunk_start -= area_ptr->low_id;
+	read->num_encoded = 0;
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8) & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     ) & 0xff;
-					fins_cmnd.body[bodylen++] = 0x00;
+	while ( read->next < num_item  &&  read->num_encoded < FINS_MULTI_READ_ITEMS ) {
 
-					recvlen += 3;
+		a              = read->next++;
+		item[a].status = encode_item( sys, & item[a], & read->encoded[read->num_encoded] );
 
-					break;
+		if ( item[a].status == FINS_RETVAL_SUCCESS ) read->encoded[read->num_encoded++].index = a;
+		else                                         read->partial                            = true;
+	}
 
+	if ( read->num_encoded == 0 ) return FINS_RETVAL_SUCCESS;
 
+	XX_finslib_init_command( sys, & read->command, 0x01, 0x04 );
 
-				case FINS_DATA_TYPE_BIT :
+	bodylen = 0;
 
-					if ( XX_finslib_decode_address( item[offset+a].address, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+	for (a=0; a<read->num_encoded; a++) {
 
-					area_ptr = XX_finslib_search_area( sys, & address, 1, FI_MRD, false );
-					if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+		memcpy( & read->command.body[bodylen], read->encoded[a].body, read->encoded[a].bodylen );
+		bodylen += read->encoded[a].bodylen;
+	}
 
-					chunk_start  = address.main_address;
-					chunk_start += area_ptr->low_addr >> 8;
-					chunk_start -= area_ptr->low_id;
+	if ( ( retval = XX_finslib_communicate( sys, & read->command, & bodylen, false ) ) != FINS_RETVAL_SUCCESS ) {
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8)  & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     )  & 0xff;
-					fins_cmnd.body[bodylen++] = address.sub_address & 0xff;
+		for (a=0; a<read->num_encoded; a++) item[read->encoded[a].index].status = retval;
+		for (a=read->next; a<num_item; a++) item[a].status                      = retval;
 
-					recvlen += 2;
+		read->num_encoded = 0;
+	}
 
-					break;
+	return retval;
 
+}  /* XX_finslib_multiple_read_send */
 
+/*
+ * int XX_finslib_multiple_read_receive( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, struct fins_multiread_tp *read );
+ *
+ * The function XX_finslib_multiple_read_receive() collects the response to a
+ * sub request sent with XX_finslib_multiple_read_send() and stores the
+ * values in the items. A sub request with more than one item is received as
+ * a probe, so that its end code does not count against the maximum error
+ * count of the connection. When the PLC rejects the sub request because of
+ * one of its items, the items are read again in halves until the offending
+ * items are isolated. These reads wait for their responses.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ * Only errors which are not related to individual items are returned. In
+ * that case the status of all items which have not been read yet is set to
+ * that error code.
+ */
 
-				case FINS_DATA_TYPE_BIT_FORCED :
+int XX_finslib_multiple_read_receive( struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, struct fins_multiread_tp *read ) {
 
-					if ( XX_finslib_decode_address( item[offset+a].address, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+	size_t a;
+	size_t half;
+	size_t bodylen;
+	int retval;
 
-					area_ptr = XX_finslib_search_area( sys, & address, 1, FI_MRD, true );
-					if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+	bodylen          = 0;
+	sys->error_probe = ( read->num_encoded > 1 );
+	retval           = XX_finslib_receive( sys, & read->command, & bodylen );
+	sys->error_probe = false;
 
-					chunk_start  = address.main_address;
-					chunk_start += area_ptr->low_addr >> 8;
-					chunk_start -= area_ptr->low_id;
+	if ( retval == FINS_RETVAL_SUCCESS ) retval = decode_chunk( item, read->encoded, read->num_encoded, read->command.body, bodylen );
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8)  & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     )  & 0xff;
-					fins_cmnd.body[bodylen++] = address.sub_address & 0xff;
+	if ( retval != FINS_RETVAL_SUCCESS  &&  ! is_item_error( retval ) ) {
 
-					recvlen += 2;
+		for (a=0; a<read->num_encoded; a++) item[read->encoded[a].index].status = retval;
+	}
 
-					break;
+	else if ( retval != FINS_RETVAL_SUCCESS  &&  read->num_encoded == 1 ) {
 
+		item[read->encoded[0].index].status = retval;
+		retval                              = FINS_RETVAL_SUCCESS;
+	}
 
+	else if ( retval != FINS_RETVAL_SUCCESS ) {
 
-				case FINS_DATA_TYPE_WORD_FORCED :
+		half = read->num_encoded / 2;
 
-					if ( XX_finslib_decode_address( item[offset+a].address, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+		if ( ( retval = read_range( sys, item, read->encoded, half ) ) != FINS_RETVAL_SUCCESS ) {
 
-					area_ptr = XX_finslib_search_area( sys, & address, 16, FI_MRD, true );
-					if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+			for (a=half; a<read->num_encoded; a++) item[read->encoded[a].index].status = retval;
+		}
 
-					chunk_start  = address.main_address;
-					chunk_start += area_ptr->low_addr >> 8;
-					chunk_start -= area_ptr->low_id;
+		else retval = read_range( sys, item, read->encoded+half, read->num_encoded-half );
+	}
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8) & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     ) & 0xff;
-					fins_cmnd.body[bodylen++] = 0x00;
+	for (a=0; a<read->num_encoded; a++) if ( item[read->encoded[a].index].status != FINS_RETVAL_SUCCESS ) read->partial = true;
 
-					recvlen += 5;
+	if ( retval != FINS_RETVAL_SUCCESS ) for (a=read->next; a<num_item; a++) item[a].status = retval;
 
-					break;
+	read->num_encoded = 0;
 
+	return retval;
 
+}  /* XX_finslib_multiple_read_receive */
 
-				case FINS_DATA_TYPE_INT32    :
-				case FINS_DATA_TYPE_UINT32   :
-				case FINS_DATA_TYPE_BCD32    :
-				case FINS_DATA_TYPE_SBCD32_0 :
-				case FINS_DATA_TYPE_SBCD32_1 :
-				case FINS_DATA_TYPE_SBCD32_2 :
-				case FINS_DATA_TYPE_SBCD32_3 :
-				case FINS_DATA_TYPE_FLOAT    :
+/*
+ * static int read_range( struct fins_sys_tp *sys, struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded );
+ *
+ * The function read_range() reads the encoded items with one multiple memory
+ * area read command. If the PLC rejects the command because of the contents
+ * of the request, the range is split in two halves which are read
+ * separately, until the items which cause the error are isolated. Commands
+ * with more than one item are sent as probes, so that their end codes do not
+ * close the connection when the maximum error count is reached. The status of
+ * each item is updated accordingly.
+ *
+ * The function only returns an error code for errors which are not related
+ * to individual items. In that case the status of all items in the range
+ * which have not been read yet is set to that error code.
+ */
 
-					if ( XX_finslib_decode_address( item[offset+a].address, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+static int read_range( struct fins_sys_tp *sys, struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded ) {
 
-					area_ptr = XX_finslib_search_area( sys, & address, 16, FI_MRD, false );
-					if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+	size_t a;
+	size_t half;
+	int retval;
 
-					chunk_start  = address.main_address;
-					chunk_start += area_ptr->low_addr >> 8;
-					chunk_start -= area_ptr->low_id;
+	sys->error_probe = ( num_encoded > 1 );
+	retval           = read_chunk( sys, item, encoded, num_encoded );
+	sys->error_probe = false;
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8) & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     ) & 0xff;
-					fins_cmnd.body[bodylen++] = 0x00;
+	if ( retval == FINS_RETVAL_SUCCESS ) return FINS_RETVAL_SUCCESS;
 
-					chunk_start++;
+	if ( ! is_item_error( retval ) ) {
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8) & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     ) & 0xff;
-					fins_cmnd.body[bodylen++] = 0x00;
+		for (a=0; a<num_encoded; a++) item[encoded[a].index].status = retval;
 
-					recvlen += 6;
+		return retval;
+	}
 
-					break;
+	if ( num_encoded == 1 ) {
 
+		item[encoded[0].index].status = retval;
+		return FINS_RETVAL_SUCCESS;
+	}
 
+	half = num_encoded / 2;
 
-				case FINS_DATA_TYPE_DOUBLE :
+	if ( ( retval = read_range( sys, item, encoded,      half             ) ) != FINS_RETVAL_SUCCESS ) {
 
-					if ( XX_finslib_decode_address( item[offset+a].address, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+		for (a=half; a<num_encoded; a++) item[encoded[a].index].status = retval;
 
-					area_ptr = XX_finslib_search_area( sys, & address, 16, FI_MRD, false );
-					if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+		return retval;
+	}
 
-					chunk_start  = address.main_address;
-					chunk_start += area_ptr->low_addr >> 8;
-					chunk_start -= area_ptr->low_id;
+	return read_range( sys, item, encoded+half, num_encoded-half );
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8) & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     ) & 0xff;
-					fins_cmnd.body[bodylen++] = 0x00;
+}  /* read_range */
 
-					chunk_start++;
+/*
+ * static bool is_item_error( int retval );
+ *
+ * The function is_item_error() returns true if an end code returned by the
+ * PLC may be caused by one of the items in a multiple memory area read
+ * command, like an address out of range or a protected area. Network,
+ * routing and communication errors are not item related.
+ */
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8) & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     ) & 0xff;
-					fins_cmnd.body[bodylen++] = 0x00;
+static bool is_item_error( int retval ) {
 
-					chunk_start++;
+	if ( retval >= 0x1000  &&  retval <= 0x11FF ) return true;
+	if ( retval >= 0x2000  &&  retval <= 0x21FF ) return true;
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8) & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     ) & 0xff;
-					fins_cmnd.body[bodylen++] = 0x00;
+	return false;
 
-					chunk_start++;
+}  /* is_item_error */
 
-					fins_cmnd.body[bodylen++] = area_ptr->area;
-					fins_cmnd.body[bodylen++] = (chunk_start >> 8) & 0xff;
-					fins_cmnd.body[bodylen++] = (chunk_start     ) & 0xff;
-					fins_cmnd.body[bodylen++] = 0x00;
+/*
+ * static int read_chunk( struct fins_sys_tp *sys, struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded );
+ *
+ * The function read_chunk() sends one multiple memory area read command for
+ * the encoded items and waits for the response. The items have already been
+ * checked when they were encoded.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
 
-					recvlen += 12;
+static int read_chunk( struct fins_sys_tp *sys, struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded ) {
 
-					break;
-			}
-		}
+	size_t a;
+	size_t bodylen;
+	struct fins_command_tp fins_cmnd;
+	int retval;
+
+	XX_finslib_init_command( sys, & fins_cmnd, 0x01, 0x04 );
+
+	bodylen = 0;
+
+	for (a=0; a<num_encoded; a++) {
+
+		memcpy( & fins_cmnd.body[bodylen], encoded[a].body, encoded[a].bodylen );
+		bodylen += encoded[a].bodylen;
+	}
+
+	if ( ( retval = XX_finslib_communicate( sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	return decode_chunk( item, encoded, num_encoded, fins_cmnd.body, bodylen );
+
+}  /* read_chunk */
+
+/*
+ * static int decode_chunk( struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded, const unsigned char *body, size_t bodylen );
+ *
+ * The function decode_chunk() checks the length of the response to a
+ * multiple memory area read command and stores the returned values in the
+ * encoded items.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int decode_chunk( struct fins_multidata_tp *item, const struct fins_multiencoded_tp *encoded, size_t num_encoded, const unsigned char *body, size_t bodylen ) {
+
+	size_t a;
+	size_t recvlen;
+	size_t pos;
+
+	recvlen = 2;
+	for (a=0; a<num_encoded; a++) recvlen += encoded[a].recvlen;
+
+	if ( bodylen != recvlen ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+	pos = 2;
+
+	for (a=0; a<num_encoded; a++) {
+
+		pos                           = decode_item( & item[encoded[a].index], body, pos );
+		item[encoded[a].index].status = FINS_RETVAL_SUCCESS;
+	}
+
+	return FINS_RETVAL_SUCCESS;
 
+}  /* decode_chunk */
 
-		if ( ( retval = XX_finslib_communicate( sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+/*
+ * static int encode_item( struct fins_sys_tp *sys, const struct fins_multidata_tp *item, struct fins_multiencoded_tp *encoded );
+ *
+ * The function encode_item() checks the address and type of one item and
+ * stores the memory addresses of the item as they appear in the body of a
+ * multiple memory area read command, together with the length of the item in
+ * the response. Each item is encoded once and the result is reused when a
+ * rejected command is split.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
 
-		if ( bodylen != recvlen ) return FINS_RETVAL_BODY_TOO_SHORT;
+static int encode_item( struct fins_sys_tp *sys, const struct fins_multidata_tp *item, struct fins_multiencoded_tp *encoded ) {
 
-		bodylen = 2;
+	size_t a;
+	size_t chunk_start;
+	size_t num_words;
+	size_t element_len;
+	int bits;
+	bool forced;
+	unsigned char sub_address;
+	struct fins_address_tp address;
+	const struct fins_area_tp *area_ptr;
 
-		for (a=0; a<chunk_length; a++) {
+	switch ( item->type ) {
+
+		case FINS_DATA_TYPE_INT16       :
+		case FINS_DATA_TYPE_UINT16      :
+		case FINS_DATA_TYPE_BCD16       :
+		case FINS_DATA_TYPE_SBCD16_0    :
+		case FINS_DATA_TYPE_SBCD16_1    :
+		case FINS_DATA_TYPE_SBCD16_2    :
+		case FINS_DATA_TYPE_SBCD16_3    : bits = 16; forced = false; num_words = 1; element_len =  3; break;
+		case FINS_DATA_TYPE_BIT         : bits =  1; forced = false; num_words = 1; element_len =  2; break;
+		case FINS_DATA_TYPE_BIT_FORCED  : bits =  1; forced = true;  num_words = 1; element_len =  2; break;
+		case FINS_DATA_TYPE_WORD_FORCED : bits = 16; forced = true;  num_words = 1; element_len =  5; break;
+		case FINS_DATA_TYPE_INT32       :
+		case FINS_DATA_TYPE_UINT32      :
+		case FINS_DATA_TYPE_BCD32       :
+		case FINS_DATA_TYPE_SBCD32_0    :
+		case FINS_DATA_TYPE_SBCD32_1    :
+		case FINS_DATA_TYPE_SBCD32_2    :
+		case FINS_DATA_TYPE_SBCD32_3    :
+		case FINS_DATA_TYPE_FLOAT       : bits = 16; forced = false; num_words = 2; element_len =  6; break;
+		case FINS_DATA_TYPE_DOUBLE      : bits = 16; forced = false; num_words = 4; element_len = 12; break;
+		default                         : return FINS_RETVAL_INVALID_DATA_TYPE;
+	}
+
+	if ( XX_finslib_decode_address( item->address, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+
+	area_ptr = XX_finslib_search_area( sys, & address, bits, FI_MRD, forced );
+	if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+
+	chunk_start  = address.main_address;
+	chunk_start += area_ptr->low_addr >> 8;
+	chunk_start -= area_ptr->low_id;
+
+	sub_address  = ( bits == 1 ) ? address.sub_address & 0xff : 0x00;
+
+	encoded->bodylen = 0;
+	encoded->recvlen = element_len;
+
+	for (a=0; a<num_words; a++) {
+
+		encoded->body[encoded->bodylen++] = area_ptr->area;
+		encoded->body[encoded->bodylen++] = (chunk_start >> 8) & 0xff;
+		encoded->body[encoded->bodylen++] = (chunk_start     ) & 0xff;
+		encoded->body[encoded->bodylen++] = sub_address;
+
+		chunk_start++;
+	}
 
-			bodylen++;
+	return FINS_RETVAL_SUCCESS;
 
-			switch ( item[offset+a].type ) {
+}  /* encode_item */
 
-				case FINS_DATA_TYPE_INT16 :
+/*
+ * static size_t decode_item( struct fins_multidata_tp *item, const unsigned char *body, size_t pos );
+ *
+ * The function decode_item() extracts the value of one item from the
+ * response of a multiple memory area read command, starting at position pos
+ * in the body. The position of the next item in the body is returned.
+ */
 
-					item[offset+a].int16   = fins_cmnd.body[bodylen+0];
-					item[offset+a].int16 <<= 8;
-					item[offset+a].int16  += fins_cmnd.body[bodylen+1];
+static size_t decode_item( struct fins_multidata_tp *item, const unsigned char *body, size_t pos ) {
 
-					bodylen += 2;
+	uint32_t bcd_val;
+	union {
+		unsigned char val_raw[4];
+		float val_float;
+	} sfloat;
+	union {
+		unsigned char val_raw[8];
+		double val_double;
+	} dfloat;
 
-					break;
+	pos++;
 
+	switch ( item->type ) {
 
+		case FINS_DATA_TYPE_INT16 :
 
-				case FINS_DATA_TYPE_INT32 :
+			item->int16   = body[pos+0];
+			item->int16 <<= 8;
+			item->int16  += body[pos+1];
 
-					item[offset+a].int32   = fins_cmnd.body[bodylen+3];
-					item[offset+a].int32 <<= 8;
-					item[offset+a].int32  += fins_cmnd.body[bodylen+4];
-					item[offset+a].int32 <<= 8;
-					item[offset+a].int32  += fins_cmnd.body[bodylen+0];
-					item[offset+a].int32 <<= 8;
-					item[offset+a].int32  += fins_cmnd.body[bodylen+1];
+			pos += 2;
 
-					bodylen += 5;
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_INT32 :
 
-				case FINS_DATA_TYPE_UINT16 :
+			item->int32   = body[pos+3];
+			item->int32 <<= 8;
+			item->int32  += body[pos+4];
+			item->int32 <<= 8;
+			item->int32  += body[pos+0];
+			item->int32 <<= 8;
+			item->int32  += body[pos+1];
 
-					item[offset+a].uint16   = fins_cmnd.body[bodylen+0];
-					item[offset+a].uint16 <<= 8;
-					item[offset+a].uint16  += fins_cmnd.body[bodylen+1];
+			pos += 5;
 
-					bodylen += 2;
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_UINT16 :
 
-				case FINS_DATA_TYPE_UINT32 :
+			item->uint16   = body[pos+0];
+			item->uint16 <<= 8;
+			item->uint16  += body[pos+1];
 
-					item[offset+a].uint32   = fins_cmnd.body[bodylen+3];
-					item[offset+a].uint32 <<= 8;
-					item[offset+a].uint32  += fins_cmnd.body[bodylen+4];
-					item[offset+a].uint32 <<= 8;
-					item[offset+a].uint32  += fins_cmnd.body[bodylen+0];
-					item[offset+a].uint32 <<= 8;
-					item[offset+a].uint32  += fins_cmnd.body[bodylen+1];
+			pos += 2;
 
-					bodylen += 5;
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_UINT32 :
 
-				case FINS_DATA_TYPE_FLOAT :
+			item->uint32   = body[pos+3];
+			item->uint32 <<= 8;
+			item->uint32  += body[pos+4];
+			item->uint32 <<= 8;
+			item->uint32  += body[pos+0];
+			item->uint32 <<= 8;
+			item->uint32  += body[pos+1];
 
-					sfloat.val_raw[0] = fins_cmnd.body[0];
-					sfloat.val_raw[1] = fins_cmnd.body[1];
-					sfloat.val_raw[2] = fins_cmnd.body[3];
-					sfloat.val_raw[3] = fins_cmnd.body[4];
+			pos += 5;
 
-					item[offset+a].sfloat = sfloat.val_float;
+			break;
 
-					bodylen += 5;
 
-					break;
 
+		case FINS_DATA_TYPE_FLOAT :
 
+			sfloat.val_raw[0] = body[pos+0];
+			sfloat.val_raw[1] = body[pos+1];
+			sfloat.val_raw[2] = body[pos+3];
+			sfloat.val_raw[3] = body[pos+4];
 
-				case FINS_DATA_TYPE_DOUBLE :
+			item->sfloat = sfloat.val_float;
 
-					dfloat.val_raw[0] = fins_cmnd.body[0];
-					dfloat.val_raw[1] = fins_cmnd.body[1];
-					dfloat.val_raw[2] = fins_cmnd.body[3];
-					dfloat.val_raw[3] = fins_cmnd.body[4];
-					dfloat.val_raw[4] = fins_cmnd.body[6];
-					dfloat.val_raw[5] = fins_cmnd.body[7];
-					dfloat.val_raw[6] = fins_cmnd.body[9];
-					dfloat.val_raw[7] = fins_cmnd.body[10];
+			pos += 5;
 
-					item[offset+a].dfloat = dfloat.val_double;
+			break;
 
-					bodylen += 11;
 
-					break;
 
+		case FINS_DATA_TYPE_DOUBLE :
 
+			dfloat.val_raw[0] = body[pos+0];
+			dfloat.val_raw[1] = body[pos+1];
+			dfloat.val_raw[2] = body[pos+3];
+			dfloat.val_raw[3] = body[pos+4];
+			dfloat.val_raw[4] = body[pos+6];
+			dfloat.val_raw[5] = body[pos+7];
+			dfloat.val_raw[6] = body[pos+9];
+			dfloat.val_raw[7] = body[pos+10];
 
-				case FINS_DATA_TYPE_BCD16 :
+			item->dfloat = dfloat.val_double;
 
-					bcd_val   = fins_cmnd.body[bodylen+0];
-					bcd_val <<= 8;
-					bcd_val  += fins_cmnd.body[bodylen+1];
-					bodylen  += 2;
+			pos += 11;
 
-					item[offset+a].uint16 = (uint16_t) finslib_bcd_to_int( bcd_val, FINS_DATA_TYPE_BCD16 );
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_BCD16 :
 
-				case FINS_DATA_TYPE_SBCD16_0 :
-				case FINS_DATA_TYPE_SBCD16_1 :
-				case FINS_DATA_TYPE_SBCD16_2 :
-				case FINS_DATA_TYPE_SBCD16_3 :
+			bcd_val   = body[pos+0];
+			bcd_val <<= 8;
+			bcd_val  += body[pos+1];
+			pos  += 2;
 
-					bcd_val   = fins_cmnd.body[bodylen+0];
-					bcd_val <<= 8;
-					bcd_val  += fins_cmnd.body[bodylen+1];
-					bodylen  += 2;
+			item->uint16 = (uint16_t) finslib_bcd_to_int( bcd_val, FINS_DATA_TYPE_BCD16 );
 
-					item[offset+a].int16 = (int16_t) finslib_bcd_to_int( bcd_val, item[offset+a].type );
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_SBCD16_0 :
+		case FINS_DATA_TYPE_SBCD16_1 :
+		case FINS_DATA_TYPE_SBCD16_2 :
+		case FINS_DATA_TYPE_SBCD16_3 :
 
-				case FINS_DATA_TYPE_BCD32 :
+			bcd_val   = body[pos+0];
+			bcd_val <<= 8;
+			bcd_val  += body[pos+1];
+			pos  += 2;
 
-					bcd_val   = fins_cmnd.body[bodylen+3];
-					bcd_val <<= 8;
-					bcd_val  += fins_cmnd.body[bodylen+4];
-					bcd_val <<= 8;
-					bcd_val  += fins_cmnd.body[bodylen+0];
-					bcd_val <<= 8;
-					bcd_val  += fins_cmnd.body[bodylen+1];
-					bodylen  += 5;
+			item->int16 = (int16_t) finslib_bcd_to_int( bcd_val, item->type );
 
-					item[offset+a].uint32 = finslib_bcd_to_int( bcd_val, FINS_DATA_TYPE_BCD32 );
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_BCD32 :
 
-				case FINS_DATA_TYPE_SBCD32_0 :
-				case FINS_DATA_TYPE_SBCD32_1 :
-				case FINS_DATA_TYPE_SBCD32_2 :
-				case FINS_DATA_TYPE_SBCD32_3 :
+			bcd_val   = body[pos+3];
+			bcd_val <<= 8;
+			bcd_val  += body[pos+4];
+			bcd_val <<= 8;
+			bcd_val  += body[pos+0];
+			bcd_val <<= 8;
+			bcd_val  += body[pos+1];
+			pos  += 5;
 
-					bcd_val   = fins_cmnd.body[bodylen+3];
-					bcd_val <<= 8;
-					bcd_val  += fins_cmnd.body[bodylen+4];
-					bcd_val <<= 8;
-					bcd_val  += fins_cmnd.body[bodylen+0];
-					bcd_val <<= 8;
-					bcd_val  += fins_cmnd.body[bodylen+1];
-					bodylen  += 5;
+			item->uint32 = finslib_bcd_to_int( bcd_val, FINS_DATA_TYPE_BCD32 );
 
-					item[offset+a].int32 = finslib_bcd_to_int( bcd_val, item[offset+a].type );
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_SBCD32_0 :
+		case FINS_DATA_TYPE_SBCD32_1 :
+		case FINS_DATA_TYPE_SBCD32_2 :
+		case FINS_DATA_TYPE_SBCD32_3 :
 
-				case FINS_DATA_TYPE_BIT :
+			bcd_val   = body[pos+3];
+			bcd_val <<= 8;
+			bcd_val  += body[pos+4];
+			bcd_val <<= 8;
+			bcd_val  += body[pos+0];
+			bcd_val <<= 8;
+			bcd_val  += body[pos+1];
+			pos  += 5;
 
-					item[offset+a].bit     = fins_cmnd.body[bodylen] & 0x01;
-					item[offset+a].b_force = false;
+			item->int32 = finslib_bcd_to_int( bcd_val, item->type );
 
-					bodylen++;
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_BIT :
 
-				case FINS_DATA_TYPE_BIT_FORCED :
+			item->bit     = body[pos] & 0x01;
+			item->b_force = false;
 
-					item[offset+a].bit     = fins_cmnd.body[bodylen] & 0x01;
-					item[offset+a].b_force = fins_cmnd.body[bodylen] & 0x02;
+			pos++;
 
-					bodylen++;
+			break;
 
-					break;
 
 
+		case FINS_DATA_TYPE_BIT_FORCED :
 
-				case FINS_DATA_TYPE_WORD_FORCED :
+			item->bit     = body[pos] & 0x01;
+			item->b_force = body[pos] & 0x02;
 
-					item[offset+a].w_force   = fins_cmnd.body[bodylen+0];
-					item[offset+a].w_force <<= 8;
-					item[offset+a].w_force  += fins_cmnd.body[bodylen+1];
+			pos++;
 
-					item[offset+a].word      = fins_cmnd.body[bodylen+2];
-					item[offset+a].word    <<= 8;
-					item[offset+a].word     += fins_cmnd.body[bodylen+3];
+			break;
 
-					bodylen += 4;
 
-					break;
-			}
-		}
 
+		case FINS_DATA_TYPE_WORD_FORCED :
 
-		todo   -= chunk_length;
-		offset += chunk_length;
+			item->w_force   = body[pos+0];
+			item->w_force <<= 8;
+			item->w_force  += body[pos+1];
 
-	} while ( todo > 0 );
+			item->word      = body[pos+2];
+			item->word    <<= 8;
+			item->word     += body[pos+3];
 
-	return FINS_RETVAL_SUCCESS;
+			pos += 4;
 
-}  /* finslib_multiple_memory_area_read */
+			break;
+	}
+
+	return pos;
+
+}  /* decode_item */
@@ -47,7 +47,6 @@
 int finslib_cpu_unit_status_read( struct fins_sys_tp *sys, struct fins_cpustatus_tp *status ) {
 
 	struct fins_command_tp fins_cmnd;
-	int a;
 	int retval;
 	size_t bodylen;
 
@@ -63,57 +62,72 @@ int finslib_cpu_unit_status_read( struct fins_sys_tp *sys, struct fins_cpustatus
 
 	if ( bodylen != 28 ) return FINS_RETVAL_BODY_TOO_SHORT;
 
-	status->running                        = fins_cmnd.body[2] & 0x01;
-	status->flash_writing                  = fins_cmnd.body[2] & 0x02;
-	status->battery_present                = fins_cmnd.body[2] & 0x04;
-	status->standby                        = fins_cmnd.body[2] & 0x80;
-
-	status->run_mode                       = fins_cmnd.body[3];
-
-	status->fatal_memory_error             = fins_cmnd.body[4] & 0x80;
-	status->fatal_io_bus_error             = fins_cmnd.body[4] & 0x40;
-	status->fatal_duplication_error        = fins_cmnd.body[4] & 0x20;
-	status->fatal_inner_board_error        = fins_cmnd.body[4] & 0x10;
-	status->fatal_io_point_overflow        = fins_cmnd.body[4] & 0x08;
-	status->fatal_io_setting_error         = fins_cmnd.body[4] & 0x04;
-	status->fatal_program_error            = fins_cmnd.body[4] & 0x02;
-	status->fatal_cycle_time_over          = fins_cmnd.body[4] & 0x01;
-	status->fatal_fals_error               = fins_cmnd.body[5] & 0x40;
-
-	status->fal_error                      = fins_cmnd.body[6] & 0x80;
-	status->duplex_error                   = fins_cmnd.body[6] & 0x40;
-	status->interrupt_task_error           = fins_cmnd.body[6] & 0x20;
-	status->basic_io_unit_error            = fins_cmnd.body[6] & 0x10;
-	status->plc_setup_error                = fins_cmnd.body[6] & 0x04;
-	status->io_verification_error          = fins_cmnd.body[6] & 0x02;
-	status->inner_board_error              = fins_cmnd.body[6] & 0x01;
-	status->cpu_bus_unit_error             = fins_cmnd.body[7] & 0x80;
-	status->special_io_unit_error          = fins_cmnd.body[7] & 0x40;
-	status->sysmac_bus_error               = fins_cmnd.body[7] & 0x20;
-	status->battery_error                  = fins_cmnd.body[7] & 0x10;
-	status->cs1_cpu_bus_unit_setting_error = fins_cmnd.body[7] & 0x08;
-	status->special_io_unit_setting_error  = fins_cmnd.body[7] & 0x04;
-
-	status->message_exists[0]              = fins_cmnd.body[9] & 0x01;
-	status->message_exists[1]              = fins_cmnd.body[9] & 0x02;
-	status->message_exists[2]              = fins_cmnd.body[9] & 0x04;
-	status->message_exists[3]              = fins_cmnd.body[9] & 0x08;
-	status->message_exists[4]              = fins_cmnd.body[9] & 0x10;
-	status->message_exists[5]              = fins_cmnd.body[9] & 0x20;
-	status->message_exists[6]              = fins_cmnd.body[9] & 0x40;
-	status->message_exists[7]              = fins_cmnd.body[9] & 0x80;
-
-	status->error_code                     = fins_cmnd.body[10];
+	XX_finslib_decode_cpu_status( & fins_cmnd.body[2], status );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_cpu_unit_status_read */
+
+/*
+ * void XX_finslib_decode_cpu_status( const unsigned char *data, struct fins_cpustatus_tp *status );
+ *
+ * The function XX_finslib_decode_cpu_status() decodes the 26 data bytes of a
+ * CPU unit status read response which follow the end code.
+ */
+
+void XX_finslib_decode_cpu_status( const unsigned char *data, struct fins_cpustatus_tp *status ) {
+
+	int a;
+
+	status->running                        = data[0] & 0x01;
+	status->flash_writing                  = data[0] & 0x02;
+	status->battery_present                = data[0] & 0x04;
+	status->standby                        = data[0] & 0x80;
+
+	status->run_mode                       = data[1];
+
+	status->fatal_memory_error             = data[2] & 0x80;
+	status->fatal_io_bus_error             = data[2] & 0x40;
+	status->fatal_duplication_error        = data[2] & 0x20;
+	status->fatal_inner_board_error        = data[2] & 0x10;
+	status->fatal_io_point_overflow        = data[2] & 0x08;
+	status->fatal_io_setting_error         = data[2] & 0x04;
+	status->fatal_program_error            = data[2] & 0x02;
+	status->fatal_cycle_time_over          = data[2] & 0x01;
+	status->fatal_fals_error               = data[3] & 0x40;
+
+	status->fal_error                      = data[4] & 0x80;
+	status->duplex_error                   = data[4] & 0x40;
+	status->interrupt_task_error           = data[4] & 0x20;
+	status->basic_io_unit_error            = data[4] & 0x10;
+	status->plc_setup_error                = data[4] & 0x04;
+	status->io_verification_error          = data[4] & 0x02;
+	status->inner_board_error              = data[4] & 0x01;
+	status->cpu_bus_unit_error             = data[5] & 0x80;
+	status->special_io_unit_error          = data[5] & 0x40;
+	status->sysmac_bus_error               = data[5] & 0x20;
+	status->battery_error                  = data[5] & 0x10;
+	status->cs1_cpu_bus_unit_setting_error = data[5] & 0x08;
+	status->special_io_unit_setting_error  = data[5] & 0x04;
+
+	status->message_exists[0]              = data[7] & 0x01;
+	status->message_exists[1]              = data[7] & 0x02;
+	status->message_exists[2]              = data[7] & 0x04;
+	status->message_exists[3]              = data[7] & 0x08;
+	status->message_exists[4]              = data[7] & 0x10;
+	status->message_exists[5]              = data[7] & 0x20;
+	status->message_exists[6]              = data[7] & 0x40;
+	status->message_exists[7]              = data[7] & 0x80;
+
+	status->error_code                     = data[8];
 	status->error_code                   <<= 8;
-	status->error_code                    += fins_cmnd.body[11];
+	status->error_code                    += data[9];
 
-	memcpy( status->error_message, & fins_cmnd.body[12], 16 );
+	memcpy( status->error_message, & data[10], 16 );
 	status->error_message[16] = 0;
 
 	a = 16;
 	while ( a > 0  &&  isspace( status->error_message[a-1] ) ) a--;
 	status->error_message[a] = 0;
 
-	return FINS_RETVAL_SUCCESS;
-
-}  /* finslib_cpu_unit_status_read */
+}  /* XX_finslib_decode_cpu_status */
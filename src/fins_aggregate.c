@@ -0,0 +1,348 @@
+/*
+ * Library: libfins
+ * File:    src/fins_aggregate.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_aggregate.c contains routines to condense a stream
+ * of samples of many analog tags into per window summaries with the minimum,
+ * maximum, average and last value and the number of samples of each tag. The
+ * state is kept as separate arrays per statistic so that the update of all tags
+ * with a new sample is a set of simple loops which the compiler can vectorize.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "fins.h"
+
+static void		clear_pane( struct fins_aggregate_tp *agg, size_t pane );
+static void		emit_window( struct fins_aggregate_tp *agg );
+
+/*
+ * struct fins_aggregate_tp *finslib_aggregate_create( size_t num_tags, uint64_t pane_usec, size_t num_panes, int *error_val );
+ *
+ * The function finslib_aggregate_create() creates an aggregation stage for a
+ * fixed number of tags. Samples are collected in panes with a length of
+ * pane_usec microseconds. Each time a pane is completed, a summary over the
+ * last num_panes panes is produced. With one pane the windows are tumbling,
+ * with more panes the windows are rolling and advance one pane at a time. On
+ * success a pointer to the stage is returned. Otherwise the return value is
+ * NULL and the reason is stored in the variable pointed to by error_val.
+ */
+
+struct fins_aggregate_tp *finslib_aggregate_create( size_t num_tags, uint64_t pane_usec, size_t num_panes, int *error_val ) {
+
+	size_t a;
+	size_t total;
+	struct fins_aggregate_tp *agg;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	agg    = NULL;
+	total  = num_tags * num_panes;
+
+	if      ( num_tags  == 0  ||  pane_usec == 0 ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+	else if ( num_panes == 0                     ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( total / num_panes != num_tags      ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( ( agg = calloc( 1, sizeof(struct fins_aggregate_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		agg->num_tags  = num_tags;
+		agg->pane_usec = pane_usec;
+		agg->num_panes = num_panes;
+
+		agg->min       = malloc( total    * sizeof(double)   );
+		agg->max       = malloc( total    * sizeof(double)   );
+		agg->sum       = malloc( total    * sizeof(double)   );
+		agg->last      = malloc( total    * sizeof(double)   );
+		agg->count     = malloc( total    * sizeof(uint32_t) );
+		agg->out_min   = malloc( num_tags * sizeof(double)   );
+		agg->out_max   = malloc( num_tags * sizeof(double)   );
+		agg->out_avg   = malloc( num_tags * sizeof(double)   );
+		agg->out_last  = malloc( num_tags * sizeof(double)   );
+		agg->out_count = malloc( num_tags * sizeof(uint32_t) );
+
+		if ( agg->min     == NULL  ||  agg->max     == NULL  ||  agg->sum     == NULL  ||  agg->last     == NULL  ||  agg->count     == NULL  ||
+		     agg->out_min == NULL  ||  agg->out_max == NULL  ||  agg->out_avg == NULL  ||  agg->out_last == NULL  ||  agg->out_count == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		for (a=0; a<num_panes; a++) clear_pane( agg, a );
+
+		agg->started = false;
+	}
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_aggregate_free( agg );
+		return NULL;
+	}
+
+	return agg;
+
+}  /* finslib_aggregate_create */
+
+/*
+ * void finslib_aggregate_free( struct fins_aggregate_tp *agg );
+ *
+ * The function finslib_aggregate_free() releases all memory associated with
+ * an aggregation stage.
+ */
+
+void finslib_aggregate_free( struct fins_aggregate_tp *agg ) {
+
+	if ( agg == NULL ) return;
+
+	free( agg->min       );
+	free( agg->max       );
+	free( agg->sum       );
+	free( agg->last      );
+	free( agg->count     );
+	free( agg->out_min   );
+	free( agg->out_max   );
+	free( agg->out_avg   );
+	free( agg->out_last  );
+	free( agg->out_count );
+	free( agg            );
+
+}  /* finslib_aggregate_free */
+
+/*
+ * int finslib_aggregate_update( struct fins_aggregate_tp *agg, const double *value, const bool *valid, uint64_t timestamp, bool *window_ready );
+ *
+ * The function finslib_aggregate_update() adds one sample of all tags to the
+ * current pane. The valid array may be NULL if all values are valid. When the
+ * timestamp lies after the end of the current pane, the pane is completed
+ * first and a summary is stored in the out_... arrays of the stage. In that
+ * case window_ready is set to true and the summary must be processed before
+ * the next call. Panes in which no samples arrived because of a gap in the
+ * timestamps are skipped and do not produce a summary.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_aggregate_update( struct fins_aggregate_tp *agg, const double *value, const bool *valid, uint64_t timestamp, bool *window_ready ) {
+
+	size_t a;
+	size_t base;
+	size_t num_skip;
+	uint64_t elapsed;
+	double *min;
+	double *max;
+	double *sum;
+	double *last;
+	uint32_t *count;
+	double v;
+
+	if ( window_ready != NULL ) *window_ready = false;
+
+	if ( agg   == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( value == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	if ( ! agg->started ) {
+
+		agg->pane_start = timestamp - ( timestamp % agg->pane_usec );
+		agg->started    = true;
+	}
+
+	else if ( timestamp >= agg->pane_start + agg->pane_usec ) {
+
+		emit_window( agg );
+		if ( window_ready != NULL ) *window_ready = true;
+
+		elapsed  = ( timestamp - agg->pane_start ) / agg->pane_usec;
+		num_skip = ( elapsed > agg->num_panes ) ? agg->num_panes : (size_t) elapsed;
+
+		for (a=0; a<num_skip; a++) {
+
+			agg->pane = ( agg->pane + 1 ) % agg->num_panes;
+			clear_pane( agg, agg->pane );
+		}
+
+		agg->pane_start += elapsed * agg->pane_usec;
+	}
+
+	base  = agg->pane * agg->num_tags;
+	min   = agg->min   + base;
+	max   = agg->max   + base;
+	sum   = agg->sum   + base;
+	last  = agg->last  + base;
+	count = agg->count + base;
+
+	/*
+	 * Without a valid array each statistic is updated in a loop of its own.
+	 * Each loop streams through one array and is vectorized by the compiler.
+	 */
+
+	if ( valid == NULL ) {
+
+		for (a=0; a<agg->num_tags; a++) min[a]   = ( value[a] < min[a] ) ? value[a] : min[a];
+		for (a=0; a<agg->num_tags; a++) max[a]   = ( value[a] > max[a] ) ? value[a] : max[a];
+		for (a=0; a<agg->num_tags; a++) sum[a]  += value[a];
+		for (a=0; a<agg->num_tags; a++) last[a]  = value[a];
+		for (a=0; a<agg->num_tags; a++) count[a]++;
+	}
+
+	else {
+		for (a=0; a<agg->num_tags; a++) {
+
+			if ( ! valid[a] ) continue;
+
+			v      = value[a];
+			min[a] = ( v < min[a] ) ? v : min[a];
+			max[a] = ( v > max[a] ) ? v : max[a];
+			sum[a] += v;
+			last[a] = v;
+			count[a]++;
+		}
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_aggregate_update */
+
+/*
+ * int finslib_aggregate_flush( struct fins_aggregate_tp *agg, bool *window_ready );
+ *
+ * The function finslib_aggregate_flush() completes the current pane without
+ * waiting for a sample after its end, for example when sampling stops. If at
+ * least one sample was collected since the stage was created or last
+ * flushed, a summary is stored in the out_... arrays and window_ready is set
+ * to true. The next sample starts a new series of panes.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_aggregate_flush( struct fins_aggregate_tp *agg, bool *window_ready ) {
+
+	size_t a;
+
+	if ( window_ready != NULL ) *window_ready = false;
+
+	if ( agg == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( ! agg->started ) return FINS_RETVAL_SUCCESS;
+
+	emit_window( agg );
+	if ( window_ready != NULL ) *window_ready = true;
+
+	for (a=0; a<agg->num_panes; a++) clear_pane( agg, a );
+
+	agg->pane    = 0;
+	agg->started = false;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_aggregate_flush */
+
+/*
+ * static void clear_pane( struct fins_aggregate_tp *agg, size_t pane );
+ *
+ * The function clear_pane() resets the statistics of all tags in a pane.
+ */
+
+static void clear_pane( struct fins_aggregate_tp *agg, size_t pane ) {
+
+	size_t a;
+	size_t base;
+
+	base = pane * agg->num_tags;
+
+	for (a=0; a<agg->num_tags; a++) {
+
+		agg->min[base+a]   =  HUGE_VAL;
+		agg->max[base+a]   = -HUGE_VAL;
+		agg->sum[base+a]   = 0.0;
+		agg->last[base+a]  = NAN;
+		agg->count[base+a] = 0;
+	}
+
+}  /* clear_pane */
+
+/*
+ * static void emit_window( struct fins_aggregate_tp *agg );
+ *
+ * The function emit_window() combines the panes of the current window into
+ * the out_... arrays. The window ends with the current pane and covers at
+ * most num_panes panes. The panes are combined from old to new so that the
+ * last value of a tag is the most recent one. Tags without samples in the
+ * window get NAN as minimum, maximum and average.
+ */
+
+static void emit_window( struct fins_aggregate_tp *agg ) {
+
+	size_t a;
+	size_t p;
+	size_t pane;
+	size_t base;
+	double *sum;
+
+	sum = agg->out_avg;
+
+	for (a=0; a<agg->num_tags; a++) {
+
+		agg->out_min[a]   =  HUGE_VAL;
+		agg->out_max[a]   = -HUGE_VAL;
+		sum[a]            = 0.0;
+		agg->out_last[a]  = NAN;
+		agg->out_count[a] = 0;
+	}
+
+	for (p=1; p<=agg->num_panes; p++) {
+
+		pane = ( agg->pane + p ) % agg->num_panes;
+		base = pane * agg->num_tags;
+
+		for (a=0; a<agg->num_tags; a++) {
+
+			agg->out_min[a]    = ( agg->min[base+a] < agg->out_min[a] ) ? agg->min[base+a] : agg->out_min[a];
+			agg->out_max[a]    = ( agg->max[base+a] > agg->out_max[a] ) ? agg->max[base+a] : agg->out_max[a];
+			sum[a]            += agg->sum[base+a];
+			agg->out_count[a] += agg->count[base+a];
+
+			if ( agg->count[base+a] > 0 ) agg->out_last[a] = agg->last[base+a];
+		}
+	}
+
+	for (a=0; a<agg->num_tags; a++) {
+
+		if ( agg->out_count[a] == 0 ) {
+
+			agg->out_min[a] = NAN;
+			agg->out_max[a] = NAN;
+			agg->out_avg[a] = NAN;
+		}
+
+		else agg->out_avg[a] = sum[a] / agg->out_count[a];
+	}
+
+	agg->out_end   = agg->pane_start + agg->pane_usec;
+	agg->out_start = agg->out_end    - agg->num_panes * agg->pane_usec;
+
+}  /* emit_window */
@@ -0,0 +1,300 @@
+/*
+ * Library: libfins
+ * File:    src/fins_alarm.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_alarm.c contains routines to detect rising and
+ * falling edges of large numbers of alarm bits in a remote PLC. The bits are
+ * kept as packed word images and compared a whole group of words at a time,
+ * so that the cost of a scan depends on the number of edges and not on the
+ * number of bits.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "fins.h"
+
+#define ALARM_GROUP		32
+
+static size_t		detect_edges( struct fins_alarmlink_tp *link, size_t offset, const unsigned char *data, size_t num_bytes, uint64_t timestamp, struct fins_alarmevent_tp *event, size_t max_events, size_t num_events );
+
+/*
+ * struct fins_alarm_tp *finslib_alarm_create( struct fins_sys_tp *sys, const struct fins_alarmblock_tp *block, size_t num_block, int *error_val );
+ *
+ * The function finslib_alarm_create() creates an alarm engine which watches
+ * a list of blocks of alarm words in a remote PLC. Each bit is identified by
+ * a tag ID which is the first tag of the block plus the bit offset in the
+ * block. All addresses are resolved once when the engine is created. On
+ * success a pointer to the engine is returned. Otherwise the return value is
+ * NULL and the reason is stored in the variable pointed to by error_val.
+ */
+
+struct fins_alarm_tp *finslib_alarm_create( struct fins_sys_tp *sys, const struct fins_alarmblock_tp *block, size_t num_block, int *error_val ) {
+
+	size_t a;
+	struct fins_alarm_tp *alarm;
+	struct fins_alarmlink_tp *link;
+	struct fins_address_tp address;
+	const struct fins_area_tp *area_ptr;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	alarm  = NULL;
+
+	if      ( sys   == NULL                     ) retval = FINS_RETVAL_NOT_INITIALIZED;
+	else if ( block == NULL  ||  num_block == 0 ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+	else if ( ( alarm = calloc( 1, sizeof(struct fins_alarm_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	else if ( ( alarm->link = calloc( num_block, sizeof(struct fins_alarmlink_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( alarm != NULL ) alarm->sys = sys;
+
+	for (a=0; retval == FINS_RETVAL_SUCCESS  &&  a<num_block; a++) {
+
+		link        = & alarm->link[a];
+		link->block = block[a];
+
+		alarm->num_link++;
+
+		link->block.address[sizeof(link->block.address)-1] = 0;
+
+		if ( link->block.num_words == 0                                  ) { retval = FINS_RETVAL_NO_DATA_BLOCK;         break; }
+		if ( XX_finslib_decode_address( link->block.address, & address ) ) { retval = FINS_RETVAL_INVALID_READ_ADDRESS; break; }
+
+		area_ptr = XX_finslib_search_area( sys, & address, 16, FI_RD, false );
+		if ( area_ptr == NULL ) { retval = FINS_RETVAL_INVALID_READ_AREA; break; }
+
+		link->area   = area_ptr->area;
+		link->start  = address.main_address;
+		link->start += area_ptr->low_addr >> 8;
+		link->start -= area_ptr->low_id;
+
+		link->image       = malloc( 2 * link->block.num_words );
+		link->image_valid = false;
+
+		if ( link->image == NULL ) { retval = FINS_RETVAL_OUT_OF_MEMORY; break; }
+	}
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_alarm_free( alarm );
+		return NULL;
+	}
+
+	return alarm;
+
+}  /* finslib_alarm_create */
+
+/*
+ * void finslib_alarm_free( struct fins_alarm_tp *alarm );
+ *
+ * The function finslib_alarm_free() releases all memory associated with an
+ * alarm engine. The connection with the PLC is not closed.
+ */
+
+void finslib_alarm_free( struct fins_alarm_tp *alarm ) {
+
+	size_t a;
+
+	if ( alarm == NULL ) return;
+
+	if ( alarm->link != NULL ) {
+
+		for (a=0; a<alarm->num_link; a++) free( alarm->link[a].image );
+
+		free( alarm->link );
+	}
+
+	free( alarm );
+
+}  /* finslib_alarm_free */
+
+/*
+ * int finslib_alarm_scan( struct fins_alarm_tp *alarm, struct fins_alarmevent_tp *event, size_t max_events, size_t *num_events );
+ *
+ * The function finslib_alarm_scan() reads all alarm blocks from the PLC and
+ * compares them with the images of the previous scan. For every bit which
+ * changed an event is stored in the event list. The first scan of a block
+ * only records the image and does not generate events. If there are more
+ * edges than room in the event list, the words with the remaining edges are
+ * left unchanged in the image so that their events are reported during the
+ * next scan. Events found before an error occured are also returned.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_alarm_scan( struct fins_alarm_tp *alarm, struct fins_alarmevent_tp *event, size_t max_events, size_t *num_events ) {
+
+	size_t a;
+	size_t chunk_length;
+	size_t offset;
+	size_t todo;
+	size_t bodylen;
+	size_t found;
+	uint32_t chunk_start;
+	uint64_t timestamp;
+	struct fins_alarmlink_tp *link;
+	struct fins_command_tp fins_cmnd;
+	int retval;
+
+	found = 0;
+
+	if ( num_events != NULL ) *num_events = 0;
+
+	if ( alarm              == NULL            ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( event == NULL  &&  max_events > 0     ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( alarm->sys->sockfd == INVALID_SOCKET  ) return FINS_RETVAL_NOT_CONNECTED;
+
+	retval = FINS_RETVAL_SUCCESS;
+
+	for (a=0; retval == FINS_RETVAL_SUCCESS  &&  a<alarm->num_link; a++) {
+
+		link   = & alarm->link[a];
+		offset = 0;
+		todo   = link->block.num_words;
+
+		do {
+			chunk_length = FINS_MAX_READ_WORDS_SYSWAY;
+			if ( chunk_length > todo ) chunk_length = todo;
+
+			chunk_start = link->start + offset;
+
+			XX_finslib_init_command( alarm->sys, & fins_cmnd, 0x01, 0x01 );
+
+			bodylen = 0;
+
+			fins_cmnd.body[bodylen++] = link->area;
+			fins_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+			fins_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+			fins_cmnd.body[bodylen++] = 0x00;
+			fins_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+			fins_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+			if ( ( retval = XX_finslib_communicate( alarm->sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) break;
+
+			if ( bodylen != 2+2*chunk_length ) { retval = FINS_RETVAL_BODY_TOO_SHORT; break; }
+
+			timestamp = finslib_epoch_usec_timer();
+
+			if ( link->image_valid ) found = detect_edges( link, 2*offset, & fins_cmnd.body[2], 2*chunk_length, timestamp, event, max_events, found );
+			else                     memcpy( link->image + 2*offset, & fins_cmnd.body[2], 2*chunk_length );
+
+			todo   -= chunk_length;
+			offset += chunk_length;
+
+		} while ( todo > 0 );
+
+		if ( retval == FINS_RETVAL_SUCCESS ) link->image_valid = true;
+	}
+
+	if ( num_events != NULL ) *num_events = found;
+
+	return retval;
+
+}  /* finslib_alarm_scan */
+
+/*
+ * static size_t detect_edges( struct fins_alarmlink_tp *link, size_t offset, const unsigned char *data, size_t num_bytes, uint64_t timestamp, struct fins_alarmevent_tp *event, size_t max_events, size_t num_events );
+ *
+ * The function detect_edges() compares a block of raw big endian words from a
+ * read response with the image at a byte offset in the image of an alarm
+ * block. Groups of words are first compared as 64 bit values. Only when a
+ * group contains a difference the words in it are examined one by one. Each
+ * changed bit results in an event, as long as there is room in the event
+ * list. The new number of events in the list is returned.
+ */
+
+static size_t detect_edges( struct fins_alarmlink_tp *link, size_t offset, const unsigned char *data, size_t num_bytes, uint64_t timestamp, struct fins_alarmevent_tp *event, size_t max_events, size_t num_events ) {
+
+	size_t a;
+	size_t b;
+	size_t last;
+	size_t num_changed;
+	uint64_t current;
+	uint64_t previous;
+	uint64_t difference;
+	uint16_t value;
+	uint16_t changed;
+	uint32_t tag;
+	unsigned char *image;
+
+	image = link->image + offset;
+	a     = 0;
+
+	while ( a < num_bytes ) {
+
+		last = num_bytes;
+
+		if ( a + ALARM_GROUP <= num_bytes ) {
+
+			difference = 0;
+
+			for (b=0; b<ALARM_GROUP; b+=8) {
+
+				memcpy( & current,  data  + a + b, 8 );
+				memcpy( & previous, image + a + b, 8 );
+
+				difference |= current ^ previous;
+			}
+
+			if ( difference == 0 ) { a += ALARM_GROUP; continue; }
+
+			last = a + ALARM_GROUP;
+		}
+
+		for (; a<last; a+=2) {
+
+			changed = ( ( data[a] ^ image[a] ) << 8 ) | ( data[a+1] ^ image[a+1] );
+			if ( changed == 0 ) continue;
+
+			num_changed = 0;
+			for (b=0; b<16; b++) if ( changed & (1u << b) ) num_changed++;
+
+			if ( num_events + num_changed > max_events ) continue;
+
+			value = ( data[a] << 8 ) | data[a+1];
+			tag   = link->block.first_tag + (uint32_t) ( 8 * ( offset + a ) );
+
+			for (b=0; b<16; b++) {
+
+				if ( ! ( changed & (1u << b) ) ) continue;
+
+				event[num_events].tag       = tag + (uint32_t) b;
+				event[num_events].rising    = ( value & (1u << b) ) != 0;
+				event[num_events].timestamp = timestamp;
+				num_events++;
+			}
+
+			image[a]   = data[a];
+			image[a+1] = data[a+1];
+		}
+	}
+
+	return num_events;
+
+}  /* detect_edges */
@@ -0,0 +1,324 @@
+/*
+ * Library: libfins
+ * File:    src/fins_bridge.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_bridge.c contains routines to forward blocks of
+ * data from memory areas in one PLC to memory areas in another PLC without
+ * decoding the data on the way.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "fins.h"
+
+#define BRIDGE_CHUNK		FINS_MAX_WRITE_WORDS_SYSWAY
+
+static int		drain_write( struct fins_bridgelink_tp *link, struct fins_command_tp *wr_cmnd, bool *pending );
+
+/*
+ * struct fins_bridge_tp *finslib_bridge_create( const struct fins_bridgerule_tp *rule, size_t num_rule, int *error_val );
+ *
+ * The function finslib_bridge_create() creates a bridge which copies memory
+ * blocks between PLCs according to a list of mapping rules. All addresses are
+ * resolved once when the bridge is created. The connections referenced in the
+ * rules must therefore already have been made and the PLC mode of each
+ * connection must be known. On success a pointer to the bridge is returned.
+ * Otherwise the return value is NULL and the reason is stored in the variable
+ * pointed to by error_val.
+ */
+
+struct fins_bridge_tp *finslib_bridge_create( const struct fins_bridgerule_tp *rule, size_t num_rule, int *error_val ) {
+
+	size_t a;
+	struct fins_bridge_tp *bridge;
+	struct fins_bridgelink_tp *link;
+	struct fins_address_tp address;
+	const struct fins_area_tp *area_ptr;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	bridge = NULL;
+
+	if      ( rule == NULL  ||  num_rule == 0 ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+	else if ( ( bridge = calloc( 1, sizeof(struct fins_bridge_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	else if ( ( bridge->link = calloc( num_rule, sizeof(struct fins_bridgelink_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	for (a=0; retval == FINS_RETVAL_SUCCESS  &&  a<num_rule; a++) {
+
+		link       = & bridge->link[a];
+		link->rule = rule[a];
+
+		bridge->num_link++;
+
+		if ( link->rule.src_sys == NULL  ||  link->rule.dst_sys == NULL ) { retval = FINS_RETVAL_NOT_INITIALIZED;       break; }
+		if ( link->rule.num_words == 0                                  ) { retval = FINS_RETVAL_NO_DATA_BLOCK;         break; }
+
+		link->rule.src_address[sizeof(link->rule.src_address)-1] = 0;
+		link->rule.dst_address[sizeof(link->rule.dst_address)-1] = 0;
+
+		if ( XX_finslib_decode_address( link->rule.src_address, & address ) ) { retval = FINS_RETVAL_INVALID_READ_ADDRESS; break; }
+
+		area_ptr = XX_finslib_search_area( link->rule.src_sys, & address, 16, FI_RD, false );
+		if ( area_ptr == NULL ) { retval = FINS_RETVAL_INVALID_READ_AREA; break; }
+
+		link->src_area   = area_ptr->area;
+		link->src_start  = address.main_address;
+		link->src_start += area_ptr->low_addr >> 8;
+		link->src_start -= area_ptr->low_id;
+
+		if ( XX_finslib_decode_address( link->rule.dst_address, & address ) ) { retval = FINS_RETVAL_INVALID_WRITE_ADDRESS; break; }
+
+		area_ptr = XX_finslib_search_area( link->rule.dst_sys, & address, 16, FI_WR, false );
+		if ( area_ptr == NULL ) { retval = FINS_RETVAL_INVALID_WRITE_AREA; break; }
+
+		link->dst_area   = area_ptr->area;
+		link->dst_start  = address.main_address;
+		link->dst_start += area_ptr->low_addr >> 8;
+		link->dst_start -= area_ptr->low_id;
+
+		link->image       = malloc( 2 * link->rule.num_words );
+		link->image_valid = false;
+
+		if ( link->image == NULL ) { retval = FINS_RETVAL_OUT_OF_MEMORY; break; }
+	}
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_bridge_free( bridge );
+		return NULL;
+	}
+
+	return bridge;
+
+}  /* finslib_bridge_create */
+
+/*
+ * void finslib_bridge_free( struct fins_bridge_tp *bridge );
+ *
+ * The function finslib_bridge_free() releases all memory associated with a
+ * bridge. The connections used by the bridge are not closed.
+ */
+
+void finslib_bridge_free( struct fins_bridge_tp *bridge ) {
+
+	size_t a;
+
+	if ( bridge == NULL ) return;
+
+	if ( bridge->link != NULL ) {
+
+		for (a=0; a<bridge->num_link; a++) free( bridge->link[a].image );
+
+		free( bridge->link );
+	}
+
+	free( bridge );
+
+}  /* finslib_bridge_free */
+
+/*
+ * int finslib_bridge_invalidate( struct fins_bridge_tp *bridge );
+ *
+ * The function finslib_bridge_invalidate() forgets which data was written to
+ * the destination PLCs. The next run of the bridge will write all blocks,
+ * whether they changed or not. This is useful after a destination PLC has
+ * been restarted or its memory was changed by another party.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_bridge_invalidate( struct fins_bridge_tp *bridge ) {
+
+	size_t a;
+
+	if ( bridge == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	for (a=0; a<bridge->num_link; a++) bridge->link[a].image_valid = false;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_bridge_invalidate */
+
+/*
+ * int finslib_bridge_run( struct fins_bridge_tp *bridge );
+ *
+ * The function finslib_bridge_run() performs one forwarding cycle of all the
+ * rules of a bridge. Each rule is processed in chunks which fit in both one
+ * read and one write frame. The read of the next chunk is sent to the source
+ * PLC before the response of the write of the previous chunk is collected
+ * from the destination PLC, so that both PLCs are working at the same time.
+ * The payload of a read response is copied unaltered in big endian format to
+ * the write command. Chunks which did not change since they were last written
+ * are not sent to the destination PLC.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_bridge_run( struct fins_bridge_tp *bridge ) {
+
+	size_t a;
+	size_t chunk_length;
+	size_t offset;
+	size_t todo;
+	size_t bodylen;
+	size_t wr_bodylen;
+	uint32_t chunk_start;
+	bool pending;
+	struct fins_bridgelink_tp *link;
+	struct fins_command_tp rd_cmnd;
+	struct fins_command_tp wr_cmnd;
+	int retval;
+	int wr_retval;
+
+	if ( bridge == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	for (a=0; a<bridge->num_link; a++) {
+
+		link    = & bridge->link[a];
+		offset  = 0;
+		todo    = link->rule.num_words;
+		pending = false;
+
+		if ( link->rule.src_sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+		if ( link->rule.dst_sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+		do {
+			chunk_length = BRIDGE_CHUNK;
+			if ( chunk_length > todo ) chunk_length = todo;
+
+			/*
+			 * Only one command is outstanding per connection. When
+			 * source and destination share a connection the write
+			 * must be finished before the next read is sent.
+			 */
+
+			if ( pending  &&  link->rule.src_sys == link->rule.dst_sys ) {
+
+				if ( ( retval = drain_write( link, & wr_cmnd, & pending ) ) != FINS_RETVAL_SUCCESS ) return retval;
+			}
+
+			chunk_start = link->src_start + offset;
+
+			XX_finslib_init_command( link->rule.src_sys, & rd_cmnd, 0x01, 0x01 );
+
+			bodylen = 0;
+
+			rd_cmnd.body[bodylen++] = link->src_area;
+			rd_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+			rd_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+			rd_cmnd.body[bodylen++] = 0x00;
+			rd_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+			rd_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+			retval = XX_finslib_communicate( link->rule.src_sys, & rd_cmnd, & bodylen, false );
+			bridge->frames_read++;
+
+			wr_retval = ( pending ) ? drain_write( link, & wr_cmnd, & pending ) : FINS_RETVAL_SUCCESS;
+
+			if ( retval    == FINS_RETVAL_SUCCESS ) retval = XX_finslib_receive( link->rule.src_sys, & rd_cmnd, & bodylen );
+			if ( retval    != FINS_RETVAL_SUCCESS ) return retval;
+			if ( wr_retval != FINS_RETVAL_SUCCESS ) return wr_retval;
+
+			if ( bodylen != 2+2*chunk_length ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+			if ( link->image_valid  &&  memcmp( link->image + 2*offset, & rd_cmnd.body[2], 2*chunk_length ) == 0 ) bridge->frames_skipped++;
+
+			else {
+				chunk_start = link->dst_start + offset;
+
+				XX_finslib_init_command( link->rule.dst_sys, & wr_cmnd, 0x01, 0x02 );
+
+				wr_bodylen = 0;
+
+				wr_cmnd.body[wr_bodylen++] = link->dst_area;
+				wr_cmnd.body[wr_bodylen++] = (chunk_start  >> 8) & 0xff;
+				wr_cmnd.body[wr_bodylen++] = (chunk_start      ) & 0xff;
+				wr_cmnd.body[wr_bodylen++] = 0x00;
+				wr_cmnd.body[wr_bodylen++] = (chunk_length >> 8) & 0xff;
+				wr_cmnd.body[wr_bodylen++] = (chunk_length     ) & 0xff;
+
+				memcpy( & wr_cmnd.body[wr_bodylen], & rd_cmnd.body[2], 2*chunk_length );
+				memcpy( link->image + 2*offset,     & rd_cmnd.body[2], 2*chunk_length );
+
+				wr_bodylen += 2*chunk_length;
+
+				/*
+				 * The image is only trusted again after all chunks
+				 * of the rule have been written successfully.
+				 */
+
+				if ( ( retval = XX_finslib_communicate( link->rule.dst_sys, & wr_cmnd, & wr_bodylen, false ) ) != FINS_RETVAL_SUCCESS ) {
+
+					link->image_valid = false;
+					return retval;
+				}
+
+				bridge->frames_written++;
+				pending = true;
+			}
+
+			todo   -= chunk_length;
+			offset += chunk_length;
+
+		} while ( todo > 0 );
+
+		if ( pending  &&  ( retval = drain_write( link, & wr_cmnd, & pending ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		link->image_valid = true;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_bridge_run */
+
+/*
+ * static int drain_write( struct fins_bridgelink_tp *link, struct fins_command_tp *wr_cmnd, bool *pending );
+ *
+ * The function drain_write() collects the response of an outstanding write
+ * command at the destination PLC of a bridge rule. If the write failed, the
+ * image of the rule is invalidated so that all data is written again during
+ * the next run.
+ */
+
+static int drain_write( struct fins_bridgelink_tp *link, struct fins_command_tp *wr_cmnd, bool *pending ) {
+
+	size_t bodylen;
+	int retval;
+
+	*pending = false;
+	bodylen  = 0;
+	retval   = XX_finslib_receive( link->rule.dst_sys, wr_cmnd, & bodylen );
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  bodylen != 2 ) retval = FINS_RETVAL_BODY_TOO_SHORT;
+	if ( retval != FINS_RETVAL_SUCCESS ) link->image_valid = false;
+
+	return retval;
+
+}  /* drain_write */
@@ -0,0 +1,190 @@
+/*
+ * Library: libfins
+ * File:    src/fins_busy_poll.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_busy_poll.c contains routines for an optional low
+ * latency receive mode of a FINS connection. In this mode the library spins on
+ * non-blocking receive calls for a limited time before it falls back to a
+ * blocking wait, which avoids the scheduler wakeup latency of a blocking call.
+ */
+
+
+#include <errno.h>
+
+#if ! defined(_WIN32)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif  /* ! defined(_WIN32) */
+
+#include "fins.h"
+
+#if defined(_WIN32)
+typedef const char	setsockopt_tp;
+#else  /* defined(_WIN32) */
+typedef void		setsockopt_tp;
+#endif  /* defined(_WIN32) */
+
+/*
+ * int finslib_busy_poll( struct fins_sys_tp *sys, uint32_t spin_usec );
+ *
+ * The function finslib_busy_poll() enables or disables the busy poll receive
+ * mode of a connection. When spin_usec is not zero, every receive on the
+ * connection first spins on non-blocking receive calls for at most spin_usec
+ * microseconds before it falls back to a normal blocking receive. Nagle's
+ * algorithm is switched off on TCP connections and the kernel is asked to
+ * busy poll the network device where the SO_BUSY_POLL option is available.
+ * A spin time of zero restores the normal blocking behavior. The statistics
+ * in the connection structure are reset by each call.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_busy_poll( struct fins_sys_tp *sys, uint32_t spin_usec ) {
+
+	if ( sys == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+#if defined(_WIN32)
+
+	(void) spin_usec;
+
+	return FINS_RETVAL_NOT_SUPPORTED;
+
+#else  /* defined(_WIN32) */
+
+	sys->busy_poll_usec      = spin_usec;
+	sys->busy_poll_hits      = 0;
+	sys->busy_poll_sleeps    = 0;
+	sys->busy_poll_spin_usec = 0;
+
+	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_SUCCESS;
+
+	return XX_finslib_busy_poll_apply( sys );
+
+#endif  /* defined(_WIN32) */
+
+}  /* finslib_busy_poll */
+
+/*
+ * int XX_finslib_busy_poll_apply( struct fins_sys_tp *sys );
+ *
+ * The function XX_finslib_busy_poll_apply() sets the socket options which
+ * belong to the busy poll mode of a connection. It is called when the mode
+ * changes and every time a new socket is opened for the connection. Failure
+ * to set SO_BUSY_POLL is not an error, because raising it above the system
+ * default needs extra privileges. Spinning in user space still works then.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int XX_finslib_busy_poll_apply( struct fins_sys_tp *sys ) {
+
+#if defined(_WIN32)
+
+	(void) sys;
+
+	return FINS_RETVAL_SUCCESS;
+
+#else  /* defined(_WIN32) */
+
+	int no_delay;
+#if defined(SO_BUSY_POLL)
+	int busy_poll;
+#endif  /* defined(SO_BUSY_POLL) */
+
+	if ( sys         == NULL           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	if ( sys->comm_type == FINS_COMM_TYPE_TCP ) {
+
+		no_delay = ( sys->busy_poll_usec > 0 );
+
+		if ( setsockopt( sys->sockfd, IPPROTO_TCP, TCP_NODELAY, (setsockopt_tp *) & no_delay, sizeof(no_delay) ) < 0 ) return FINS_RETVAL_ERRNO_BASE + errno;
+	}
+
+#if defined(SO_BUSY_POLL)
+	busy_poll = (int) sys->busy_poll_usec;
+
+	setsockopt( sys->sockfd, SOL_SOCKET, SO_BUSY_POLL, (setsockopt_tp *) & busy_poll, sizeof(busy_poll) );
+#endif  /* defined(SO_BUSY_POLL) */
+
+	return FINS_RETVAL_SUCCESS;
+
+#endif  /* defined(_WIN32) */
+
+}  /* XX_finslib_busy_poll_apply */
+
+/*
+ * int XX_finslib_busy_recv( struct fins_sys_tp *sys, void *buf, int len, struct sockaddr *from, socklen_t *fromlen );
+ *
+ * The function XX_finslib_busy_recv() receives data from the socket of a
+ * connection. It behaves like recvfrom(), but when the busy poll mode of the
+ * connection is enabled, it first spins on non-blocking receive calls until
+ * data arrives or the spin time is used up. The spin and sleep statistics of
+ * the connection are updated.
+ *
+ * The function returns the number of bytes received, or a negative value
+ * with the reason in errno.
+ */
+
+int XX_finslib_busy_recv( struct fins_sys_tp *sys, void *buf, int len, struct sockaddr *from, socklen_t *fromlen ) {
+
+#if ! defined(_WIN32)
+
+	int recv_len;
+	uint64_t start;
+	uint64_t now;
+
+	if ( sys->busy_poll_usec > 0 ) {
+
+		start = finslib_monotonic_usec_timer();
+
+		for (;;) {
+
+			recv_len = XX_finslib_timestamp_recv( sys, buf, len, MSG_DONTWAIT, from, fromlen );
+			now      = finslib_monotonic_usec_timer();
+
+			if ( recv_len >= 0  ||  ( errno != EAGAIN  &&  errno != EWOULDBLOCK  &&  errno != EINTR ) ) {
+
+				sys->busy_poll_hits++;
+				sys->busy_poll_spin_usec += now - start;
+
+				return recv_len;
+			}
+
+			if ( now - start >= sys->busy_poll_usec ) break;
+		}
+
+		sys->busy_poll_sleeps++;
+		sys->busy_poll_spin_usec += now - start;
+	}
+
+#endif  /* ! defined(_WIN32) */
+
+	return XX_finslib_timestamp_recv( sys, buf, len, 0, from, fromlen );
+
+}  /* XX_finslib_busy_recv */
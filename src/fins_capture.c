@@ -0,0 +1,520 @@
+/*
+ * Library: libfins
+ * File:    src/fins_capture.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_capture.c contains routines to capture memory of a
+ * remote PLC at a high rate around a trigger event, in the way an oscilloscope
+ * does. All memory is allocated before the capture starts and the result is
+ * written to a file by a background thread.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fins.h"
+
+#define CAPTURE_MAGIC		"FINSCAP1"
+
+static bool		check_trigger( struct fins_capture_tp *capture, const uint16_t *sample );
+static void		wait_writer( struct fins_capture_tp *capture );
+static int		write_file( struct fins_capture_tp *capture );
+
+#if defined(_WIN32)
+static DWORD WINAPI	writer_thread( LPVOID arg );
+#else  /* defined(_WIN32) */
+static void *		writer_thread( void *arg );
+#endif  /* defined(_WIN32) */
+
+/*
+ * struct fins_capture_tp *finslib_capture_create( struct fins_sys_tp *sys, const char *start, size_t num_words, size_t pre_samples, size_t post_samples, const struct fins_capturetrigger_tp *trigger, int *error_val );
+ *
+ * The function finslib_capture_create() creates a capture of a block of words
+ * in a remote PLC. The block must fit in one read frame so that each sample
+ * costs exactly one round trip. The ring buffer for pre_samples samples
+ * before and post_samples samples after the trigger and the buffer used to
+ * write the file are allocated here. On success a pointer to the capture is
+ * returned and the capture is armed. Otherwise the return value is NULL and
+ * the reason is stored in the variable pointed to by error_val.
+ */
+
+struct fins_capture_tp *finslib_capture_create( struct fins_sys_tp *sys, const char *start, size_t num_words, size_t pre_samples, size_t post_samples, const struct fins_capturetrigger_tp *trigger, int *error_val ) {
+
+	struct fins_capture_tp *capture;
+	struct fins_address_tp address;
+	const struct fins_area_tp *area_ptr;
+	int retval;
+
+	retval  = FINS_RETVAL_SUCCESS;
+	capture = NULL;
+
+	if      ( sys          == NULL                                        ) retval = FINS_RETVAL_NOT_INITIALIZED;
+	else if ( start        == NULL                                        ) retval = FINS_RETVAL_NO_READ_ADDRESS;
+	else if ( trigger      == NULL  ||  num_words == 0                    ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+	else if ( num_words    >  FINS_MAX_READ_WORDS_SYSWAY                  ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( post_samples == 0  ||  trigger->word >= num_words           ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( trigger->bit >  15                                          ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( trigger->type < FINS_CAPTURE_TRIGGER_RISING  ||
+		  trigger->type > FINS_CAPTURE_TRIGGER_BELOW                  ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( XX_finslib_decode_address( start, & address )               ) retval = FINS_RETVAL_INVALID_READ_ADDRESS;
+	else if ( ( area_ptr = XX_finslib_search_area( sys, & address, 16, FI_RD, false ) ) == NULL ) retval = FINS_RETVAL_INVALID_READ_AREA;
+	else if ( ( capture  = calloc( 1, sizeof(struct fins_capture_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		capture->sys          = sys;
+		capture->area         = area_ptr->area;
+		capture->start        = address.main_address;
+		capture->start       += area_ptr->low_addr >> 8;
+		capture->start       -= area_ptr->low_id;
+		capture->num_words    = num_words;
+		capture->pre_samples  = pre_samples;
+		capture->post_samples = post_samples;
+		capture->ring_size    = pre_samples + post_samples;
+		capture->trigger      = *trigger;
+
+		capture->ring         = malloc( capture->ring_size * num_words * sizeof(uint16_t) );
+		capture->timestamp    = malloc( capture->ring_size * sizeof(uint64_t) );
+		capture->file_buffer  = malloc( 8 + 2 * num_words );
+
+		if ( capture->ring == NULL  ||  capture->timestamp == NULL  ||  capture->file_buffer == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	}
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_capture_free( capture );
+		return NULL;
+	}
+
+	finslib_capture_arm( capture );
+
+	return capture;
+
+}  /* finslib_capture_create */
+
+/*
+ * void finslib_capture_free( struct fins_capture_tp *capture );
+ *
+ * The function finslib_capture_free() waits until a pending file write has
+ * finished and releases all memory associated with a capture.
+ */
+
+void finslib_capture_free( struct fins_capture_tp *capture ) {
+
+	if ( capture == NULL ) return;
+
+	wait_writer( capture );
+
+	free( capture->ring        );
+	free( capture->timestamp   );
+	free( capture->file_buffer );
+	free( capture->file_name   );
+	free( capture              );
+
+}  /* finslib_capture_free */
+
+/*
+ * int finslib_capture_arm( struct fins_capture_tp *capture );
+ *
+ * The function finslib_capture_arm() empties the ring buffer and waits for a
+ * new trigger. If the previous capture is still being written to a file, the
+ * function waits until the write has finished.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_capture_arm( struct fins_capture_tp *capture ) {
+
+	if ( capture == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	wait_writer( capture );
+
+	capture->state         = FINS_CAPTURE_STATE_ARMED;
+	capture->head          = 0;
+	capture->num_filled    = 0;
+	capture->num_pre       = 0;
+	capture->post_todo     = capture->post_samples;
+	capture->trigger_time  = 0;
+	capture->prev_valid    = false;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_capture_arm */
+
+/*
+ * int finslib_capture_sample( struct fins_capture_tp *capture );
+ *
+ * The function finslib_capture_sample() reads one sample from the PLC and
+ * stores it in the ring buffer. While armed, the trigger condition is checked
+ * for each sample. The sample in which the trigger condition becomes true is
+ * the first of the post trigger samples. Once all post trigger samples have
+ * been collected the state changes to complete and the buffer is frozen.
+ * Further calls then return without reading from the PLC.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_capture_sample( struct fins_capture_tp *capture ) {
+
+	size_t a;
+	size_t bodylen;
+	uint16_t *sample;
+	struct fins_command_tp fins_cmnd;
+	int retval;
+
+	if ( capture              == NULL                        ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( capture->state       == FINS_CAPTURE_STATE_COMPLETE ) return FINS_RETVAL_SUCCESS;
+	if ( capture->sys->sockfd == INVALID_SOCKET              ) return FINS_RETVAL_NOT_CONNECTED;
+
+	XX_finslib_init_command( capture->sys, & fins_cmnd, 0x01, 0x01 );
+
+	bodylen = 0;
+
+	fins_cmnd.body[bodylen++] = capture->area;
+	fins_cmnd.body[bodylen++] = (capture->start     >> 8) & 0xff;
+	fins_cmnd.body[bodylen++] = (capture->start         ) & 0xff;
+	fins_cmnd.body[bodylen++] = 0x00;
+	fins_cmnd.body[bodylen++] = (capture->num_words >> 8) & 0xff;
+	fins_cmnd.body[bodylen++] = (capture->num_words     ) & 0xff;
+
+	if ( ( retval = XX_finslib_communicate( capture->sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	if ( bodylen != 2+2*capture->num_words ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+	sample = capture->ring + capture->head * capture->num_words;
+
+	for (a=0; a<capture->num_words; a++) sample[a] = ( fins_cmnd.body[2+2*a] << 8 ) | fins_cmnd.body[3+2*a];
+
+	capture->timestamp[capture->head] = finslib_epoch_usec_timer();
+
+	if ( capture->state == FINS_CAPTURE_STATE_ARMED  &&  check_trigger( capture, sample ) ) {
+
+		capture->state        = FINS_CAPTURE_STATE_TRIGGERED;
+		capture->num_pre      = ( capture->num_filled < capture->pre_samples ) ? capture->num_filled : capture->pre_samples;
+		capture->trigger_time = capture->timestamp[capture->head];
+	}
+
+	capture->head = ( capture->head + 1 ) % capture->ring_size;
+	if ( capture->num_filled < capture->ring_size ) capture->num_filled++;
+
+	if ( capture->state == FINS_CAPTURE_STATE_TRIGGERED ) {
+
+		capture->post_todo--;
+		if ( capture->post_todo == 0 ) capture->state = FINS_CAPTURE_STATE_COMPLETE;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_capture_sample */
+
+/*
+ * int finslib_capture_run( struct fins_capture_tp *capture, uint32_t period_usec, int timeout );
+ *
+ * The function finslib_capture_run() takes samples until the capture is
+ * complete. With a period of zero the samples are taken back to back, which
+ * is the fastest rate the connection can sustain. Otherwise the function
+ * sleeps between samples to keep the requested period. The sleep ends at an
+ * absolute time of the monotonic clock, so that periods shorter than a
+ * millisecond are kept and steps of the system time do not delay or bunch
+ * the samples. If the capture is not complete after timeout seconds
+ * FINS_RETVAL_TIMED_OUT is returned. A timeout of zero waits forever.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_capture_run( struct fins_capture_tp *capture, uint32_t period_usec, int timeout ) {
+
+	time_t start_time;
+	uint64_t next_sample;
+	uint64_t now;
+	int retval;
+#if ! defined(_WIN32)
+	struct timespec ts;
+#endif  /* ! defined(_WIN32) */
+
+	if ( capture == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	start_time  = finslib_monotonic_sec_timer();
+	next_sample = finslib_monotonic_usec_timer();
+
+	while ( capture->state != FINS_CAPTURE_STATE_COMPLETE ) {
+
+		if ( timeout > 0  &&  finslib_monotonic_sec_timer() - start_time >= timeout ) return FINS_RETVAL_TIMED_OUT;
+
+		if ( period_usec > 0 ) {
+
+			now = finslib_monotonic_usec_timer();
+
+			if ( now < next_sample ) {
+
+#if defined(_WIN32)
+				finslib_milli_second_sleep( (int) ( ( next_sample - now ) / 1000 ) );
+				while ( finslib_monotonic_usec_timer() < next_sample ) {};
+#else  /* defined(_WIN32) */
+				ts.tv_sec  = (time_t) ( next_sample / 1000000 );
+				ts.tv_nsec = (long)   ( next_sample % 1000000 ) * 1000;
+
+				while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, & ts, NULL ) == EINTR ) {};
+#endif  /* defined(_WIN32) */
+			}
+
+			next_sample += period_usec;
+			if ( next_sample < now ) next_sample = now + period_usec;
+		}
+
+		if ( ( retval = finslib_capture_sample( capture ) ) != FINS_RETVAL_SUCCESS ) return retval;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_capture_run */
+
+/*
+ * int finslib_capture_save( struct fins_capture_tp *capture, const char *file_name );
+ *
+ * The function finslib_capture_save() starts writing a completed capture to
+ * a file in the background and returns immediately. The capture must not be
+ * sampled or armed until the write has finished, which can be checked with
+ * finslib_capture_wait(). The file starts with the eight characters
+ * FINSCAP1, followed by the number of words per sample, the number of
+ * samples and the index of the trigger sample as 32 bit big endian values.
+ * Each sample follows as a 64 bit big endian timestamp in microseconds since
+ * the epoch and the words of the sample in big endian order.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_capture_save( struct fins_capture_tp *capture, const char *file_name ) {
+
+	size_t len;
+
+	if ( capture        == NULL                        ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( file_name      == NULL  ||  *file_name == 0   ) return FINS_RETVAL_INVALID_FILENAME;
+	if ( capture->state != FINS_CAPTURE_STATE_COMPLETE ) return FINS_RETVAL_TRY_LATER;
+
+	wait_writer( capture );
+
+	len = strlen( file_name );
+
+	free( capture->file_name );
+	capture->file_name = malloc( len + 1 );
+	if ( capture->file_name == NULL ) return FINS_RETVAL_OUT_OF_MEMORY;
+
+	memcpy( capture->file_name, file_name, len + 1 );
+
+	capture->write_retval = FINS_RETVAL_SUCCESS;
+
+#if defined(_WIN32)
+	capture->writer = CreateThread( NULL, 0, writer_thread, capture, 0, NULL );
+	if ( capture->writer == NULL ) return write_file( capture );
+#else  /* defined(_WIN32) */
+	if ( pthread_create( & capture->writer, NULL, writer_thread, capture ) != 0 ) return write_file( capture );
+#endif  /* defined(_WIN32) */
+
+	capture->writing = true;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_capture_save */
+
+/*
+ * int finslib_capture_wait( struct fins_capture_tp *capture );
+ *
+ * The function finslib_capture_wait() waits until a file write started with
+ * finslib_capture_save() has finished and returns the result of the write.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_capture_wait( struct fins_capture_tp *capture ) {
+
+	if ( capture == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	wait_writer( capture );
+
+	return capture->write_retval;
+
+}  /* finslib_capture_wait */
+
+/*
+ * static bool check_trigger( struct fins_capture_tp *capture, const uint16_t *sample );
+ *
+ * The function check_trigger() checks if the trigger condition became true
+ * between the previous sample and the current one. Edges and threshold
+ * crossings can only be detected once a previous sample is known.
+ */
+
+static bool check_trigger( struct fins_capture_tp *capture, const uint16_t *sample ) {
+
+	uint16_t current;
+	uint16_t previous;
+	uint16_t mask;
+	bool triggered;
+
+	current  = sample[capture->trigger.word];
+	previous = capture->prev_word;
+	mask     = (uint16_t) ( 1u << capture->trigger.bit );
+
+	capture->prev_word = current;
+
+	if ( ! capture->prev_valid ) {
+
+		capture->prev_valid = true;
+		return false;
+	}
+
+	switch ( capture->trigger.type ) {
+
+		case FINS_CAPTURE_TRIGGER_RISING  : triggered = ( ! ( previous & mask ) )  &&  ( current & mask );							break;
+		case FINS_CAPTURE_TRIGGER_FALLING : triggered = ( previous & mask )  &&  ( ! ( current & mask ) );							break;
+		case FINS_CAPTURE_TRIGGER_ABOVE   : triggered = (int16_t) previous <= capture->trigger.level  &&  (int16_t) current >  capture->trigger.level;	break;
+		case FINS_CAPTURE_TRIGGER_BELOW   : triggered = (int16_t) previous >= capture->trigger.level  &&  (int16_t) current <  capture->trigger.level;	break;
+		default                           : triggered = false;													break;
+	}
+
+	return triggered;
+
+}  /* check_trigger */
+
+/*
+ * static void wait_writer( struct fins_capture_tp *capture );
+ *
+ * The function wait_writer() waits for the background write thread of a
+ * capture to finish, if one is running.
+ */
+
+static void wait_writer( struct fins_capture_tp *capture ) {
+
+	if ( ! capture->writing ) return;
+
+#if defined(_WIN32)
+	WaitForSingleObject( capture->writer, INFINITE );
+	CloseHandle( capture->writer );
+#else  /* defined(_WIN32) */
+	pthread_join( capture->writer, NULL );
+#endif  /* defined(_WIN32) */
+
+	capture->writing = false;
+
+}  /* wait_writer */
+
+/*
+ * static DWORD WINAPI writer_thread( LPVOID arg );
+ * static void *writer_thread( void *arg );
+ *
+ * The function writer_thread() is the entry point of the background thread
+ * which writes a capture to a file.
+ */
+
+#if defined(_WIN32)
+static DWORD WINAPI writer_thread( LPVOID arg ) {
+
+	write_file( arg );
+	return 0;
+
+}  /* writer_thread */
+#else  /* defined(_WIN32) */
+static void *writer_thread( void *arg ) {
+
+	write_file( arg );
+	return NULL;
+
+}  /* writer_thread */
+#endif  /* defined(_WIN32) */
+
+/*
+ * static int write_file( struct fins_capture_tp *capture );
+ *
+ * The function write_file() writes the samples of a completed capture to a
+ * file, oldest sample first. The result is also stored in the write_retval
+ * field of the capture.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int write_file( struct fins_capture_tp *capture ) {
+
+	FILE *fp;
+	size_t a;
+	size_t b;
+	size_t len;
+	size_t index;
+	size_t num_samples;
+	uint32_t header[3];
+	uint64_t stamp;
+	const uint16_t *sample;
+	unsigned char *buf;
+	bool ok;
+
+	buf         = capture->file_buffer;
+	num_samples = capture->num_pre + capture->post_samples;
+	header[0]   = (uint32_t) capture->num_words;
+	header[1]   = (uint32_t) num_samples;
+	header[2]   = (uint32_t) capture->num_pre;
+
+	fp = fopen( capture->file_name, "wb" );
+	if ( fp == NULL ) { capture->write_retval = FINS_RETVAL_LOCAL_FILE_ERROR; return capture->write_retval; }
+
+	ok = ( fwrite( CAPTURE_MAGIC, 1, 8, fp ) == 8 );
+
+	for (a=0; ok  &&  a<3; a++) {
+
+		for (b=0; b<4; b++) buf[b] = (header[a] >> (24-8*b)) & 0xff;
+		ok = ( fwrite( buf, 1, 4, fp ) == 4 );
+	}
+
+	index = ( capture->head + capture->ring_size - num_samples ) % capture->ring_size;
+
+	for (a=0; ok  &&  a<num_samples; a++) {
+
+		stamp  = capture->timestamp[index];
+		sample = capture->ring + index * capture->num_words;
+		len    = 0;
+
+		for (b=0; b<8; b++) buf[len++] = (stamp >> (56-8*b)) & 0xff;
+
+		for (b=0; b<capture->num_words; b++) {
+
+			buf[len++] = (sample[b] >> 8) & 0xff;
+			buf[len++] = (sample[b]     ) & 0xff;
+		}
+
+		ok    = ( fwrite( buf, 1, len, fp ) == len );
+		index = ( index + 1 ) % capture->ring_size;
+	}
+
+	if ( fclose( fp ) != 0 ) ok = false;
+
+	capture->write_retval = ( ok ) ? FINS_RETVAL_SUCCESS : FINS_RETVAL_LOCAL_FILE_ERROR;
+
+	return capture->write_retval;
+
+}  /* write_file */
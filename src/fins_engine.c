@@ -0,0 +1,663 @@
+/*
+ * Library: libfins
+ * File:    src/fins_engine.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_engine.c contains a multi-threaded poll engine for
+ * large fleets of PLCs. The connections are divided over worker threads, one
+ * per CPU core, and every worker polls its own connections. A worker sends the
+ * requests of many connections before it collects the responses, so that the
+ * round trip times overlap. Workers which have nothing to do take over polls
+ * which are overdue at other workers. All results are passed to the application
+ * through one lock-free ring.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#if ! defined(_WIN32)
+#include <poll.h>
+#include <unistd.h>
+#endif  /* ! defined(_WIN32) */
+
+#include "fins.h"
+
+#if defined(_MSC_VER)
+#define ENGINE_LOAD(ptr)		((uint64_t) InterlockedCompareExchange64( (volatile LONG64 *) (ptr), 0, 0 ))
+#define ENGINE_STORE(ptr,val)		InterlockedExchange64( (volatile LONG64 *) (ptr), (LONG64) (val) )
+#define ENGINE_CLAIM(ptr)		( InterlockedCompareExchange( (volatile LONG *) (ptr), 1, 0 ) == 0 )
+#define ENGINE_RELEASE(ptr)		InterlockedExchange( (volatile LONG *) (ptr), 0 )
+#define ENGINE_FLAG(ptr)		((uint32_t) InterlockedCompareExchange( (volatile LONG *) (ptr), 0, 0 ))
+#define ENGINE_SET_FLAG(ptr,val)	InterlockedExchange( (volatile LONG *) (ptr), (LONG) (val) )
+#else  /* defined(_MSC_VER) */
+#define ENGINE_LOAD(ptr)		__atomic_load_n( (ptr), __ATOMIC_ACQUIRE )
+#define ENGINE_STORE(ptr,val)		__atomic_store_n( (ptr), (val), __ATOMIC_RELEASE )
+#define ENGINE_CLAIM(ptr)		__sync_bool_compare_and_swap( (ptr), 0, 1 )
+#define ENGINE_RELEASE(ptr)		__atomic_store_n( (ptr), 0, __ATOMIC_RELEASE )
+#define ENGINE_FLAG(ptr)		__atomic_load_n( (ptr), __ATOMIC_ACQUIRE )
+#define ENGINE_SET_FLAG(ptr,val)	__atomic_store_n( (ptr), (val), __ATOMIC_RELEASE )
+#endif  /* defined(_MSC_VER) */
+
+#define ENGINE_MAX_JOBS			1000000
+#define ENGINE_STAGGER			16
+#define ENGINE_RESPONSE_USEC		1000000
+
+static void		collect( struct fins_engineworker_tp *worker, uint64_t wake );
+static void		finish_job( struct fins_engineworker_tp *worker, struct fins_enginejob_tp *job, int retval );
+static size_t		num_cpus( void );
+static void		start_job( struct fins_engineworker_tp *worker, struct fins_enginejob_tp *job, uint64_t now );
+static bool		steal_job( struct fins_engineworker_tp *worker, uint64_t now );
+static void		worker_loop( struct fins_engineworker_tp *worker );
+
+#if defined(_WIN32)
+static DWORD WINAPI	worker_thread( LPVOID arg );
+#else  /* defined(_WIN32) */
+static void *		worker_thread( void *arg );
+#endif  /* defined(_WIN32) */
+
+/*
+ * struct fins_engine_tp *finslib_engine_create( size_t num_workers, size_t max_jobs, struct fins_ring_tp *ring, bool bind_cpu, int *error_val );
+ *
+ * The function finslib_engine_create() creates a poll engine with a number
+ * of worker threads. If num_workers is 0, one worker per online CPU core is
+ * used. Room for max_jobs polls is allocated in advance, so that polls can
+ * be added while the workers run. All results are pushed in the ring, which
+ * must be of type FINS_RING_MPMC because every worker is a producer. With
+ * bind_cpu set, worker n is bound to CPU core n. On success a pointer to the
+ * engine is returned. Otherwise the return value is NULL and the reason is
+ * stored in the variable pointed to by error_val.
+ */
+
+struct fins_engine_tp *finslib_engine_create( size_t num_workers, size_t max_jobs, struct fins_ring_tp *ring, bool bind_cpu, int *error_val ) {
+
+	struct fins_engine_tp *engine;
+	size_t a;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	engine = NULL;
+
+	if ( num_workers == 0 ) num_workers = num_cpus();
+
+	if      ( ring == NULL                                                    ) retval = FINS_RETVAL_NOT_INITIALIZED;
+	else if ( ! ring->multi_producer                                          ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( num_workers > FINS_ENGINE_MAX_WORKERS                           ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( max_jobs == 0  ||  max_jobs > ENGINE_MAX_JOBS                   ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( ( engine = calloc( 1, sizeof(struct fins_engine_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		engine->worker      = calloc( num_workers, sizeof(struct fins_engineworker_tp) );
+		engine->job         = calloc( max_jobs,    sizeof(struct fins_enginejob_tp)    );
+		engine->num_workers = num_workers;
+		engine->max_jobs    = max_jobs;
+		engine->ring        = ring;
+		engine->bind_cpu    = bind_cpu;
+		engine->steal_usec  = FINS_ENGINE_STEAL_USEC;
+
+		if ( engine->worker == NULL  ||  engine->job == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	}
+
+	for (a=0; retval == FINS_RETVAL_SUCCESS  &&  a<num_workers; a++) {
+
+		engine->worker[a].engine = engine;
+		engine->worker[a].index  = a;
+		engine->worker[a].job    = calloc( max_jobs, sizeof(struct fins_enginejob_tp *) );
+		engine->worker[a].slot   = calloc( FINS_ENGINE_WINDOW, sizeof(struct fins_engineslot_tp) );
+
+		if ( engine->worker[a].job == NULL  ||  engine->worker[a].slot == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	}
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_engine_free( engine );
+		return NULL;
+	}
+
+	return engine;
+
+}  /* finslib_engine_create */
+
+/*
+ * void finslib_engine_free( struct fins_engine_tp *engine );
+ *
+ * The function finslib_engine_free() stops the workers of an engine if they
+ * are still running and releases the engine. The connections, items and the
+ * ring are owned by the application and are not touched.
+ */
+
+void finslib_engine_free( struct fins_engine_tp *engine ) {
+
+	size_t a;
+
+	if ( engine == NULL ) return;
+
+	finslib_engine_stop( engine );
+
+	for (a=0; engine->worker != NULL  &&  a<engine->num_workers; a++) {
+
+		free( engine->worker[a].job  );
+		free( engine->worker[a].slot );
+	}
+
+	free( engine->worker );
+	free( engine->job    );
+	free( engine         );
+
+}  /* finslib_engine_free */
+
+/*
+ * int finslib_engine_add( struct fins_engine_tp *engine, struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, uint32_t first_tag_id, uint32_t interval_msec );
+ *
+ * The function finslib_engine_add() adds a cyclic poll of a list of items to
+ * an engine. The connection is owned by the worker with the lowest load, so
+ * that its state normally stays in the cache of one CPU core. Because a
+ * connection has only one poll in flight at a time, each connection can only
+ * be used by one poll of the engine. The first polls of the connections are
+ * spread over the interval to avoid that all PLCs are polled at once. Polls
+ * can be added while the workers run, but only from one thread at a time.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_engine_add( struct fins_engine_tp *engine, struct fins_sys_tp *sys, struct fins_multidata_tp *item, size_t num_item, uint32_t first_tag_id, uint32_t interval_msec ) {
+
+	struct fins_enginejob_tp *job;
+	struct fins_engineworker_tp *worker;
+	size_t a;
+
+	if ( engine == NULL  ||  sys      == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( item   == NULL  ||  num_item == 0    ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	for (a=0; a<engine->num_jobs; a++) if ( engine->job[a].sys == sys ) return FINS_RETVAL_DUPLICATE_CONNECTION;
+
+	if ( interval_msec == 0  ||  engine->num_jobs >= engine->max_jobs ) return FINS_RETVAL_INVALID_LAYOUT;
+
+	worker = & engine->worker[0];
+
+	for (a=1; a<engine->num_workers; a++) if ( engine->worker[a].load < worker->load ) worker = & engine->worker[a];
+
+	job                = & engine->job[engine->num_jobs];
+	job->sys           = sys;
+	job->item          = item;
+	job->num_item      = num_item;
+	job->first_tag_id  = first_tag_id;
+	job->interval_usec = 1000 * (uint64_t) interval_msec;
+	job->next_usec     = finslib_monotonic_usec_timer() + ( job->interval_usec * ( engine->num_jobs % ENGINE_STAGGER ) ) / ENGINE_STAGGER;
+	job->busy          = 0;
+	job->home          = worker->index;
+	job->retval        = FINS_RETVAL_SUCCESS;
+
+	worker->job[worker->num_job] = job;
+	worker->load                += 1000.0 / (double) interval_msec;
+
+	engine->num_jobs++;
+	ENGINE_STORE( & worker->num_job, worker->num_job + 1 );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_engine_add */
+
+/*
+ * int finslib_engine_start( struct fins_engine_tp *engine );
+ *
+ * The function finslib_engine_start() starts the worker threads of an
+ * engine. Calling the function while the workers already run has no effect.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_engine_start( struct fins_engine_tp *engine ) {
+
+	size_t a;
+	int retval;
+
+	if ( engine == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	if ( ENGINE_FLAG( & engine->running ) ) return FINS_RETVAL_SUCCESS;
+
+	ENGINE_SET_FLAG( & engine->running, 1 );
+
+	retval = FINS_RETVAL_SUCCESS;
+
+	for (a=0; a<engine->num_workers; a++) {
+
+#if defined(_WIN32)
+		engine->worker[a].thread = CreateThread( NULL, 0, worker_thread, & engine->worker[a], 0, NULL );
+		if ( engine->worker[a].thread == NULL ) { retval = FINS_RETVAL_OUT_OF_MEMORY; break; }
+#else  /* defined(_WIN32) */
+		if ( ( retval = pthread_create( & engine->worker[a].thread, NULL, worker_thread, & engine->worker[a] ) ) != 0 ) { retval += FINS_RETVAL_ERRNO_BASE; break; }
+#endif  /* defined(_WIN32) */
+
+		engine->worker[a].started = true;
+	}
+
+	if ( retval != FINS_RETVAL_SUCCESS ) finslib_engine_stop( engine );
+
+	return retval;
+
+}  /* finslib_engine_start */
+
+/*
+ * void finslib_engine_stop( struct fins_engine_tp *engine );
+ *
+ * The function finslib_engine_stop() stops the worker threads of an engine
+ * and waits until they have finished their current poll. The engine can be
+ * started again later.
+ */
+
+void finslib_engine_stop( struct fins_engine_tp *engine ) {
+
+	size_t a;
+
+	if ( engine == NULL ) return;
+
+	ENGINE_SET_FLAG( & engine->running, 0 );
+
+	for (a=0; a<engine->num_workers; a++) {
+
+		if ( ! engine->worker[a].started ) continue;
+
+#if defined(_WIN32)
+		WaitForSingleObject( engine->worker[a].thread, INFINITE );
+		CloseHandle( engine->worker[a].thread );
+#else  /* defined(_WIN32) */
+		pthread_join( engine->worker[a].thread, NULL );
+#endif  /* defined(_WIN32) */
+
+		engine->worker[a].started = false;
+	}
+
+}  /* finslib_engine_stop */
+
+/*
+ * static void worker_loop( struct fins_engineworker_tp *worker );
+ *
+ * The function worker_loop() is the main loop of a worker. In each round the
+ * worker sends the requests of all due polls of its own connections without
+ * waiting for the responses, up to FINS_ENGINE_WINDOW polls at the same time.
+ * If none were due, it tries to steal one overdue poll from another worker.
+ * The responses are then collected in the order in which they arrive. A
+ * worker without outstanding polls sleeps until its next poll is due, but
+ * never longer than FINS_ENGINE_IDLE_USEC, so that it keeps looking for work
+ * of busy workers. When the engine stops, the outstanding polls are finished
+ * first.
+ */
+
+static void worker_loop( struct fins_engineworker_tp *worker ) {
+
+	struct fins_engine_tp *engine;
+	struct fins_enginejob_tp *job;
+	struct fins_rtprofile_tp profile;
+	uint64_t now;
+	uint64_t due;
+	uint64_t wake;
+	size_t num_job;
+	size_t a;
+	bool started;
+
+	engine         = worker->engine;
+	worker->retval = FINS_RETVAL_SUCCESS;
+
+	if ( engine->bind_cpu ) {
+
+		memset( & profile, 0, sizeof(profile) );
+		profile.cpu    = (int) ( worker->index % num_cpus() );
+		worker->retval = finslib_rtprofile_apply( & profile );
+	}
+
+	while ( ENGINE_FLAG( & engine->running ) ) {
+
+		now     = finslib_monotonic_usec_timer();
+		wake    = now + FINS_ENGINE_IDLE_USEC;
+		num_job = ENGINE_LOAD( & worker->num_job );
+		started = false;
+
+		for (a=0; a<num_job  &&  worker->num_slot < FINS_ENGINE_WINDOW; a++) {
+
+			job = worker->job[a];
+			due = ENGINE_LOAD( & job->next_usec );
+
+			if ( due > now ) {
+
+				if ( due < wake ) wake = due;
+				continue;
+			}
+
+			if ( ! ENGINE_CLAIM( & job->busy ) ) continue;
+
+			if ( ENGINE_LOAD( & job->next_usec ) > now ) {
+
+				ENGINE_RELEASE( & job->busy );
+				continue;
+			}
+
+			start_job( worker, job, now );
+			started = true;
+		}
+
+		if ( ! started  &&  worker->num_slot < FINS_ENGINE_WINDOW ) started = steal_job( worker, now );
+
+		if ( worker->num_slot > 0 ) {
+
+			collect( worker, ( started ) ? now : wake );
+			continue;
+		}
+
+		if ( started ) continue;
+
+		now = finslib_monotonic_usec_timer();
+
+		if ( wake > now ) {
+
+#if defined(_WIN32)
+			Sleep( 1 );
+#else  /* defined(_WIN32) */
+			usleep( (useconds_t) ( wake - now ) );
+#endif  /* defined(_WIN32) */
+
+			worker->idle_usec += finslib_monotonic_usec_timer() - now;
+		}
+	}
+
+	while ( worker->num_slot > 0 ) collect( worker, finslib_monotonic_usec_timer() + FINS_ENGINE_IDLE_USEC );
+
+}  /* worker_loop */
+
+/*
+ * static bool steal_job( struct fins_engineworker_tp *worker, uint64_t now );
+ *
+ * The function steal_job() looks for a poll of another worker which is more
+ * than the steal time of the engine overdue. Such a poll is late because its
+ * own worker is busy with other polls, so an idle worker runs it instead.
+ * Polls which are only slightly late are left alone, so that connections
+ * normally stay with their own worker. The victims are visited starting with
+ * the next worker, which spreads the thieves over the busy workers. The
+ * function returns true if a poll was stolen.
+ */
+
+static bool steal_job( struct fins_engineworker_tp *worker, uint64_t now ) {
+
+	struct fins_engine_tp *engine;
+	struct fins_engineworker_tp *victim;
+	struct fins_enginejob_tp *job;
+	size_t num_job;
+	size_t a;
+	size_t b;
+
+	engine = worker->engine;
+
+	for (a=1; a<engine->num_workers; a++) {
+
+		victim  = & engine->worker[ (worker->index + a) % engine->num_workers ];
+		num_job = ENGINE_LOAD( & victim->num_job );
+
+		for (b=0; b<num_job; b++) {
+
+			job = victim->job[b];
+
+			if ( ENGINE_LOAD( & job->next_usec ) + engine->steal_usec > now ) continue;
+			if ( ! ENGINE_CLAIM( & job->busy )                             ) continue;
+
+			if ( ENGINE_LOAD( & job->next_usec ) + engine->steal_usec > now ) {
+
+				ENGINE_RELEASE( & job->busy );
+				continue;
+			}
+
+			job->stolen++;
+			worker->steals++;
+
+			start_job( worker, job, now );
+
+			return true;
+		}
+	}
+
+	return false;
+
+}  /* steal_job */
+
+/*
+ * static void start_job( struct fins_engineworker_tp *worker, struct fins_enginejob_tp *job, uint64_t now );
+ *
+ * The function start_job() starts one claimed poll by sending the first
+ * request of the multiple memory area read without waiting for the
+ * response. The poll then occupies a slot of the worker until all responses
+ * have been collected. A poll which cannot be sent is finished at once.
+ */
+
+static void start_job( struct fins_engineworker_tp *worker, struct fins_enginejob_tp *job, uint64_t now ) {
+
+	struct fins_engineslot_tp *slot;
+	uint64_t late;
+	int retval;
+
+	late = ( now > job->next_usec ) ? now - job->next_usec : 0;
+
+	if ( late > job->max_late_usec ) job->max_late_usec = late;
+
+	slot            = & worker->slot[worker->num_slot];
+	slot->job       = job;
+	slot->read.next = 0;
+
+	retval = XX_finslib_multiple_read_send( job->sys, job->item, job->num_item, & slot->read );
+
+	if ( retval != FINS_RETVAL_SUCCESS  ||  slot->read.num_encoded == 0 ) {
+
+		finish_job( worker, job, ( retval != FINS_RETVAL_SUCCESS ) ? retval : ( slot->read.partial ) ? FINS_RETVAL_PARTIAL_READ : FINS_RETVAL_SUCCESS );
+		return;
+	}
+
+	slot->send_usec = finslib_monotonic_usec_timer();
+	worker->num_slot++;
+
+}  /* start_job */
+
+/*
+ * static void collect( struct fins_engineworker_tp *worker, uint64_t wake );
+ *
+ * The function collect() waits until responses arrive on the connections of
+ * the outstanding polls of a worker, but not later than wake. Every response
+ * which has arrived is received and the next request of the same poll is
+ * sent at once. A poll is finished when its last response has been
+ * received. A connection which did not answer within ENGINE_RESPONSE_USEC is
+ * received from anyway, so that the socket timeout of the connection ends
+ * the poll with an error.
+ */
+
+static void collect( struct fins_engineworker_tp *worker, uint64_t wake ) {
+
+	struct fins_engineslot_tp *slot;
+	struct fins_enginejob_tp *job;
+	uint64_t now;
+	uint64_t deadline;
+	size_t a;
+	int retval;
+	bool ready[FINS_ENGINE_WINDOW];
+#if defined(_WIN32)
+	fd_set readfds;
+	struct timeval tv;
+#else  /* defined(_WIN32) */
+	struct pollfd fds[FINS_ENGINE_WINDOW];
+#endif  /* defined(_WIN32) */
+
+	now = finslib_monotonic_usec_timer();
+
+	for (a=0; a<worker->num_slot; a++) {
+
+		deadline = worker->slot[a].send_usec + ENGINE_RESPONSE_USEC;
+		if ( deadline < wake ) wake = deadline;
+	}
+
+	if ( wake < now ) wake = now;
+
+#if defined(_WIN32)
+	FD_ZERO( & readfds );
+	for (a=0; a<worker->num_slot; a++) FD_SET( worker->slot[a].job->sys->sockfd, & readfds );
+
+	tv.tv_sec  = (long) ( ( wake - now ) / 1000000 );
+	tv.tv_usec = (long) ( ( wake - now ) % 1000000 );
+
+	select( 0, & readfds, NULL, NULL, & tv );
+
+	for (a=0; a<worker->num_slot; a++) ready[a] = FD_ISSET( worker->slot[a].job->sys->sockfd, & readfds );
+#else  /* defined(_WIN32) */
+	for (a=0; a<worker->num_slot; a++) {
+
+		fds[a].fd      = worker->slot[a].job->sys->sockfd;
+		fds[a].events  = POLLIN;
+		fds[a].revents = 0;
+	}
+
+	poll( fds, (nfds_t) worker->num_slot, (int) ( ( wake - now + 999 ) / 1000 ) );
+
+	for (a=0; a<worker->num_slot; a++) ready[a] = ( fds[a].revents != 0 );
+#endif  /* defined(_WIN32) */
+
+	worker->idle_usec += finslib_monotonic_usec_timer() - now;
+	now                = finslib_monotonic_usec_timer();
+
+	for (a=worker->num_slot; a>0; a--) {
+
+		slot = & worker->slot[a-1];
+		job  = slot->job;
+
+		if ( ! ready[a-1]  &&  slot->send_usec + ENGINE_RESPONSE_USEC > now ) continue;
+
+		retval = XX_finslib_multiple_read_receive( job->sys, job->item, job->num_item, & slot->read );
+
+		if ( retval == FINS_RETVAL_SUCCESS  &&  slot->read.next < job->num_item ) retval = XX_finslib_multiple_read_send( job->sys, job->item, job->num_item, & slot->read );
+
+		if ( retval == FINS_RETVAL_SUCCESS  &&  slot->read.num_encoded > 0 ) {
+
+			slot->send_usec = finslib_monotonic_usec_timer();
+			continue;
+		}
+
+		finish_job( worker, job, ( retval != FINS_RETVAL_SUCCESS ) ? retval : ( slot->read.partial ) ? FINS_RETVAL_PARTIAL_READ : FINS_RETVAL_SUCCESS );
+
+		worker->num_slot--;
+		if ( a-1 < worker->num_slot ) memcpy( slot, & worker->slot[worker->num_slot], sizeof(struct fins_engineslot_tp) );
+	}
+
+}  /* collect */
+
+/*
+ * static void finish_job( struct fins_engineworker_tp *worker, struct fins_enginejob_tp *job, int retval );
+ *
+ * The function finish_job() completes one poll. The results are pushed in
+ * the ring of the engine and the next poll is scheduled one interval after
+ * the previous due time, so that the polls keep their phase. Polls which are
+ * already missed are skipped. The claim is released when the poll has been
+ * scheduled.
+ */
+
+static void finish_job( struct fins_engineworker_tp *worker, struct fins_enginejob_tp *job, int retval ) {
+
+	uint64_t due;
+	uint64_t now;
+	uint64_t missed;
+	size_t a;
+
+	if ( retval != FINS_RETVAL_SUCCESS  &&  retval != FINS_RETVAL_PARTIAL_READ ) {
+
+		for (a=0; a<job->num_item; a++) job->item[a].status = retval;
+	}
+
+	if ( finslib_ring_push_multidata( worker->engine->ring, job->item, job->num_item, job->first_tag_id, finslib_epoch_usec_timer() ) == FINS_RETVAL_RING_FULL ) worker->ring_full++;
+
+	job->retval = retval;
+	job->polls++;
+	worker->polls++;
+
+	due = job->next_usec + job->interval_usec;
+	now = finslib_monotonic_usec_timer();
+
+	if ( due <= now ) {
+
+		missed        = ( now - due ) / job->interval_usec + 1;
+		due          += missed * job->interval_usec;
+		job->skipped += missed;
+	}
+
+	ENGINE_STORE( & job->next_usec, due );
+	ENGINE_RELEASE( & job->busy );
+
+}  /* finish_job */
+
+/*
+ * static size_t num_cpus( void );
+ *
+ * The function num_cpus() returns the number of online CPU cores, or 1 if
+ * the number cannot be determined.
+ */
+
+static size_t num_cpus( void ) {
+
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+
+	GetSystemInfo( & info );
+
+	return ( info.dwNumberOfProcessors > 0 ) ? (size_t) info.dwNumberOfProcessors : 1;
+#else  /* defined(_WIN32) */
+	long num;
+
+	num = sysconf( _SC_NPROCESSORS_ONLN );
+
+	return ( num > 0 ) ? (size_t) num : 1;
+#endif  /* defined(_WIN32) */
+
+}  /* num_cpus */
+
+/*
+ * static DWORD WINAPI worker_thread( LPVOID arg );
+ * static void *worker_thread( void *arg );
+ *
+ * The function worker_thread() is the entry point of the worker threads of
+ * an engine.
+ */
+
+#if defined(_WIN32)
+static DWORD WINAPI worker_thread( LPVOID arg ) {
+
+	worker_loop( arg );
+	return 0;
+
+}  /* worker_thread */
+#else  /* defined(_WIN32) */
+static void *worker_thread( void *arg ) {
+
+	worker_loop( arg );
+	return NULL;
+
+}  /* worker_thread */
+#endif  /* defined(_WIN32) */
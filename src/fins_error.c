@@ -116,6 +116,23 @@ const char *finslib_errmsg( int error_code, char *buffer, size_t buffer_len ) {
 		case FINS_RETVAL_RESPONSE_HEADER_INCOMPLETE  : snprintf( buffer, buffer_len, "Response header incomplete"                         ); break;
 		case FINS_RETVAL_INVALID_FORCE_COMMAND       : snprintf( buffer, buffer_len, "Invalid force command"                              ); break;
 
+		case FINS_RETVAL_INVALID_LAYOUT              : snprintf( buffer, buffer_len, "Invalid size or layout"                             ); break;
+		case FINS_RETVAL_MAILBOX_CORRUPT             : snprintf( buffer, buffer_len, "Mailbox index words corrupt"                        ); break;
+		case FINS_RETVAL_SNAPSHOT_TORN               : snprintf( buffer, buffer_len, "Snapshot region changed while reading"              ); break;
+		case FINS_RETVAL_VERIFY_FAILED               : snprintf( buffer, buffer_len, "Verification of written data failed"                ); break;
+		case FINS_RETVAL_LOCAL_FILE_ERROR            : snprintf( buffer, buffer_len, "Local file could not be read or written"            ); break;
+		case FINS_RETVAL_TIMED_OUT                   : snprintf( buffer, buffer_len, "Operation timed out"                                ); break;
+		case FINS_RETVAL_PARTIAL_READ                : snprintf( buffer, buffer_len, "One or more items could not be read"                ); break;
+		case FINS_RETVAL_INVALID_DATA_TYPE           : snprintf( buffer, buffer_len, "Invalid data type"                                  ); break;
+		case FINS_RETVAL_NOT_SUPPORTED               : snprintf( buffer, buffer_len, "Not supported on this platform"                     ); break;
+		case FINS_RETVAL_RING_FULL                   : snprintf( buffer, buffer_len, "Ring full, record dropped"                          ); break;
+		case FINS_RETVAL_DUPLICATE_TAG               : snprintf( buffer, buffer_len, "Duplicate tag name"                                 ); break;
+		case FINS_RETVAL_TAG_SYNTAX_ERROR            : snprintf( buffer, buffer_len, "Syntax error in tag list"                           ); break;
+		case FINS_RETVAL_DUPLICATE_NAME              : snprintf( buffer, buffer_len, "Name already in use"                                ); break;
+		case FINS_RETVAL_INVALID_TRAFFIC_CLASS       : snprintf( buffer, buffer_len, "Invalid traffic class"                              ); break;
+		case FINS_RETVAL_EVENTS_LOST                 : snprintf( buffer, buffer_len, "Events were overwritten before they were read"      ); break;
+		case FINS_RETVAL_DUPLICATE_CONNECTION        : snprintf( buffer, buffer_len, "The connection is already in use"                   ); break;
+
 		case FINS_RETVAL_LOCAL_NODE_NOT_IN_NETWORK   : snprintf( buffer, buffer_len, "Local node not in network"                          ); break;
 		case FINS_RETVAL_LOCAL_TOKEN_TIMEOUT         : snprintf( buffer, buffer_len, "Local node token timeout"                           ); break;
 		case FINS_RETVAL_LOCAL_RETRIES_FAILED        : snprintf( buffer, buffer_len, "Local node retries failed"                          ); break;
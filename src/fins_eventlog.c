@@ -0,0 +1,680 @@
+/*
+ * Library: libfins
+ * File:    src/fins_eventlog.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_eventlog.c contains routines for a log of tag
+ * change events in shared memory. One writer appends events with increasing
+ * sequence numbers to a ring and any number of reader processes follow the log
+ * independently without locks. Readers can resume from any event which is still
+ * retained in the ring.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fins.h"
+
+#if ! defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  /* ! defined(_WIN32) */
+
+#if defined(_MSC_VER)
+#define LOG_LOAD(ptr)			((uint64_t) InterlockedCompareExchange64( (volatile LONG64 *) (ptr), 0, 0 ))
+#define LOG_STORE(ptr,val)		InterlockedExchange64( (volatile LONG64 *) (ptr), (LONG64) (val) )
+#define LOG_FENCE()			MemoryBarrier()
+#else  /* defined(_MSC_VER) */
+#define LOG_LOAD(ptr)			__atomic_load_n( (ptr), __ATOMIC_ACQUIRE )
+#define LOG_STORE(ptr,val)		__atomic_store_n( (ptr), (val), __ATOMIC_RELEASE )
+#define LOG_FENCE()			__atomic_thread_fence( __ATOMIC_SEQ_CST )
+#endif  /* defined(_MSC_VER) */
+
+#define EVENTLOG_MAGIC			"FINSEVT1"
+#define EVENTLOG_MAX_CAPACITY		((size_t) 1 << 30)
+#define EVENTLOG_MIN_LAST		64
+
+struct eventlog_header_tp {
+	char		magic[8];
+	uint32_t	byte_order;
+	uint32_t	slot_size;
+	uint64_t	capacity;
+	unsigned char	pad_head[64];
+	uint64_t	head;
+	unsigned char	pad_end[64];
+};
+
+struct eventlog_slot_tp {
+	uint64_t		guard;
+	struct fins_event_tp	event;
+};
+
+#define EVENTLOG_BYTE_ORDER		0x01020304
+#define EVENTLOG_SLOTS(map)		((struct eventlog_slot_tp *) ( (char *) (map) + sizeof(struct eventlog_header_tp) ))
+
+static bool			changed( struct fins_eventlog_tp *log, const struct fins_result_tp *result );
+static bool			grow_last( struct fins_eventlog_tp *log );
+static int			map_log( const char *name, size_t capacity, bool writer, void **map, size_t *map_size, void *mapping );
+static void			unmap_log( void *map, size_t map_size, void *mapping );
+
+/*
+ * struct fins_eventlog_tp *finslib_eventlog_create( const char *name, size_t capacity, int *error_val );
+ *
+ * The function finslib_eventlog_create() creates or opens the shared memory
+ * object of a change event log for writing. The capacity is rounded up to
+ * the next power of two. When a log with the same name and capacity already
+ * exists, for example after a restart of the writer, the sequence numbers
+ * continue where the previous writer stopped and the retained events remain
+ * available to the readers. On success a pointer to the log is returned.
+ * Otherwise the return value is NULL and the reason is stored in the variable
+ * pointed to by error_val.
+ */
+
+struct fins_eventlog_tp *finslib_eventlog_create( const char *name, size_t capacity, int *error_val ) {
+
+	struct fins_eventlog_tp *log;
+	struct eventlog_header_tp *hdr;
+	size_t size;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	log    = NULL;
+	size   = 2;
+
+	if      ( name == NULL  ||  name[0] == 0  ||  strlen( name ) >= FINS_EVENTLOG_NAME_LEN ) retval = FINS_RETVAL_INVALID_FILENAME;
+	else if ( capacity == 0  ||  capacity > EVENTLOG_MAX_CAPACITY                           ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( ( log = calloc( 1, sizeof(struct fins_eventlog_tp) ) ) == NULL                ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	while ( size < capacity ) size <<= 1;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		if ( name[0] != '/' ) snprintf( log->name, sizeof(log->name), "/%s", name );
+		else                  snprintf( log->name, sizeof(log->name), "%s",  name );
+
+#if defined(_WIN32)
+		retval = map_log( log->name, size, true, & log->map, & log->map_size, & log->mapping );
+#else  /* defined(_WIN32) */
+		retval = map_log( log->name, size, true, & log->map, & log->map_size, NULL );
+#endif  /* defined(_WIN32) */
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		hdr = log->map;
+
+		if ( memcmp( hdr->magic, EVENTLOG_MAGIC, 8 ) != 0 ) {
+
+			memset( log->map, 0, log->map_size );
+
+			hdr->byte_order = EVENTLOG_BYTE_ORDER;
+			hdr->slot_size  = sizeof(struct eventlog_slot_tp);
+			hdr->capacity   = size;
+			hdr->head       = 1;
+
+			LOG_FENCE();
+
+			memcpy( hdr->magic, EVENTLOG_MAGIC, 8 );
+		}
+
+		else if ( hdr->byte_order != EVENTLOG_BYTE_ORDER  ||  hdr->slot_size != sizeof(struct eventlog_slot_tp)  ||  hdr->capacity != size  ||  hdr->head == 0 ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		log->mask = size - 1;
+		log->head = LOG_LOAD( & hdr->head );
+
+		if ( ! grow_last( log ) ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	}
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_eventlog_free( log );
+		return NULL;
+	}
+
+	return log;
+
+}  /* finslib_eventlog_create */
+
+/*
+ * void finslib_eventlog_free( struct fins_eventlog_tp *log );
+ *
+ * The function finslib_eventlog_free() unmaps a change event log and
+ * releases the memory of the writer. The shared memory object itself remains,
+ * so that readers can continue and a new writer can resume the log.
+ */
+
+void finslib_eventlog_free( struct fins_eventlog_tp *log ) {
+
+	if ( log == NULL ) return;
+
+#if defined(_WIN32)
+	unmap_log( log->map, log->map_size, log->mapping );
+#else  /* defined(_WIN32) */
+	unmap_log( log->map, log->map_size, NULL );
+#endif  /* defined(_WIN32) */
+
+	free( log->last );
+	free( log );
+
+}  /* finslib_eventlog_free */
+
+/*
+ * int finslib_eventlog_remove( const char *name );
+ *
+ * The function finslib_eventlog_remove() removes the shared memory object of
+ * a change event log. Processes which have the log mapped can continue to
+ * use it, but new readers and writers create a new log.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_eventlog_remove( const char *name ) {
+
+#if defined(_WIN32)
+	if ( name == NULL  ||  name[0] == 0 ) return FINS_RETVAL_INVALID_FILENAME;
+
+	return FINS_RETVAL_SUCCESS;
+#else  /* defined(_WIN32) */
+	char path[FINS_EVENTLOG_NAME_LEN+1];
+
+	if ( name == NULL  ||  name[0] == 0  ||  strlen( name ) >= FINS_EVENTLOG_NAME_LEN ) return FINS_RETVAL_INVALID_FILENAME;
+
+	if ( name[0] != '/' ) snprintf( path, sizeof(path), "/%s", name );
+	else                  snprintf( path, sizeof(path), "%s",  name );
+
+	if ( shm_unlink( path ) != 0 ) return FINS_RETVAL_LOCAL_FILE_ERROR;
+
+	return FINS_RETVAL_SUCCESS;
+#endif  /* defined(_WIN32) */
+
+}  /* finslib_eventlog_remove */
+
+/*
+ * int finslib_eventlog_append( struct fins_eventlog_tp *log, const struct fins_result_tp *result, size_t num_result, bool changes_only, size_t *num_appended );
+ *
+ * The function finslib_eventlog_append() appends a list of results to a
+ * change event log. With the flag changes_only a result is only appended
+ * when its value or status differs from the last logged result of the same
+ * tag, so that the results of a poll cycle can be passed unfiltered. The
+ * events become visible to the readers together after the whole list has
+ * been written. A log must only have one writer.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_eventlog_append( struct fins_eventlog_tp *log, const struct fins_result_tp *result, size_t num_result, bool changes_only, size_t *num_appended ) {
+
+	struct eventlog_header_tp *hdr;
+	struct eventlog_slot_tp *slot;
+	uint64_t now;
+	size_t a;
+	size_t appended;
+
+	if ( num_appended != NULL ) *num_appended = 0;
+
+	if ( log    == NULL                    ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( result == NULL  &&  num_result > 0 ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	hdr      = log->map;
+	now      = finslib_epoch_usec_timer();
+	appended = 0;
+
+	for (a=0; a<num_result; a++) {
+
+		if ( ! changed( log, & result[a] )  &&  changes_only ) { log->unchanged++; continue; }
+
+		slot = EVENTLOG_SLOTS( log->map ) + ( log->head & log->mask );
+
+		LOG_STORE( & slot->guard, 0 );
+		LOG_FENCE();
+
+		slot->event.sequence  = log->head;
+		slot->event.timestamp = ( result[a].timestamp != 0 ) ? result[a].timestamp : now;
+		slot->event.tag_id    = result[a].tag_id;
+		slot->event.status    = result[a].status;
+		slot->event.value     = result[a].value;
+
+		LOG_STORE( & slot->guard, log->head );
+
+		log->head++;
+		appended++;
+	}
+
+	if ( appended > 0 ) LOG_STORE( & hdr->head, log->head );
+
+	log->appended += appended;
+
+	if ( num_appended != NULL ) *num_appended = appended;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_eventlog_append */
+
+/*
+ * struct fins_eventreader_tp *finslib_eventreader_open( const char *name, int *error_val );
+ *
+ * The function finslib_eventreader_open() maps an existing change event log
+ * read only. Each reader has its own position in the log, which starts at
+ * the oldest retained event. On success a pointer to the reader is returned.
+ * Otherwise the return value is NULL and the reason is stored in the variable
+ * pointed to by error_val.
+ */
+
+struct fins_eventreader_tp *finslib_eventreader_open( const char *name, int *error_val ) {
+
+	struct fins_eventreader_tp *reader;
+	const struct eventlog_header_tp *hdr;
+	char path[FINS_EVENTLOG_NAME_LEN+1];
+	void *map;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	reader = NULL;
+	map    = NULL;
+
+	if      ( name == NULL  ||  name[0] == 0  ||  strlen( name ) >= FINS_EVENTLOG_NAME_LEN ) retval = FINS_RETVAL_INVALID_FILENAME;
+	else if ( ( reader = calloc( 1, sizeof(struct fins_eventreader_tp) ) ) == NULL          ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		if ( name[0] != '/' ) snprintf( path, sizeof(path), "/%s", name );
+		else                  snprintf( path, sizeof(path), "%s",  name );
+
+#if defined(_WIN32)
+		retval = map_log( path, 0, false, & map, & reader->map_size, & reader->mapping );
+#else  /* defined(_WIN32) */
+		retval = map_log( path, 0, false, & map, & reader->map_size, NULL );
+#endif  /* defined(_WIN32) */
+
+		reader->map = map;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		hdr = reader->map;
+
+		if      ( memcmp( hdr->magic, EVENTLOG_MAGIC, 8 ) != 0                                ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( hdr->byte_order != EVENTLOG_BYTE_ORDER                                      ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( hdr->slot_size  != sizeof(struct eventlog_slot_tp)                          ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( hdr->capacity == 0  ||  ( hdr->capacity & (hdr->capacity-1) ) != 0          ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( sizeof(struct eventlog_header_tp) + hdr->capacity * sizeof(struct eventlog_slot_tp) > reader->map_size ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else reader->mask = hdr->capacity - 1;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) finslib_eventreader_seek( reader, FINS_EVENTLOG_OLDEST );
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_eventreader_close( reader );
+		return NULL;
+	}
+
+	return reader;
+
+}  /* finslib_eventreader_open */
+
+/*
+ * void finslib_eventreader_close( struct fins_eventreader_tp *reader );
+ *
+ * The function finslib_eventreader_close() unmaps a change event log and
+ * releases the memory of the reader.
+ */
+
+void finslib_eventreader_close( struct fins_eventreader_tp *reader ) {
+
+	void *map;
+
+	if ( reader == NULL ) return;
+
+	memcpy( & map, & reader->map, sizeof(map) );
+
+#if defined(_WIN32)
+	unmap_log( map, reader->map_size, reader->mapping );
+#else  /* defined(_WIN32) */
+	unmap_log( map, reader->map_size, NULL );
+#endif  /* defined(_WIN32) */
+
+	free( reader );
+
+}  /* finslib_eventreader_close */
+
+/*
+ * int finslib_eventreader_seek( struct fins_eventreader_tp *reader, uint64_t sequence );
+ *
+ * The function finslib_eventreader_seek() sets the position of a reader to
+ * the event with the given sequence number, typically the last processed
+ * event plus one after a restart of the reader. FINS_EVENTLOG_OLDEST selects
+ * the oldest retained event and FINS_EVENTLOG_NEWEST skips all events which
+ * are already in the log. If the requested event is no longer retained, the
+ * position is set to the oldest retained event and FINS_RETVAL_EVENTS_LOST is
+ * returned.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_eventreader_seek( struct fins_eventreader_tp *reader, uint64_t sequence ) {
+
+	const struct eventlog_header_tp *hdr;
+	uint64_t head;
+	uint64_t oldest;
+
+	if ( reader == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	hdr    = reader->map;
+	head   = LOG_LOAD( & hdr->head );
+	oldest = ( head > reader->mask + 1 ) ? head - reader->mask - 1 : 1;
+
+	if ( sequence == FINS_EVENTLOG_OLDEST  ||  sequence > head ) sequence = ( sequence == FINS_EVENTLOG_OLDEST ) ? oldest : head;
+
+	if ( sequence < oldest ) {
+
+		reader->lost += oldest - sequence;
+		reader->next  = oldest;
+
+		return FINS_RETVAL_EVENTS_LOST;
+	}
+
+	reader->next = sequence;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_eventreader_seek */
+
+/*
+ * int finslib_eventreader_read( struct fins_eventreader_tp *reader, struct fins_event_tp *event, size_t max_events, size_t *num_events );
+ *
+ * The function finslib_eventreader_read() copies the events from the position
+ * of a reader up to the newest event, but at most max_events, and advances
+ * the position. The function never waits and returns with no events when the
+ * reader is up to date. When the writer has overwritten events which were
+ * not yet read, the events before the gap are returned, the position moves
+ * to the oldest retained event and FINS_RETVAL_EVENTS_LOST is returned.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_eventreader_read( struct fins_eventreader_tp *reader, struct fins_event_tp *event, size_t max_events, size_t *num_events ) {
+
+	const struct eventlog_header_tp *hdr;
+	const struct eventlog_slot_tp *slot;
+	uint64_t guard;
+	uint64_t head;
+	uint64_t oldest;
+	size_t num;
+
+	if ( num_events != NULL ) *num_events = 0;
+
+	if ( reader == NULL                         ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( event  == NULL  ||  num_events == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	hdr  = reader->map;
+	slot = (const void *) ( (const char *) reader->map + sizeof(struct eventlog_header_tp) );
+	head = LOG_LOAD( & hdr->head );
+	num  = 0;
+
+	while ( num < max_events  &&  reader->next < head ) {
+
+		if ( LOG_LOAD( & slot[reader->next & reader->mask].guard ) == reader->next ) {
+
+			event[num] = slot[reader->next & reader->mask].event;
+
+			LOG_FENCE();
+
+			if ( LOG_LOAD( & slot[reader->next & reader->mask].guard ) == reader->next ) {
+
+				reader->next++;
+				num++;
+
+				continue;
+			}
+		}
+
+		guard  = LOG_LOAD( & slot[reader->next & reader->mask].guard );
+		head   = LOG_LOAD( & hdr->head );
+
+		if ( guard >= head ) head = guard + 1;
+
+		oldest = ( head > reader->mask + 1 ) ? head - reader->mask - 1 : 1;
+
+		if ( oldest <= reader->next ) oldest = reader->next + 1;
+
+		reader->lost += oldest - reader->next;
+		reader->next  = oldest;
+		*num_events   = num;
+
+		return FINS_RETVAL_EVENTS_LOST;
+	}
+
+	*num_events = num;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_eventreader_read */
+
+/*
+ * static bool changed( struct fins_eventlog_tp *log, const struct fins_result_tp *result );
+ *
+ * The function changed() returns true if the value or status of a result
+ * differs from the last result of the same tag which was passed to the log,
+ * and remembers the new result. Values are compared bitwise, so that a NaN
+ * which stays a NaN is not a change. A tag which was never seen before is a
+ * change. If the table cannot grow, every result counts as a change.
+ */
+
+static bool changed( struct fins_eventlog_tp *log, const struct fins_result_tp *result ) {
+
+	struct fins_eventlast_tp *last;
+	size_t a;
+
+	if ( 2 * ( log->num_last + 1 ) > log->max_last  &&  ! grow_last( log ) ) return true;
+
+	a = ( result->tag_id * 2654435761u ) & ( log->max_last - 1 );
+
+	while ( log->last[a].used  &&  log->last[a].tag_id != result->tag_id ) a = ( a + 1 ) & ( log->max_last - 1 );
+
+	last = & log->last[a];
+
+	if ( last->used  &&  last->status == result->status  &&  memcmp( & last->value, & result->value, sizeof(double) ) == 0 ) return false;
+
+	if ( ! last->used ) log->num_last++;
+
+	last->used   = true;
+	last->tag_id = result->tag_id;
+	last->status = result->status;
+	last->value  = result->value;
+
+	return true;
+
+}  /* changed */
+
+/*
+ * static bool grow_last( struct fins_eventlog_tp *log );
+ *
+ * The function grow_last() doubles the size of the hash table with the last
+ * logged result per tag, or creates it with a minimum size. The function
+ * returns false if no memory could be allocated.
+ */
+
+static bool grow_last( struct fins_eventlog_tp *log ) {
+
+	struct fins_eventlast_tp *old;
+	size_t old_max;
+	size_t a;
+	size_t b;
+
+	old     = log->last;
+	old_max = log->max_last;
+
+	log->max_last = ( old_max > 0 ) ? 2 * old_max : EVENTLOG_MIN_LAST;
+	log->last     = calloc( log->max_last, sizeof(struct fins_eventlast_tp) );
+
+	if ( log->last == NULL ) {
+
+		log->last     = old;
+		log->max_last = old_max;
+
+		return false;
+	}
+
+	for (a=0; a<old_max; a++) {
+
+		if ( ! old[a].used ) continue;
+
+		b = ( old[a].tag_id * 2654435761u ) & ( log->max_last - 1 );
+
+		while ( log->last[b].used ) b = ( b + 1 ) & ( log->max_last - 1 );
+
+		log->last[b] = old[a];
+	}
+
+	free( old );
+
+	return true;
+
+}  /* grow_last */
+
+/*
+ * static int map_log( const char *name, size_t capacity, bool writer, void **map, size_t *map_size, void *mapping );
+ *
+ * The function map_log() maps the shared memory object of a change event
+ * log. A writer creates the object with room for capacity events if it does
+ * not exist yet. A reader maps an existing object read only with its current
+ * size. On Windows the handle of the file mapping is stored in the variable
+ * pointed to by mapping.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int map_log( const char *name, size_t capacity, bool writer, void **map, size_t *map_size, void *mapping ) {
+
+	size_t size;
+#if defined(_WIN32)
+	HANDLE handle;
+	MEMORY_BASIC_INFORMATION info;
+#else  /* defined(_WIN32) */
+	struct stat st;
+	void *ptr;
+	int fd;
+	int retval;
+#endif  /* defined(_WIN32) */
+
+	size = sizeof(struct eventlog_header_tp) + capacity * sizeof(struct eventlog_slot_tp);
+
+#if defined(_WIN32)
+	if ( writer ) handle = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD) ( (uint64_t) size >> 32 ), (DWORD) size, name+1 );
+	else          handle = OpenFileMappingA( FILE_MAP_READ, FALSE, name+1 );
+
+	if ( handle == NULL ) return FINS_RETVAL_LOCAL_FILE_ERROR;
+
+	*map = MapViewOfFile( handle, ( writer ) ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0 );
+
+	if ( *map == NULL  ||  VirtualQuery( *map, & info, sizeof(info) ) == 0 ) {
+
+		if ( *map != NULL ) UnmapViewOfFile( *map );
+		CloseHandle( handle );
+
+		*map = NULL;
+
+		return FINS_RETVAL_LOCAL_FILE_ERROR;
+	}
+
+	*map_size            = (size_t) info.RegionSize;
+	*(HANDLE *) mapping  = handle;
+
+	if ( writer  &&  *map_size < size ) return FINS_RETVAL_INVALID_LAYOUT;
+
+	return FINS_RETVAL_SUCCESS;
+#else  /* defined(_WIN32) */
+	(void) mapping;
+
+	retval = FINS_RETVAL_SUCCESS;
+	fd     = shm_open( name, ( writer ) ? O_RDWR | O_CREAT : O_RDONLY, 0644 );
+
+	if ( fd < 0 ) return FINS_RETVAL_LOCAL_FILE_ERROR;
+
+	if ( fstat( fd, & st ) != 0 ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+
+	else if ( writer ) {
+
+		if      ( st.st_size == 0                                    ) { if ( ftruncate( fd, (off_t) size ) != 0 ) retval = FINS_RETVAL_LOCAL_FILE_ERROR; }
+		else if ( st.st_size != (off_t) size                         ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	}
+
+	else if ( st.st_size < (off_t) sizeof(struct eventlog_header_tp) ) retval = FINS_RETVAL_INVALID_LAYOUT;
+
+	else size = (size_t) st.st_size;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		ptr = mmap( NULL, size, ( writer ) ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+
+		if ( ptr == MAP_FAILED ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+
+		else {
+			*map      = ptr;
+			*map_size = size;
+		}
+	}
+
+	close( fd );
+
+	return retval;
+#endif  /* defined(_WIN32) */
+
+}  /* map_log */
+
+/*
+ * static void unmap_log( void *map, size_t map_size, void *mapping );
+ *
+ * The function unmap_log() unmaps the shared memory of a change event log.
+ * On Windows the file mapping handle is closed as well.
+ */
+
+static void unmap_log( void *map, size_t map_size, void *mapping ) {
+
+#if defined(_WIN32)
+	(void) map_size;
+
+	if ( map                        != NULL ) UnmapViewOfFile( map );
+	if ( mapping != NULL  &&  *(HANDLE *) mapping != NULL ) CloseHandle( *(HANDLE *) mapping );
+#else  /* defined(_WIN32) */
+	(void) mapping;
+
+	if ( map != NULL ) munmap( map, map_size );
+#endif  /* defined(_WIN32) */
+
+}  /* unmap_log */
@@ -0,0 +1,340 @@
+/*
+ * Library: libfins
+ * File:    src/fins_gated.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_gated.c contains routines to keep a local copy of
+ * large memory blocks in a remote PLC up to date. Each block is paired with a
+ * version word which the PLC program changes whenever the block is updated.
+ * Only blocks with a changed version word are read again.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "fins.h"
+
+#define GATED_VERSIONS_PER_FRAME	24
+
+static int		read_versions( struct fins_gated_tp *gated, size_t first, size_t num );
+static int		read_block( struct fins_gated_tp *gated, struct fins_gatedlink_tp *link );
+
+/*
+ * struct fins_gated_tp *finslib_gated_create( struct fins_sys_tp *sys, const struct fins_gatedblock_tp *block, size_t num_block, int *error_val );
+ *
+ * The function finslib_gated_create() creates a poller which keeps a local
+ * copy of a list of memory blocks in a remote PLC. Each block has a version
+ * word which may be a change counter or a checksum maintained by the PLC
+ * program. All addresses are resolved once when the poller is created. On
+ * success a pointer to the poller is returned. Otherwise the return value is
+ * NULL and the reason is stored in the variable pointed to by error_val.
+ */
+
+struct fins_gated_tp *finslib_gated_create( struct fins_sys_tp *sys, const struct fins_gatedblock_tp *block, size_t num_block, int *error_val ) {
+
+	size_t a;
+	struct fins_gated_tp *gated;
+	struct fins_gatedlink_tp *link;
+	struct fins_address_tp address;
+	const struct fins_area_tp *area_ptr;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	gated  = NULL;
+
+	if      ( sys   == NULL                     ) retval = FINS_RETVAL_NOT_INITIALIZED;
+	else if ( block == NULL  ||  num_block == 0 ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+	else if ( ( gated = calloc( 1, sizeof(struct fins_gated_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	else if ( ( gated->link = calloc( num_block, sizeof(struct fins_gatedlink_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( gated != NULL ) gated->sys = sys;
+
+	for (a=0; retval == FINS_RETVAL_SUCCESS  &&  a<num_block; a++) {
+
+		link        = & gated->link[a];
+		link->block = block[a];
+
+		gated->num_link++;
+
+		link->block.address[sizeof(link->block.address)-1] = 0;
+		link->block.version[sizeof(link->block.version)-1] = 0;
+
+		if ( link->block.num_words == 0                                  ) { retval = FINS_RETVAL_NO_DATA_BLOCK;         break; }
+		if ( XX_finslib_decode_address( link->block.address, & address ) ) { retval = FINS_RETVAL_INVALID_READ_ADDRESS; break; }
+
+		area_ptr = XX_finslib_search_area( sys, & address, 16, FI_RD, false );
+		if ( area_ptr == NULL ) { retval = FINS_RETVAL_INVALID_READ_AREA; break; }
+
+		link->area   = area_ptr->area;
+		link->start  = address.main_address;
+		link->start += area_ptr->low_addr >> 8;
+		link->start -= area_ptr->low_id;
+
+		if ( XX_finslib_decode_address( link->block.version, & address ) ) { retval = FINS_RETVAL_INVALID_READ_ADDRESS; break; }
+
+		area_ptr = XX_finslib_search_area( sys, & address, 16, FI_MRD, false );
+		if ( area_ptr == NULL ) { retval = FINS_RETVAL_INVALID_READ_AREA; break; }
+
+		link->version_area   = area_ptr->area;
+		link->version_start  = address.main_address;
+		link->version_start += area_ptr->low_addr >> 8;
+		link->version_start -= area_ptr->low_id;
+
+		link->data       = malloc( link->block.num_words * sizeof(uint16_t) );
+		link->data_valid = false;
+		link->changed    = false;
+
+		if ( link->data == NULL ) { retval = FINS_RETVAL_OUT_OF_MEMORY; break; }
+	}
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_gated_free( gated );
+		return NULL;
+	}
+
+	return gated;
+
+}  /* finslib_gated_create */
+
+/*
+ * void finslib_gated_free( struct fins_gated_tp *gated );
+ *
+ * The function finslib_gated_free() releases all memory associated with a
+ * version gated poller. The connection with the PLC is not closed.
+ */
+
+void finslib_gated_free( struct fins_gated_tp *gated ) {
+
+	size_t a;
+
+	if ( gated == NULL ) return;
+
+	if ( gated->link != NULL ) {
+
+		for (a=0; a<gated->num_link; a++) free( gated->link[a].data );
+
+		free( gated->link );
+	}
+
+	free( gated );
+
+}  /* finslib_gated_free */
+
+/*
+ * int finslib_gated_invalidate( struct fins_gated_tp *gated );
+ *
+ * The function finslib_gated_invalidate() marks the local copies of all
+ * blocks as invalid. All blocks are read again during the next poll,
+ * regardless of their version words.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_gated_invalidate( struct fins_gated_tp *gated ) {
+
+	size_t a;
+
+	if ( gated == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	for (a=0; a<gated->num_link; a++) gated->link[a].data_valid = false;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_gated_invalidate */
+
+/*
+ * int finslib_gated_poll( struct fins_gated_tp *gated, size_t *num_changed );
+ *
+ * The function finslib_gated_poll() reads the version words of all blocks
+ * with as few multiple memory area read frames as possible. Only the blocks
+ * of which the version word differs from the value seen when the block was
+ * last read are read again, with as few frames as possible. The changed flag
+ * of each block tells if the block was read during this poll. Because the
+ * version word is read before the block, an update which happens while the
+ * block is being read shows up as a new version during the next poll.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_gated_poll( struct fins_gated_tp *gated, size_t *num_changed ) {
+
+	size_t a;
+	size_t chunk_length;
+	size_t changed;
+	struct fins_gatedlink_tp *link;
+	int retval;
+
+	changed = 0;
+
+	if ( num_changed != NULL ) *num_changed = 0;
+
+	if ( gated              == NULL           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( gated->sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	for (a=0; a<gated->num_link; a++) gated->link[a].changed = false;
+
+	for (a=0; a<gated->num_link; a+=chunk_length) {
+
+		chunk_length = GATED_VERSIONS_PER_FRAME;
+		if ( chunk_length > gated->num_link - a ) chunk_length = gated->num_link - a;
+
+		if ( ( retval = read_versions( gated, a, chunk_length ) ) != FINS_RETVAL_SUCCESS ) return retval;
+	}
+
+	retval = FINS_RETVAL_SUCCESS;
+
+	for (a=0; a<gated->num_link; a++) {
+
+		link = & gated->link[a];
+
+		if ( link->data_valid  &&  link->version == link->next_version ) { gated->blocks_skipped++; continue; }
+
+		link->data_valid = false;
+
+		if ( ( retval = read_block( gated, link ) ) != FINS_RETVAL_SUCCESS ) break;
+
+		link->version    = link->next_version;
+		link->data_valid = true;
+		link->changed    = true;
+		changed++;
+	}
+
+	if ( num_changed != NULL ) *num_changed = changed;
+
+	return retval;
+
+}  /* finslib_gated_poll */
+
+/*
+ * static int read_versions( struct fins_gated_tp *gated, size_t first, size_t num );
+ *
+ * The function read_versions() reads the version words of a number of
+ * consecutive blocks with one multiple memory area read command. The values
+ * are stored in the next_version field of the blocks.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int read_versions( struct fins_gated_tp *gated, size_t first, size_t num ) {
+
+	size_t a;
+	size_t bodylen;
+	size_t pos;
+	struct fins_gatedlink_tp *link;
+	struct fins_command_tp fins_cmnd;
+	int retval;
+
+	XX_finslib_init_command( gated->sys, & fins_cmnd, 0x01, 0x04 );
+
+	bodylen = 0;
+
+	for (a=0; a<num; a++) {
+
+		link = & gated->link[first+a];
+
+		fins_cmnd.body[bodylen++] = link->version_area;
+		fins_cmnd.body[bodylen++] = (link->version_start >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (link->version_start     ) & 0xff;
+		fins_cmnd.body[bodylen++] = 0x00;
+	}
+
+	if ( ( retval = XX_finslib_communicate( gated->sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	gated->frames_read++;
+
+	if ( bodylen != 2+3*num ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+	pos = 2;
+
+	for (a=0; a<num; a++) {
+
+		gated->link[first+a].next_version = ( fins_cmnd.body[pos+1] << 8 ) | fins_cmnd.body[pos+2];
+		pos += 3;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* read_versions */
+
+/*
+ * static int read_block( struct fins_gated_tp *gated, struct fins_gatedlink_tp *link );
+ *
+ * The function read_block() reads the contents of one block from the PLC in
+ * frames of the maximum size and stores it in the local copy.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int read_block( struct fins_gated_tp *gated, struct fins_gatedlink_tp *link ) {
+
+	size_t a;
+	size_t chunk_length;
+	size_t offset;
+	size_t todo;
+	size_t bodylen;
+	uint32_t chunk_start;
+	struct fins_command_tp fins_cmnd;
+	int retval;
+
+	offset = 0;
+	todo   = link->block.num_words;
+
+	do {
+		chunk_length = FINS_MAX_READ_WORDS_SYSWAY;
+		if ( chunk_length > todo ) chunk_length = todo;
+
+		chunk_start = link->start + offset;
+
+		XX_finslib_init_command( gated->sys, & fins_cmnd, 0x01, 0x01 );
+
+		bodylen = 0;
+
+		fins_cmnd.body[bodylen++] = link->area;
+		fins_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+		fins_cmnd.body[bodylen++] = 0x00;
+		fins_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+		if ( ( retval = XX_finslib_communicate( gated->sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		gated->frames_read++;
+
+		if ( bodylen != 2+2*chunk_length ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+		for (a=0; a<chunk_length; a++) link->data[offset+a] = ( fins_cmnd.body[2+2*a] << 8 ) | fins_cmnd.body[3+2*a];
+
+		todo   -= chunk_length;
+		offset += chunk_length;
+
+	} while ( todo > 0 );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* read_block */
@@ -57,6 +57,7 @@
 #define BUFLEN		1024
 #define SEND_TIMEOUT	10
 #define RECV_TIMEOUT	10
+#define PIPELINE_WINDOW	8		/* Max number of commands in flight in XX_finslib_pipeline() */
 
 #if defined(_WIN32)
 typedef const char	send_tp;
@@ -113,6 +114,18 @@ static void init_system( struct fins_sys_tp *sys, int error_max ) {
 	sys->error_max     = error_max;
 	sys->last_error    = FINS_RETVAL_SUCCESS;
 	sys->error_changed = false;
+	sys->error_probe   = false;
+
+	sys->busy_poll_usec      = 0;
+	sys->busy_poll_hits      = 0;
+	sys->busy_poll_sleeps    = 0;
+	sys->busy_poll_spin_usec = 0;
+
+	memset( & sys->latency, 0, sizeof(sys->latency) );
+	memset( & sys->stats,   0, sizeof(sys->stats)   );
+
+	sys->segment       = NULL;
+	sys->traffic_class = FINS_TRAFFIC_CONTROL;
 
 }  /* init_system */
 
@@ -238,6 +251,9 @@ struct fins_sys_tp *finslib_tcp_connect( struct fins_sys_tp *sys, const char *ad
 
 	if ( connect( sys->sockfd, (struct sockaddr *) &cs_addr, sizeof(cs_addr) ) < 0 ) return fins_close_socket_with_error( sys, error_val );
 
+	if ( sys->busy_poll_usec != 0                  ) XX_finslib_busy_poll_apply( sys );
+	if ( sys->latency.mode   != FINS_TIMESTAMP_OFF ) XX_finslib_timestamp_apply(  sys );
+
 						/****************************************/
 						/*					*/
 	fins_tcp_header[0]  = 'F';		/* Header				*/
@@ -327,6 +343,8 @@ struct fins_sys_tp *finslib_tcp_connect( struct fins_sys_tp *sys, const char *ad
 
 	if ( error_val != NULL ) *error_val = sys->last_error;
 
+	sys->stats.connects++;
+
 	return sys;
 
 }  /* finslib_tcp_connect */
@@ -390,6 +408,11 @@ struct fins_sys_tp *finslib_udp_connect( struct fins_sys_tp *sys, const char *ad
 
 	if ( bind( sys->sockfd, (struct sockaddr *) &ws_addr, sizeof(ws_addr) ) < 0 ) return fins_close_socket_with_error( sys, error_val );
 
+	if ( sys->busy_poll_usec != 0                  ) XX_finslib_busy_poll_apply( sys );
+	if ( sys->latency.mode   != FINS_TIMESTAMP_OFF ) XX_finslib_timestamp_apply(  sys );
+
+	sys->stats.connects++;
+
 	return sys;
 
 }  /* finslib_udp_connect */
@@ -406,6 +429,7 @@ void finslib_disconnect( struct fins_sys_tp *sys ) {
 
 	if ( sys == NULL ) return;
 
+	finslib_segment_leave( sys );
 	fins_close_socket( sys );
 	free( sys );
 
@@ -478,10 +502,13 @@ static struct fins_sys_tp *fins_close_socket( struct fins_sys_tp *sys ) {
 		closesocket( sys->sockfd );
 	}
 
-	sys->error_count = 0;
-	sys->comm_type   = FINS_COMM_TYPE_UNKNOWN;
-	sys->sockfd      = INVALID_SOCKET;
-	sys->timeout     = finslib_monotonic_sec_timer();
+	memset( sys->stats.send_usec, 0, sizeof(sys->stats.send_usec) );
+
+	sys->stats.in_flight = 0;
+	sys->error_count     = 0;
+	sys->comm_type       = FINS_COMM_TYPE_UNKNOWN;
+	sys->sockfd          = INVALID_SOCKET;
+	sys->timeout         = finslib_monotonic_sec_timer();
 
 	return sys;
 
@@ -507,7 +534,7 @@ static int fins_tcp_recv( struct fins_sys_tp *sys, unsigned char *buf, int len )
 
 	for (;;) {
 
-		recv_len = recv( sys->sockfd, buf, len, 0 );
+		recv_len = XX_finslib_busy_recv( sys, buf, len, NULL, NULL );
 
 		if ( recv_len > 0 ) {
 
@@ -588,13 +615,18 @@ static int fins_send_tcp_header( struct fins_sys_tp *sys, size_t bodylen ) {
  * reset to 0. Otherwise if the counter reached the maximum error counts, the
  * counter is reset and the connection is closed. In that case the function
  * returns the maximum error count error. Otherwise the error indicated as the
- * parameter.
+ * parameter. The command statistics of the connection are updated as well.
+ * End codes returned by the PLC while the error_probe flag is set do not
+ * count, because the PLC answered and the command was only sent to find out
+ * which part of a request it rejects.
  */
 
 static int check_error_count( struct fins_sys_tp *sys, int error_code ) {
 
 	if ( sys == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
 
+	if ( error_code != FINS_RETVAL_SUCCESS  &&  error_code != FINS_RETVAL_SUCCESS_LAST_DATA ) sys->stats.errors++;
+
 	if ( sys->sockfd    == INVALID_SOCKET                ||
 	     sys->error_max <  0                             ||
 	     error_code     == FINS_RETVAL_SUCCESS           ||
@@ -607,6 +639,14 @@ static int check_error_count( struct fins_sys_tp *sys, int error_code ) {
 		return error_code;
 	}
 
+	if ( sys->error_probe  &&  error_code > FINS_RETVAL_SUCCESS  &&  error_code < 0x8000 ) {
+
+		sys->error_changed = ( error_code != sys->last_error );
+		sys->last_error    =   error_code;
+
+		return error_code;
+	}
+
 	sys->error_count++;
 
 	if ( sys->error_count > sys->error_max ) error_code = FINS_RETVAL_MAX_ERROR_COUNT;
@@ -823,21 +863,17 @@ static int fins_recv_tcp_command( struct fins_sys_tp *sys, int total_len, struct
  * The function XX_finslib_communicate() is the function used by outside
  * routines to perform the actual communication with a FINS server. The
  * function both sends the command and receives the response and hides all the
- * details of the low level communication for the calling routine.
+ * details of the low level communication for the calling routine. If no
+ * response is waited for, the command structure must be kept intact until the
+ * response is later collected with XX_finslib_receive().
  *
  * The function returns a success or error code from the list FINS_RETVAL_...
  */
 
 int XX_finslib_communicate( struct fins_sys_tp *sys, struct fins_command_tp *command, size_t *bodylen, bool wait_response ) {
 
-	int a;
-	int recvlen;
 	int retval;
 	int error_val;
-	socklen_t addrlen;
-	uint16_t endcode;
-	unsigned char sent_header[FINS_HEADER_LEN];
-	unsigned char waste_buffer[BUFLEN];
 	struct sockaddr_in cs_addr;
 
 	if ( sys         == NULL           ) return check_error_count( sys, FINS_RETVAL_NOT_INITIALIZED   );
@@ -847,23 +883,14 @@ int XX_finslib_communicate( struct fins_sys_tp *sys, struct fins_command_tp *com
 
 	error_val = FINS_RETVAL_SUCCESS;
 
-	for (a=0; a<FINS_HEADER_LEN; a++) sent_header[a] = command->header[a];
-
+	if ( sys->segment != NULL ) XX_finslib_segment_request( sys, command, *bodylen );
 
+	XX_finslib_timestamp_send( sys, command->header[FINS_SID] );
 
 	if ( sys->comm_type == FINS_COMM_TYPE_TCP ) {
 
 		if ( ( retval = fins_send_tcp_header(  sys, *bodylen          ) ) != FINS_RETVAL_SUCCESS ) return check_error_count( sys, retval );
 		if ( ( retval = fins_send_tcp_command( sys, *bodylen, command ) ) != FINS_RETVAL_SUCCESS ) return check_error_count( sys, retval );
-
-		if ( ! wait_response ) return FINS_RETVAL_SUCCESS;
-
-		recvlen = fins_recv_tcp_header( sys, & error_val );
-
-		if ( recvlen <  0 ) return check_error_count( sys, error_val                  );
-		if ( recvlen == 0 ) return check_error_count( sys, FINS_RETVAL_BODY_TOO_SHORT );
-
-		if ( ( retval = fins_recv_tcp_command( sys, recvlen, command ) ) != FINS_RETVAL_SUCCESS ) return check_error_count( sys, retval );
 	}
 
 	else if ( sys->comm_type == FINS_COMM_TYPE_UDP ) {
@@ -895,11 +922,72 @@ int XX_finslib_communicate( struct fins_sys_tp *sys, struct fins_command_tp *com
 		}
 
 		if ( ( retval = fins_send_udp_command( sys, *bodylen, command, & cs_addr ) ) != FINS_RETVAL_SUCCESS ) return check_error_count( sys, retval );
+	}
+
+	else return check_error_count( sys, FINS_RETVAL_NOT_INITIALIZED );
+
+	sys->stats.requests++;
+	sys->stats.in_flight++;
+	sys->stats.send_usec[ command->header[FINS_SID] % FINS_STATS_SENT ] = finslib_monotonic_usec_timer();
+
+	if ( ! wait_response ) return FINS_RETVAL_SUCCESS;
+
+	return XX_finslib_receive( sys, command, bodylen );
+
+}  /* XX_finslib_communicate */
+
+/*
+ * int XX_finslib_receive( fins_sys_tp *sys, fins_command_tp *command, size_t *bodylen );
+ *
+ * The function XX_finslib_receive() collects the response to a command which
+ * was previously sent with XX_finslib_communicate() without waiting for the
+ * response. The header of the sent command must still be present in the
+ * command structure because it is used to check that the response belongs to
+ * the command. Splitting sending and receiving makes it possible to have
+ * commands outstanding on multiple connections at the same time.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int XX_finslib_receive( struct fins_sys_tp *sys, struct fins_command_tp *command, size_t *bodylen ) {
+
+	int a;
+	int recvlen;
+	int retval;
+	int error_val;
+	socklen_t addrlen;
+	uint16_t endcode;
+	unsigned char sent_header[FINS_HEADER_LEN];
+	unsigned char waste_buffer[BUFLEN];
+	struct sockaddr_in cs_addr;
 
-		if ( ! wait_response ) return FINS_RETVAL_SUCCESS;
+	if ( sys         == NULL           ) return check_error_count( sys, FINS_RETVAL_NOT_INITIALIZED   );
+	if ( command     == NULL           ) return check_error_count( sys, FINS_RETVAL_NO_COMMAND        );
+	if ( bodylen     == NULL           ) return check_error_count( sys, FINS_RETVAL_NO_COMMAND_LENGTH );
+	if ( sys->sockfd == INVALID_SOCKET ) return check_error_count( sys, FINS_RETVAL_NOT_CONNECTED     );
+
+	if ( sys->stats.in_flight > 0 ) sys->stats.in_flight--;
+
+	error_val = FINS_RETVAL_SUCCESS;
+
+	for (a=0; a<FINS_HEADER_LEN; a++) sent_header[a] = command->header[a];
+
+
+
+	if ( sys->comm_type == FINS_COMM_TYPE_TCP ) {
+
+		recvlen = fins_recv_tcp_header( sys, & error_val );
+
+		if ( recvlen <  0 ) return check_error_count( sys, error_val                  );
+		if ( recvlen == 0 ) return check_error_count( sys, FINS_RETVAL_BODY_TOO_SHORT );
+
+		if ( ( retval = fins_recv_tcp_command( sys, recvlen, command ) ) != FINS_RETVAL_SUCCESS ) return check_error_count( sys, retval );
+	}
+
+	else if ( sys->comm_type == FINS_COMM_TYPE_UDP ) {
 
 		addrlen = sizeof( cs_addr );
-		recvlen = recvfrom( sys->sockfd, command->header, MAX_MSG, 0, (struct sockaddr *) & cs_addr, &addrlen );
+		recvlen = XX_finslib_busy_recv( sys, command->header, MAX_MSG, (struct sockaddr *) & cs_addr, &addrlen );
 
 		if ( recvlen < 0               ) return check_error_count( sys, FINS_RETVAL_ERRNO_BASE + errno );
 		if ( recvlen < FINS_HEADER_LEN ) return check_error_count( sys, FINS_RETVAL_BODY_TOO_SHORT     );
@@ -907,6 +995,8 @@ int XX_finslib_communicate( struct fins_sys_tp *sys, struct fins_command_tp *com
 
 	else return check_error_count( sys, FINS_RETVAL_NOT_INITIALIZED );
 
+	XX_finslib_timestamp_done( sys, command->header[FINS_SID] );
+
 
 
 	if ( command->header[FINS_ICF]  !=  (sent_header[FINS_ICF] | 0x40)  ||
@@ -926,6 +1016,10 @@ int XX_finslib_communicate( struct fins_sys_tp *sys, struct fins_command_tp *com
 		return check_error_count( sys, FINS_RETVAL_SYNC_ERROR );
 	}
 
+	XX_finslib_stats_response( sys, command->header[FINS_SID] );
+
+	if ( sys->segment != NULL ) XX_finslib_segment_response( sys, (size_t) recvlen );
+
 	recvlen -= FINS_HEADER_LEN;
 	*bodylen = recvlen;
 
@@ -937,7 +1031,92 @@ int XX_finslib_communicate( struct fins_sys_tp *sys, struct fins_command_tp *com
 
 	return check_error_count( sys, endcode );
 
-}  /* XX_finslib_communicate */
+}  /* XX_finslib_receive */
+
+/*
+ * int XX_finslib_pipeline( struct fins_sys_tp *sys, size_t first, size_t last, size_t window, int (*prepare)( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen ), int (*complete)( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval ), void *context, size_t *failed );
+ *
+ * The function XX_finslib_pipeline() sends the frames first up to but not
+ * including last to a PLC with up to window commands outstanding at the same
+ * time. The function prepare() builds the command of a frame. The function
+ * complete() is called for each frame in order with the response or with the
+ * error of the send or receive, and returns the final result of the frame.
+ * No new frames are sent after the first error, but the responses of the
+ * frames already in flight are still collected. The index of the first
+ * failed frame, or last if all frames succeeded, is stored in failed.
+ *
+ * The function returns the result of the first failed frame, or a success
+ * code from the list FINS_RETVAL_... if all frames succeeded.
+ */
+
+int XX_finslib_pipeline( struct fins_sys_tp *sys, size_t first, size_t last, size_t window, int (*prepare)( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen ), int (*complete)( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval ), void *context, size_t *failed ) {
+
+	struct fins_command_tp fins_cmnd[PIPELINE_WINDOW];
+	size_t frame[PIPELINE_WINDOW];
+	size_t next;
+	size_t head;
+	size_t tail;
+	size_t slot;
+	size_t bodylen;
+	int retval;
+	int first_error;
+	bool sending;
+
+	if ( window == 0               ) window = 1;
+	if ( window >  PIPELINE_WINDOW ) window = PIPELINE_WINDOW;
+
+	*failed     = last;
+	first_error = FINS_RETVAL_SUCCESS;
+	sending     = true;
+	next        = first;
+	head        = 0;
+	tail        = 0;
+
+	do {
+		while ( sending  &&  next < last  &&  head - tail < window ) {
+
+			slot    = head % window;
+			bodylen = 0;
+			retval  = prepare( context, next, & fins_cmnd[slot], & bodylen );
+
+			if ( retval == FINS_RETVAL_SUCCESS ) retval = XX_finslib_communicate( sys, & fins_cmnd[slot], & bodylen, false );
+
+			if ( retval != FINS_RETVAL_SUCCESS ) {
+
+				retval  = complete( context, next, & fins_cmnd[slot], 0, retval );
+				sending = false;
+
+				if ( next < *failed ) { *failed = next; first_error = retval; }
+
+				break;
+			}
+
+			frame[slot] = next;
+			head++;
+			next++;
+		}
+
+		if ( tail == head ) break;
+
+		slot    = tail % window;
+		bodylen = 0;
+		retval  = XX_finslib_receive( sys, & fins_cmnd[slot], & bodylen );
+		retval  = complete( context, frame[slot], & fins_cmnd[slot], bodylen, retval );
+
+		tail++;
+
+		if ( retval != FINS_RETVAL_SUCCESS ) {
+
+			sending = false;
+
+			if ( frame[slot] < *failed ) { *failed = frame[slot]; first_error = retval; }
+		}
+
+	} while ( tail < head  ||  ( sending  &&  next < last ) );
+
+	return first_error;
+
+}  /* XX_finslib_pipeline */
 
 /*
  * int XX_finslib_wsa_errorcode_to_fins_retval( int errorcode );
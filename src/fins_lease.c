@@ -0,0 +1,338 @@
+/*
+ * Library: libfins
+ * File:    src/fins_lease.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_lease.c contains routines to hold the access
+ * right of a remote PLC during a whole batch of privileged commands. The
+ * commands in a batch are pipelined to hide the network round trip time.
+ */
+
+#include <string.h>
+#include "fins.h"
+
+#define LEASE_RETRY_MSEC	100
+
+struct batch_tp {
+	struct fins_sys_tp *	sys;
+	struct fins_leaseop_tp *op;
+};
+
+static int		complete_op( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval );
+static bool		must_resend( const struct fins_leaseop_tp *op );
+static int		prepare_op( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen );
+static int		run_batch( struct fins_lease_tp *lease, struct fins_leaseop_tp *op, size_t first, size_t last, size_t *failed );
+
+/*
+ * int finslib_lease_init( struct fins_lease_tp *lease, struct fins_sys_tp *sys, int policy, int timeout );
+ *
+ * The function finslib_lease_init() prepares a lease for a connection. The
+ * lease does not hold the access right yet. The policy and timeout are used
+ * when finslib_lease_run() has to acquire the right. A lease must be
+ * initialized once before it is used by the other lease functions.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_lease_init( struct fins_lease_tp *lease, struct fins_sys_tp *sys, int policy, int timeout ) {
+
+	if ( lease == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	memset( lease, 0, sizeof(struct fins_lease_tp) );
+
+	lease->sys     = sys;
+	lease->policy  = policy;
+	lease->timeout = timeout;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_lease_init */
+
+/*
+ * int finslib_lease_acquire( struct fins_sys_tp *sys, struct fins_lease_tp *lease, int policy, int timeout );
+ *
+ * The function finslib_lease_acquire() acquires the access right of the
+ * remote PLC for a lease which was prepared with finslib_lease_init(). The
+ * policy and timeout are stored in the lease for later renewals by
+ * finslib_lease_run(). If another node holds the right, the
+ * function retries until timeout seconds have passed. The policy flags
+ * determine when the right may be taken by force. With the flag
+ * FINS_LEASE_FORCE_OWN_NODE the right is forced immediately when it is held
+ * by a node with the same address as our own, which is typically a left over
+ * of a process which died while holding the right. With the flag
+ * FINS_LEASE_FORCE_ON_TIMEOUT the right is forced when the timeout expires.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_lease_acquire( struct fins_sys_tp *sys, struct fins_lease_tp *lease, int policy, int timeout ) {
+
+	time_t start_time;
+	bool own_node;
+	bool expired;
+	int retval;
+
+	if ( sys         == NULL           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( lease       == NULL           ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	if ( lease->sys != sys ) {
+
+		lease->sys  = sys;
+		lease->held = false;
+	}
+
+	lease->policy  = policy;
+	lease->timeout = timeout;
+
+	if ( lease->held ) return FINS_RETVAL_SUCCESS;
+
+	start_time = finslib_monotonic_sec_timer();
+
+	do {
+		retval = finslib_access_right_acquire( sys, & lease->holder );
+
+		if ( retval == FINS_RETVAL_SUCCESS ) {
+
+			lease->held = true;
+
+			return FINS_RETVAL_SUCCESS;
+		}
+
+		if ( retval != FINS_RETVAL_ACCESS_NO_RIGHTS ) return retval;
+
+		own_node = ( lease->holder.network == sys->local_net  &&  lease->holder.node == sys->local_node );
+		expired  = ( finslib_monotonic_sec_timer() - start_time >= timeout );
+
+		if ( ( own_node  &&  ( policy & FINS_LEASE_FORCE_OWN_NODE   ) )  ||
+		     ( expired   &&  ( policy & FINS_LEASE_FORCE_ON_TIMEOUT ) ) ) {
+
+			if ( ( retval = finslib_access_right_forced_acquire( sys ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+			lease->held = true;
+			lease->num_forced++;
+
+			return FINS_RETVAL_SUCCESS;
+		}
+
+		if ( ! expired ) finslib_milli_second_sleep( LEASE_RETRY_MSEC );
+
+	} while ( ! expired );
+
+	return FINS_RETVAL_ACCESS_NO_RIGHTS;
+
+}  /* finslib_lease_acquire */
+
+/*
+ * int finslib_lease_release( struct fins_lease_tp *lease );
+ *
+ * The function finslib_lease_release() gives the access right of a lease back
+ * to the PLC. The lease can be reused by calling finslib_lease_acquire() or
+ * finslib_lease_run() again.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_lease_release( struct fins_lease_tp *lease ) {
+
+	if ( lease       == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( lease->sys  == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( ! lease->held       ) return FINS_RETVAL_SUCCESS;
+
+	lease->held = false;
+
+	return finslib_access_right_release( lease->sys );
+
+}  /* finslib_lease_release */
+
+/*
+ * int finslib_lease_run( struct fins_lease_tp *lease, struct fins_leaseop_tp *op, size_t num_op );
+ *
+ * The function finslib_lease_run() executes a batch of commands while the
+ * access right of a lease is held. If the lease does not hold the right, it
+ * is acquired first with the policy of the lease. Commands are sent in
+ * order with up to FINS_LEASE_WINDOW commands outstanding at the same time.
+ * No new commands are sent after the first command which fails, but the
+ * results of the commands which were already in flight are collected and
+ * stored in the retval field of each command. When the failure is caused by
+ * another node which took the access right away, the right is acquired again
+ * once and only the commands which were rejected for that reason or never
+ * sent are sent again, in order. Commands which the PLC already executed are
+ * never sent twice. Commands which were never sent have the value
+ * FINS_RETVAL_CANCELED. With the policy flag FINS_LEASE_RELEASE_AFTER_RUN
+ * the right is given back after the batch.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_lease_run( struct fins_lease_tp *lease, struct fins_leaseop_tp *op, size_t num_op ) {
+
+	size_t a;
+	size_t b;
+	size_t failed;
+	int retval;
+	int release_retval;
+
+	if ( lease              == NULL            ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( lease->sys         == NULL            ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( num_op             == 0               ) return FINS_RETVAL_SUCCESS;
+	if ( op                 == NULL            ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( lease->sys->sockfd == INVALID_SOCKET  ) return FINS_RETVAL_NOT_CONNECTED;
+
+	for (a=0; a<num_op; a++) {
+
+		if ( op[a].send_len > 0  &&  op[a].send_buffer == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+		if ( op[a].send_len > FINS_BODY_LEN                    ) return FINS_RETVAL_BODY_TOO_LONG;
+
+		op[a].retval = FINS_RETVAL_CANCELED;
+	}
+
+	if ( ! lease->held  &&  ( retval = finslib_lease_acquire( lease->sys, lease, lease->policy, lease->timeout ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	retval = run_batch( lease, op, 0, num_op, & failed );
+
+	if ( retval == FINS_RETVAL_ACCESS_NO_RIGHTS ) {
+
+		lease->held = false;
+		retval      = finslib_lease_acquire( lease->sys, lease, lease->policy, lease->timeout );
+		a           = failed;
+
+		while ( retval == FINS_RETVAL_SUCCESS  &&  a < num_op ) {
+
+			if ( op[a].retval == FINS_RETVAL_SUCCESS ) a++;
+
+			else if ( must_resend( & op[a] ) ) {
+
+				for (b=a+1; b<num_op  &&  must_resend( & op[b] ); b++) ;
+
+				retval = run_batch( lease, op, a, b, & failed );
+				a      = b;
+			}
+
+			else retval = op[a].retval;
+		}
+	}
+
+	if ( ( lease->policy & FINS_LEASE_RELEASE_AFTER_RUN )  &&  lease->held ) {
+
+		release_retval = finslib_lease_release( lease );
+		if ( retval == FINS_RETVAL_SUCCESS ) retval = release_retval;
+	}
+
+	return retval;
+
+}  /* finslib_lease_run */
+
+/*
+ * static int run_batch( struct fins_lease_tp *lease, struct fins_leaseop_tp *op, size_t first, size_t last, size_t *failed );
+ *
+ * The function run_batch() pipelines the commands of a batch from command
+ * first up to but not including command last. New commands are only sent as long as no error has been
+ * seen. Responses are collected in the order the commands were sent. The
+ * error of the first failed command in batch order is returned and its index
+ * is stored in failed.
+ */
+
+static int run_batch( struct fins_lease_tp *lease, struct fins_leaseop_tp *op, size_t first, size_t last, size_t *failed ) {
+
+	struct batch_tp batch;
+
+	batch.sys = lease->sys;
+	batch.op  = op;
+
+	return XX_finslib_pipeline( lease->sys, first, last, FINS_LEASE_WINDOW, prepare_op, complete_op, & batch, failed );
+
+}  /* run_batch */
+
+/*
+ * static bool must_resend( const struct fins_leaseop_tp *op );
+ *
+ * The function must_resend() returns true if a command of a batch has to be
+ * sent again after the access right was acquired again. This is the case
+ * when the command was never sent or when the PLC rejected it because the
+ * access right was held by another node. Commands with any other result were
+ * executed or failed in the PLC and are never sent twice.
+ */
+
+static bool must_resend( const struct fins_leaseop_tp *op ) {
+
+	return ( op->retval == FINS_RETVAL_CANCELED  ||  op->retval == FINS_RETVAL_ACCESS_NO_RIGHTS );
+
+}  /* must_resend */
+
+/*
+ * static int prepare_op( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen );
+ *
+ * The function prepare_op() builds the command for one operation of a batch.
+ */
+
+static int prepare_op( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen ) {
+
+	struct batch_tp *batch;
+	struct fins_leaseop_tp *op;
+
+	batch = context;
+	op    = & batch->op[frame];
+
+	XX_finslib_init_command( batch->sys, command, (op->command >> 8) & 0xff, op->command & 0xff );
+
+	*bodylen = op->send_len;
+	if ( *bodylen > 0 ) memcpy( command->body, op->send_buffer, *bodylen );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* prepare_op */
+
+/*
+ * static int complete_op( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval );
+ *
+ * The function complete_op() stores the response and the result of one
+ * operation of a batch.
+ */
+
+static int complete_op( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval ) {
+
+	struct batch_tp *batch;
+	struct fins_leaseop_tp *op;
+
+	batch = context;
+	op    = & batch->op[frame];
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  op->recv_buffer != NULL ) {
+
+		if ( bodylen > op->recv_len ) retval = FINS_RETVAL_BODY_TOO_LONG;
+		else {
+			memcpy( op->recv_buffer, command->body, bodylen );
+			op->recv_len = bodylen;
+		}
+	}
+
+	op->retval = retval;
+
+	return retval;
+
+}  /* complete_op */
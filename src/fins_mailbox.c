@@ -0,0 +1,455 @@
+/*
+ * Library: libfins
+ * File:    src/fins_mailbox.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_mailbox.c contains routines to stream fixed size
+ * blocks of data to and from ladder logic through a ring buffer of slots in
+ * a memory area of a remote PLC. The ring buffer is guarded by a head and a
+ * tail index word which are the only handshake between host and PLC.
+ */
+
+#include <stdlib.h>
+#include "fins.h"
+
+#define MAILBOX_HEAD		0
+#define MAILBOX_TAIL		1
+#define MAILBOX_SLOTS		2
+
+static int		mailbox_read( struct fins_mailbox_tp *mailbox, size_t offset, uint16_t *data, size_t num_words );
+static int		mailbox_sync( struct fins_mailbox_tp *mailbox, const uint16_t *index );
+static int		mailbox_write( struct fins_mailbox_tp *mailbox, size_t offset, const uint16_t *data, size_t num_words );
+
+/*
+ * struct fins_mailbox_tp *finslib_mailbox_create( struct fins_sys_tp *sys, const char *start, size_t num_slots, size_t slot_words, int direction, int *error_val );
+ *
+ * The function finslib_mailbox_create() creates a mailbox context for a ring
+ * buffer in the memory of a remote PLC. The ring starts with the head index
+ * word, followed by the tail index word and num_slots slots of slot_words
+ * words each. The producer owns the head word and the consumer owns the tail
+ * word. One slot is always left empty to distinguish a full from an empty
+ * ring. No communication takes place when the mailbox is created. On success
+ * a pointer to the mailbox is returned. Otherwise the return value is NULL
+ * and the reason is stored in the variable pointed to by error_val.
+ */
+
+struct fins_mailbox_tp *finslib_mailbox_create( struct fins_sys_tp *sys, const char *start, size_t num_slots, size_t slot_words, int direction, int *error_val ) {
+
+	size_t available;
+	struct fins_mailbox_tp *mailbox;
+	struct fins_address_tp address;
+	const struct fins_area_tp *area_ptr;
+	int retval;
+
+	retval   = FINS_RETVAL_SUCCESS;
+	mailbox  = NULL;
+	area_ptr = NULL;
+
+	if      ( sys   == NULL                                      ) retval = FINS_RETVAL_NOT_INITIALIZED;
+	else if ( start == NULL                                      ) retval = FINS_RETVAL_NO_WRITE_ADDRESS;
+	else if ( num_slots < 2  ||  num_slots > 0xFFFF              ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( slot_words == 0                                    ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( direction != FINS_MAILBOX_TO_PLC  &&
+		  direction != FINS_MAILBOX_FROM_PLC                 ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( XX_finslib_decode_address( start, & address )      ) retval = FINS_RETVAL_INVALID_WRITE_ADDRESS;
+	else if ( ( area_ptr = XX_finslib_search_area( sys, & address, 16, FI_WR, false ) ) == NULL ) retval = FINS_RETVAL_INVALID_WRITE_AREA;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		/*
+		 * The index words and all slots must fit in the same area
+		 */
+
+		available = area_ptr->high_id - address.main_address;
+
+		if      ( available < MAILBOX_SLOTS                                 ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( slot_words > ( available - MAILBOX_SLOTS + 1 ) / num_slots ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  ( mailbox = calloc( 1, sizeof(struct fins_mailbox_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) return NULL;
+
+	mailbox->sys         = sys;
+	mailbox->area        = area_ptr->area;
+	mailbox->start       = address.main_address;
+	mailbox->start      += area_ptr->low_addr >> 8;
+	mailbox->start      -= area_ptr->low_id;
+	mailbox->num_slots   = num_slots;
+	mailbox->slot_words  = slot_words;
+	mailbox->direction   = direction;
+	mailbox->head        = 0;
+	mailbox->tail        = 0;
+	mailbox->synced      = false;
+
+	return mailbox;
+
+}  /* finslib_mailbox_create */
+
+/*
+ * void finslib_mailbox_free( struct fins_mailbox_tp *mailbox );
+ *
+ * The function finslib_mailbox_free() releases the memory of a mailbox
+ * context. The connection with the PLC is not closed.
+ */
+
+void finslib_mailbox_free( struct fins_mailbox_tp *mailbox ) {
+
+	if ( mailbox != NULL ) free( mailbox );
+
+}  /* finslib_mailbox_free */
+
+/*
+ * int finslib_mailbox_reset( struct fins_mailbox_tp *mailbox );
+ *
+ * The function finslib_mailbox_reset() empties the ring buffer by writing
+ * zero to both the head and the tail index word in the PLC. The ladder logic
+ * should not access the mailbox while it is reset.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_mailbox_reset( struct fins_mailbox_tp *mailbox ) {
+
+	uint16_t index[2];
+	int retval;
+
+	if ( mailbox == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	index[MAILBOX_HEAD] = 0;
+	index[MAILBOX_TAIL] = 0;
+
+	mailbox->synced = false;
+
+	if ( ( retval = mailbox_write( mailbox, MAILBOX_HEAD, index, 2 ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	mailbox->head   = 0;
+	mailbox->tail   = 0;
+	mailbox->synced = true;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_mailbox_reset */
+
+/*
+ * int finslib_mailbox_send( struct fins_mailbox_tp *mailbox, const uint16_t *data, size_t num_blocks, size_t *num_sent );
+ *
+ * The function finslib_mailbox_send() puts as many blocks as possible from a
+ * list of blocks in free slots of a host to PLC mailbox. Each block is
+ * slot_words words long. All blocks are written first, after which the head
+ * index word is advanced with one single write. Because the host owns the
+ * head word, the index words are only read when the cached tail suggests that
+ * there is not enough room for all blocks. The number of blocks actually
+ * queued is returned in num_sent. The function does not wait for the PLC to
+ * free slots.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_mailbox_send( struct fins_mailbox_tp *mailbox, const uint16_t *data, size_t num_blocks, size_t *num_sent ) {
+
+	size_t num_free;
+	size_t todo;
+	size_t run;
+	uint16_t index[2];
+	uint16_t head;
+	int retval;
+
+	if ( num_sent != NULL ) *num_sent = 0;
+
+	if ( mailbox            == NULL                ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( mailbox->direction != FINS_MAILBOX_TO_PLC ) return FINS_RETVAL_INVALID_LAYOUT;
+	if ( num_blocks         == 0                   ) return FINS_RETVAL_SUCCESS;
+	if ( data               == NULL                ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	num_free = ( mailbox->tail + mailbox->num_slots - mailbox->head - 1 ) % mailbox->num_slots;
+
+	if ( ! mailbox->synced  ||  num_free < num_blocks ) {
+
+		if ( ( retval = mailbox_read( mailbox, MAILBOX_HEAD, index, 2 ) ) != FINS_RETVAL_SUCCESS ) return retval;
+		if ( ( retval = mailbox_sync( mailbox, index                    ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		num_free = ( mailbox->tail + mailbox->num_slots - mailbox->head - 1 ) % mailbox->num_slots;
+	}
+
+	todo = ( num_blocks < num_free ) ? num_blocks : num_free;
+	if ( todo == 0 ) return FINS_RETVAL_SUCCESS;
+
+	/*
+	 * The free slots are at most two runs of adjacent slots, one up
+	 * to the end of the ring and one from the start of the ring.
+	 */
+
+	run = mailbox->num_slots - mailbox->head;
+	if ( run > todo ) run = todo;
+
+	retval = mailbox_write( mailbox, MAILBOX_SLOTS + mailbox->head * mailbox->slot_words, data, run * mailbox->slot_words );
+	if ( retval == FINS_RETVAL_SUCCESS  &&  run < todo ) retval = mailbox_write( mailbox, MAILBOX_SLOTS, data + run * mailbox->slot_words, ( todo - run ) * mailbox->slot_words );
+	if ( retval != FINS_RETVAL_SUCCESS ) return retval;
+
+	head = (uint16_t) ( ( mailbox->head + todo ) % mailbox->num_slots );
+
+	if ( ( retval = mailbox_write( mailbox, MAILBOX_HEAD, & head, 1 ) ) != FINS_RETVAL_SUCCESS ) {
+
+		mailbox->synced = false;
+		return retval;
+	}
+
+	mailbox->head = head;
+
+	if ( num_sent != NULL ) *num_sent = todo;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_mailbox_send */
+
+/*
+ * int finslib_mailbox_receive( struct fins_mailbox_tp *mailbox, uint16_t *data, size_t max_blocks, size_t *num_blocks );
+ *
+ * The function finslib_mailbox_receive() takes all blocks, with a maximum of
+ * max_blocks, which the ladder logic has put in a PLC to host mailbox. When
+ * the whole mailbox fits in one read frame, the index words and slots are
+ * fetched with one single read. Otherwise the index words are read first,
+ * followed by the filled slots. The tail index word is advanced with one
+ * write afterwards. The number of blocks received is returned in num_blocks.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_mailbox_receive( struct fins_mailbox_tp *mailbox, uint16_t *data, size_t max_blocks, size_t *num_blocks ) {
+
+	size_t a;
+	size_t num_used;
+	size_t num_words;
+	size_t todo;
+	size_t run;
+	size_t from;
+	uint16_t buffer[FINS_MAX_READ_WORDS_SYSWAY];
+	uint16_t tail;
+	bool complete;
+	int retval;
+
+	if ( num_blocks != NULL ) *num_blocks = 0;
+
+	if ( mailbox            == NULL                  ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( mailbox->direction != FINS_MAILBOX_FROM_PLC ) return FINS_RETVAL_INVALID_LAYOUT;
+	if ( max_blocks         == 0                     ) return FINS_RETVAL_SUCCESS;
+	if ( data               == NULL                  ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	num_words = MAILBOX_SLOTS + mailbox->num_slots * mailbox->slot_words;
+	complete  = ( num_words <= FINS_MAX_READ_WORDS_SYSWAY );
+
+	if ( ! complete ) num_words = MAILBOX_SLOTS;
+
+	if ( ( retval = mailbox_read( mailbox, MAILBOX_HEAD, buffer, num_words ) ) != FINS_RETVAL_SUCCESS ) return retval;
+	if ( ( retval = mailbox_sync( mailbox, buffer                          ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	num_used = ( mailbox->head + mailbox->num_slots - mailbox->tail ) % mailbox->num_slots;
+
+	todo = ( max_blocks < num_used ) ? max_blocks : num_used;
+	if ( todo == 0 ) return FINS_RETVAL_SUCCESS;
+
+	run = mailbox->num_slots - mailbox->tail;
+	if ( run > todo ) run = todo;
+
+	if ( complete ) {
+
+		from = MAILBOX_SLOTS + mailbox->tail * mailbox->slot_words;
+		for (a=0; a<run*mailbox->slot_words; a++) data[a] = buffer[from+a];
+
+		for (a=run*mailbox->slot_words; a<todo*mailbox->slot_words; a++) data[a] = buffer[MAILBOX_SLOTS+a-run*mailbox->slot_words];
+	}
+
+	else {
+		retval = mailbox_read( mailbox, MAILBOX_SLOTS + mailbox->tail * mailbox->slot_words, data, run * mailbox->slot_words );
+		if ( retval == FINS_RETVAL_SUCCESS  &&  run < todo ) retval = mailbox_read( mailbox, MAILBOX_SLOTS, data + run * mailbox->slot_words, ( todo - run ) * mailbox->slot_words );
+		if ( retval != FINS_RETVAL_SUCCESS ) return retval;
+	}
+
+	tail = (uint16_t) ( ( mailbox->tail + todo ) % mailbox->num_slots );
+
+	if ( ( retval = mailbox_write( mailbox, MAILBOX_TAIL, & tail, 1 ) ) != FINS_RETVAL_SUCCESS ) {
+
+		mailbox->synced = false;
+		return retval;
+	}
+
+	mailbox->tail = tail;
+
+	if ( num_blocks != NULL ) *num_blocks = todo;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_mailbox_receive */
+
+/*
+ * static int mailbox_sync( struct fins_mailbox_tp *mailbox, const uint16_t *index );
+ *
+ * The function mailbox_sync() updates the cached index words of a mailbox
+ * with the values read from the PLC. The index owned by the host is only
+ * taken over from the PLC the first time. Afterwards it must match the cached
+ * value, or otherwise some other party changed the mailbox behind our back.
+ */
+
+static int mailbox_sync( struct fins_mailbox_tp *mailbox, const uint16_t *index ) {
+
+	if ( index[MAILBOX_HEAD] >= mailbox->num_slots  ||  index[MAILBOX_TAIL] >= mailbox->num_slots ) {
+
+		mailbox->synced = false;
+		return FINS_RETVAL_MAILBOX_CORRUPT;
+	}
+
+	if ( mailbox->synced ) {
+
+		if ( mailbox->direction == FINS_MAILBOX_TO_PLC    &&  index[MAILBOX_HEAD] != mailbox->head ) mailbox->synced = false;
+		if ( mailbox->direction == FINS_MAILBOX_FROM_PLC  &&  index[MAILBOX_TAIL] != mailbox->tail ) mailbox->synced = false;
+
+		if ( ! mailbox->synced ) return FINS_RETVAL_MAILBOX_CORRUPT;
+	}
+
+	mailbox->head   = index[MAILBOX_HEAD];
+	mailbox->tail   = index[MAILBOX_TAIL];
+	mailbox->synced = true;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* mailbox_sync */
+
+/*
+ * static int mailbox_read( struct fins_mailbox_tp *mailbox, size_t offset, uint16_t *data, size_t num_words );
+ *
+ * The function mailbox_read() reads a number of words at an offset relative
+ * to the start of a mailbox in the PLC.
+ */
+
+static int mailbox_read( struct fins_mailbox_tp *mailbox, size_t offset, uint16_t *data, size_t num_words ) {
+
+	size_t a;
+	size_t chunk_start;
+	size_t chunk_length;
+	size_t bodylen;
+	struct fins_command_tp fins_cmnd;
+	int retval;
+
+	if ( mailbox->sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	chunk_start = mailbox->start + offset;
+
+	while ( num_words > 0 ) {
+
+		chunk_length = FINS_MAX_READ_WORDS_SYSWAY;
+		if ( chunk_length > num_words ) chunk_length = num_words;
+
+		XX_finslib_init_command( mailbox->sys, & fins_cmnd, 0x01, 0x01 );
+
+		bodylen = 0;
+
+		fins_cmnd.body[bodylen++] = mailbox->area;
+		fins_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+		fins_cmnd.body[bodylen++] = 0x00;
+		fins_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+		if ( ( retval = XX_finslib_communicate( mailbox->sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		if ( bodylen != 2+2*chunk_length ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+		bodylen = 2;
+
+		for (a=0; a<chunk_length; a++) {
+
+			*data    = fins_cmnd.body[bodylen++];
+			*data  <<= 8;
+			*data   += fins_cmnd.body[bodylen++];
+			data++;
+		}
+
+		num_words   -= chunk_length;
+		chunk_start += chunk_length;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* mailbox_read */
+
+/*
+ * static int mailbox_write( struct fins_mailbox_tp *mailbox, size_t offset, const uint16_t *data, size_t num_words );
+ *
+ * The function mailbox_write() writes a number of words at an offset
+ * relative to the start of a mailbox in the PLC.
+ */
+
+static int mailbox_write( struct fins_mailbox_tp *mailbox, size_t offset, const uint16_t *data, size_t num_words ) {
+
+	size_t a;
+	size_t chunk_start;
+	size_t chunk_length;
+	size_t bodylen;
+	struct fins_command_tp fins_cmnd;
+	int retval;
+
+	if ( mailbox->sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	chunk_start = mailbox->start + offset;
+
+	while ( num_words > 0 ) {
+
+		chunk_length = FINS_MAX_WRITE_WORDS_SYSWAY;
+		if ( chunk_length > num_words ) chunk_length = num_words;
+
+		XX_finslib_init_command( mailbox->sys, & fins_cmnd, 0x01, 0x02 );
+
+		bodylen = 0;
+
+		fins_cmnd.body[bodylen++] = mailbox->area;
+		fins_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+		fins_cmnd.body[bodylen++] = 0x00;
+		fins_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+		for (a=0; a<chunk_length; a++) {
+
+			fins_cmnd.body[bodylen++] = (data[a] >> 8) & 0xff;
+			fins_cmnd.body[bodylen++] = (data[a]     ) & 0xff;
+		}
+
+		if ( ( retval = XX_finslib_communicate( mailbox->sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		if ( bodylen != 2 ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+		data        += chunk_length;
+		num_words   -= chunk_length;
+		chunk_start += chunk_length;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* mailbox_write */
@@ -0,0 +1,952 @@
+/*
+ * Library: libfins
+ * File:    src/fins_metrics.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_metrics.c contains routines to collect statistics
+ * of FINS connections and to expose them with a small embedded HTTP server in
+ * the Prometheus text format. The server runs in its own thread and only reads
+ * the counters of the connections, so that it never delays communication.
+ */
+
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ! defined(_WIN32)
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif  /* ! defined(_WIN32) */
+
+#include "fins.h"
+
+#define METRICS_REQUEST_LEN	2048
+#define METRICS_POLL_MSEC	250
+#define METRICS_IO_TIMEOUT	1
+
+#if defined(MSG_NOSIGNAL)
+#define METRICS_SEND_FLAGS	MSG_NOSIGNAL
+#else  /* defined(MSG_NOSIGNAL) */
+#define METRICS_SEND_FLAGS	0
+#endif  /* defined(MSG_NOSIGNAL) */
+
+#define STAT_REQUESTS		1
+#define STAT_RESPONSES		2
+#define STAT_ERRORS		3
+#define STAT_RECONNECTS		4
+#define STAT_IN_FLIGHT		5
+#define STAT_CONNECTED		6
+#define STAT_LAST_ERROR		7
+#define STAT_LATENCY_MAX	8
+
+struct text_tp {
+	char *	data;
+	size_t	len;
+	size_t	size;
+};
+
+static const uint64_t latency_bound[FINS_STATS_BUCKETS-1] = {
+	100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+};
+
+static const struct {
+	int		stat;
+	const char *	name;
+	const char *	type;
+	const char *	help;
+} conn_metric[] = {
+	{ STAT_REQUESTS,    "fins_requests_total",              "counter", "Number of FINS commands sent."                     },
+	{ STAT_RESPONSES,   "fins_responses_total",             "counter", "Number of FINS responses received."                },
+	{ STAT_ERRORS,      "fins_errors_total",                "counter", "Number of FINS commands which ended with an error." },
+	{ STAT_RECONNECTS,  "fins_reconnects_total",            "counter", "Number of times the connection was re-established." },
+	{ STAT_IN_FLIGHT,   "fins_in_flight",                   "gauge",   "Number of FINS commands waiting for a response."   },
+	{ STAT_CONNECTED,   "fins_connected",                   "gauge",   "1 if the connection is open, 0 otherwise."         },
+	{ STAT_LAST_ERROR,  "fins_last_error",                  "gauge",   "Result code of the last FINS command."             },
+	{ STAT_LATENCY_MAX, "fins_request_duration_max_seconds", "gauge",  "Longest FINS round trip time."                     },
+	{ 0,                NULL,                               NULL,      NULL                                                }
+};
+
+static int		add_source( struct fins_metrics_tp *metrics, struct fins_sys_tp *sys, struct fins_rtclock_tp *rtclock, const char *name );
+static void		append( struct text_tp *text, const char *fmt, ... );
+static void		append_label( struct text_tp *text, const char *label, const char *value );
+static void		format_clocks( struct fins_metrics_tp *metrics, struct text_tp *text );
+static void		format_connections( struct fins_metrics_tp *metrics, struct text_tp *text );
+static void		format_latency( struct fins_metrics_tp *metrics, struct text_tp *text );
+static struct fins_metricssrc_tp *	find_source( struct fins_metrics_tp *metrics, const char *name );
+static double		latency_quantile( const struct fins_stats_tp *stats, double q );
+static void		lock_metrics( struct fins_metrics_tp *metrics );
+static void		serve_client( struct fins_metrics_tp *metrics, SOCKET fd );
+static void		serve_requests( struct fins_metrics_tp *metrics );
+static int		socket_error( void );
+static void		unlock_metrics( struct fins_metrics_tp *metrics );
+
+#if defined(_WIN32)
+static DWORD WINAPI	metrics_thread( LPVOID arg );
+#else  /* defined(_WIN32) */
+static void *		metrics_thread( void *arg );
+#endif  /* defined(_WIN32) */
+
+/*
+ * void XX_finslib_stats_response( struct fins_sys_tp *sys, uint8_t sid );
+ *
+ * The function XX_finslib_stats_response() counts a received response on a
+ * connection and adds the round trip time since the command with the same
+ * SID was sent to the latency histogram of the connection. The send times
+ * are kept per SID, so that pipelined commands are each measured from their
+ * own send.
+ */
+
+void XX_finslib_stats_response( struct fins_sys_tp *sys, uint8_t sid ) {
+
+	int a;
+	uint64_t rtt;
+	uint64_t *send_usec;
+
+	sys->stats.responses++;
+
+	send_usec = & sys->stats.send_usec[ sid % FINS_STATS_SENT ];
+
+	if ( *send_usec == 0 ) return;
+
+	rtt        = finslib_monotonic_usec_timer() - *send_usec;
+	*send_usec = 0;
+
+	sys->stats.latency_count++;
+	sys->stats.latency_sum_usec += rtt;
+
+	if ( rtt > sys->stats.latency_max_usec ) sys->stats.latency_max_usec = rtt;
+
+	for (a=0; a<FINS_STATS_BUCKETS-1  &&  rtt > latency_bound[a]; a++) ;
+
+	sys->stats.latency_bucket[a]++;
+
+}  /* XX_finslib_stats_response */
+
+/*
+ * struct fins_metrics_tp *finslib_metrics_create( const char *address, uint16_t port, int *error_val );
+ *
+ * The function finslib_metrics_create() starts a metrics exporter which
+ * listens for HTTP requests on a local address and port. If the address
+ * starts with a slash, it is used as the path of a Unix domain socket and the
+ * port is ignored. On success a pointer to the exporter is returned.
+ * Otherwise the return value is NULL and the reason is stored in the
+ * variable pointed to by error_val.
+ */
+
+struct fins_metrics_tp *finslib_metrics_create( const char *address, uint16_t port, int *error_val ) {
+
+	struct fins_metrics_tp *metrics;
+	struct sockaddr_in ws_addr;
+	int retval;
+	int reuse;
+#if ! defined(_WIN32)
+	struct sockaddr_un un_addr;
+	struct stat st;
+#endif  /* ! defined(_WIN32) */
+
+	if ( address == NULL  ||  *address == 0 ) address = "127.0.0.1";
+	if ( port    == 0                       ) port    = FINS_METRICS_DEFAULT_PORT;
+
+	metrics = calloc( 1, sizeof(struct fins_metrics_tp) );
+	if ( metrics == NULL ) {
+
+		if ( error_val != NULL ) *error_val = FINS_RETVAL_OUT_OF_MEMORY;
+		return NULL;
+	}
+
+	metrics->sockfd = INVALID_SOCKET;
+	retval          = FINS_RETVAL_SUCCESS;
+
+	if ( address[0] == '/' ) {
+#if defined(_WIN32)
+		retval = FINS_RETVAL_NOT_SUPPORTED;
+#else  /* defined(_WIN32) */
+		memset( & un_addr, 0, sizeof(un_addr) );
+		un_addr.sun_family = AF_UNIX;
+
+		if ( strlen( address ) >= sizeof(un_addr.sun_path)  ||  strlen( address ) >= sizeof(metrics->path) ) retval = FINS_RETVAL_INVALID_FILENAME;
+
+		else {
+			strcpy( un_addr.sun_path, address );
+			strcpy( metrics->path,    address );
+
+			if ( stat( address, & st ) == 0  &&  S_ISSOCK( st.st_mode ) ) unlink( address );
+
+			metrics->sockfd = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+			if      ( metrics->sockfd == INVALID_SOCKET                                              ) retval = socket_error();
+			else if ( bind( metrics->sockfd, (struct sockaddr *) & un_addr, sizeof(un_addr) ) < 0 ) { retval = socket_error(); metrics->path[0] = 0; }
+		}
+#endif  /* defined(_WIN32) */
+	}
+
+	else {
+		memset( & ws_addr, 0, sizeof(ws_addr) );
+
+		ws_addr.sin_family = AF_INET;
+		ws_addr.sin_port   = htons( port );
+		reuse              = 1;
+
+		if ( finslib_inet_pton( AF_INET, address, & ws_addr.sin_addr.s_addr ) != 1 ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+
+		else {
+			metrics->sockfd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+
+			if ( metrics->sockfd == INVALID_SOCKET ) retval = socket_error();
+
+			else {
+				setsockopt( metrics->sockfd, SOL_SOCKET, SO_REUSEADDR, (const void *) & reuse, sizeof(reuse) );
+
+				if ( bind( metrics->sockfd, (struct sockaddr *) & ws_addr, sizeof(ws_addr) ) < 0 ) retval = socket_error();
+			}
+		}
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  listen( metrics->sockfd, 8 ) < 0 ) retval = socket_error();
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		if ( error_val != NULL ) *error_val = retval;
+
+		if ( metrics->sockfd  != INVALID_SOCKET ) closesocket( metrics->sockfd );
+#if ! defined(_WIN32)
+		if ( metrics->path[0] != 0              ) unlink( metrics->path );
+#endif  /* ! defined(_WIN32) */
+
+		free( metrics );
+		return NULL;
+	}
+
+#if defined(_WIN32)
+	InitializeCriticalSection( & metrics->lock );
+
+	metrics->thread = CreateThread( NULL, 0, metrics_thread, metrics, 0, NULL );
+	if ( metrics->thread == NULL ) retval = socket_error();
+#else  /* defined(_WIN32) */
+	pthread_mutex_init( & metrics->lock, NULL );
+
+	if ( pthread_create( & metrics->thread, NULL, metrics_thread, metrics ) != 0 ) retval = FINS_RETVAL_ERRNO_BASE + errno;
+#endif  /* defined(_WIN32) */
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		if ( error_val != NULL ) *error_val = retval;
+
+		closesocket( metrics->sockfd );
+#if defined(_WIN32)
+		DeleteCriticalSection( & metrics->lock );
+#else  /* defined(_WIN32) */
+		if ( metrics->path[0] != 0 ) unlink( metrics->path );
+		pthread_mutex_destroy( & metrics->lock );
+#endif  /* defined(_WIN32) */
+
+		free( metrics );
+		return NULL;
+	}
+
+	if ( error_val != NULL ) *error_val = FINS_RETVAL_SUCCESS;
+
+	return metrics;
+
+}  /* finslib_metrics_create */
+
+/*
+ * void finslib_metrics_free( struct fins_metrics_tp *metrics );
+ *
+ * The function finslib_metrics_free() stops a metrics exporter and releases
+ * all its resources. The registered connections and clocks are not affected.
+ */
+
+void finslib_metrics_free( struct fins_metrics_tp *metrics ) {
+
+	if ( metrics == NULL ) return;
+
+	lock_metrics( metrics );
+	metrics->stop = true;
+	unlock_metrics( metrics );
+
+#if defined(_WIN32)
+	WaitForSingleObject( metrics->thread, INFINITE );
+	CloseHandle( metrics->thread );
+	DeleteCriticalSection( & metrics->lock );
+#else  /* defined(_WIN32) */
+	pthread_join( metrics->thread, NULL );
+	pthread_mutex_destroy( & metrics->lock );
+#endif  /* defined(_WIN32) */
+
+	closesocket( metrics->sockfd );
+
+#if ! defined(_WIN32)
+	if ( metrics->path[0] != 0 ) unlink( metrics->path );
+#endif  /* ! defined(_WIN32) */
+
+	free( metrics->source );
+	free( metrics );
+
+}  /* finslib_metrics_free */
+
+/*
+ * int finslib_metrics_add_connection( struct fins_metrics_tp *metrics, struct fins_sys_tp *sys, const char *name );
+ *
+ * The function finslib_metrics_add_connection() adds a connection to the list
+ * of connections reported by a metrics exporter. The name is used as the
+ * value of the connection label. The connection must stay valid until it is
+ * removed from the exporter or the exporter is stopped.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_metrics_add_connection( struct fins_metrics_tp *metrics, struct fins_sys_tp *sys, const char *name ) {
+
+	if ( metrics == NULL  ||  sys == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	return add_source( metrics, sys, NULL, name );
+
+}  /* finslib_metrics_add_connection */
+
+/*
+ * int finslib_metrics_add_clock( struct fins_metrics_tp *metrics, struct fins_rtclock_tp *rtclock, const char *name );
+ *
+ * The function finslib_metrics_add_clock() adds a periodic clock to the list
+ * of clocks reported by a metrics exporter, so that the scheduling lag of
+ * poll threads becomes visible. The name is used as the value of the clock
+ * label and must be different from all other registered names.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_metrics_add_clock( struct fins_metrics_tp *metrics, struct fins_rtclock_tp *rtclock, const char *name ) {
+
+	if ( metrics == NULL  ||  rtclock == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	return add_source( metrics, NULL, rtclock, name );
+
+}  /* finslib_metrics_add_clock */
+
+/*
+ * int finslib_metrics_remove( struct fins_metrics_tp *metrics, const char *name );
+ *
+ * The function finslib_metrics_remove() removes a connection or clock from a
+ * metrics exporter. When the function returns, the exporter no longer
+ * accesses it. Removing a name which is not registered is not an error.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_metrics_remove( struct fins_metrics_tp *metrics, const char *name ) {
+
+	struct fins_metricssrc_tp *src;
+	size_t idx;
+
+	if ( metrics == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( name    == NULL ) return FINS_RETVAL_SUCCESS;
+
+	lock_metrics( metrics );
+
+	src = find_source( metrics, name );
+
+	if ( src != NULL ) {
+
+		idx = (size_t) ( src - metrics->source );
+
+		memmove( src, src + 1, ( metrics->num_source - idx - 1 ) * sizeof(struct fins_metricssrc_tp) );
+		metrics->num_source--;
+	}
+
+	unlock_metrics( metrics );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_metrics_remove */
+
+/*
+ * static int add_source( struct fins_metrics_tp *metrics, struct fins_sys_tp *sys, struct fins_rtclock_tp *rtclock, const char *name );
+ *
+ * The function add_source() appends a connection or a clock to the source
+ * list of a metrics exporter. The lock is only shared with the exporter
+ * thread, so that registering a source never blocks communication.
+ */
+
+static int add_source( struct fins_metrics_tp *metrics, struct fins_sys_tp *sys, struct fins_rtclock_tp *rtclock, const char *name ) {
+
+	struct fins_metricssrc_tp *new_source;
+	struct fins_metricssrc_tp *src;
+	int retval;
+
+	if ( name == NULL  ||  *name == 0  ||  strlen( name ) >= FINS_METRICS_NAME_LEN ) return FINS_RETVAL_INVALID_LAYOUT;
+
+	retval = FINS_RETVAL_SUCCESS;
+
+	lock_metrics( metrics );
+
+	if ( find_source( metrics, name ) != NULL ) retval = FINS_RETVAL_DUPLICATE_NAME;
+
+	else if ( metrics->num_source >= metrics->max_source ) {
+
+		new_source = realloc( metrics->source, ( metrics->max_source + 16 ) * sizeof(struct fins_metricssrc_tp) );
+
+		if ( new_source == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+		else {
+			metrics->source      = new_source;
+			metrics->max_source += 16;
+		}
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		src = & metrics->source[metrics->num_source];
+
+		memset( src, 0, sizeof(struct fins_metricssrc_tp) );
+
+		src->sys     = sys;
+		src->rtclock = rtclock;
+		strcpy( src->name, name );
+
+		metrics->num_source++;
+	}
+
+	unlock_metrics( metrics );
+
+	return retval;
+
+}  /* add_source */
+
+/*
+ * static void append( struct text_tp *text, const char *fmt, ... );
+ *
+ * The function append() adds formatted text to the end of a growing text
+ * buffer. When memory runs out, the text is truncated silently and the
+ * exporter serves whatever could be formatted.
+ */
+
+static void append( struct text_tp *text, const char *fmt, ... ) {
+
+	va_list ap;
+	char *new_data;
+	int len;
+
+	for (;;) {
+
+		if ( text->data != NULL ) {
+
+			va_start( ap, fmt );
+			len = vsnprintf( text->data + text->len, text->size - text->len, fmt, ap );
+			va_end( ap );
+
+			if ( len < 0 ) return;
+
+			if ( text->len + (size_t) len < text->size ) {
+
+				text->len += (size_t) len;
+				return;
+			}
+		}
+
+		new_data = realloc( text->data, text->size + 4096 );
+		if ( new_data == NULL ) {
+
+			if ( text->data != NULL ) text->data[text->len] = 0;
+			return;
+		}
+
+		text->data  = new_data;
+		text->size += 4096;
+	}
+
+}  /* append */
+
+/*
+ * static void append_label( struct text_tp *text, const char *label, const char *value );
+ *
+ * The function append_label() adds a label with its value to a metric line.
+ * Backslashes, double quotes and line feeds in the value are escaped as the
+ * text exposition format requires.
+ */
+
+static void append_label( struct text_tp *text, const char *label, const char *value ) {
+
+	append( text, "%s=\"", label );
+
+	while ( *value ) {
+
+		if      ( *value == '\\' ) append( text, "\\\\" );
+		else if ( *value == '"'  ) append( text, "\\\"" );
+		else if ( *value == '\n' ) append( text, "\\n"  );
+		else                       append( text, "%c", *value );
+
+		value++;
+	}
+
+	append( text, "\"" );
+
+}  /* append_label */
+
+/*
+ * static void format_connections( struct fins_metrics_tp *metrics, struct text_tp *text );
+ *
+ * The function format_connections() adds the counters and gauges of all
+ * registered connections to the text. The counters are read without locking
+ * the connection, so values may be one command behind.
+ */
+
+static void format_connections( struct fins_metrics_tp *metrics, struct text_tp *text ) {
+
+	const struct fins_sys_tp *sys;
+	uint64_t reconnects;
+	size_t a;
+	int b;
+
+	for (b=0; conn_metric[b].name != NULL; b++) {
+
+		append( text, "# HELP %s %s\n", conn_metric[b].name, conn_metric[b].help );
+		append( text, "# TYPE %s %s\n", conn_metric[b].name, conn_metric[b].type );
+
+		for (a=0; a<metrics->num_source; a++) {
+
+			sys = metrics->source[a].sys;
+			if ( sys == NULL ) continue;
+
+			reconnects = ( sys->stats.connects > 0 ) ? sys->stats.connects - 1 : 0;
+
+			append( text, "%s{", conn_metric[b].name );
+			append_label( text, "connection", metrics->source[a].name );
+			append( text, "} " );
+
+			switch ( conn_metric[b].stat ) {
+
+				case STAT_REQUESTS    : append( text, "%llu", (unsigned long long) sys->stats.requests      ); break;
+				case STAT_RESPONSES   : append( text, "%llu", (unsigned long long) sys->stats.responses     ); break;
+				case STAT_ERRORS      : append( text, "%llu", (unsigned long long) sys->stats.errors        ); break;
+				case STAT_RECONNECTS  : append( text, "%llu", (unsigned long long) reconnects               ); break;
+				case STAT_IN_FLIGHT   : append( text, "%lu",  (unsigned long) sys->stats.in_flight          ); break;
+				case STAT_CONNECTED   : append( text, "%d",   ( sys->sockfd != INVALID_SOCKET ) ? 1 : 0     ); break;
+				case STAT_LAST_ERROR  : append( text, "%d",   sys->last_error                               ); break;
+				case STAT_LATENCY_MAX : append( text, "%.6f", (double) sys->stats.latency_max_usec / 1e6    ); break;
+			}
+
+			append( text, "\n" );
+		}
+	}
+
+}  /* format_connections */
+
+/*
+ * static void format_latency( struct fins_metrics_tp *metrics, struct text_tp *text );
+ *
+ * The function format_latency() adds the round trip time histogram of all
+ * registered connections to the text, followed by quantiles estimated from
+ * the histogram buckets.
+ */
+
+static void format_latency( struct fins_metrics_tp *metrics, struct text_tp *text ) {
+
+	static const double quantile[3] = { 0.5, 0.9, 0.99 };
+	const struct fins_sys_tp *sys;
+	uint64_t cumulative;
+	size_t a;
+	int b;
+
+	append( text, "# HELP fins_request_duration_seconds Round trip time of FINS commands.\n" );
+	append( text, "# TYPE fins_request_duration_seconds histogram\n" );
+
+	for (a=0; a<metrics->num_source; a++) {
+
+		sys = metrics->source[a].sys;
+		if ( sys == NULL ) continue;
+
+		cumulative = 0;
+
+		for (b=0; b<FINS_STATS_BUCKETS; b++) {
+
+			cumulative += sys->stats.latency_bucket[b];
+
+			append( text, "fins_request_duration_seconds_bucket{" );
+			append_label( text, "connection", metrics->source[a].name );
+
+			if ( b < FINS_STATS_BUCKETS-1 ) append( text, ",le=\"%g\"} %llu\n", (double) latency_bound[b] / 1000000.0, (unsigned long long) cumulative );
+			else                            append( text, ",le=\"+Inf\"} %llu\n", (unsigned long long) cumulative );
+		}
+
+		append( text, "fins_request_duration_seconds_sum{" );
+		append_label( text, "connection", metrics->source[a].name );
+		append( text, "} %.6f\n", (double) sys->stats.latency_sum_usec / 1000000.0 );
+
+		append( text, "fins_request_duration_seconds_count{" );
+		append_label( text, "connection", metrics->source[a].name );
+		append( text, "} %llu\n", (unsigned long long) sys->stats.latency_count );
+	}
+
+	append( text, "# HELP fins_request_duration_quantile_seconds Round trip time quantiles estimated from the histogram.\n" );
+	append( text, "# TYPE fins_request_duration_quantile_seconds gauge\n" );
+
+	for (a=0; a<metrics->num_source; a++) {
+
+		sys = metrics->source[a].sys;
+		if ( sys == NULL ) continue;
+
+		for (b=0; b<3; b++) {
+
+			append( text, "fins_request_duration_quantile_seconds{" );
+			append_label( text, "connection", metrics->source[a].name );
+
+			if ( sys->stats.latency_count == 0 ) append( text, ",quantile=\"%g\"} NaN\n", quantile[b] );
+			else                                 append( text, ",quantile=\"%g\"} %.6f\n", quantile[b], latency_quantile( & sys->stats, quantile[b] ) );
+		}
+	}
+
+}  /* format_latency */
+
+/*
+ * static void format_clocks( struct fins_metrics_tp *metrics, struct text_tp *text );
+ *
+ * The function format_clocks() adds the cycle counters and wakeup lag of all
+ * registered periodic clocks to the text.
+ */
+
+static void format_clocks( struct fins_metrics_tp *metrics, struct text_tp *text ) {
+
+	static const char *name[4] = {
+		"fins_clock_cycles_total",
+		"fins_clock_deadline_misses_total",
+		"fins_clock_wakeup_lag_max_seconds",
+		"fins_clock_wakeup_lag_mean_seconds"
+	};
+	static const char *type[4] = { "counter", "counter", "gauge", "gauge" };
+	static const char *help[4] = {
+		"Number of completed cycles of a periodic clock.",
+		"Number of cycle starts which were missed.",
+		"Worst case delay between the cycle start and the wakeup of the thread.",
+		"Average delay between the cycle start and the wakeup of the thread."
+	};
+	const struct fins_rtclock_tp *rtclock;
+	size_t a;
+	int b;
+
+	for (b=0; b<4; b++) {
+
+		append( text, "# HELP %s %s\n", name[b], help[b] );
+		append( text, "# TYPE %s %s\n", name[b], type[b] );
+
+		for (a=0; a<metrics->num_source; a++) {
+
+			rtclock = metrics->source[a].rtclock;
+			if ( rtclock == NULL ) continue;
+
+			append( text, "%s{", name[b] );
+			append_label( text, "clock", metrics->source[a].name );
+			append( text, "} " );
+
+			switch ( b ) {
+
+				case 0 : append( text, "%lu\n",  (unsigned long) rtclock->cycles                      ); break;
+				case 1 : append( text, "%lu\n",  (unsigned long) rtclock->deadline_misses             ); break;
+				case 2 : append( text, "%.6f\n", (double) rtclock->max_wakeup_usec / 1e6               ); break;
+				case 3 : append( text, "%.6f\n", ( rtclock->cycles > 0 ) ? (double) rtclock->total_wakeup_usec / (double) rtclock->cycles / 1e6 : 0.0 ); break;
+			}
+		}
+	}
+
+}  /* format_clocks */
+
+/*
+ * static double latency_quantile( const struct fins_stats_tp *stats, double q );
+ *
+ * The function latency_quantile() estimates a quantile of the round trip time
+ * in seconds by linear interpolation inside the histogram bucket which holds
+ * the quantile. The upper bound of the last bucket is the largest round trip
+ * time seen.
+ */
+
+static double latency_quantile( const struct fins_stats_tp *stats, double q ) {
+
+	double target;
+	double lower;
+	double upper;
+	uint64_t cumulative;
+	int a;
+
+	target     = q * (double) stats->latency_count;
+	cumulative = 0;
+
+	for (a=0; a<FINS_STATS_BUCKETS-1; a++) {
+
+		if ( (double) ( cumulative + stats->latency_bucket[a] ) >= target ) break;
+		cumulative += stats->latency_bucket[a];
+	}
+
+	lower = ( a > 0                    ) ? (double) latency_bound[a-1]    : 0.0;
+	upper = ( a < FINS_STATS_BUCKETS-1 ) ? (double) latency_bound[a]      : (double) stats->latency_max_usec;
+
+	if ( upper > (double) stats->latency_max_usec ) upper = (double) stats->latency_max_usec;
+	if ( upper < lower                            ) upper = lower;
+
+	if ( stats->latency_bucket[a] > 0 ) lower += ( upper - lower ) * ( target - (double) cumulative ) / (double) stats->latency_bucket[a];
+
+	return lower / 1000000.0;
+
+}  /* latency_quantile */
+
+/*
+ * static struct fins_metricssrc_tp *find_source( struct fins_metrics_tp *metrics, const char *name );
+ *
+ * The function find_source() searches a registered source by name. The
+ * caller must hold the lock of the exporter.
+ */
+
+static struct fins_metricssrc_tp *find_source( struct fins_metrics_tp *metrics, const char *name ) {
+
+	size_t a;
+
+	for (a=0; a<metrics->num_source; a++) if ( strcmp( metrics->source[a].name, name ) == 0 ) return & metrics->source[a];
+
+	return NULL;
+
+}  /* find_source */
+
+/*
+ * static void serve_client( struct fins_metrics_tp *metrics, SOCKET fd );
+ *
+ * The function serve_client() reads one HTTP request from an accepted
+ * connection and answers it. Only GET requests for /metrics or / are
+ * answered with the metrics, all other paths get a 404 response.
+ */
+
+static void serve_client( struct fins_metrics_tp *metrics, SOCKET fd ) {
+
+	char request[METRICS_REQUEST_LEN];
+	char header[160];
+	const char *path;
+	const char *body;
+	struct text_tp text;
+	size_t len;
+	size_t pos;
+	int recv_len;
+	int send_len;
+	bool found;
+#if defined(_WIN32)
+	DWORD timeout;
+#else  /* defined(_WIN32) */
+	struct timeval timeout;
+#endif  /* defined(_WIN32) */
+
+#if defined(_WIN32)
+	timeout = METRICS_IO_TIMEOUT * 1000;
+#else  /* defined(_WIN32) */
+	timeout.tv_sec  = METRICS_IO_TIMEOUT;
+	timeout.tv_usec = 0;
+#endif  /* defined(_WIN32) */
+
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, (const void *) & timeout, sizeof(timeout) );
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, (const void *) & timeout, sizeof(timeout) );
+
+	len = 0;
+
+	while ( len < sizeof(request)-1 ) {
+
+		recv_len = recv( fd, request + len, (int) ( sizeof(request) - 1 - len ), 0 );
+		if ( recv_len <= 0 ) return;
+
+		len          += (size_t) recv_len;
+		request[len]  = 0;
+
+		if ( strstr( request, "\r\n\r\n" ) != NULL ) break;
+	}
+
+	found = false;
+
+	if ( strncmp( request, "GET ", 4 ) == 0 ) {
+
+		path = request + 4;
+
+		if      ( strncmp( path, "/metrics", 8 ) == 0  &&  ( path[8] == ' '  ||  path[8] == '?' ) ) found = true;
+		else if ( strncmp( path, "/",        1 ) == 0  &&  ( path[1] == ' '  ||  path[1] == '?' ) ) found = true;
+	}
+
+	memset( & text, 0, sizeof(text) );
+
+	if ( found ) {
+
+		lock_metrics( metrics );
+
+		metrics->scrapes++;
+
+		format_connections( metrics, & text );
+		format_latency(     metrics, & text );
+		format_clocks(      metrics, & text );
+
+		append( & text, "# HELP fins_metrics_scrapes_total Number of requests served by the exporter.\n" );
+		append( & text, "# TYPE fins_metrics_scrapes_total counter\n" );
+		append( & text, "fins_metrics_scrapes_total %llu\n", (unsigned long long) metrics->scrapes );
+
+		unlock_metrics( metrics );
+	}
+
+	body = ( text.data != NULL ) ? text.data : "";
+
+	if ( found ) snprintf( header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", (unsigned int) text.len );
+	else         snprintf( header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: close\r\n\r\n" );
+
+	if ( ! found ) body = "Not Found\n";
+
+	len = strlen( header );
+	pos = 0;
+
+	while ( pos < len ) {
+
+		send_len = send( fd, header + pos, (int) ( len - pos ), METRICS_SEND_FLAGS );
+		if ( send_len <= 0 ) break;
+		pos += (size_t) send_len;
+	}
+
+	len = strlen( body );
+
+	while ( pos >= strlen( header )  &&  len > 0 ) {
+
+		send_len = send( fd, body, (int) len, METRICS_SEND_FLAGS );
+		if ( send_len <= 0 ) break;
+
+		body += send_len;
+		len  -= (size_t) send_len;
+	}
+
+	free( text.data );
+
+}  /* serve_client */
+
+/*
+ * static void serve_requests( struct fins_metrics_tp *metrics );
+ *
+ * The function serve_requests() waits for incoming connections and serves
+ * them one at a time until the exporter is stopped. The wait is limited so
+ * that a stop request is noticed within a fraction of a second.
+ */
+
+static void serve_requests( struct fins_metrics_tp *metrics ) {
+
+	fd_set fds;
+	struct timeval tv;
+	SOCKET fd;
+	bool stop;
+
+	for (;;) {
+
+		lock_metrics( metrics );
+		stop = metrics->stop;
+		unlock_metrics( metrics );
+
+		if ( stop ) return;
+
+		FD_ZERO( & fds );
+		FD_SET( metrics->sockfd, & fds );
+
+		tv.tv_sec  = 0;
+		tv.tv_usec = METRICS_POLL_MSEC * 1000;
+
+		if ( select( (int) metrics->sockfd + 1, & fds, NULL, NULL, & tv ) <= 0 ) continue;
+
+		fd = accept( metrics->sockfd, NULL, NULL );
+		if ( fd == INVALID_SOCKET ) continue;
+
+		serve_client( metrics, fd );
+		closesocket( fd );
+	}
+
+}  /* serve_requests */
+
+/*
+ * static DWORD WINAPI metrics_thread( LPVOID arg );
+ * static void *metrics_thread( void *arg );
+ *
+ * The function metrics_thread() is the entry point of the exporter thread.
+ */
+
+#if defined(_WIN32)
+static DWORD WINAPI metrics_thread( LPVOID arg ) {
+
+	serve_requests( arg );
+	return 0;
+
+}  /* metrics_thread */
+#else  /* defined(_WIN32) */
+static void *metrics_thread( void *arg ) {
+
+	serve_requests( arg );
+	return NULL;
+
+}  /* metrics_thread */
+#endif  /* defined(_WIN32) */
+
+/*
+ * static void lock_metrics( struct fins_metrics_tp *metrics );
+ * static void unlock_metrics( struct fins_metrics_tp *metrics );
+ *
+ * The functions lock_metrics() and unlock_metrics() protect the source list
+ * against concurrent changes while the exporter thread formats a response.
+ */
+
+static void lock_metrics( struct fins_metrics_tp *metrics ) {
+
+#if defined(_WIN32)
+	EnterCriticalSection( & metrics->lock );
+#else  /* defined(_WIN32) */
+	pthread_mutex_lock( & metrics->lock );
+#endif  /* defined(_WIN32) */
+
+}  /* lock_metrics */
+
+static void unlock_metrics( struct fins_metrics_tp *metrics ) {
+
+#if defined(_WIN32)
+	LeaveCriticalSection( & metrics->lock );
+#else  /* defined(_WIN32) */
+	pthread_mutex_unlock( & metrics->lock );
+#endif  /* defined(_WIN32) */
+
+}  /* unlock_metrics */
+
+/*
+ * static int socket_error( void );
+ *
+ * The function socket_error() translates the error of the last failed socket
+ * call to a FINS_RETVAL_... value.
+ */
+
+static int socket_error( void ) {
+
+#if defined(_WIN32)
+	return XX_finslib_wsa_errorcode_to_fins_retval( WSAGetLastError() );
+#else  /* defined(_WIN32) */
+	return FINS_RETVAL_ERRNO_BASE + errno;
+#endif  /* defined(_WIN32) */
+
+}  /* socket_error */
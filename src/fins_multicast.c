@@ -0,0 +1,789 @@
+/*
+ * Library: libfins
+ * File:    src/fins_multicast.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_multicast.c contains routines to distribute data
+ * which is polled from a remote PLC to any number of hosts on the local network
+ * with UDP multicast. A publisher polls the PLC once and sends versioned and
+ * sequence numbered block updates. Subscribers rebuild a local copy of the data
+ * from these updates.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ! defined(_WIN32)
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#endif  /* ! defined(_WIN32) */
+
+#include "fins.h"
+
+#define MCAST_HEADER_LEN	20
+#define MCAST_BUFLEN		(MCAST_HEADER_LEN+2*FINS_MULTICAST_MAX_WORDS)
+#define MCAST_TYPE_FULL		0x01
+#define MCAST_TYPE_DELTA	0x02
+#define MCAST_MERGE_GAP		(MCAST_HEADER_LEN/2)
+
+#if defined(_WIN32)
+typedef char		recv_tp;
+typedef const char	sendto_tp;
+typedef const char	setsockopt_tp;
+#else  /* defined(_WIN32) */
+typedef void		recv_tp;
+typedef void		sendto_tp;
+typedef void		setsockopt_tp;
+#endif  /* defined(_WIN32) */
+
+static struct fins_mcastlink_tp *	find_link( struct fins_subscriber_tp *sub, uint16_t id );
+static void				handle_datagram( struct fins_subscriber_tp *sub, const unsigned char *buf, size_t len, size_t *num_changed );
+static void				invalidate_all( struct fins_subscriber_tp *sub );
+static int				publish_block( struct fins_publisher_tp *pub, struct fins_mcastlink_tp *link, uint64_t now );
+static int				send_datagram( struct fins_publisher_tp *pub, const struct fins_mcastlink_tp *link, uint8_t type, size_t offset, size_t count );
+static int				socket_error( void );
+
+/*
+ * struct fins_publisher_tp *finslib_publisher_create( struct fins_sys_tp *sys, const char *group, uint16_t port, const char *interface_address, int ttl, uint32_t refresh_msec, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val );
+ *
+ * The function finslib_publisher_create() creates a publisher which polls a
+ * list of memory blocks in a remote PLC and multicasts the changes to a
+ * multicast group. The interface address may be NULL to let the operating
+ * system choose the interface. Every block is sent completely at least once
+ * every refresh_msec milliseconds, so that subscribers which joined late or
+ * missed a datagram can recover without asking for a retransmission. On
+ * success a pointer to the publisher is returned. Otherwise the return value
+ * is NULL and the reason is stored in the variable pointed to by error_val.
+ */
+
+struct fins_publisher_tp *finslib_publisher_create( struct fins_sys_tp *sys, const char *group, uint16_t port, const char *interface_address, int ttl, uint32_t refresh_msec, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val ) {
+
+	struct fins_publisher_tp *pub;
+	struct in_addr iface;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	pub    = NULL;
+
+	if      ( sys   == NULL                     ) retval = FINS_RETVAL_NOT_INITIALIZED;
+	else if ( group == NULL  ||  port == 0      ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+	else if ( block == NULL  ||  num_block == 0 ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+	else if ( ( pub = calloc( 1, sizeof(struct fins_publisher_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( pub != NULL ) {
+
+		pub->sys          = sys;
+		pub->sockfd       = INVALID_SOCKET;
+		pub->refresh_usec = 1000 * (uint64_t) refresh_msec;
+		pub->link         = XX_finslib_mcast_create_links( block, num_block, true, & retval );
+
+		if ( pub->link != NULL ) pub->num_link = num_block;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) retval = XX_finslib_mcast_resolve_links( sys, pub->link, pub->num_link );
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		memset( & pub->group, 0, sizeof(pub->group) );
+
+		pub->group.sin_family = AF_INET;
+		pub->group.sin_port   = htons( port );
+
+		if ( finslib_inet_pton( AF_INET, group, & pub->group.sin_addr ) != 1 ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+		else if ( interface_address != NULL  &&  finslib_inet_pton( AF_INET, interface_address, & iface ) != 1 ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+		else if ( ( pub->sockfd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP ) ) == INVALID_SOCKET ) retval = socket_error();
+		else if ( setsockopt( pub->sockfd, IPPROTO_IP, IP_MULTICAST_TTL, (setsockopt_tp *) & ttl, sizeof(ttl) ) < 0 ) retval = socket_error();
+		else if ( interface_address != NULL  &&  setsockopt( pub->sockfd, IPPROTO_IP, IP_MULTICAST_IF, (setsockopt_tp *) & iface, sizeof(iface) ) < 0 ) retval = socket_error();
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  ( pub->buffer = malloc( MCAST_BUFLEN ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_publisher_free( pub );
+		return NULL;
+	}
+
+	return pub;
+
+}  /* finslib_publisher_create */
+
+/*
+ * void finslib_publisher_free( struct fins_publisher_tp *pub );
+ *
+ * The function finslib_publisher_free() closes the multicast socket of a
+ * publisher and releases all memory associated with it. The connection with
+ * the PLC is not closed.
+ */
+
+void finslib_publisher_free( struct fins_publisher_tp *pub ) {
+
+	if ( pub == NULL ) return;
+
+	if ( pub->sockfd != INVALID_SOCKET ) closesocket( pub->sockfd );
+
+	XX_finslib_mcast_free_links( pub->link, pub->num_link );
+	free( pub->buffer );
+	free( pub );
+
+}  /* finslib_publisher_free */
+
+/*
+ * int finslib_publisher_poll( struct fins_publisher_tp *pub );
+ *
+ * The function finslib_publisher_poll() reads all blocks from the PLC and
+ * publishes them. A block which is due for a periodic refresh is sent
+ * completely. Otherwise only the changed parts of a block are sent. Changed
+ * words which are close to each other are combined in one datagram, because
+ * sending a few unchanged words costs less than the header of an extra
+ * datagram. Unchanged blocks which are not due for a refresh are not sent.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_publisher_poll( struct fins_publisher_tp *pub ) {
+
+	size_t a;
+	uint64_t now;
+	int retval;
+
+	if ( pub              == NULL           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( pub->sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	for (a=0; a<pub->num_link; a++) {
+
+		pub->link[a].changed = false;
+
+		if ( ( retval = XX_finslib_mcast_read_block( pub->sys, & pub->link[a], & pub->frames_read ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		now = finslib_epoch_usec_timer();
+
+		if ( ( retval = publish_block( pub, & pub->link[a], now ) ) != FINS_RETVAL_SUCCESS ) {
+
+			pub->link[a].data_valid = false;
+			return retval;
+		}
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_publisher_poll */
+
+/*
+ * struct fins_subscriber_tp *finslib_subscriber_create( const char *group, uint16_t port, const char *interface_address, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val );
+ *
+ * The function finslib_subscriber_create() joins a multicast group and
+ * prepares a local copy of the blocks which are sent by a publisher. The
+ * block definitions must have the same IDs and sizes as those of the
+ * publisher. Datagrams for other blocks are ignored. The interface address
+ * may be NULL to let the operating system choose the interface. On success a
+ * pointer to the subscriber is returned. Otherwise the return value is NULL
+ * and the reason is stored in the variable pointed to by error_val.
+ */
+
+struct fins_subscriber_tp *finslib_subscriber_create( const char *group, uint16_t port, const char *interface_address, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val ) {
+
+	struct fins_subscriber_tp *sub;
+	struct sockaddr_in local_addr;
+	struct ip_mreq mreq;
+	int reuse;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	sub    = NULL;
+	reuse  = 1;
+
+	memset( & mreq, 0, sizeof(mreq) );
+
+	mreq.imr_interface.s_addr = htonl( INADDR_ANY );
+
+	if      ( group == NULL  ||  port == 0      ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+	else if ( block == NULL  ||  num_block == 0 ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+	else if ( finslib_inet_pton( AF_INET, group, & mreq.imr_multiaddr ) != 1 ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+	else if ( interface_address != NULL  &&  finslib_inet_pton( AF_INET, interface_address, & mreq.imr_interface ) != 1 ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+	else if ( ( sub = calloc( 1, sizeof(struct fins_subscriber_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( sub != NULL ) {
+
+		sub->sockfd = INVALID_SOCKET;
+		sub->link   = XX_finslib_mcast_create_links( block, num_block, false, & retval );
+
+		if ( sub->link != NULL ) sub->num_link = num_block;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		memset( & local_addr, 0, sizeof(local_addr) );
+
+		local_addr.sin_family      = AF_INET;
+		local_addr.sin_addr.s_addr = htonl( INADDR_ANY );
+		local_addr.sin_port        = htons( port );
+
+		if      ( ( sub->sockfd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP ) ) == INVALID_SOCKET ) retval = socket_error();
+		else if ( setsockopt( sub->sockfd, SOL_SOCKET, SO_REUSEADDR, (setsockopt_tp *) & reuse, sizeof(reuse) ) < 0 ) retval = socket_error();
+#if defined(SO_REUSEPORT)
+		else if ( setsockopt( sub->sockfd, SOL_SOCKET, SO_REUSEPORT, (setsockopt_tp *) & reuse, sizeof(reuse) ) < 0 ) retval = socket_error();
+#endif  /* defined(SO_REUSEPORT) */
+		else if ( bind( sub->sockfd, (struct sockaddr *) & local_addr, sizeof(local_addr) ) < 0 ) retval = socket_error();
+		else if ( setsockopt( sub->sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (setsockopt_tp *) & mreq, sizeof(mreq) ) < 0 ) retval = socket_error();
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  ( sub->buffer = malloc( MCAST_BUFLEN ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_subscriber_free( sub );
+		return NULL;
+	}
+
+	return sub;
+
+}  /* finslib_subscriber_create */
+
+/*
+ * void finslib_subscriber_free( struct fins_subscriber_tp *sub );
+ *
+ * The function finslib_subscriber_free() leaves the multicast group and
+ * releases all memory associated with a subscriber.
+ */
+
+void finslib_subscriber_free( struct fins_subscriber_tp *sub ) {
+
+	if ( sub == NULL ) return;
+
+	if ( sub->sockfd != INVALID_SOCKET ) closesocket( sub->sockfd );
+
+	XX_finslib_mcast_free_links( sub->link, sub->num_link );
+	free( sub->buffer );
+	free( sub );
+
+}  /* finslib_subscriber_free */
+
+/*
+ * int finslib_subscriber_receive( struct fins_subscriber_tp *sub, int timeout_msec, size_t *num_changed );
+ *
+ * The function finslib_subscriber_receive() waits at most timeout_msec
+ * milliseconds for a datagram from the publisher. It then processes that
+ * datagram and all other datagrams which are already waiting, without
+ * blocking again. The number of blocks which changed is returned in
+ * num_changed and the changed flag of these blocks is set.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_subscriber_receive( struct fins_subscriber_tp *sub, int timeout_msec, size_t *num_changed ) {
+
+	size_t a;
+	size_t changed;
+	fd_set readfds;
+	struct timeval tv;
+	int retval;
+	int len;
+
+	changed = 0;
+
+	if ( num_changed != NULL ) *num_changed = 0;
+
+	if ( sub == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	for (a=0; a<sub->num_link; a++) sub->link[a].changed = false;
+
+	if ( timeout_msec < 0 ) timeout_msec = 0;
+
+	tv.tv_sec  = timeout_msec / 1000;
+	tv.tv_usec = 1000 * ( timeout_msec % 1000 );
+
+	do {
+		FD_ZERO( & readfds );
+		FD_SET( sub->sockfd, & readfds );
+
+		retval = select( (int) sub->sockfd + 1, & readfds, NULL, NULL, & tv );
+
+		if ( retval <  0 ) return socket_error();
+		if ( retval == 0 ) break;
+
+		len = recv( sub->sockfd, (recv_tp *) sub->buffer, MCAST_BUFLEN, 0 );
+		if ( len < 0 ) return socket_error();
+
+		handle_datagram( sub, sub->buffer, (size_t) len, & changed );
+
+		tv.tv_sec  = 0;
+		tv.tv_usec = 0;
+
+	} while ( true );
+
+	if ( num_changed != NULL ) *num_changed = changed;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_subscriber_receive */
+
+/*
+ * struct fins_mcastlink_tp *XX_finslib_mcast_create_links( const struct fins_mcastblock_tp *block, size_t num_block, bool publisher, int *error_val );
+ *
+ * The function XX_finslib_mcast_create_links() allocates and initializes the
+ * administration of a list of multicast blocks. A publisher needs an extra
+ * buffer per block to compare the new data with the previous data. Blocks are
+ * checked for a valid size and unique IDs. If the administration cannot be
+ * created, NULL is returned and the reason is stored in error_val.
+ */
+
+struct fins_mcastlink_tp *XX_finslib_mcast_create_links( const struct fins_mcastblock_tp *block, size_t num_block, bool publisher, int *error_val ) {
+
+	size_t a;
+	size_t b;
+	struct fins_mcastlink_tp *link;
+	int retval;
+
+	if ( *error_val != FINS_RETVAL_SUCCESS ) return NULL;
+
+	link = calloc( num_block, sizeof(struct fins_mcastlink_tp) );
+	if ( link == NULL ) { *error_val = FINS_RETVAL_OUT_OF_MEMORY; return NULL; }
+
+	retval = FINS_RETVAL_SUCCESS;
+
+	for (a=0; retval == FINS_RETVAL_SUCCESS  &&  a<num_block; a++) {
+
+		link[a].block = block[a];
+		link[a].block.address[sizeof(link[a].block.address)-1] = 0;
+
+		if ( block[a].num_words == 0  ||  block[a].num_words > 0xFFFF ) { retval = FINS_RETVAL_INVALID_LAYOUT; break; }
+
+		for (b=0; b<a; b++) if ( block[b].id == block[a].id ) retval = FINS_RETVAL_INVALID_LAYOUT;
+
+		link[a].data = calloc( block[a].num_words, sizeof(uint16_t) );
+		if ( link[a].data == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+		if ( publisher ) {
+
+			link[a].next = malloc( block[a].num_words * sizeof(uint16_t) );
+			if ( link[a].next == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+		}
+	}
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		XX_finslib_mcast_free_links( link, num_block );
+		link = NULL;
+	}
+
+	*error_val = retval;
+
+	return link;
+
+}  /* XX_finslib_mcast_create_links */
+
+/*
+ * void XX_finslib_mcast_free_links( struct fins_mcastlink_tp *link, size_t num_link );
+ *
+ * The function XX_finslib_mcast_free_links() releases the administration of a
+ * list of multicast blocks.
+ */
+
+void XX_finslib_mcast_free_links( struct fins_mcastlink_tp *link, size_t num_link ) {
+
+	size_t a;
+
+	if ( link == NULL ) return;
+
+	for (a=0; a<num_link; a++) {
+
+		free( link[a].data );
+		free( link[a].next );
+	}
+
+	free( link );
+
+}  /* XX_finslib_mcast_free_links */
+
+/*
+ * int XX_finslib_mcast_resolve_links( struct fins_sys_tp *sys, struct fins_mcastlink_tp *link, size_t num_link );
+ *
+ * The function XX_finslib_mcast_resolve_links() translates the start
+ * addresses of a list of blocks to the area codes and word addresses used in
+ * the FINS read commands to the PLC.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int XX_finslib_mcast_resolve_links( struct fins_sys_tp *sys, struct fins_mcastlink_tp *link, size_t num_link ) {
+
+	size_t a;
+	struct fins_address_tp address;
+	const struct fins_area_tp *area_ptr;
+
+	for (a=0; a<num_link; a++) {
+
+		if ( XX_finslib_decode_address( link[a].block.address, & address ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+
+		area_ptr = XX_finslib_search_area( sys, & address, 16, FI_RD, false );
+		if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+
+		link[a].area   = area_ptr->area;
+		link[a].start  = address.main_address;
+		link[a].start += area_ptr->low_addr >> 8;
+		link[a].start -= area_ptr->low_id;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* XX_finslib_mcast_resolve_links */
+
+/*
+ * int XX_finslib_mcast_read_block( struct fins_sys_tp *sys, struct fins_mcastlink_tp *link, uint32_t *frames_read );
+ *
+ * The function XX_finslib_mcast_read_block() reads the contents of one block
+ * from the PLC in frames of the maximum size into the next buffer of the
+ * block. The number of frames sent is added to the counter frames_read.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int XX_finslib_mcast_read_block( struct fins_sys_tp *sys, struct fins_mcastlink_tp *link, uint32_t *frames_read ) {
+
+	size_t a;
+	size_t chunk_length;
+	size_t offset;
+	size_t todo;
+	size_t bodylen;
+	uint32_t chunk_start;
+	struct fins_command_tp fins_cmnd;
+	int retval;
+
+	offset = 0;
+	todo   = link->block.num_words;
+
+	do {
+		chunk_length = FINS_MAX_READ_WORDS_SYSWAY;
+		if ( chunk_length > todo ) chunk_length = todo;
+
+		chunk_start = link->start + offset;
+
+		XX_finslib_init_command( sys, & fins_cmnd, 0x01, 0x01 );
+
+		bodylen = 0;
+
+		fins_cmnd.body[bodylen++] = link->area;
+		fins_cmnd.body[bodylen++] = (chunk_start  >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_start      ) & 0xff;
+		fins_cmnd.body[bodylen++] = 0x00;
+		fins_cmnd.body[bodylen++] = (chunk_length >> 8) & 0xff;
+		fins_cmnd.body[bodylen++] = (chunk_length     ) & 0xff;
+
+		if ( ( retval = XX_finslib_communicate( sys, & fins_cmnd, & bodylen, true ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		(*frames_read)++;
+
+		if ( bodylen != 2+2*chunk_length ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+		for (a=0; a<chunk_length; a++) link->next[offset+a] = ( fins_cmnd.body[2+2*a] << 8 ) | fins_cmnd.body[3+2*a];
+
+		todo   -= chunk_length;
+		offset += chunk_length;
+
+	} while ( todo > 0 );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* XX_finslib_mcast_read_block */
+
+/*
+ * static int publish_block( struct fins_publisher_tp *pub, struct fins_mcastlink_tp *link, uint64_t now );
+ *
+ * The function publish_block() compares the freshly read data of a block
+ * with the previously published data and sends either the whole block or
+ * the changed ranges. Afterwards the fresh data becomes the published data.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int publish_block( struct fins_publisher_tp *pub, struct fins_mcastlink_tp *link, uint64_t now ) {
+
+	size_t a;
+	size_t first;
+	size_t last;
+	size_t offset;
+	size_t count;
+	uint16_t *swap;
+	bool full;
+	int retval;
+
+	full = ( ! link->data_valid )  ||  ( now - link->last_full >= pub->refresh_usec );
+
+	if ( ! link->data_valid  ||  memcmp( link->next, link->data, link->block.num_words * sizeof(uint16_t) ) ) {
+
+		link->version++;
+		link->changed = true;
+	}
+
+	swap       = link->data;
+	link->data = link->next;
+	link->next = swap;
+
+	if ( full ) {
+
+		for (offset=0; offset<link->block.num_words; offset+=count) {
+
+			count = link->block.num_words - offset;
+			if ( count > FINS_MULTICAST_MAX_WORDS ) count = FINS_MULTICAST_MAX_WORDS;
+
+			if ( ( retval = send_datagram( pub, link, MCAST_TYPE_FULL, offset, count ) ) != FINS_RETVAL_SUCCESS ) return retval;
+		}
+
+		link->last_full  = now;
+		link->data_valid = true;
+
+		return FINS_RETVAL_SUCCESS;
+	}
+
+	if ( ! link->changed ) return FINS_RETVAL_SUCCESS;
+
+	a = 0;
+
+	while ( a < link->block.num_words ) {
+
+		if ( link->data[a] == link->next[a] ) { a++; continue; }
+
+		first = a;
+		last  = a;
+
+		for (a=first+1; a<link->block.num_words  &&  a-last <= MCAST_MERGE_GAP  &&  a-first < FINS_MULTICAST_MAX_WORDS; a++) {
+
+			if ( link->data[a] != link->next[a] ) last = a;
+		}
+
+		if ( ( retval = send_datagram( pub, link, MCAST_TYPE_DELTA, first, last-first+1 ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		a = last + 1;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* publish_block */
+
+/*
+ * static int send_datagram( struct fins_publisher_tp *pub, const struct fins_mcastlink_tp *link, uint8_t type, size_t offset, size_t count );
+ *
+ * The function send_datagram() sends a range of words of a block to the
+ * multicast group. Each datagram carries the sequence number of the
+ * publisher, the block ID, version and size and the position of the range in
+ * the block. All values are in big endian order.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int send_datagram( struct fins_publisher_tp *pub, const struct fins_mcastlink_tp *link, uint8_t type, size_t offset, size_t count ) {
+
+	size_t a;
+	size_t len;
+	unsigned char *buf;
+
+	buf = pub->buffer;
+	len = 0;
+
+	buf[len++] = 'F';
+	buf[len++] = 'M';
+	buf[len++] = type;
+	buf[len++] = 0x00;
+	buf[len++] = (pub->sequence      >> 24) & 0xff;
+	buf[len++] = (pub->sequence      >> 16) & 0xff;
+	buf[len++] = (pub->sequence      >>  8) & 0xff;
+	buf[len++] = (pub->sequence           ) & 0xff;
+	buf[len++] = (link->block.id     >>  8) & 0xff;
+	buf[len++] = (link->block.id          ) & 0xff;
+	buf[len++] = (link->version      >> 24) & 0xff;
+	buf[len++] = (link->version      >> 16) & 0xff;
+	buf[len++] = (link->version      >>  8) & 0xff;
+	buf[len++] = (link->version           ) & 0xff;
+	buf[len++] = (link->block.num_words >> 8) & 0xff;
+	buf[len++] = (link->block.num_words     ) & 0xff;
+	buf[len++] = (offset             >>  8) & 0xff;
+	buf[len++] = (offset                  ) & 0xff;
+	buf[len++] = (count              >>  8) & 0xff;
+	buf[len++] = (count                   ) & 0xff;
+
+	for (a=0; a<count; a++) {
+
+		buf[len++] = (link->data[offset+a] >> 8) & 0xff;
+		buf[len++] = (link->data[offset+a]     ) & 0xff;
+	}
+
+	pub->sequence++;
+
+	if ( sendto( pub->sockfd, (sendto_tp *) buf, (int) len, 0, (struct sockaddr *) & pub->group, sizeof(pub->group) ) != (int) len ) return socket_error();
+
+	pub->datagrams_sent++;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* send_datagram */
+
+/*
+ * static void handle_datagram( struct fins_subscriber_tp *sub, const unsigned char *buf, size_t len, size_t *num_changed );
+ *
+ * The function handle_datagram() applies one datagram to the local copy. A
+ * gap in the sequence numbers means that a datagram was lost and all blocks
+ * become invalid until they have been received completely in a periodic
+ * refresh. A delta is only accepted for a valid block when it continues the
+ * version of the local copy. Malformed datagrams are ignored.
+ */
+
+static void handle_datagram( struct fins_subscriber_tp *sub, const unsigned char *buf, size_t len, size_t *num_changed ) {
+
+	size_t a;
+	size_t offset;
+	size_t count;
+	size_t num_words;
+	uint32_t sequence;
+	uint32_t version;
+	uint16_t id;
+	struct fins_mcastlink_tp *link;
+	bool was_valid;
+
+	if ( len < MCAST_HEADER_LEN  ||  buf[0] != 'F'  ||  buf[1] != 'M' ) return;
+
+	sequence  = ( (uint32_t) buf[4]  << 24 ) | ( (uint32_t) buf[5]  << 16 ) | ( (uint32_t) buf[6] << 8 ) | buf[7];
+	id        = (uint16_t) ( ( buf[8] << 8 ) | buf[9] );
+	version   = ( (uint32_t) buf[10] << 24 ) | ( (uint32_t) buf[11] << 16 ) | ( (uint32_t) buf[12] << 8 ) | buf[13];
+	num_words = ( (size_t)   buf[14] <<  8 ) | buf[15];
+	offset    = ( (size_t)   buf[16] <<  8 ) | buf[17];
+	count     = ( (size_t)   buf[18] <<  8 ) | buf[19];
+
+	if ( len != MCAST_HEADER_LEN + 2*count ) return;
+
+	sub->datagrams_received++;
+
+	if ( sub->sequence_valid  &&  sequence != sub->sequence ) {
+
+		sub->gaps++;
+		invalidate_all( sub );
+	}
+
+	sub->sequence       = sequence + 1;
+	sub->sequence_valid = true;
+
+	link = find_link( sub, id );
+	if ( link == NULL  ||  link->block.num_words != num_words  ||  offset + count > num_words ) return;
+
+	for (a=0; a<count; a++) link->data[offset+a] = (uint16_t) ( ( buf[MCAST_HEADER_LEN+2*a] << 8 ) | buf[MCAST_HEADER_LEN+2*a+1] );
+
+	was_valid = link->data_valid;
+
+	if ( buf[2] == MCAST_TYPE_FULL ) {
+
+		if ( link->full_version != version  ||  offset == 0 ) link->full_received = 0;
+
+		link->full_version   = version;
+		link->full_received += count;
+
+		if ( link->full_received >= num_words ) {
+
+			if ( ! was_valid  ||  link->version != version ) {
+
+				if ( ! link->changed ) (*num_changed)++;
+				link->changed = true;
+			}
+
+			link->version       = version;
+			link->data_valid    = true;
+			link->full_received = 0;
+		}
+	}
+
+	else if ( buf[2] == MCAST_TYPE_DELTA  &&  was_valid ) {
+
+		if ( version == link->version + 1  ||  version == link->version ) {
+
+			link->version = version;
+
+			if ( ! link->changed ) (*num_changed)++;
+			link->changed = true;
+		}
+
+		else link->data_valid = false;
+	}
+
+}  /* handle_datagram */
+
+/*
+ * static void invalidate_all( struct fins_subscriber_tp *sub );
+ *
+ * The function invalidate_all() marks all local blocks as invalid after a
+ * datagram was lost.
+ */
+
+static void invalidate_all( struct fins_subscriber_tp *sub ) {
+
+	size_t a;
+
+	for (a=0; a<sub->num_link; a++) {
+
+		sub->link[a].data_valid    = false;
+		sub->link[a].full_received = 0;
+	}
+
+}  /* invalidate_all */
+
+/*
+ * static struct fins_mcastlink_tp *find_link( struct fins_subscriber_tp *sub, uint16_t id );
+ *
+ * The function find_link() returns the local block with the given ID, or
+ * NULL if the subscriber does not follow that block.
+ */
+
+static struct fins_mcastlink_tp *find_link( struct fins_subscriber_tp *sub, uint16_t id ) {
+
+	size_t a;
+
+	for (a=0; a<sub->num_link; a++) if ( sub->link[a].block.id == id ) return & sub->link[a];
+
+	return NULL;
+
+}  /* find_link */
+
+/*
+ * static int socket_error( void );
+ *
+ * The function socket_error() translates the error of the last failed socket
+ * call to a FINS_RETVAL_... value.
+ */
+
+static int socket_error( void ) {
+
+#if defined(_WIN32)
+	return XX_finslib_wsa_errorcode_to_fins_retval( WSAGetLastError() );
+#else  /* defined(_WIN32) */
+	return FINS_RETVAL_ERRNO_BASE + errno;
+#endif  /* defined(_WIN32) */
+
+}  /* socket_error */
@@ -0,0 +1,252 @@
+/*
+ * Library: libfins
+ * File:    src/fins_realtime.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_realtime.c contains routines to run the threads which
+ * poll a remote PLC with a real-time execution profile and a periodic clock which
+ * reports deadline misses and wakeup latency.
+ */
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif  /* defined(__linux__) */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#if ! defined(_WIN32)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif  /* ! defined(_WIN32) */
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif  /* defined(__GLIBC__) */
+
+#include "fins.h"
+
+#define PREFAULT_CHUNK		16384
+
+#if ! defined(_WIN32)
+static void		prefault_stack( size_t size );
+#endif  /* ! defined(_WIN32) */
+
+/*
+ * int finslib_rtprofile_apply( const struct fins_rtprofile_tp *profile );
+ *
+ * The function finslib_rtprofile_apply() applies a real-time execution
+ * profile to the calling thread. The thread is bound to one CPU core, gets a
+ * SCHED_FIFO priority, all memory of the process is locked in RAM and part of
+ * the stack is touched in advance, so that the poll loop of the thread does
+ * not suffer from preemption by normal threads or from page faults. The
+ * function should be called at the start of the thread which polls the PLC,
+ * before the buffers of the poll loop are allocated.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_rtprofile_apply( const struct fins_rtprofile_tp *profile ) {
+
+#if defined(_WIN32)
+
+	(void) profile;
+
+	return FINS_RETVAL_NOT_SUPPORTED;
+
+#else  /* defined(_WIN32) */
+
+	int retval;
+	struct sched_param param;
+#if defined(__linux__)
+	cpu_set_t cpu_set;
+#endif  /* defined(__linux__) */
+
+	if ( profile == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	if ( profile->cpu >= 0 ) {
+
+#if defined(__linux__)
+		if ( profile->cpu >= CPU_SETSIZE ) return FINS_RETVAL_INVALID_LAYOUT;
+
+		CPU_ZERO( & cpu_set );
+		CPU_SET( profile->cpu, & cpu_set );
+
+		if ( ( retval = pthread_setaffinity_np( pthread_self(), sizeof(cpu_set), & cpu_set ) ) != 0 ) return FINS_RETVAL_ERRNO_BASE + retval;
+#else  /* defined(__linux__) */
+		return FINS_RETVAL_NOT_SUPPORTED;
+#endif  /* defined(__linux__) */
+	}
+
+	if ( profile->priority > 0 ) {
+
+		if ( profile->priority < sched_get_priority_min( SCHED_FIFO )  ||
+		     profile->priority > sched_get_priority_max( SCHED_FIFO ) ) return FINS_RETVAL_INVALID_LAYOUT;
+
+		memset( & param, 0, sizeof(param) );
+		param.sched_priority = profile->priority;
+
+		if ( ( retval = pthread_setschedparam( pthread_self(), SCHED_FIFO, & param ) ) != 0 ) return FINS_RETVAL_ERRNO_BASE + retval;
+	}
+
+	if ( profile->lock_memory ) {
+
+#if defined(__GLIBC__)
+		mallopt( M_TRIM_THRESHOLD, -1 );
+		mallopt( M_MMAP_MAX,        0 );
+#endif  /* defined(__GLIBC__) */
+
+		if ( mlockall( MCL_CURRENT | MCL_FUTURE ) != 0 ) return FINS_RETVAL_ERRNO_BASE + errno;
+	}
+
+	if ( profile->stack_prefault > 0 ) prefault_stack( profile->stack_prefault );
+
+	return FINS_RETVAL_SUCCESS;
+
+#endif  /* defined(_WIN32) */
+
+}  /* finslib_rtprofile_apply */
+
+/*
+ * int finslib_rtclock_init( struct fins_rtclock_tp *rtclock, uint32_t period_usec );
+ *
+ * The function finslib_rtclock_init() prepares a periodic clock for a poll
+ * loop with a fixed cycle time. The first cycle starts one period after the
+ * first call to finslib_rtclock_wait().
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_rtclock_init( struct fins_rtclock_tp *rtclock, uint32_t period_usec ) {
+
+	if ( rtclock     == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( period_usec == 0    ) return FINS_RETVAL_INVALID_LAYOUT;
+
+	rtclock->period_usec       = period_usec;
+	rtclock->next_usec         = 0;
+	rtclock->cycles            = 0;
+	rtclock->deadline_misses   = 0;
+	rtclock->max_wakeup_usec   = 0;
+	rtclock->total_wakeup_usec = 0;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_rtclock_init */
+
+/*
+ * int finslib_rtclock_wait( struct fins_rtclock_tp *rtclock );
+ *
+ * The function finslib_rtclock_wait() sleeps until the start of the next
+ * cycle of a periodic clock. Cycles are scheduled on absolute times, so that
+ * the period does not drift with the time spent in the loop. If the loop took
+ * so long that one or more cycle starts were missed, these are counted as
+ * deadline misses and the clock continues with the next cycle start in the
+ * future. The delay between the planned and actual wakeup is recorded.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_rtclock_wait( struct fins_rtclock_tp *rtclock ) {
+
+	uint64_t now;
+	uint64_t missed;
+	uint32_t wakeup;
+#if ! defined(_WIN32)
+	struct timespec ts;
+#endif  /* ! defined(_WIN32) */
+
+	if ( rtclock              == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( rtclock->period_usec == 0    ) return FINS_RETVAL_INVALID_LAYOUT;
+
+	now = finslib_monotonic_usec_timer();
+
+	if ( rtclock->next_usec == 0 ) rtclock->next_usec = now + rtclock->period_usec;
+	else {
+		rtclock->next_usec += rtclock->period_usec;
+
+		if ( now >= rtclock->next_usec ) {
+
+			missed                    = ( now - rtclock->next_usec ) / rtclock->period_usec + 1;
+			rtclock->deadline_misses += (uint32_t) missed;
+			rtclock->next_usec       += missed * rtclock->period_usec;
+		}
+	}
+
+#if defined(_WIN32)
+
+	finslib_milli_second_sleep( (int) ( ( rtclock->next_usec - now ) / 1000 ) );
+	while ( finslib_monotonic_usec_timer() < rtclock->next_usec ) {};
+
+#else  /* defined(_WIN32) */
+
+	ts.tv_sec  = (time_t) ( rtclock->next_usec / 1000000 );
+	ts.tv_nsec = (long)   ( rtclock->next_usec % 1000000 ) * 1000;
+
+	while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, & ts, NULL ) == EINTR ) {};
+
+#endif  /* defined(_WIN32) */
+
+	wakeup = (uint32_t) ( finslib_monotonic_usec_timer() - rtclock->next_usec );
+
+	rtclock->cycles++;
+	rtclock->total_wakeup_usec += wakeup;
+	if ( wakeup > rtclock->max_wakeup_usec ) rtclock->max_wakeup_usec = wakeup;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_rtclock_wait */
+
+#if ! defined(_WIN32)
+
+/*
+ * static void prefault_stack( size_t size );
+ *
+ * The function prefault_stack() touches the given number of bytes of the
+ * stack below the current stack frame, so that the pages are mapped before
+ * the time critical code needs them. The work is done in chunks by recursion,
+ * with the stack memory written after the recursive call, so that the
+ * compiler cannot turn it into a loop which reuses one stack frame.
+ */
+
+static void prefault_stack( size_t size ) {
+
+	unsigned char chunk[PREFAULT_CHUNK];
+	volatile unsigned char *ptr;
+	size_t a;
+
+	if ( size > PREFAULT_CHUNK ) prefault_stack( size - PREFAULT_CHUNK );
+
+	ptr = chunk;
+
+	for (a=0; a<PREFAULT_CHUNK; a+=256) ptr[a] = 0;
+
+}  /* prefault_stack */
+
+#endif  /* ! defined(_WIN32) */
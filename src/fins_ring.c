@@ -0,0 +1,389 @@
+/*
+ * Library: libfins
+ * File:    src/fins_ring.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_ring.c contains bounded lock-free rings which pass
+ * results of PLC reads from I/O threads to consumer threads. All records are
+ * preallocated when the ring is created, so no memory is allocated while
+ * results are passed.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#if ! defined(_WIN32)
+#include <sched.h>
+#endif  /* ! defined(_WIN32) */
+
+#include "fins.h"
+
+#if defined(_MSC_VER)
+#define RING_LOAD(ptr)			((uint64_t) InterlockedCompareExchange64( (volatile LONG64 *) (ptr), 0, 0 ))
+#define RING_STORE(ptr,val)		InterlockedExchange64( (volatile LONG64 *) (ptr), (LONG64) (val) )
+#define RING_CAS(ptr,old,new)		( InterlockedCompareExchange64( (volatile LONG64 *) (ptr), (LONG64) (new), (LONG64) (old) ) == (LONG64) (old) )
+#define RING_ADD(ptr,val)		InterlockedExchangeAdd64( (volatile LONG64 *) (ptr), (LONG64) (val) )
+#define RING_YIELD()			SwitchToThread()
+#else  /* defined(_MSC_VER) */
+#define RING_LOAD(ptr)			__atomic_load_n( (ptr), __ATOMIC_ACQUIRE )
+#define RING_STORE(ptr,val)		__atomic_store_n( (ptr), (val), __ATOMIC_RELEASE )
+#define RING_CAS(ptr,old,new)		__sync_bool_compare_and_swap( (ptr), (old), (new) )
+#define RING_ADD(ptr,val)		__atomic_fetch_add( (ptr), (val), __ATOMIC_RELAXED )
+#define RING_YIELD()			sched_yield()
+#endif  /* defined(_MSC_VER) */
+
+#define RING_MAX_CAPACITY		((size_t) 1 << 30)
+
+static bool		dequeue( struct fins_ring_tp *ring, struct fins_result_tp *result );
+static bool		enqueue( struct fins_ring_tp *ring, const struct fins_result_tp *result );
+static double		multidata_value( const struct fins_multidata_tp *item );
+
+/*
+ * struct fins_ring_tp *finslib_ring_create( size_t capacity, int type, int policy, int *error_val );
+ *
+ * The function finslib_ring_create() creates a bounded ring of result
+ * records. The capacity is rounded up to the next power of two. A ring of type
+ * FINS_RING_SPSC may only be used by one producer and one consumer thread at a
+ * time, while FINS_RING_MPMC rings can be shared by any number of threads.
+ * The policy determines what happens when a record is pushed in a full ring.
+ *
+ * If an error occurs, NULL is returned and the reason is stored in error_val.
+ */
+
+struct fins_ring_tp *finslib_ring_create( size_t capacity, int type, int policy, int *error_val ) {
+
+	size_t num_slots;
+	size_t a;
+	struct fins_ring_tp *ring;
+
+	if ( capacity == 0  ||  capacity > RING_MAX_CAPACITY                                             ||
+	     ( type   != FINS_RING_SPSC         &&  type   != FINS_RING_MPMC                         )  ||
+	     ( policy != FINS_RING_DROP_OLDEST  &&  policy != FINS_RING_DROP_NEWEST  &&  policy != FINS_RING_BLOCK ) ) {
+
+		if ( error_val != NULL ) *error_val = FINS_RETVAL_INVALID_LAYOUT;
+		return NULL;
+	}
+
+	num_slots = 1;
+	while ( num_slots < capacity ) num_slots <<= 1;
+
+	ring = calloc( 1, sizeof(struct fins_ring_tp) );
+
+	if ( ring == NULL ) {
+
+		if ( error_val != NULL ) *error_val = FINS_RETVAL_OUT_OF_MEMORY;
+		return NULL;
+	}
+
+	ring->slot = calloc( num_slots, sizeof(struct fins_ringslot_tp) );
+
+	if ( ring->slot == NULL ) {
+
+		free( ring );
+
+		if ( error_val != NULL ) *error_val = FINS_RETVAL_OUT_OF_MEMORY;
+		return NULL;
+	}
+
+	for (a=0; a<num_slots; a++) ring->slot[a].sequence = a;
+
+	ring->mask           = num_slots - 1;
+	ring->policy         = policy;
+	ring->multi_producer = ( type == FINS_RING_MPMC );
+	ring->multi_consumer = ( type == FINS_RING_MPMC  ||  policy == FINS_RING_DROP_OLDEST );
+
+	if ( error_val != NULL ) *error_val = FINS_RETVAL_SUCCESS;
+
+	return ring;
+
+}  /* finslib_ring_create */
+
+/*
+ * void finslib_ring_free( struct fins_ring_tp *ring );
+ *
+ * The function finslib_ring_free() releases a ring and all its records. No
+ * thread may use the ring anymore when it is freed.
+ */
+
+void finslib_ring_free( struct fins_ring_tp *ring ) {
+
+	if ( ring == NULL ) return;
+
+	if ( ring->slot != NULL ) free( ring->slot );
+	free( ring );
+
+}  /* finslib_ring_free */
+
+/*
+ * int finslib_ring_push( struct fins_ring_tp *ring, const struct fins_result_tp *result );
+ *
+ * The function finslib_ring_push() copies one record in a ring. When the ring
+ * is full, the overflow policy of the ring decides whether the oldest record
+ * is discarded, the new record is discarded, or the function waits until a
+ * consumer makes room.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ * FINS_RETVAL_RING_FULL is returned if the new record was discarded.
+ */
+
+int finslib_ring_push( struct fins_ring_tp *ring, const struct fins_result_tp *result ) {
+
+	struct fins_result_tp oldest;
+
+	if ( ring   == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( result == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	while ( ! enqueue( ring, result ) ) {
+
+		switch ( ring->policy ) {
+
+			case FINS_RING_DROP_NEWEST :
+
+				RING_ADD( & ring->dropped, 1 );
+				return FINS_RETVAL_RING_FULL;
+
+			case FINS_RING_DROP_OLDEST :
+
+				if ( dequeue( ring, & oldest ) ) RING_ADD( & ring->dropped, 1 );
+				break;
+
+			default :
+
+				RING_YIELD();
+				break;
+		}
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_ring_push */
+
+/*
+ * int finslib_ring_pop( struct fins_ring_tp *ring, struct fins_result_tp *result, size_t max_results, size_t *num_results );
+ *
+ * The function finslib_ring_pop() copies at most max_results of the oldest
+ * records from a ring to an array and removes them from the ring. The
+ * function does not wait. When the ring is empty, the number of records
+ * returned is zero.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_ring_pop( struct fins_ring_tp *ring, struct fins_result_tp *result, size_t max_results, size_t *num_results ) {
+
+	size_t count;
+
+	if ( num_results != NULL ) *num_results = 0;
+
+	if ( ring        == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( result      == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( num_results == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	count = 0;
+
+	while ( count < max_results  &&  dequeue( ring, & result[count] ) ) count++;
+
+	*num_results = count;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_ring_pop */
+
+/*
+ * int finslib_ring_push_multidata( struct fins_ring_tp *ring, const struct fins_multidata_tp *item, size_t num_item, uint32_t first_tag_id, uint64_t timestamp );
+ *
+ * The function finslib_ring_push_multidata() pushes the items of a call to
+ * finslib_multiple_memory_area_read() in a ring. Item n gets the tag ID
+ * first_tag_id+n, the value is converted to a double according to the data
+ * type of the item and the status of the item is copied.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ * FINS_RETVAL_RING_FULL is returned if one or more records were discarded.
+ */
+
+int finslib_ring_push_multidata( struct fins_ring_tp *ring, const struct fins_multidata_tp *item, size_t num_item, uint32_t first_tag_id, uint64_t timestamp ) {
+
+	size_t a;
+	int retval;
+	int final_retval;
+	struct fins_result_tp result;
+
+	if ( ring == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( item == NULL ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	final_retval = FINS_RETVAL_SUCCESS;
+
+	for (a=0; a<num_item; a++) {
+
+		result.tag_id    = first_tag_id + (uint32_t) a;
+		result.status    = item[a].status;
+		result.timestamp = timestamp;
+		result.value     = ( item[a].status == FINS_RETVAL_SUCCESS ) ? multidata_value( & item[a] ) : 0.0;
+
+		retval = finslib_ring_push( ring, & result );
+		if ( retval != FINS_RETVAL_SUCCESS ) final_retval = retval;
+	}
+
+	return final_retval;
+
+}  /* finslib_ring_push_multidata */
+
+/*
+ * static bool enqueue( struct fins_ring_tp *ring, const struct fins_result_tp *result );
+ *
+ * The function enqueue() stores one record in a free slot of a ring. Each slot
+ * has a sequence number which tells whether the slot is free for the current
+ * round of the producer index. A producer claims a slot by advancing the
+ * producer index, with an atomic compare and swap if there may be more than
+ * one producer. The record is published by advancing the sequence number of
+ * the slot. The function returns false if the ring is full.
+ */
+
+static bool enqueue( struct fins_ring_tp *ring, const struct fins_result_tp *result ) {
+
+	uint64_t pos;
+	uint64_t seq;
+	int64_t dif;
+	struct fins_ringslot_tp *slot;
+
+	pos = RING_LOAD( & ring->head );
+
+	for (;;) {
+
+		slot = & ring->slot[pos & ring->mask];
+		seq  = RING_LOAD( & slot->sequence );
+		dif  = (int64_t) ( seq - pos );
+
+		if ( dif == 0 ) {
+
+			if ( ! ring->multi_producer ) {
+
+				RING_STORE( & ring->head, pos+1 );
+				break;
+			}
+
+			if ( RING_CAS( & ring->head, pos, pos+1 ) ) break;
+
+			pos = RING_LOAD( & ring->head );
+		}
+
+		else if ( dif < 0 ) return false;
+		else                pos = RING_LOAD( & ring->head );
+	}
+
+	slot->result = *result;
+	RING_STORE( & slot->sequence, pos+1 );
+
+	return true;
+
+}  /* enqueue */
+
+/*
+ * static bool dequeue( struct fins_ring_tp *ring, struct fins_result_tp *result );
+ *
+ * The function dequeue() removes the oldest record from a ring. It is the
+ * mirror of enqueue(). After the record has been copied, the sequence number
+ * of the slot is advanced by the size of the ring, which frees the slot for
+ * the next round of the producer index. The function returns false if the
+ * ring is empty.
+ */
+
+static bool dequeue( struct fins_ring_tp *ring, struct fins_result_tp *result ) {
+
+	uint64_t pos;
+	uint64_t seq;
+	int64_t dif;
+	struct fins_ringslot_tp *slot;
+
+	pos = RING_LOAD( & ring->tail );
+
+	for (;;) {
+
+		slot = & ring->slot[pos & ring->mask];
+		seq  = RING_LOAD( & slot->sequence );
+		dif  = (int64_t) ( seq - (pos+1) );
+
+		if ( dif == 0 ) {
+
+			if ( ! ring->multi_consumer ) {
+
+				RING_STORE( & ring->tail, pos+1 );
+				break;
+			}
+
+			if ( RING_CAS( & ring->tail, pos, pos+1 ) ) break;
+
+			pos = RING_LOAD( & ring->tail );
+		}
+
+		else if ( dif < 0 ) return false;
+		else                pos = RING_LOAD( & ring->tail );
+	}
+
+	*result = slot->result;
+	RING_STORE( & slot->sequence, pos + ring->mask + 1 );
+
+	return true;
+
+}  /* dequeue */
+
+/*
+ * static double multidata_value( const struct fins_multidata_tp *item );
+ *
+ * The function multidata_value() returns the value of an item of a multiple
+ * memory area read as a double, based on the data type of the item.
+ */
+
+static double multidata_value( const struct fins_multidata_tp *item ) {
+
+	switch ( item->type ) {
+
+		case FINS_DATA_TYPE_INT16       :
+		case FINS_DATA_TYPE_SBCD16_0    :
+		case FINS_DATA_TYPE_SBCD16_1    :
+		case FINS_DATA_TYPE_SBCD16_2    :
+		case FINS_DATA_TYPE_SBCD16_3    : return (double) item->int16;
+		case FINS_DATA_TYPE_UINT16      :
+		case FINS_DATA_TYPE_BCD16       : return (double) item->uint16;
+		case FINS_DATA_TYPE_INT32       :
+		case FINS_DATA_TYPE_SBCD32_0    :
+		case FINS_DATA_TYPE_SBCD32_1    :
+		case FINS_DATA_TYPE_SBCD32_2    :
+		case FINS_DATA_TYPE_SBCD32_3    : return (double) item->int32;
+		case FINS_DATA_TYPE_UINT32      :
+		case FINS_DATA_TYPE_BCD32       : return (double) item->uint32;
+		case FINS_DATA_TYPE_FLOAT       : return (double) item->sfloat;
+		case FINS_DATA_TYPE_DOUBLE      : return          item->dfloat;
+		case FINS_DATA_TYPE_BIT         :
+		case FINS_DATA_TYPE_BIT_FORCED  : return ( item->bit ) ? 1.0 : 0.0;
+		case FINS_DATA_TYPE_WORD_FORCED : return (double) item->word;
+	}
+
+	return 0.0;
+
+}  /* multidata_value */
@@ -42,15 +42,15 @@ static const struct fins_area_tp fins_area[] = {
 	{ FINS_MODE_CS, "CIO", 1,    1,      0x30,      0,    6143, 0x000000, 0x17FF0F,  FI_RD | FI_WR |           FI_MRD                   | FI_FRC, false },
 	{ FINS_MODE_CS, "CIO", 1,    1,      0x70,      0,    6143, 0x000000, 0x17FF0F,                            FI_MRD,                            true  },
 	{ FINS_MODE_CS, "CIO", 16,   2,      0xB0,      0,    6143, 0x000000, 0x17FF00,  FI_RD | FI_WR | FI_FILL | FI_MRD | FI_TRS | FI_TRD,          false },
-	{ FINS_MODE_CS, "CIO", 16,   4,      0xF0,      0,    6143, 0x000000, 0x17FF00,                            FI_MRD,                            true  },
+	{ FINS_MODE_CS, "CIO", 16,   4,      0xF0,      0,    6143, 0x000000, 0x17FF00,  FI_RD                   | FI_MRD,                            true  },
 	{ FINS_MODE_CS, "W",   1,    1,      0x31,      0,     511, 0x000000, 0x01FF0F,  FI_RD | FI_WR           | FI_MRD                   | FI_FRC, false },
 	{ FINS_MODE_CS, "W",   1,    1,      0x71,      0,     511, 0x000000, 0x01FF0F,                            FI_MRD,                            true  },
 	{ FINS_MODE_CS, "W",   16,   2,      0xB1,      0,     511, 0x000000, 0x01FF00,  FI_RD | FI_WR | FI_FILL | FI_MRD | FI_TRS | FI_TRD,          false },
-	{ FINS_MODE_CS, "W",   16,   4,      0xF1,      0,     511, 0x000000, 0x01FF00,                            FI_MRD,                            true  },
+	{ FINS_MODE_CS, "W",   16,   4,      0xF1,      0,     511, 0x000000, 0x01FF00,  FI_RD                   | FI_MRD,                            true  },
 	{ FINS_MODE_CS, "H",   1,    1,      0x32,      0,     511, 0x000000, 0x01FF0F,  FI_RD | FI_WR           | FI_MRD                   | FI_FRC, false },
 	{ FINS_MODE_CS, "H",   1,    1,      0x72,      0,     511, 0x000000, 0x01FF0F,                            FI_MRD,                            true  },
 	{ FINS_MODE_CS, "H",   16,   2,      0xB2,      0,     511, 0x000000, 0x01FF00,  FI_RD | FI_WR | FI_FILL | FI_MRD | FI_TRS | FI_TRD,          false },
-	{ FINS_MODE_CS, "H",   16,   4,      0xF2,      0,     511, 0x000000, 0x01FF00,                            FI_MRD,                            true  },
+	{ FINS_MODE_CS, "H",   16,   4,      0xF2,      0,     511, 0x000000, 0x01FF00,  FI_RD                   | FI_MRD,                            true  },
 	{ FINS_MODE_CS, "A",   1,    1,      0x33,      0,     959, 0x000000, 0x03BF0F,  FI_RD                   | FI_MRD,                            false },
 	{ FINS_MODE_CS, "A",   1,    1,      0x33,    448,     959, 0x01C000, 0x03BF0F,          FI_WR,                                               false },
 	{ FINS_MODE_CS, "A",   16,   2,      0xB3,      0,     959, 0x000000, 0x03BF00,  FI_RD                   | FI_MRD | FI_TRS,                   false },
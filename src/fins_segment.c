@@ -0,0 +1,524 @@
+/*
+ * Library: libfins
+ * File:    src/fins_segment.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_segment.c contains routines to share a bandwidth
+ * budget between all connections with PLCs on the same network segment. Bulk
+ * traffic is scheduled fairly within the budget and control traffic is never
+ * delayed.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fins.h"
+
+#define SEGMENT_TCP_OVERHEAD	74
+#define SEGMENT_UDP_OVERHEAD	46
+
+static double			byte_capacity( const struct fins_segment_tp *segment );
+static void			charge( struct fins_segment_tp *segment, size_t bytes );
+static double			frame_capacity( const struct fins_segment_tp *segment );
+static bool			is_bulk( const struct fins_sys_tp *sys, const struct fins_command_tp *command, size_t bodylen );
+static size_t			overhead( const struct fins_sys_tp *sys );
+static void			refill( struct fins_segment_tp *segment, uint64_t now );
+static uint64_t			short_usec( const struct fins_segment_tp *segment );
+static void			wait_turn( struct fins_segment_tp *segment, uint64_t timeout_usec );
+
+/*
+ * struct fins_segment_tp *finslib_segment_create( const char *name, uint32_t bytes_per_sec, uint32_t frames_per_sec, int *error_val );
+ *
+ * The function finslib_segment_create() creates a network segment with a
+ * shared budget of bytes and frames per second. A budget of 0 means no limit
+ * for that unit. On success a pointer to the segment is returned. Otherwise
+ * the return value is NULL and the reason is stored in the variable pointed
+ * to by error_val.
+ */
+
+struct fins_segment_tp *finslib_segment_create( const char *name, uint32_t bytes_per_sec, uint32_t frames_per_sec, int *error_val ) {
+
+	struct fins_segment_tp *segment;
+#if ! defined(_WIN32)
+	pthread_condattr_t attr;
+#endif  /* ! defined(_WIN32) */
+	int retval;
+
+	retval  = FINS_RETVAL_SUCCESS;
+	segment = NULL;
+
+	if      ( name == NULL  ||  name[0] == 0  ||  strlen( name ) >= FINS_SEGMENT_NAME_LEN ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( ( segment = calloc( 1, sizeof(struct fins_segment_tp) ) ) == NULL          ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) return NULL;
+
+	strcpy( segment->name, name );
+
+	segment->bytes_per_sec  = bytes_per_sec;
+	segment->frames_per_sec = frames_per_sec;
+	segment->byte_tokens    = byte_capacity(  segment );
+	segment->frame_tokens   = frame_capacity( segment );
+	segment->refill_usec    = finslib_monotonic_usec_timer();
+
+#if defined(_WIN32)
+	InitializeCriticalSection( & segment->lock );
+	InitializeConditionVariable( & segment->turn );
+#else  /* defined(_WIN32) */
+	pthread_mutex_init( & segment->lock, NULL );
+
+	pthread_condattr_init( & attr );
+	pthread_condattr_setclock( & attr, CLOCK_MONOTONIC );
+	pthread_cond_init( & segment->turn, & attr );
+	pthread_condattr_destroy( & attr );
+#endif  /* defined(_WIN32) */
+
+	return segment;
+
+}  /* finslib_segment_create */
+
+/*
+ * void finslib_segment_free( struct fins_segment_tp *segment );
+ *
+ * The function finslib_segment_free() releases a network segment. All
+ * connections must have left the segment before it is released.
+ */
+
+void finslib_segment_free( struct fins_segment_tp *segment ) {
+
+	if ( segment == NULL ) return;
+
+#if defined(_WIN32)
+	DeleteCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	pthread_cond_destroy( & segment->turn );
+	pthread_mutex_destroy( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+	free( segment );
+
+}  /* finslib_segment_free */
+
+/*
+ * int finslib_segment_join( struct fins_segment_tp *segment, struct fins_sys_tp *sys, int traffic_class );
+ *
+ * The function finslib_segment_join() adds a connection to a network
+ * segment. From then on all traffic of the connection counts against the
+ * budget of the segment and bulk traffic waits for its fair share. A
+ * connection which is already in another segment leaves that segment first.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_segment_join( struct fins_segment_tp *segment, struct fins_sys_tp *sys, int traffic_class ) {
+
+	if ( segment == NULL  ||  sys == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	if ( traffic_class != FINS_TRAFFIC_CONTROL  &&
+	     traffic_class != FINS_TRAFFIC_BULK     &&
+	     traffic_class != FINS_TRAFFIC_AUTO        ) return FINS_RETVAL_INVALID_TRAFFIC_CLASS;
+
+	finslib_segment_leave( sys );
+
+#if defined(_WIN32)
+	EnterCriticalSection( & segment->lock );
+	segment->num_members++;
+	LeaveCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	pthread_mutex_lock( & segment->lock );
+	segment->num_members++;
+	pthread_mutex_unlock( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+	sys->segment       = segment;
+	sys->traffic_class = traffic_class;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_segment_join */
+
+/*
+ * void finslib_segment_leave( struct fins_sys_tp *sys );
+ *
+ * The function finslib_segment_leave() removes a connection from its network
+ * segment. Nothing happens if the connection is not in a segment.
+ */
+
+void finslib_segment_leave( struct fins_sys_tp *sys ) {
+
+	struct fins_segment_tp *segment;
+
+	if ( sys == NULL  ||  sys->segment == NULL ) return;
+
+	segment = sys->segment;
+
+#if defined(_WIN32)
+	EnterCriticalSection( & segment->lock );
+	segment->num_members--;
+	LeaveCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	pthread_mutex_lock( & segment->lock );
+	segment->num_members--;
+	pthread_mutex_unlock( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+	sys->segment       = NULL;
+	sys->traffic_class = FINS_TRAFFIC_CONTROL;
+
+}  /* finslib_segment_leave */
+
+/*
+ * int finslib_segment_set_budget( struct fins_segment_tp *segment, uint32_t bytes_per_sec, uint32_t frames_per_sec );
+ *
+ * The function finslib_segment_set_budget() changes the budget of a network
+ * segment while it is in use, for example to give bulk transfers more room
+ * outside production hours. Waiting bulk requests are rescheduled with the
+ * new budget.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_segment_set_budget( struct fins_segment_tp *segment, uint32_t bytes_per_sec, uint32_t frames_per_sec ) {
+
+	if ( segment == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+#if defined(_WIN32)
+	EnterCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	pthread_mutex_lock( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+	refill( segment, finslib_monotonic_usec_timer() );
+
+	segment->bytes_per_sec  = bytes_per_sec;
+	segment->frames_per_sec = frames_per_sec;
+
+	if ( segment->byte_tokens  > byte_capacity(  segment ) ) segment->byte_tokens  = byte_capacity(  segment );
+	if ( segment->frame_tokens > frame_capacity( segment ) ) segment->frame_tokens = frame_capacity( segment );
+
+#if defined(_WIN32)
+	WakeAllConditionVariable( & segment->turn );
+	LeaveCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	pthread_cond_broadcast( & segment->turn );
+	pthread_mutex_unlock( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_segment_set_budget */
+
+/*
+ * void XX_finslib_segment_request( struct fins_sys_tp *sys, const struct fins_command_tp *command, size_t bodylen );
+ *
+ * The function XX_finslib_segment_request() is called before a command is
+ * sent on a connection in a network segment. Control traffic is counted and
+ * sent immediately. Bulk traffic draws a ticket and waits until all earlier
+ * bulk requests of the segment have been sent and the budget is no longer
+ * exhausted. Tickets are served per frame in FIFO order. The frames of one
+ * connection are sent one after another by the thread using it, so a
+ * connection waits for at most one ticket at a time and the waiting
+ * connections are served one frame each in rotation. This also holds when
+ * a connection pipelines several commands, but such a connection does not
+ * wait for its responses between turns and so gets a larger share of the
+ * budget than a connection which sends one command at a time.
+ */
+
+void XX_finslib_segment_request( struct fins_sys_tp *sys, const struct fins_command_tp *command, size_t bodylen ) {
+
+	struct fins_segment_tp *segment;
+	uint64_t ticket;
+	uint64_t start;
+	uint64_t waited;
+	bool bulk;
+
+	segment = sys->segment;
+	bulk    = is_bulk( sys, command, bodylen );
+
+#if defined(_WIN32)
+	EnterCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	pthread_mutex_lock( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+	start = finslib_monotonic_usec_timer();
+
+	refill( segment, start );
+
+	if ( bulk ) {
+
+		ticket = segment->next_ticket++;
+
+		while ( ticket != segment->serving_ticket  ||  short_usec( segment ) > 0 ) {
+
+			wait_turn( segment, ( ticket == segment->serving_ticket ) ? short_usec( segment ) : 0 );
+
+			refill( segment, finslib_monotonic_usec_timer() );
+		}
+
+		segment->serving_ticket++;
+		segment->bulk_requests++;
+
+		waited = segment->refill_usec - start;
+
+		if ( waited > 0 ) {
+
+			segment->bulk_delayed++;
+			segment->wait_usec += waited;
+			if ( waited > segment->max_wait_usec ) segment->max_wait_usec = waited;
+		}
+	}
+
+	else segment->control_requests++;
+
+	charge( segment, FINS_HEADER_LEN + bodylen + overhead( sys ) );
+
+#if defined(_WIN32)
+	if ( bulk ) WakeAllConditionVariable( & segment->turn );
+	LeaveCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	if ( bulk ) pthread_cond_broadcast( & segment->turn );
+	pthread_mutex_unlock( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+}  /* XX_finslib_segment_request */
+
+/*
+ * void XX_finslib_segment_response( struct fins_sys_tp *sys, size_t len );
+ *
+ * The function XX_finslib_segment_response() charges a received response of
+ * len bytes to the budget of the network segment of a connection. Responses
+ * are never delayed, but a large response leaves the budget in debt so that
+ * the next bulk request waits until the debt is paid off.
+ */
+
+void XX_finslib_segment_response( struct fins_sys_tp *sys, size_t len ) {
+
+	struct fins_segment_tp *segment;
+
+	segment = sys->segment;
+
+#if defined(_WIN32)
+	EnterCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	pthread_mutex_lock( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+	refill( segment, finslib_monotonic_usec_timer() );
+	charge( segment, len + overhead( sys ) );
+
+#if defined(_WIN32)
+	LeaveCriticalSection( & segment->lock );
+#else  /* defined(_WIN32) */
+	pthread_mutex_unlock( & segment->lock );
+#endif  /* defined(_WIN32) */
+
+}  /* XX_finslib_segment_response */
+
+/*
+ * static double byte_capacity( const struct fins_segment_tp *segment );
+ *
+ * The function byte_capacity() returns the maximum number of bytes which can
+ * be saved up in the budget of a segment. It is at least one frame of the
+ * maximum size, so that every command can be sent.
+ */
+
+static double byte_capacity( const struct fins_segment_tp *segment ) {
+
+	double capacity;
+
+	capacity = (double) segment->bytes_per_sec * FINS_SEGMENT_BURST_MSEC / 1000.0;
+
+	if ( capacity < FINS_HEADER_LEN + FINS_BODY_LEN + SEGMENT_TCP_OVERHEAD ) capacity = FINS_HEADER_LEN + FINS_BODY_LEN + SEGMENT_TCP_OVERHEAD;
+
+	return capacity;
+
+}  /* byte_capacity */
+
+/*
+ * static void charge( struct fins_segment_tp *segment, size_t bytes );
+ *
+ * The function charge() takes one frame of the given size from the budget of
+ * a segment. The budget may become negative.
+ */
+
+static void charge( struct fins_segment_tp *segment, size_t bytes ) {
+
+	segment->bytes  += bytes;
+	segment->frames += 1;
+
+	if ( segment->bytes_per_sec  > 0 ) segment->byte_tokens  -= (double) bytes;
+	if ( segment->frames_per_sec > 0 ) segment->frame_tokens -= 1.0;
+
+}  /* charge */
+
+/*
+ * static double frame_capacity( const struct fins_segment_tp *segment );
+ *
+ * The function frame_capacity() returns the maximum number of frames which
+ * can be saved up in the budget of a segment. It is at least one command and
+ * its response.
+ */
+
+static double frame_capacity( const struct fins_segment_tp *segment ) {
+
+	double capacity;
+
+	capacity = (double) segment->frames_per_sec * FINS_SEGMENT_BURST_MSEC / 1000.0;
+
+	if ( capacity < 2.0 ) capacity = 2.0;
+
+	return capacity;
+
+}  /* frame_capacity */
+
+/*
+ * static bool is_bulk( const struct fins_sys_tp *sys, const struct fins_command_tp *command, size_t bodylen );
+ *
+ * The function is_bulk() returns true if a command must be scheduled as bulk
+ * traffic. With the automatic traffic class, parameter area, program area
+ * and file memory commands are bulk, as are memory area reads and writes of
+ * at least FINS_SEGMENT_BULK_WORDS items. These are the commands used for
+ * backups and large transfers. All other commands are control traffic.
+ */
+
+static bool is_bulk( const struct fins_sys_tp *sys, const struct fins_command_tp *command, size_t bodylen ) {
+
+	if ( sys->traffic_class == FINS_TRAFFIC_BULK    ) return true;
+	if ( sys->traffic_class == FINS_TRAFFIC_CONTROL ) return false;
+
+	switch ( command->header[FINS_MRC] ) {
+
+		case 0x02 :
+		case 0x03 :
+		case 0x22 : return true;
+
+		case 0x01 :
+			if ( command->header[FINS_SRC] != 0x01  &&  command->header[FINS_SRC] != 0x02 ) return false;
+			if ( bodylen < 6                                                               ) return false;
+
+			return ( ( ( command->body[4] << 8 ) | command->body[5] ) >= FINS_SEGMENT_BULK_WORDS );
+	}
+
+	return false;
+
+}  /* is_bulk */
+
+/*
+ * static size_t overhead( const struct fins_sys_tp *sys );
+ *
+ * The function overhead() returns the approximate number of bytes each frame
+ * of a connection adds on the wire for the Ethernet, IP and transport
+ * headers, including the FINS/TCP header for TCP connections.
+ */
+
+static size_t overhead( const struct fins_sys_tp *sys ) {
+
+	return ( sys->comm_type == FINS_COMM_TYPE_TCP ) ? SEGMENT_TCP_OVERHEAD : SEGMENT_UDP_OVERHEAD;
+
+}  /* overhead */
+
+/*
+ * static void refill( struct fins_segment_tp *segment, uint64_t now );
+ *
+ * The function refill() adds the budget earned since the last refill to a
+ * segment, up to the capacity of the bucket.
+ */
+
+static void refill( struct fins_segment_tp *segment, uint64_t now ) {
+
+	double elapsed;
+
+	if ( now <= segment->refill_usec ) return;
+
+	elapsed              = (double) ( now - segment->refill_usec ) / 1000000.0;
+	segment->refill_usec = now;
+
+	segment->byte_tokens  += elapsed * segment->bytes_per_sec;
+	segment->frame_tokens += elapsed * segment->frames_per_sec;
+
+	if ( segment->byte_tokens  > byte_capacity(  segment ) ) segment->byte_tokens  = byte_capacity(  segment );
+	if ( segment->frame_tokens > frame_capacity( segment ) ) segment->frame_tokens = frame_capacity( segment );
+
+}  /* refill */
+
+/*
+ * static uint64_t short_usec( const struct fins_segment_tp *segment );
+ *
+ * The function short_usec() returns the number of microseconds until the
+ * budget of a segment is no longer exhausted, or 0 if a bulk request may be
+ * sent now.
+ */
+
+static uint64_t short_usec( const struct fins_segment_tp *segment ) {
+
+	double wait;
+	double frame_wait;
+
+	wait       = 0.0;
+	frame_wait = 0.0;
+
+	if ( segment->bytes_per_sec  > 0  &&  segment->byte_tokens  <= 0.0 ) wait       = ( 1.0 - segment->byte_tokens  ) * 1000000.0 / segment->bytes_per_sec;
+	if ( segment->frames_per_sec > 0  &&  segment->frame_tokens <= 0.0 ) frame_wait = ( 1.0 - segment->frame_tokens ) * 1000000.0 / segment->frames_per_sec;
+
+	if ( frame_wait > wait ) wait = frame_wait;
+
+	return (uint64_t) wait;
+
+}  /* short_usec */
+
+/*
+ * static void wait_turn( struct fins_segment_tp *segment, uint64_t timeout_usec );
+ *
+ * The function wait_turn() waits until another thread signals a change in
+ * the bulk queue of a segment, or until timeout_usec microseconds have
+ * passed. A timeout of 0 waits for the signal only. The lock of the segment
+ * must be held by the caller.
+ */
+
+static void wait_turn( struct fins_segment_tp *segment, uint64_t timeout_usec ) {
+
+#if defined(_WIN32)
+	SleepConditionVariableCS( & segment->turn, & segment->lock, ( timeout_usec > 0 ) ? (DWORD) ( ( timeout_usec + 999 ) / 1000 ) : INFINITE );
+#else  /* defined(_WIN32) */
+	struct timespec ts;
+
+	if ( timeout_usec == 0 ) { pthread_cond_wait( & segment->turn, & segment->lock ); return; }
+
+	clock_gettime( CLOCK_MONOTONIC, & ts );
+
+	ts.tv_sec  += (time_t) ( timeout_usec / 1000000 );
+	ts.tv_nsec += (long) ( 1000 * ( timeout_usec % 1000000 ) );
+
+	if ( ts.tv_nsec >= 1000000000 ) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+
+	pthread_cond_timedwait( & segment->turn, & segment->lock, & ts );
+#endif  /* defined(_WIN32) */
+
+}  /* wait_turn */
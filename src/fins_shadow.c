@@ -0,0 +1,257 @@
+/*
+ * Library: libfins
+ * File:    src/fins_shadow.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_shadow.c contains routines to write data sets
+ * which are larger than one FINS frame to a remote PLC in such a way that the
+ * PLC program never sees a partially written set.
+ */
+
+#include "fins.h"
+
+#define SHADOW_WINDOW		4
+
+struct block_tp {
+	struct fins_sys_tp *	sys;
+	uint8_t			area;
+	uint32_t		start;
+	const uint16_t *	data;
+	size_t			num_words;
+	size_t			max_chunk;
+	bool			verify;
+};
+
+static size_t		chunk_size( const struct block_tp *block, size_t frame );
+static int		complete_chunk( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval );
+static int		prepare_chunk( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen );
+static int		resolve_bank( struct fins_sys_tp *sys, const char *bank, uint8_t *area, uint32_t *start );
+static int		transfer( struct fins_sys_tp *sys, uint8_t area, uint32_t start, const uint16_t *data, size_t num_words, bool verify );
+
+/*
+ * int finslib_shadow_write( struct fins_sys_tp *sys, const char *bank_a, const char *bank_b, const char *selector, const uint16_t *data, size_t num_words, bool verify );
+ *
+ * The function finslib_shadow_write() writes a data set to one of two banks
+ * in the PLC. The selector word tells the PLC program which bank is active. A
+ * value of zero selects bank A, any other value bank B. The new data set is
+ * written to the inactive bank with several frames in flight at the same time.
+ * When requested, the bank is read back and compared with the data. Only then
+ * the selector word is changed to the bank with the new data, which happens in
+ * one single word write. The PLC program therefore sees either the old or the
+ * new data set, never a mixture of both. When an error occurs before the
+ * selector is written, the active bank is left untouched.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_shadow_write( struct fins_sys_tp *sys, const char *bank_a, const char *bank_b, const char *selector, const uint16_t *data, size_t num_words, bool verify ) {
+
+	uint8_t area;
+	uint32_t start;
+	uint16_t active;
+	uint16_t target;
+	int retval;
+
+	if ( num_words   == 0              ) return FINS_RETVAL_SUCCESS;
+	if ( sys         == NULL           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( bank_a      == NULL           ) return FINS_RETVAL_NO_WRITE_ADDRESS;
+	if ( bank_b      == NULL           ) return FINS_RETVAL_NO_WRITE_ADDRESS;
+	if ( selector    == NULL           ) return FINS_RETVAL_NO_WRITE_ADDRESS;
+	if ( data        == NULL           ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	if ( ( retval = finslib_memory_area_read_uint16( sys, selector, & active, 1 ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	target = ( active == 0 ) ? 1 : 0;
+
+	if ( ( retval = resolve_bank( sys, ( target == 0 ) ? bank_a : bank_b, & area, & start ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	if (            ( retval = transfer( sys, area, start, data, num_words, false ) ) != FINS_RETVAL_SUCCESS ) return retval;
+	if ( verify  && ( retval = transfer( sys, area, start, data, num_words, true  ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	return finslib_memory_area_write_uint16( sys, selector, & target, 1 );
+
+}  /* finslib_shadow_write */
+
+/*
+ * static int resolve_bank( struct fins_sys_tp *sys, const char *bank, uint8_t *area, uint32_t *start );
+ *
+ * The function resolve_bank() translates the address of a bank to an area
+ * code and word address. The bank must be both readable and writable.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int resolve_bank( struct fins_sys_tp *sys, const char *bank, uint8_t *area, uint32_t *start ) {
+
+	struct fins_address_tp address;
+	const struct fins_area_tp *area_ptr;
+
+	if ( XX_finslib_decode_address( bank, & address ) ) return FINS_RETVAL_INVALID_WRITE_ADDRESS;
+
+	area_ptr = XX_finslib_search_area( sys, & address, 16, FI_RD | FI_WR, false );
+	if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_WRITE_AREA;
+
+	*area  = area_ptr->area;
+	*start = address.main_address;
+	*start += area_ptr->low_addr >> 8;
+	*start -= area_ptr->low_id;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* resolve_bank */
+
+/*
+ * static int transfer( struct fins_sys_tp *sys, uint8_t area, uint32_t start, const uint16_t *data, size_t num_words, bool verify );
+ *
+ * The function transfer() writes a block of words to the PLC, or when verify
+ * is true reads the block back and compares it with the data. Up to
+ * SHADOW_WINDOW frames are sent before the first response is collected. No
+ * new frames are sent after the first error, but the responses of the frames
+ * already in flight are still collected.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int transfer( struct fins_sys_tp *sys, uint8_t area, uint32_t start, const uint16_t *data, size_t num_words, bool verify ) {
+
+	struct block_tp block;
+	size_t num_chunks;
+	size_t failed;
+
+	block.sys       = sys;
+	block.area      = area;
+	block.start     = start;
+	block.data      = data;
+	block.num_words = num_words;
+	block.verify    = verify;
+	block.max_chunk = ( verify ) ? FINS_MAX_READ_WORDS_SYSWAY : FINS_MAX_WRITE_WORDS_SYSWAY;
+
+	num_chunks = ( num_words + block.max_chunk - 1 ) / block.max_chunk;
+
+	return XX_finslib_pipeline( sys, 0, num_chunks, SHADOW_WINDOW, prepare_chunk, complete_chunk, & block, & failed );
+
+}  /* transfer */
+
+/*
+ * static int prepare_chunk( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen );
+ *
+ * The function prepare_chunk() builds the write or read command for one chunk
+ * of a block.
+ */
+
+static int prepare_chunk( void *context, size_t frame, struct fins_command_tp *command, size_t *bodylen ) {
+
+	struct block_tp *block;
+	size_t offset;
+	size_t size;
+	size_t a;
+	uint32_t chunk_start;
+
+	block       = context;
+	offset      = frame * block->max_chunk;
+	size        = chunk_size( block, frame );
+	chunk_start = block->start + offset;
+
+	XX_finslib_init_command( block->sys, command, 0x01, ( block->verify ) ? 0x01 : 0x02 );
+
+	*bodylen = 0;
+
+	command->body[(*bodylen)++] = block->area;
+	command->body[(*bodylen)++] = (chunk_start >> 8) & 0xff;
+	command->body[(*bodylen)++] = (chunk_start     ) & 0xff;
+	command->body[(*bodylen)++] = 0x00;
+	command->body[(*bodylen)++] = (size        >> 8) & 0xff;
+	command->body[(*bodylen)++] = (size            ) & 0xff;
+
+	if ( ! block->verify ) {
+
+		for (a=0; a<size; a++) {
+
+			command->body[(*bodylen)++] = (block->data[offset+a] >> 8) & 0xff;
+			command->body[(*bodylen)++] = (block->data[offset+a]     ) & 0xff;
+		}
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* prepare_chunk */
+
+/*
+ * static int complete_chunk( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval );
+ *
+ * The function complete_chunk() checks the response for one chunk of a block.
+ * When verifying, the words read back are compared with the data.
+ */
+
+static int complete_chunk( void *context, size_t frame, const struct fins_command_tp *command, size_t bodylen, int retval ) {
+
+	struct block_tp *block;
+	size_t offset;
+	size_t size;
+	size_t a;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) return retval;
+
+	block  = context;
+	offset = frame * block->max_chunk;
+	size   = chunk_size( block, frame );
+
+	if ( ! block->verify ) {
+
+		if ( bodylen != 2 ) return FINS_RETVAL_BODY_TOO_SHORT;
+		return FINS_RETVAL_SUCCESS;
+	}
+
+	if ( bodylen != 2+2*size ) return FINS_RETVAL_BODY_TOO_SHORT;
+
+	for (a=0; a<size; a++) {
+
+		if ( ( ( command->body[2+2*a] << 8 ) | command->body[3+2*a] ) != block->data[offset+a] ) return FINS_RETVAL_VERIFY_FAILED;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* complete_chunk */
+
+/*
+ * static size_t chunk_size( const struct block_tp *block, size_t frame );
+ *
+ * The function chunk_size() returns the number of words in one chunk of a
+ * block. Only the last chunk can be shorter than the maximum.
+ */
+
+static size_t chunk_size( const struct block_tp *block, size_t frame ) {
+
+	size_t offset;
+
+	offset = frame * block->max_chunk;
+
+	if ( block->num_words - offset > block->max_chunk ) return block->max_chunk;
+	return block->num_words - offset;
+
+}  /* chunk_size */
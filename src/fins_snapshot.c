@@ -0,0 +1,120 @@
+/*
+ * Library: libfins
+ * File:    src/fins_snapshot.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_snapshot.c contains routines to read a consistent
+ * image of a memory region in a remote PLC which is too large to be read with
+ * one FINS frame.
+ */
+
+#include "fins.h"
+
+/*
+ * int finslib_snapshot_read( struct fins_sys_tp *sys, const char *start, const char *scratch, uint16_t *data, size_t num_words );
+ *
+ * The function finslib_snapshot_read() reads a consistent image of a memory
+ * region which may be larger than one frame. A read spread over several
+ * frames is serviced over several PLC scans and the region may be changed by
+ * the ladder program in between. The function therefore first lets the PLC
+ * copy the region to a scratch area with one memory area transfer command.
+ * That copy is executed in one go by the PLC. The scratch copy is then read
+ * with as many frames as needed. The scratch area must not be used by the
+ * PLC program. Regions which fit in one frame are read directly.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_snapshot_read( struct fins_sys_tp *sys, const char *start, const char *scratch, uint16_t *data, size_t num_words ) {
+
+	int retval;
+
+	if ( num_words   == 0              ) return FINS_RETVAL_SUCCESS;
+	if ( sys         == NULL           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( start       == NULL           ) return FINS_RETVAL_NO_READ_ADDRESS;
+	if ( scratch     == NULL           ) return FINS_RETVAL_NO_WRITE_ADDRESS;
+	if ( data        == NULL           ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	if ( num_words <= FINS_MAX_READ_WORDS_SYSWAY ) return finslib_memory_area_read_uint16( sys, start, data, num_words );
+
+	if ( ( retval = finslib_memory_area_transfer( sys, start, scratch, num_words ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	return finslib_memory_area_read_uint16( sys, scratch, data, num_words );
+
+}  /* finslib_snapshot_read */
+
+/*
+ * int finslib_snapshot_read_sequenced( struct fins_sys_tp *sys, const char *start, const char *sequence, uint16_t *data, size_t num_words, int max_retries );
+ *
+ * The function finslib_snapshot_read_sequenced() reads a consistent image of
+ * a memory region for which the PLC program maintains a sequence word. The
+ * PLC program must change the sequence word in the same scan in which it
+ * updates the region. The sequence word is read before and after the region.
+ * If both values are equal, no update took place while the region was read.
+ * Otherwise the region is read again, where the last sequence value serves as
+ * the starting value of the next attempt. A consistent read therefore costs
+ * two single word reads more than a plain read. If the region is still torn
+ * after max_retries extra attempts, FINS_RETVAL_SNAPSHOT_TORN is returned and
+ * the data buffer contains the last, possibly inconsistent, image.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_snapshot_read_sequenced( struct fins_sys_tp *sys, const char *start, const char *sequence, uint16_t *data, size_t num_words, int max_retries ) {
+
+	uint16_t seq_before;
+	uint16_t seq_after;
+	int attempt;
+	int retval;
+
+	if ( num_words   == 0              ) return FINS_RETVAL_SUCCESS;
+	if ( sys         == NULL           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( start       == NULL           ) return FINS_RETVAL_NO_READ_ADDRESS;
+	if ( sequence    == NULL           ) return FINS_RETVAL_NO_READ_ADDRESS;
+	if ( data        == NULL           ) return FINS_RETVAL_NO_DATA_BLOCK;
+	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	if ( num_words <= FINS_MAX_READ_WORDS_SYSWAY ) return finslib_memory_area_read_uint16( sys, start, data, num_words );
+
+	if ( max_retries < 0 ) max_retries = 0;
+
+	if ( ( retval = finslib_memory_area_read_uint16( sys, sequence, & seq_before, 1 ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+	for (attempt=0; attempt<=max_retries; attempt++) {
+
+		if ( ( retval = finslib_memory_area_read_uint16( sys, start,    data,        num_words ) ) != FINS_RETVAL_SUCCESS ) return retval;
+		if ( ( retval = finslib_memory_area_read_uint16( sys, sequence, & seq_after, 1         ) ) != FINS_RETVAL_SUCCESS ) return retval;
+
+		if ( seq_after == seq_before ) return FINS_RETVAL_SUCCESS;
+
+		seq_before = seq_after;
+	}
+
+	return FINS_RETVAL_SNAPSHOT_TORN;
+
+}  /* finslib_snapshot_read_sequenced */
@@ -0,0 +1,382 @@
+/*
+ * Library: libfins
+ * File:    src/fins_statuswatch.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_statuswatch.c contains routines to watch the CPU
+ * status of one or more remote PLCs and report only the changes. The raw
+ * status response of each PLC is kept and compared byte for byte with the next
+ * response, so that an unchanged status costs one compare and is not decoded.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "fins.h"
+
+#define STATUS_FATAL_MASK	0xFF40
+#define STATUS_BATTERY_MASK	0x0010
+#define STATUS_NON_FATAL_MASK	0xF7EC
+
+static void		add_event( struct fins_statuswatch_tp *watch, int type, uint16_t flags, uint64_t timestamp );
+static void		commit_status( struct fins_statuswatch_tp *watch );
+static size_t		deliver_events( struct fins_statuswatch_tp *watch, struct fins_statusevent_tp *event, size_t max_events, size_t num_events );
+static void		receive_status( struct fins_statuswatch_tp *watch, struct fins_command_tp *command );
+static void		send_status( struct fins_statuswatch_tp *watch, struct fins_command_tp *command );
+
+/*
+ * struct fins_statuswatch_tp *finslib_statuswatch_create( struct fins_sys_tp *sys, int *error_val );
+ *
+ * The function finslib_statuswatch_create() creates a status watch for the
+ * CPU unit of a remote PLC. On success a pointer to the watch is returned.
+ * Otherwise the return value is NULL and the reason is stored in the variable
+ * pointed to by error_val.
+ */
+
+struct fins_statuswatch_tp *finslib_statuswatch_create( struct fins_sys_tp *sys, int *error_val ) {
+
+	struct fins_statuswatch_tp *watch;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	watch  = NULL;
+
+	if      ( sys == NULL                                                         ) retval = FINS_RETVAL_NOT_INITIALIZED;
+	else if ( ( watch = calloc( 1, sizeof(struct fins_statuswatch_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) return NULL;
+
+	watch->sys    = sys;
+	watch->retval = FINS_RETVAL_SUCCESS;
+
+	return watch;
+
+}  /* finslib_statuswatch_create */
+
+/*
+ * void finslib_statuswatch_free( struct fins_statuswatch_tp *watch );
+ *
+ * The function finslib_statuswatch_free() releases the memory of a status
+ * watch. The connection with the PLC is not closed.
+ */
+
+void finslib_statuswatch_free( struct fins_statuswatch_tp *watch ) {
+
+	free( watch );
+
+}  /* finslib_statuswatch_free */
+
+/*
+ * int finslib_statuswatch_poll( struct fins_statuswatch_tp *watch, struct fins_statusevent_tp *event, size_t max_events, size_t *num_events );
+ *
+ * The function finslib_statuswatch_poll() reads the CPU unit status of a PLC
+ * and stores an event in the event list for each kind of change since the
+ * previous poll. The status is only decoded when the raw response differs
+ * from the previous one. The first successful poll only records the status
+ * and does not generate events. If the events do not fit in the event list
+ * none are returned and the status is not updated, so that the same events
+ * are found again in the next poll. One poll never generates more than
+ * FINS_STATUS_MAX_EVENTS events.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_statuswatch_poll( struct fins_statuswatch_tp *watch, struct fins_statusevent_tp *event, size_t max_events, size_t *num_events ) {
+
+	struct fins_command_tp fins_cmnd;
+	size_t found;
+
+	if ( num_events != NULL ) *num_events = 0;
+
+	if ( watch == NULL                     ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( event == NULL  &&  max_events > 0 ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	send_status(    watch, & fins_cmnd );
+	receive_status( watch, & fins_cmnd );
+
+	found = deliver_events( watch, event, max_events, 0 );
+
+	if ( num_events != NULL ) *num_events = found;
+
+	return watch->retval;
+
+}  /* finslib_statuswatch_poll */
+
+/*
+ * int finslib_statuswatch_poll_fleet( struct fins_statuswatch_tp **watch, size_t num_watch, size_t max_concurrent, struct fins_statusevent_tp *event, size_t max_events, size_t *num_events );
+ *
+ * The function finslib_statuswatch_poll_fleet() polls the status of a list of
+ * PLCs with at most max_concurrent status reads in progress at the same time.
+ * All reads are done in the calling thread. The requests are sent without
+ * waiting for the responses and the responses are collected in the order of
+ * the list. When a response has been received the request for the next PLC
+ * is sent, so that the round trip times of the PLCs overlap. Each watch must
+ * use its own connection. The events are returned in the
+ * order of the watch list. The events of a PLC are either returned completely
+ * or left for the next call, so the event list should have room for at least
+ * FINS_STATUS_MAX_EVENTS events. The result of each read is stored in the
+ * watch. The function returns the first error in the order of the list, or a
+ * success code if all reads succeeded.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_statuswatch_poll_fleet( struct fins_statuswatch_tp **watch, size_t num_watch, size_t max_concurrent, struct fins_statusevent_tp *event, size_t max_events, size_t *num_events ) {
+
+	size_t a;
+	size_t found;
+	size_t sent;
+	struct fins_command_tp *command;
+	int retval;
+
+	if ( num_events != NULL ) *num_events = 0;
+
+	if ( watch == NULL  ||  num_watch == 0 ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( event == NULL  &&  max_events > 0 ) return FINS_RETVAL_NO_DATA_BLOCK;
+
+	for (a=0; a<num_watch; a++) if ( watch[a] == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	if ( max_concurrent == 0         ) max_concurrent = 1;
+	if ( max_concurrent >  num_watch ) max_concurrent = num_watch;
+
+	if ( ( command = malloc( max_concurrent * sizeof(struct fins_command_tp) ) ) == NULL ) return FINS_RETVAL_OUT_OF_MEMORY;
+
+	sent = 0;
+
+	for (a=0; a<num_watch; a++) {
+
+		while ( sent < num_watch  &&  sent < a + max_concurrent ) {
+
+			send_status( watch[sent], & command[sent % max_concurrent] );
+			sent++;
+		}
+
+		receive_status( watch[a], & command[a % max_concurrent] );
+	}
+
+	free( command );
+
+	found  = 0;
+	retval = FINS_RETVAL_SUCCESS;
+
+	for (a=0; a<num_watch; a++) {
+
+		found = deliver_events( watch[a], event, max_events, found );
+
+		if ( retval == FINS_RETVAL_SUCCESS ) retval = watch[a]->retval;
+	}
+
+	if ( num_events != NULL ) *num_events = found;
+
+	return retval;
+
+}  /* finslib_statuswatch_poll_fleet */
+
+/*
+ * static void send_status( struct fins_statuswatch_tp *watch, struct fins_command_tp *command );
+ *
+ * The function send_status() sends the request for the CPU unit status of a
+ * PLC without waiting for the response. The result of sending is stored in
+ * the watch.
+ */
+
+static void send_status( struct fins_statuswatch_tp *watch, struct fins_command_tp *command ) {
+
+	size_t bodylen;
+
+	watch->num_pending = 0;
+	watch->polls++;
+
+	if ( watch->sys->sockfd == INVALID_SOCKET ) {
+
+		watch->retval = FINS_RETVAL_NOT_CONNECTED;
+		return;
+	}
+
+	XX_finslib_init_command( watch->sys, command, 0x06, 0x01 );
+
+	bodylen       = 0;
+	watch->retval = XX_finslib_communicate( watch->sys, command, & bodylen, false );
+
+}  /* send_status */
+
+/*
+ * static void receive_status( struct fins_statuswatch_tp *watch, struct fins_command_tp *command );
+ *
+ * The function receive_status() receives the response on a status request
+ * which was sent with send_status() and compares the raw CPU unit status
+ * with the status of the previous successful read. The events are kept in
+ * the watch until they are delivered.
+ */
+
+static void receive_status( struct fins_statuswatch_tp *watch, struct fins_command_tp *command ) {
+
+	size_t bodylen;
+	uint64_t timestamp;
+	uint16_t old_bits;
+	uint16_t new_bits;
+	const unsigned char *old_raw;
+	const unsigned char *new_raw;
+
+	if ( watch->retval == FINS_RETVAL_SUCCESS ) {
+
+		bodylen       = 0;
+		watch->retval = XX_finslib_receive( watch->sys, command, & bodylen );
+
+		if ( watch->retval == FINS_RETVAL_SUCCESS  &&  bodylen != 2+FINS_CPUSTATUS_RAW_LEN ) watch->retval = FINS_RETVAL_BODY_TOO_SHORT;
+		if ( watch->retval == FINS_RETVAL_SUCCESS ) memcpy( watch->next_raw, & command->body[2], FINS_CPUSTATUS_RAW_LEN );
+	}
+
+	timestamp = finslib_epoch_usec_timer();
+
+	if ( watch->retval != FINS_RETVAL_SUCCESS ) {
+
+		if ( ! watch->comm_lost ) add_event( watch, FINS_STATUS_EVENT_COMM_LOST, 0, timestamp );
+		return;
+	}
+
+	if ( ! watch->valid ) return;
+
+	if ( watch->comm_lost ) add_event( watch, FINS_STATUS_EVENT_COMM_RESTORED, 0, timestamp );
+
+	old_raw = watch->raw;
+	new_raw = watch->next_raw;
+
+	if ( memcmp( old_raw, new_raw, FINS_CPUSTATUS_RAW_LEN ) == 0 ) return;
+
+	if ( old_raw[1] != new_raw[1] ) add_event( watch, FINS_STATUS_EVENT_MODE_CHANGE, 0, timestamp );
+	if ( ( old_raw[0] ^ new_raw[0] ) & 0x01 ) add_event( watch, FINS_STATUS_EVENT_RUN_CHANGE, new_raw[0] & 0x01, timestamp );
+
+	old_bits = ( (old_raw[2] << 8) | old_raw[3] ) & STATUS_FATAL_MASK;
+	new_bits = ( (new_raw[2] << 8) | new_raw[3] ) & STATUS_FATAL_MASK;
+
+	if ( new_bits & ~old_bits ) add_event( watch, FINS_STATUS_EVENT_FATAL_ERROR,   new_bits & ~old_bits, timestamp );
+	if ( old_bits & ~new_bits ) add_event( watch, FINS_STATUS_EVENT_FATAL_CLEARED, old_bits & ~new_bits, timestamp );
+
+	old_bits = ( (old_raw[4] << 8) | old_raw[5] ) & STATUS_NON_FATAL_MASK;
+	new_bits = ( (new_raw[4] << 8) | new_raw[5] ) & STATUS_NON_FATAL_MASK;
+
+	if ( new_bits & ~old_bits ) add_event( watch, FINS_STATUS_EVENT_NON_FATAL_ERROR,   new_bits & ~old_bits, timestamp );
+	if ( old_bits & ~new_bits ) add_event( watch, FINS_STATUS_EVENT_NON_FATAL_CLEARED, old_bits & ~new_bits, timestamp );
+
+	old_bits = old_raw[5] & STATUS_BATTERY_MASK;
+	new_bits = new_raw[5] & STATUS_BATTERY_MASK;
+
+	if ( new_bits & ~old_bits ) add_event( watch, FINS_STATUS_EVENT_BATTERY_ERROR,   new_bits, timestamp );
+	if ( old_bits & ~new_bits ) add_event( watch, FINS_STATUS_EVENT_BATTERY_CLEARED, old_bits, timestamp );
+
+	if ( old_raw[8] != new_raw[8]  ||  old_raw[9] != new_raw[9] ) add_event( watch, FINS_STATUS_EVENT_ERROR_CODE, 0, timestamp );
+	if ( old_raw[7] != new_raw[7]                               ) add_event( watch, FINS_STATUS_EVENT_MESSAGE, old_raw[7] ^ new_raw[7], timestamp );
+
+}  /* receive_status */
+
+/*
+ * static void add_event( struct fins_statuswatch_tp *watch, int type, uint16_t flags, uint64_t timestamp );
+ *
+ * The function add_event() adds an event to the list of events of a watch
+ * which are waiting to be delivered.
+ */
+
+static void add_event( struct fins_statuswatch_tp *watch, int type, uint16_t flags, uint64_t timestamp ) {
+
+	struct fins_statusevent_tp *ev;
+
+	if ( watch->num_pending >= FINS_STATUS_MAX_EVENTS ) return;
+
+	ev = & watch->pending[watch->num_pending++];
+
+	ev->watch      = watch;
+	ev->type       = type;
+	ev->flags      = flags;
+	ev->retval     = watch->retval;
+	ev->timestamp  = timestamp;
+	ev->run_mode   = watch->next_raw[1];
+	ev->error_code = (uint16_t) ( (watch->next_raw[8] << 8) | watch->next_raw[9] );
+
+	if ( watch->retval != FINS_RETVAL_SUCCESS ) {
+
+		ev->run_mode   = watch->raw[1];
+		ev->error_code = (uint16_t) ( (watch->raw[8] << 8) | watch->raw[9] );
+	}
+
+}  /* add_event */
+
+/*
+ * static size_t deliver_events( struct fins_statuswatch_tp *watch, struct fins_statusevent_tp *event, size_t max_events, size_t num_events );
+ *
+ * The function deliver_events() copies the waiting events of a watch to the
+ * event list and updates the status of the watch. If the events do not fit
+ * the watch is left unchanged. The new number of events in the list is
+ * returned.
+ */
+
+static size_t deliver_events( struct fins_statuswatch_tp *watch, struct fins_statusevent_tp *event, size_t max_events, size_t num_events ) {
+
+	if ( num_events + watch->num_pending > max_events ) return num_events;
+
+	if ( watch->num_pending > 0 ) memcpy( & event[num_events], watch->pending, watch->num_pending * sizeof(struct fins_statusevent_tp) );
+
+	num_events += watch->num_pending;
+
+	commit_status( watch );
+
+	return num_events;
+
+}  /* deliver_events */
+
+/*
+ * static void commit_status( struct fins_statuswatch_tp *watch );
+ *
+ * The function commit_status() makes the result of the last read the
+ * reference for the next poll. The status is only decoded if the raw data
+ * changed.
+ */
+
+static void commit_status( struct fins_statuswatch_tp *watch ) {
+
+	watch->num_pending = 0;
+
+	if ( watch->retval != FINS_RETVAL_SUCCESS ) {
+
+		watch->comm_lost = true;
+		return;
+	}
+
+	watch->comm_lost = false;
+
+	if ( watch->valid  &&  memcmp( watch->raw, watch->next_raw, FINS_CPUSTATUS_RAW_LEN ) == 0 ) return;
+
+	memcpy( watch->raw, watch->next_raw, FINS_CPUSTATUS_RAW_LEN );
+
+	XX_finslib_decode_cpu_status( watch->raw, & watch->status );
+
+	watch->valid = true;
+	watch->decodes++;
+
+}  /* commit_status */
@@ -0,0 +1,804 @@
+/*
+ * Library: libfins
+ * File:    src/fins_tagdb.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_tagdb.c contains routines to compile a list of tags
+ * to a binary tag database and to use that database without parsing. All
+ * addresses in the database are resolved when it is compiled. The database is
+ * mapped in memory when it is opened, so that opening takes a constant time
+ * and processes using the same database share the same memory pages.
+ */
+
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fins.h"
+
+#if ! defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  /* ! defined(_WIN32) */
+
+#define TAGDB_MAGIC		"FINSTAG1"
+#define TAGDB_BYTE_ORDER	0x01020304
+#define TAGDB_LINE_LEN		512
+
+struct tagdb_header_tp {
+	char		magic[8];
+	uint32_t	byte_order;
+	uint32_t	plc_mode;
+	uint32_t	num_tags;
+	uint32_t	num_groups;
+	uint32_t	hash_size;
+	uint32_t	names_size;
+	uint32_t	tag_offset;
+	uint32_t	group_offset;
+	uint32_t	hash_offset;
+	uint32_t	names_offset;
+	uint32_t	reserved[6];
+};
+
+struct tagdb_entry_tp {
+	struct fins_tag_tp	tag;
+	size_t			line;
+};
+
+static const struct {
+	const char *	name;
+	uint8_t		data_type;
+} tag_types[] = {
+	{ "INT16",       FINS_DATA_TYPE_INT16       },
+	{ "INT32",       FINS_DATA_TYPE_INT32       },
+	{ "UINT16",      FINS_DATA_TYPE_UINT16      },
+	{ "UINT32",      FINS_DATA_TYPE_UINT32      },
+	{ "BCD16",       FINS_DATA_TYPE_BCD16       },
+	{ "BCD32",       FINS_DATA_TYPE_BCD32       },
+	{ "SBCD16_0",    FINS_DATA_TYPE_SBCD16_0    },
+	{ "SBCD16_1",    FINS_DATA_TYPE_SBCD16_1    },
+	{ "SBCD16_2",    FINS_DATA_TYPE_SBCD16_2    },
+	{ "SBCD16_3",    FINS_DATA_TYPE_SBCD16_3    },
+	{ "SBCD32_0",    FINS_DATA_TYPE_SBCD32_0    },
+	{ "SBCD32_1",    FINS_DATA_TYPE_SBCD32_1    },
+	{ "SBCD32_2",    FINS_DATA_TYPE_SBCD32_2    },
+	{ "SBCD32_3",    FINS_DATA_TYPE_SBCD32_3    },
+	{ "FLOAT",       FINS_DATA_TYPE_FLOAT       },
+	{ "DOUBLE",      FINS_DATA_TYPE_DOUBLE      },
+	{ "BIT",         FINS_DATA_TYPE_BIT         },
+	{ "BIT_FORCED",  FINS_DATA_TYPE_BIT_FORCED  },
+	{ "WORD_FORCED", FINS_DATA_TYPE_WORD_FORCED },
+	{ NULL,          FINS_DATA_TYPE_NONE        }
+};
+
+static int		compare_entries( const void *a, const void *b );
+static uint32_t		hash_name( const char *name );
+static int		parse_line( char *line, char **field, size_t max_fields, size_t *num_fields );
+static uint8_t		parse_type( const char *str );
+static int		resolve_tag( struct fins_sys_tp *sys, const char *address, struct fins_tag_tp *tag );
+static char *		trim( char *str );
+static int		write_db( const char *db_file, int plc_mode, const struct tagdb_entry_tp *entry, size_t num_entries, const char *names, size_t names_size, size_t *error_line );
+
+/*
+ * int finslib_tagdb_compile( const char *list_file, const char *db_file, int plc_mode, size_t *num_tags, size_t *error_line );
+ *
+ * The function finslib_tagdb_compile() reads a list of tags from a text file
+ * and writes them as a binary tag database. Each line of the list contains
+ * the name, the address, the data type and the poll group of one tag,
+ * separated by commas. The data type defaults to UINT16 and the poll group
+ * to 0. Empty lines and lines starting with a # are skipped. All addresses
+ * are resolved for the given PLC mode. The database is first written to a
+ * temporary file which then replaces the database file, so that processes
+ * which have the old database open are not affected. If the list contains
+ * an error, the line number is stored in the variable pointed to by
+ * error_line.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_tagdb_compile( const char *list_file, const char *db_file, int plc_mode, size_t *num_tags, size_t *error_line ) {
+
+	FILE *fp;
+	char line[TAGDB_LINE_LEN];
+	char *field[4];
+	char *new_names;
+	struct tagdb_entry_tp *new_entry;
+	struct tagdb_entry_tp *entry;
+	struct fins_sys_tp *sys;
+	size_t num_fields;
+	size_t num_entries;
+	size_t max_entries;
+	size_t names_size;
+	size_t max_names;
+	size_t line_number;
+	size_t len;
+	char *names;
+	char *endptr;
+	unsigned long group;
+	int retval;
+
+	if ( num_tags   != NULL ) *num_tags   = 0;
+	if ( error_line != NULL ) *error_line = 0;
+
+	if ( list_file == NULL  ||  *list_file == 0 ) return FINS_RETVAL_INVALID_FILENAME;
+	if ( db_file   == NULL  ||  *db_file   == 0 ) return FINS_RETVAL_INVALID_FILENAME;
+	if ( plc_mode  != FINS_MODE_CS  &&  plc_mode != FINS_MODE_CV ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	sys = calloc( 1, sizeof(struct fins_sys_tp) );
+	if ( sys == NULL ) return FINS_RETVAL_OUT_OF_MEMORY;
+
+	sys->plc_mode = plc_mode;
+
+	fp = fopen( list_file, "r" );
+	if ( fp == NULL ) { free( sys ); return FINS_RETVAL_LOCAL_FILE_ERROR; }
+
+	entry       = NULL;
+	names       = NULL;
+	num_entries = 0;
+	max_entries = 0;
+	names_size  = 0;
+	max_names   = 0;
+	line_number = 0;
+	retval      = FINS_RETVAL_SUCCESS;
+
+	while ( retval == FINS_RETVAL_SUCCESS  &&  fgets( line, TAGDB_LINE_LEN, fp ) != NULL ) {
+
+		line_number++;
+
+		len = strlen( line );
+		if ( len == TAGDB_LINE_LEN-1  &&  line[len-1] != '\n'  &&  ! feof( fp ) ) { retval = FINS_RETVAL_TAG_SYNTAX_ERROR; break; }
+
+		if ( ( retval = parse_line( line, field, 4, & num_fields ) ) != FINS_RETVAL_SUCCESS ) break;
+		if ( num_fields == 0 ) continue;
+
+		if ( num_entries >= max_entries ) {
+
+			max_entries = ( max_entries == 0 ) ? 1024 : 2*max_entries;
+			new_entry   = realloc( entry, max_entries * sizeof(struct tagdb_entry_tp) );
+			if ( new_entry == NULL ) { retval = FINS_RETVAL_OUT_OF_MEMORY; break; }
+			entry = new_entry;
+		}
+
+		len = strlen( field[0] ) + 1;
+
+		while ( names_size + len > max_names ) {
+
+			max_names = ( max_names == 0 ) ? 65536 : 2*max_names;
+			new_names = realloc( names, max_names );
+			if ( new_names == NULL ) { retval = FINS_RETVAL_OUT_OF_MEMORY; break; }
+			names = new_names;
+		}
+
+		if ( retval != FINS_RETVAL_SUCCESS ) break;
+
+		memset( & entry[num_entries], 0, sizeof(struct tagdb_entry_tp) );
+
+		entry[num_entries].line          = line_number;
+		entry[num_entries].tag.name      = (uint32_t) names_size;
+		entry[num_entries].tag.hash      = hash_name( field[0] );
+		entry[num_entries].tag.data_type = FINS_DATA_TYPE_UINT16;
+
+		memcpy( names + names_size, field[0], len );
+		names_size += len;
+
+		if ( num_fields > 2  &&  *field[2] != 0 ) {
+
+			entry[num_entries].tag.data_type = parse_type( field[2] );
+			if ( entry[num_entries].tag.data_type == FINS_DATA_TYPE_NONE ) { retval = FINS_RETVAL_INVALID_DATA_TYPE; break; }
+		}
+
+		if ( num_fields > 3  &&  *field[3] != 0 ) {
+
+			group = strtoul( field[3], & endptr, 10 );
+			if ( *endptr != 0  ||  group > 0xFFFF ) { retval = FINS_RETVAL_TAG_SYNTAX_ERROR; break; }
+			entry[num_entries].tag.poll_group = (uint16_t) group;
+		}
+
+		if ( num_fields < 2 ) { retval = FINS_RETVAL_TAG_SYNTAX_ERROR; break; }
+		if ( ( retval = resolve_tag( sys, field[1], & entry[num_entries].tag ) ) != FINS_RETVAL_SUCCESS ) break;
+
+		num_entries++;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  ferror( fp ) ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+
+	fclose( fp );
+	free( sys );
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		if ( error_line != NULL ) *error_line = line_number;
+	}
+
+	else if ( num_entries == 0 ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+
+	else {
+		qsort( entry, num_entries, sizeof(struct tagdb_entry_tp), compare_entries );
+
+		retval = write_db( db_file, plc_mode, entry, num_entries, names, names_size, error_line );
+
+		if ( retval == FINS_RETVAL_SUCCESS  &&  num_tags != NULL ) *num_tags = num_entries;
+	}
+
+	free( entry );
+	free( names );
+
+	return retval;
+
+}  /* finslib_tagdb_compile */
+
+/*
+ * struct fins_tagdb_tp *finslib_tagdb_open( const char *db_file, int *error_val );
+ *
+ * The function finslib_tagdb_open() maps a compiled tag database in memory.
+ * Only the header of the database is checked, the tags themselves are used
+ * as they are stored in the file. On success a pointer to the database is
+ * returned. Otherwise the return value is NULL and the reason is stored in
+ * the variable pointed to by error_val.
+ */
+
+struct fins_tagdb_tp *finslib_tagdb_open( const char *db_file, int *error_val ) {
+
+	struct fins_tagdb_tp *db;
+	const struct tagdb_header_tp *hdr;
+	const unsigned char *base;
+	int retval;
+#if defined(_WIN32)
+	LARGE_INTEGER file_size;
+#else  /* defined(_WIN32) */
+	int fd;
+	struct stat st;
+	void *map;
+#endif  /* defined(_WIN32) */
+
+	if ( db_file == NULL  ||  *db_file == 0 ) {
+
+		if ( error_val != NULL ) *error_val = FINS_RETVAL_INVALID_FILENAME;
+		return NULL;
+	}
+
+	db = calloc( 1, sizeof(struct fins_tagdb_tp) );
+	if ( db == NULL ) {
+
+		if ( error_val != NULL ) *error_val = FINS_RETVAL_OUT_OF_MEMORY;
+		return NULL;
+	}
+
+	retval = FINS_RETVAL_SUCCESS;
+
+#if defined(_WIN32)
+	db->file    = INVALID_HANDLE_VALUE;
+	db->mapping = NULL;
+	db->file    = CreateFileA( db_file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+
+	if      ( db->file == INVALID_HANDLE_VALUE                                                            ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+	else if ( ! GetFileSizeEx( db->file, & file_size )                                                    ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+	else if ( file_size.QuadPart < (LONGLONG) sizeof(struct tagdb_header_tp)                              ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( ( db->mapping = CreateFileMappingA( db->file, NULL, PAGE_READONLY, 0, 0, NULL ) ) == NULL   ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+	else if ( ( db->map = MapViewOfFile( db->mapping, FILE_MAP_READ, 0, 0, 0 ) ) == NULL                  ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+	else db->map_size = (size_t) file_size.QuadPart;
+#else  /* defined(_WIN32) */
+	fd = open( db_file, O_RDONLY );
+
+	if      ( fd < 0                                                   ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+	else if ( fstat( fd, & st ) != 0                                   ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+	else if ( st.st_size < (off_t) sizeof(struct tagdb_header_tp)      ) retval = FINS_RETVAL_INVALID_LAYOUT;
+	else if ( ( map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 ) ) == MAP_FAILED ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+	else {
+		db->map      = map;
+		db->map_size = (size_t) st.st_size;
+	}
+
+	if ( fd >= 0 ) close( fd );
+#endif  /* defined(_WIN32) */
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		base = db->map;
+		hdr  = db->map;
+
+		if      ( memcmp( hdr->magic, TAGDB_MAGIC, 8 ) != 0                                                 ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( hdr->byte_order != TAGDB_BYTE_ORDER                                                       ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( hdr->hash_size == 0  ||  ( hdr->hash_size & (hdr->hash_size-1) ) != 0                     ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( hdr->names_size == 0                                                                      ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( (uint64_t) hdr->tag_offset   + (uint64_t) hdr->num_tags   * sizeof(struct fins_tag_tp) > db->map_size ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( (uint64_t) hdr->group_offset + (uint64_t) hdr->num_groups * 3 * sizeof(uint32_t)       > db->map_size ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( (uint64_t) hdr->hash_offset  + (uint64_t) hdr->hash_size  * sizeof(uint32_t)           > db->map_size ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( (uint64_t) hdr->names_offset + (uint64_t) hdr->names_size                              > db->map_size ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( ( hdr->tag_offset | hdr->group_offset | hdr->hash_offset ) & 3                            ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else if ( base[hdr->names_offset + hdr->names_size - 1] != 0                                        ) retval = FINS_RETVAL_INVALID_LAYOUT;
+		else {
+			db->plc_mode   = (int) hdr->plc_mode;
+			db->num_tags   = hdr->num_tags;
+			db->num_groups = hdr->num_groups;
+			db->hash_mask  = hdr->hash_size - 1;
+			db->tag        = (const void *) ( base + hdr->tag_offset   );
+			db->group      = (const void *) ( base + hdr->group_offset );
+			db->hash       = (const void *) ( base + hdr->hash_offset  );
+			db->names      = (const char *) ( base + hdr->names_offset );
+		}
+	}
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_tagdb_close( db );
+		return NULL;
+	}
+
+	return db;
+
+}  /* finslib_tagdb_open */
+
+/*
+ * void finslib_tagdb_close( struct fins_tagdb_tp *db );
+ *
+ * The function finslib_tagdb_close() unmaps a tag database and releases the
+ * memory associated with it. All pointers to tags in the database become
+ * invalid.
+ */
+
+void finslib_tagdb_close( struct fins_tagdb_tp *db ) {
+
+	if ( db == NULL ) return;
+
+#if defined(_WIN32)
+	if ( db->map     != NULL                 ) UnmapViewOfFile( db->map );
+	if ( db->mapping != NULL                 ) CloseHandle( db->mapping );
+	if ( db->file    != INVALID_HANDLE_VALUE ) CloseHandle( db->file );
+#else  /* defined(_WIN32) */
+	if ( db->map != NULL ) munmap( db->map, db->map_size );
+#endif  /* defined(_WIN32) */
+
+	free( db );
+
+}  /* finslib_tagdb_close */
+
+/*
+ * const struct fins_tag_tp *finslib_tagdb_find( const struct fins_tagdb_tp *db, const char *name );
+ *
+ * The function finslib_tagdb_find() looks up a tag by name in the hash index
+ * of a tag database. A pointer to the tag is returned, or NULL if the tag
+ * does not exist.
+ */
+
+const struct fins_tag_tp *finslib_tagdb_find( const struct fins_tagdb_tp *db, const char *name ) {
+
+	uint32_t hash;
+	uint32_t slot;
+	uint32_t idx;
+	uint32_t probes;
+	const char *tag_name;
+
+	if ( db == NULL  ||  name == NULL ) return NULL;
+
+	hash = hash_name( name );
+	slot = hash & db->hash_mask;
+
+	for (probes=0; probes<=db->hash_mask; probes++) {
+
+		idx = db->hash[slot];
+		if ( idx == 0  ||  idx > db->num_tags ) return NULL;
+
+		if ( db->tag[idx-1].hash == hash ) {
+
+			tag_name = finslib_tagdb_name( db, & db->tag[idx-1] );
+			if ( tag_name != NULL  &&  strcmp( tag_name, name ) == 0 ) return & db->tag[idx-1];
+		}
+
+		slot = ( slot + 1 ) & db->hash_mask;
+	}
+
+	return NULL;
+
+}  /* finslib_tagdb_find */
+
+/*
+ * const struct fins_tag_tp *finslib_tagdb_group( const struct fins_tagdb_tp *db, uint16_t poll_group, size_t *num_tags );
+ *
+ * The function finslib_tagdb_group() returns a pointer to the first tag of a
+ * poll group. The tags of a group are stored consecutively, sorted on area
+ * and address. The number of tags in the group is stored in the variable
+ * pointed to by num_tags. If the group does not exist NULL is returned.
+ */
+
+const struct fins_tag_tp *finslib_tagdb_group( const struct fins_tagdb_tp *db, uint16_t poll_group, size_t *num_tags ) {
+
+	size_t low;
+	size_t high;
+	size_t mid;
+	const uint32_t *grp;
+
+	if ( num_tags != NULL ) *num_tags = 0;
+
+	if ( db == NULL ) return NULL;
+
+	low  = 0;
+	high = db->num_groups;
+
+	while ( low < high ) {
+
+		mid = ( low + high ) / 2;
+		grp = & db->group[3*mid];
+
+		if      ( grp[0] < poll_group ) low  = mid + 1;
+		else if ( grp[0] > poll_group ) high = mid;
+		else {
+			if ( grp[1] > db->num_tags  ||  grp[2] > db->num_tags - grp[1] ) return NULL;
+			if ( num_tags != NULL ) *num_tags = grp[2];
+			return & db->tag[grp[1]];
+		}
+	}
+
+	return NULL;
+
+}  /* finslib_tagdb_group */
+
+/*
+ * const char *finslib_tagdb_name( const struct fins_tagdb_tp *db, const struct fins_tag_tp *tag );
+ *
+ * The function finslib_tagdb_name() returns the name of a tag in a tag
+ * database, or NULL if the tag does not have a valid name.
+ */
+
+const char *finslib_tagdb_name( const struct fins_tagdb_tp *db, const struct fins_tag_tp *tag ) {
+
+	const struct tagdb_header_tp *hdr;
+
+	if ( db == NULL  ||  tag == NULL ) return NULL;
+
+	hdr = db->map;
+
+	if ( tag->name >= hdr->names_size ) return NULL;
+
+	return db->names + tag->name;
+
+}  /* finslib_tagdb_name */
+
+/*
+ * static int write_db( const char *db_file, int plc_mode, const struct tagdb_entry_tp *entry, size_t num_entries, const char *names, size_t names_size, size_t *error_line );
+ *
+ * The function write_db() builds the hash index and the poll group table of
+ * a sorted list of tags and writes the database to a file. The file is
+ * written under a temporary name and renamed when it is complete.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int write_db( const char *db_file, int plc_mode, const struct tagdb_entry_tp *entry, size_t num_entries, const char *names, size_t names_size, size_t *error_line ) {
+
+	struct tagdb_header_tp hdr;
+	uint32_t *hash;
+	uint32_t *group;
+	uint32_t hash_size;
+	uint32_t slot;
+	uint32_t idx;
+	size_t num_groups;
+	size_t a;
+	size_t len;
+	char *tmp_file;
+	FILE *fp;
+	int retval;
+
+	if ( num_entries > 0x3FFFFFFF  ||  names_size > 0x3FFFFFFF ) return FINS_RETVAL_INVALID_LAYOUT;
+
+	hash_size = 16;
+	while ( hash_size < 2*num_entries ) hash_size *= 2;
+
+	hash  = calloc( hash_size, sizeof(uint32_t) );
+	group = malloc( 3 * num_entries * sizeof(uint32_t) );
+	len   = strlen( db_file );
+
+	tmp_file = malloc( len + 5 );
+
+	if ( hash == NULL  ||  group == NULL  ||  tmp_file == NULL ) {
+
+		free( hash );
+		free( group );
+		free( tmp_file );
+
+		return FINS_RETVAL_OUT_OF_MEMORY;
+	}
+
+	retval     = FINS_RETVAL_SUCCESS;
+	num_groups = 0;
+
+	for (a=0; a<num_entries; a++) {
+
+		slot = entry[a].tag.hash & (hash_size-1);
+
+		while ( ( idx = hash[slot] ) != 0 ) {
+
+			if ( entry[idx-1].tag.hash == entry[a].tag.hash  &&  strcmp( names + entry[idx-1].tag.name, names + entry[a].tag.name ) == 0 ) {
+
+				retval = FINS_RETVAL_DUPLICATE_TAG;
+				if ( error_line != NULL ) *error_line = ( entry[a].line > entry[idx-1].line ) ? entry[a].line : entry[idx-1].line;
+				break;
+			}
+
+			slot = ( slot + 1 ) & (hash_size-1);
+		}
+
+		if ( retval != FINS_RETVAL_SUCCESS ) break;
+
+		hash[slot] = (uint32_t) ( a + 1 );
+
+		if ( num_groups == 0  ||  group[3*(num_groups-1)] != entry[a].tag.poll_group ) {
+
+			group[3*num_groups  ] = entry[a].tag.poll_group;
+			group[3*num_groups+1] = (uint32_t) a;
+			group[3*num_groups+2] = 0;
+			num_groups++;
+		}
+
+		group[3*(num_groups-1)+2]++;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) {
+
+		memset( & hdr, 0, sizeof(hdr) );
+		memcpy( hdr.magic, TAGDB_MAGIC, 8 );
+
+		hdr.byte_order   = TAGDB_BYTE_ORDER;
+		hdr.plc_mode     = (uint32_t) plc_mode;
+		hdr.num_tags     = (uint32_t) num_entries;
+		hdr.num_groups   = (uint32_t) num_groups;
+		hdr.hash_size    = hash_size;
+		hdr.names_size   = (uint32_t) names_size;
+		hdr.tag_offset   = sizeof(hdr);
+		hdr.group_offset = hdr.tag_offset   + hdr.num_tags   * (uint32_t) sizeof(struct fins_tag_tp);
+		hdr.hash_offset  = hdr.group_offset + hdr.num_groups * 3 * (uint32_t) sizeof(uint32_t);
+		hdr.names_offset = hdr.hash_offset  + hdr.hash_size  * (uint32_t) sizeof(uint32_t);
+
+		snprintf( tmp_file, len + 5, "%s.tmp", db_file );
+
+		fp = fopen( tmp_file, "wb" );
+
+		if ( fp == NULL ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+
+		else {
+			if ( fwrite( & hdr, sizeof(hdr), 1, fp ) != 1 ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+
+			for (a=0; retval == FINS_RETVAL_SUCCESS  &&  a<num_entries; a++) {
+
+				if ( fwrite( & entry[a].tag, sizeof(struct fins_tag_tp), 1, fp ) != 1 ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+			}
+
+			if ( retval == FINS_RETVAL_SUCCESS  &&  fwrite( group, 3 * sizeof(uint32_t), num_groups, fp ) != num_groups ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+			if ( retval == FINS_RETVAL_SUCCESS  &&  fwrite( hash,  sizeof(uint32_t),     hash_size,  fp ) != hash_size  ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+			if ( retval == FINS_RETVAL_SUCCESS  &&  fwrite( names, 1,                    names_size, fp ) != names_size ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+
+			if ( fclose( fp ) != 0 ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+
+#if defined(_WIN32)
+			if ( retval == FINS_RETVAL_SUCCESS  &&  ! MoveFileExA( tmp_file, db_file, MOVEFILE_REPLACE_EXISTING ) ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+#else  /* defined(_WIN32) */
+			if ( retval == FINS_RETVAL_SUCCESS  &&  rename( tmp_file, db_file ) != 0 ) retval = FINS_RETVAL_LOCAL_FILE_ERROR;
+#endif  /* defined(_WIN32) */
+
+			if ( retval != FINS_RETVAL_SUCCESS ) remove( tmp_file );
+		}
+	}
+
+	free( hash );
+	free( group );
+	free( tmp_file );
+
+	return retval;
+
+}  /* write_db */
+
+/*
+ * static int resolve_tag( struct fins_sys_tp *sys, const char *address, struct fins_tag_tp *tag );
+ *
+ * The function resolve_tag() resolves the address of a tag to a FINS memory
+ * area code and word address, based on the data type of the tag.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int resolve_tag( struct fins_sys_tp *sys, const char *address, struct fins_tag_tp *tag ) {
+
+	int bits;
+	bool forced;
+	uint32_t start;
+	struct fins_address_tp addr;
+	const struct fins_area_tp *area_ptr;
+
+	switch ( tag->data_type ) {
+
+		case FINS_DATA_TYPE_BIT         : bits =  1; forced = false; tag->num_words = 1; break;
+		case FINS_DATA_TYPE_BIT_FORCED  : bits =  1; forced = true;  tag->num_words = 1; break;
+		case FINS_DATA_TYPE_WORD_FORCED : bits = 16; forced = true;  tag->num_words = 1; break;
+		case FINS_DATA_TYPE_INT32       :
+		case FINS_DATA_TYPE_UINT32      :
+		case FINS_DATA_TYPE_BCD32       :
+		case FINS_DATA_TYPE_SBCD32_0    :
+		case FINS_DATA_TYPE_SBCD32_1    :
+		case FINS_DATA_TYPE_SBCD32_2    :
+		case FINS_DATA_TYPE_SBCD32_3    :
+		case FINS_DATA_TYPE_FLOAT       : bits = 16; forced = false; tag->num_words = 2; break;
+		case FINS_DATA_TYPE_DOUBLE      : bits = 16; forced = false; tag->num_words = 4; break;
+		default                         : bits = 16; forced = false; tag->num_words = 1; break;
+	}
+
+	if ( XX_finslib_decode_address( address, & addr ) ) return FINS_RETVAL_INVALID_READ_ADDRESS;
+
+	area_ptr = XX_finslib_search_area( sys, & addr, bits, FI_RD, forced );
+	if ( area_ptr == NULL ) return FINS_RETVAL_INVALID_READ_AREA;
+
+	start  = addr.main_address;
+	start += area_ptr->low_addr >> 8;
+	start -= area_ptr->low_id;
+
+	tag->area    = area_ptr->area;
+	tag->address = start;
+	tag->bit     = ( bits == 1 ) ? addr.sub_address & 0xff : 0x00;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* resolve_tag */
+
+/*
+ * static int parse_line( char *line, char **field, size_t max_fields, size_t *num_fields );
+ *
+ * The function parse_line() splits a line of a tag list in comma separated
+ * fields. Spaces around each field are removed. Empty lines and comment
+ * lines have zero fields.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int parse_line( char *line, char **field, size_t max_fields, size_t *num_fields ) {
+
+	char *ptr;
+	char *comma;
+
+	*num_fields = 0;
+
+	ptr = trim( line );
+	if ( *ptr == 0  ||  *ptr == '#' ) return FINS_RETVAL_SUCCESS;
+
+	while ( ptr != NULL ) {
+
+		if ( *num_fields >= max_fields ) return FINS_RETVAL_TAG_SYNTAX_ERROR;
+
+		comma = strchr( ptr, ',' );
+		if ( comma != NULL ) *comma++ = 0;
+
+		field[(*num_fields)++] = trim( ptr );
+		ptr                    = comma;
+	}
+
+	if ( *field[0] == 0 ) return FINS_RETVAL_TAG_SYNTAX_ERROR;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* parse_line */
+
+/*
+ * static uint8_t parse_type( const char *str );
+ *
+ * The function parse_type() converts the name or number of a data type to
+ * one of the FINS_DATA_TYPE_... values. FINS_DATA_TYPE_NONE is returned if
+ * the data type is not known.
+ */
+
+static uint8_t parse_type( const char *str ) {
+
+	int a;
+	size_t b;
+	unsigned long value;
+	char *endptr;
+
+	if ( isdigit( (unsigned char) *str ) ) {
+
+		value = strtoul( str, & endptr, 10 );
+		if ( *endptr != 0  ||  value > FINS_DATA_TYPE_LAST ) return FINS_DATA_TYPE_NONE;
+		return (uint8_t) value;
+	}
+
+	for (a=0; tag_types[a].name != NULL; a++) {
+
+		for (b=0; str[b] != 0  &&  toupper( (unsigned char) str[b] ) == tag_types[a].name[b]; b++) ;
+
+		if ( str[b] == 0  &&  tag_types[a].name[b] == 0 ) return tag_types[a].data_type;
+	}
+
+	return FINS_DATA_TYPE_NONE;
+
+}  /* parse_type */
+
+/*
+ * static char *trim( char *str );
+ *
+ * The function trim() removes leading and trailing white space from a string.
+ */
+
+static char *trim( char *str ) {
+
+	size_t len;
+
+	while ( isspace( (unsigned char) *str ) ) str++;
+
+	len = strlen( str );
+	while ( len > 0  &&  isspace( (unsigned char) str[len-1] ) ) str[--len] = 0;
+
+	return str;
+
+}  /* trim */
+
+/*
+ * static uint32_t hash_name( const char *name );
+ *
+ * The function hash_name() calculates the 32 bit FNV-1a hash of a tag name.
+ */
+
+static uint32_t hash_name( const char *name ) {
+
+	uint32_t hash;
+
+	hash = 2166136261u;
+
+	while ( *name ) {
+
+		hash ^= (unsigned char) *name++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+
+}  /* hash_name */
+
+/*
+ * static int compare_entries( const void *a, const void *b );
+ *
+ * The function compare_entries() is the compare function used to sort the
+ * tags on poll group, area, address and bit.
+ */
+
+static int compare_entries( const void *a, const void *b ) {
+
+	const struct tagdb_entry_tp *ea;
+	const struct tagdb_entry_tp *eb;
+
+	ea = a;
+	eb = b;
+
+	if ( ea->tag.poll_group != eb->tag.poll_group ) return ( ea->tag.poll_group < eb->tag.poll_group ) ? -1 : 1;
+	if ( ea->tag.area       != eb->tag.area       ) return ( ea->tag.area       < eb->tag.area       ) ? -1 : 1;
+	if ( ea->tag.address    != eb->tag.address    ) return ( ea->tag.address    < eb->tag.address    ) ? -1 : 1;
+	if ( ea->tag.bit        != eb->tag.bit        ) return ( ea->tag.bit        < eb->tag.bit        ) ? -1 : 1;
+	if ( ea->line           != eb->line           ) return ( ea->line           < eb->line           ) ? -1 : 1;
+
+	return 0;
+
+}  /* compare_entries */
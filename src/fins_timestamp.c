@@ -0,0 +1,433 @@
+/*
+ * Library: libfins
+ * File:    src/fins_timestamp.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_timestamp.c contains routines to timestamp FINS
+ * frames in the kernel network stack or in the network card. With these
+ * timestamps the response time of a request is split into the time spent in
+ * the sending host, on the network plus in the PLC and in the receiving host.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#endif  /* defined(__linux__) */
+
+#include "fins.h"
+
+#if defined(_WIN32)
+typedef char		recv_tp;
+#else  /* defined(_WIN32) */
+typedef void		recv_tp;
+#endif  /* defined(_WIN32) */
+
+#if defined(__linux__)
+#define CONTROL_LEN		512
+
+static void		enable_nic_timestamps( struct fins_sys_tp *sys );
+static bool		read_timestamps( struct msghdr *msg, uint64_t *sw, uint64_t *hw );
+static uint64_t		realtime_nsec( void );
+#endif  /* defined(__linux__) */
+
+/*
+ * int finslib_timestamping( struct fins_sys_tp *sys, int mode );
+ *
+ * The function finslib_timestamping() enables or disables kernel timestamps
+ * of the frames sent and received over a connection. With software
+ * timestamps the kernel records when a frame leaves the network stack and
+ * when a response enters it. Hardware mode asks the network card to record
+ * these moments on the wire, with the software timestamps as fallback. The
+ * latency statistics of the connection are reset by each call.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_timestamping( struct fins_sys_tp *sys, int mode ) {
+
+	if ( sys == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	if ( mode != FINS_TIMESTAMP_OFF  &&  mode != FINS_TIMESTAMP_SOFTWARE  &&  mode != FINS_TIMESTAMP_HARDWARE ) return FINS_RETVAL_INVALID_LAYOUT;
+
+#if defined(__linux__)
+
+	memset( & sys->latency, 0, sizeof(sys->latency) );
+	sys->latency.mode = mode;
+
+	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_SUCCESS;
+
+	return XX_finslib_timestamp_apply( sys );
+
+#else  /* defined(__linux__) */
+
+	return ( mode == FINS_TIMESTAMP_OFF ) ? FINS_RETVAL_SUCCESS : FINS_RETVAL_NOT_SUPPORTED;
+
+#endif  /* defined(__linux__) */
+
+}  /* finslib_timestamping */
+
+/*
+ * int XX_finslib_timestamp_apply( struct fins_sys_tp *sys );
+ *
+ * The function XX_finslib_timestamp_apply() sets the SO_TIMESTAMPING option
+ * of the socket of a connection according to the timestamp mode. It is
+ * called when the mode changes and every time a new socket is opened for the
+ * connection.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int XX_finslib_timestamp_apply( struct fins_sys_tp *sys ) {
+
+#if defined(__linux__)
+
+	int flags;
+
+	if ( sys         == NULL           ) return FINS_RETVAL_NOT_INITIALIZED;
+	if ( sys->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	flags = 0;
+
+	if ( sys->latency.mode != FINS_TIMESTAMP_OFF ) {
+
+		flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+	}
+
+	if ( sys->latency.mode == FINS_TIMESTAMP_HARDWARE ) {
+
+		flags |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+
+		enable_nic_timestamps( sys );
+	}
+
+	if ( setsockopt( sys->sockfd, SOL_SOCKET, SO_TIMESTAMPING, & flags, sizeof(flags) ) < 0 ) return FINS_RETVAL_ERRNO_BASE + errno;
+
+	sys->latency.pending    = false;
+	sys->latency.overlapped = false;
+
+	return FINS_RETVAL_SUCCESS;
+
+#else  /* defined(__linux__) */
+
+	(void) sys;
+
+	return FINS_RETVAL_SUCCESS;
+
+#endif  /* defined(__linux__) */
+
+}  /* XX_finslib_timestamp_apply */
+
+/*
+ * void XX_finslib_timestamp_send( struct fins_sys_tp *sys, uint8_t sid );
+ *
+ * The function XX_finslib_timestamp_send() is called just before a frame is
+ * handed to the kernel. It records the time of the send call and the SID of
+ * the frame. A frame is only measured when no other command on the
+ * connection is waiting for a response, because otherwise the first data
+ * received may belong to another frame. When a frame is sent while the
+ * response to the measured frame is still expected, the frames overlap and
+ * the exchange is not measured either.
+ */
+
+void XX_finslib_timestamp_send( struct fins_sys_tp *sys, uint8_t sid ) {
+
+#if defined(__linux__)
+
+	if ( sys->latency.mode == FINS_TIMESTAMP_OFF ) return;
+
+	if ( sys->latency.pending ) {
+
+		sys->latency.overlapped = true;
+		return;
+	}
+
+	if ( sys->stats.in_flight > 0 ) return;
+
+	sys->latency.pending  = true;
+	sys->latency.sid      = sid;
+	sys->latency.app_send = realtime_nsec();
+	sys->latency.tx       = 0;
+	sys->latency.rx       = 0;
+	sys->latency.tx_hw    = 0;
+	sys->latency.rx_hw    = 0;
+
+#else  /* defined(__linux__) */
+
+	(void) sys;
+	(void) sid;
+
+#endif  /* defined(__linux__) */
+
+}  /* XX_finslib_timestamp_send */
+
+/*
+ * int XX_finslib_timestamp_recv( struct fins_sys_tp *sys, void *buf, int len, int flags, struct sockaddr *from, socklen_t *fromlen );
+ *
+ * The function XX_finslib_timestamp_recv() receives data from the socket of
+ * a connection like recvfrom(). When timestamps are enabled and a response is
+ * expected, the receive timestamps of the first data of the response are
+ * taken from the control messages.
+ *
+ * The function returns the number of bytes received, or a negative value
+ * with the reason in errno.
+ */
+
+int XX_finslib_timestamp_recv( struct fins_sys_tp *sys, void *buf, int len, int flags, struct sockaddr *from, socklen_t *fromlen ) {
+
+#if defined(__linux__)
+
+	int recv_len;
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		char buffer[CONTROL_LEN];
+		struct cmsghdr align;
+	} control;
+
+	if ( sys->latency.mode == FINS_TIMESTAMP_OFF  ||  ! sys->latency.pending  ||  sys->latency.rx != 0 ) {
+
+		return recvfrom( sys->sockfd, buf, len, flags, from, fromlen );
+	}
+
+	iov.iov_base       = buf;
+	iov.iov_len        = len;
+
+	memset( & msg, 0, sizeof(msg) );
+	msg.msg_name       = from;
+	msg.msg_namelen    = ( fromlen != NULL ) ? *fromlen : 0;
+	msg.msg_iov        = & iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+
+	recv_len = recvmsg( sys->sockfd, & msg, flags );
+
+	if ( recv_len > 0 ) {
+
+		if ( fromlen != NULL ) *fromlen = msg.msg_namelen;
+
+		read_timestamps( & msg, & sys->latency.rx, & sys->latency.rx_hw );
+	}
+
+	return recv_len;
+
+#else  /* defined(__linux__) */
+
+	return recvfrom( sys->sockfd, (recv_tp *) buf, len, flags, from, fromlen );
+
+#endif  /* defined(__linux__) */
+
+}  /* XX_finslib_timestamp_recv */
+
+/*
+ * void XX_finslib_timestamp_done( struct fins_sys_tp *sys, uint8_t sid );
+ *
+ * The function XX_finslib_timestamp_done() is called when a complete response
+ * has been received. The transmit timestamps are collected from the error
+ * queue of the socket, where the kernel leaves them. The last one belongs to
+ * the end of the request. If the response carries the SID of the measured
+ * frame and no other frame was sent in between, the three parts of the
+ * response time are added to the statistics of the connection. When hardware
+ * timestamps of both directions are present, these are used for the time on
+ * the network.
+ */
+
+void XX_finslib_timestamp_done( struct fins_sys_tp *sys, uint8_t sid ) {
+
+#if defined(__linux__)
+
+	char dummy[1];
+	uint64_t sw;
+	uint64_t hw;
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		char buffer[CONTROL_LEN];
+		struct cmsghdr align;
+	} control;
+
+	if ( sys->latency.mode == FINS_TIMESTAMP_OFF  ||  ! sys->latency.pending ) return;
+
+	sys->latency.app_recv = realtime_nsec();
+
+	for (;;) {
+
+		iov.iov_base       = dummy;
+		iov.iov_len        = sizeof(dummy);
+
+		memset( & msg, 0, sizeof(msg) );
+		msg.msg_iov        = & iov;
+		msg.msg_iovlen     = 1;
+		msg.msg_control    = control.buffer;
+		msg.msg_controllen = sizeof(control.buffer);
+
+		if ( recvmsg( sys->sockfd, & msg, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 ) break;
+
+		if ( read_timestamps( & msg, & sw, & hw ) ) {
+
+			if ( sw > sys->latency.tx    ) sys->latency.tx    = sw;
+			if ( hw > sys->latency.tx_hw ) sys->latency.tx_hw = hw;
+		}
+	}
+
+	if ( ! sys->latency.overlapped                              &&
+	       sys->latency.sid      == sid                         &&
+	       sys->latency.tx       >= sys->latency.app_send       &&
+	       sys->latency.rx       >= sys->latency.tx             &&
+	       sys->latency.app_recv >= sys->latency.rx             &&
+	       sys->latency.tx       != 0                           ) {
+
+		sys->latency.frames++;
+		sys->latency.host_send_nsec += sys->latency.tx       - sys->latency.app_send;
+		sys->latency.host_recv_nsec += sys->latency.app_recv - sys->latency.rx;
+
+		if ( sys->latency.tx_hw != 0  &&  sys->latency.rx_hw >= sys->latency.tx_hw ) sys->latency.wire_nsec += sys->latency.rx_hw - sys->latency.tx_hw;
+		else                                                                          sys->latency.wire_nsec += sys->latency.rx    - sys->latency.tx;
+	}
+
+	sys->latency.pending    = false;
+	sys->latency.overlapped = false;
+
+#else  /* defined(__linux__) */
+
+	(void) sys;
+	(void) sid;
+
+#endif  /* defined(__linux__) */
+
+}  /* XX_finslib_timestamp_done */
+
+#if defined(__linux__)
+
+/*
+ * static bool read_timestamps( struct msghdr *msg, uint64_t *sw, uint64_t *hw );
+ *
+ * The function read_timestamps() searches the control messages of a received
+ * message for SO_TIMESTAMPING information and returns the software and raw
+ * hardware timestamps in nanoseconds. Timestamps which are not present are
+ * returned as zero. The function returns true if timestamps were found.
+ */
+
+static bool read_timestamps( struct msghdr *msg, uint64_t *sw, uint64_t *hw ) {
+
+	struct cmsghdr *cmsg;
+	struct scm_timestamping tss;
+
+	*sw = 0;
+	*hw = 0;
+
+	for (cmsg=CMSG_FIRSTHDR(msg); cmsg!=NULL; cmsg=CMSG_NXTHDR(msg,cmsg)) {
+
+		if ( cmsg->cmsg_level != SOL_SOCKET  ||  cmsg->cmsg_type != SCM_TIMESTAMPING ) continue;
+
+		memcpy( & tss, CMSG_DATA(cmsg), sizeof(tss) );
+
+		*sw = ( (uint64_t) tss.ts[0].tv_sec ) * 1000000000 + (uint64_t) tss.ts[0].tv_nsec;
+		*hw = ( (uint64_t) tss.ts[2].tv_sec ) * 1000000000 + (uint64_t) tss.ts[2].tv_nsec;
+
+		return true;
+	}
+
+	return false;
+
+}  /* read_timestamps */
+
+/*
+ * static void enable_nic_timestamps( struct fins_sys_tp *sys );
+ *
+ * The function enable_nic_timestamps() looks up the network interface which
+ * carries the connection and asks its driver to timestamp all packets in
+ * hardware. This needs the CAP_NET_ADMIN privilege and a network card which
+ * supports it. Failures are ignored, because software timestamps are still
+ * available then.
+ */
+
+static void enable_nic_timestamps( struct fins_sys_tp *sys ) {
+
+	struct sockaddr_in local;
+	socklen_t local_len;
+	struct ifaddrs *ifa_list;
+	struct ifaddrs *ifa;
+	struct ifreq ifr;
+	struct hwtstamp_config config;
+
+	local_len = sizeof(local);
+
+	if ( getsockname( sys->sockfd, (struct sockaddr *) & local, & local_len ) < 0 ) return;
+	if ( getifaddrs( & ifa_list ) < 0 ) return;
+
+	for (ifa=ifa_list; ifa!=NULL; ifa=ifa->ifa_next) {
+
+		if ( ifa->ifa_addr == NULL  ||  ifa->ifa_addr->sa_family != AF_INET ) continue;
+		if ( ((struct sockaddr_in *) (void *) ifa->ifa_addr)->sin_addr.s_addr != local.sin_addr.s_addr ) continue;
+
+		memset( & config, 0, sizeof(config) );
+		config.tx_type   = HWTSTAMP_TX_ON;
+		config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+		memset( & ifr, 0, sizeof(ifr) );
+		snprintf( ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifa->ifa_name );
+		ifr.ifr_data = (char *) & config;
+
+		ioctl( sys->sockfd, SIOCSHWTSTAMP, & ifr );
+
+		break;
+	}
+
+	freeifaddrs( ifa_list );
+
+}  /* enable_nic_timestamps */
+
+/*
+ * static uint64_t realtime_nsec( void );
+ *
+ * The function realtime_nsec() returns the system clock in nanoseconds. The
+ * kernel uses the same clock for software timestamps.
+ */
+
+static uint64_t realtime_nsec( void ) {
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_REALTIME, & ts );
+
+	return ( (uint64_t) ts.tv_sec ) * 1000000000 + (uint64_t) ts.tv_nsec;
+
+}  /* realtime_nsec */
+
+#endif  /* defined(__linux__) */
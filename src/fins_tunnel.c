@@ -0,0 +1,1939 @@
+/*
+ * Library: libfins
+ * File:    src/fins_tunnel.c
+ * Author:  Lammert Bies
+ *
+ * This file is licensed under the MIT License as stated below
+ *
+ * Copyright (c) 2016-2020 Lammert Bies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Description
+ * -----------
+ * The source file src/fins_tunnel.c contains routines for a tunnel which makes a
+ * PLC behind a slow and expensive WAN link available to normal FINS/TCP clients.
+ * An agent close to the PLC polls a list of memory blocks and sends only the
+ * changed words in batches over a TCP link. An endpoint on the far side keeps a
+ * copy of the blocks, answers reads of the copied memory locally and forwards
+ * all other commands over the link to be executed by the agent.
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else  /* defined(_WIN32) */
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#endif  /* defined(_WIN32) */
+
+#include "fins.h"
+
+#define TUNNEL_HEADER_LEN	8
+#define TUNNEL_BATCH_LEN	8
+#define TUNNEL_ENTRY_LEN	18
+#define TUNNEL_MAX_WORDS	4096
+#define TUNNEL_MERGE_GAP	(TUNNEL_ENTRY_LEN/2)
+#define TUNNEL_RETRY_USEC	1000000
+
+#define TUNNEL_TYPE_HELLO	0x01
+#define TUNNEL_TYPE_BATCH	0x02
+#define TUNNEL_TYPE_REQUEST	0x03
+#define TUNNEL_TYPE_RESPONSE	0x04
+
+#define TUNNEL_ENTRY_FULL	0x01
+#define TUNNEL_ENTRY_DELTA	0x02
+#define TUNNEL_ENTRY_INVALID	0x03
+
+#define FINS_TCP_HEADER_LEN	16
+#define ENDCODE_NO_RESPONSE	0x0205
+
+#if defined(MSG_NOSIGNAL)
+#define TUNNEL_SEND_FLAGS	MSG_NOSIGNAL
+#else  /* defined(MSG_NOSIGNAL) */
+#define TUNNEL_SEND_FLAGS	0
+#endif  /* defined(MSG_NOSIGNAL) */
+
+#if defined(_WIN32)
+typedef char		recv_tp;
+typedef const char	send_tp;
+typedef const char	setsockopt_tp;
+#else  /* defined(_WIN32) */
+typedef void		recv_tp;
+typedef void		send_tp;
+typedef void		setsockopt_tp;
+#endif  /* defined(_WIN32) */
+
+static int			agent_connect( struct fins_tunnelagent_tp *agent );
+static void			agent_execute( struct fins_tunnelagent_tp *agent, const unsigned char *payload, size_t len );
+static int			agent_hello( struct fins_tunnelagent_tp *agent, const unsigned char *payload, size_t len );
+static int			agent_send_batch( struct fins_tunnelagent_tp *agent, bool sync );
+static bool			batch_entry( struct fins_tunnelagent_tp *agent, size_t *frame, size_t *num_entries, const struct fins_mcastlink_tp *block, uint8_t kind, size_t offset, size_t count );
+static void			batch_finish( struct fins_tunnelagent_tp *agent, size_t frame, size_t num_entries );
+static bool			batch_start( struct fins_tunnelagent_tp *agent, size_t *frame, size_t *num_entries, bool sync );
+static void			client_close( struct fins_tunnelclient_tp *client );
+static void			client_process( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client );
+static void			client_respond( struct fins_tunnelclient_tp *client, const unsigned char *header, const unsigned char *body, size_t bodylen );
+static void			client_respond_endcode( struct fins_tunnelclient_tp *client, const unsigned char *header, uint16_t endcode );
+static void			ep_accept_client( struct fins_tunnelendpoint_tp *ep );
+static void			ep_accept_link( struct fins_tunnelendpoint_tp *ep );
+static void			ep_apply_batch( struct fins_tunnelendpoint_tp *ep, const unsigned char *payload, size_t len );
+static struct fins_mcastlink_tp *	ep_block( struct fins_tunnelendpoint_tp *ep, uint16_t id, bool create );
+static void			ep_fail_pending( struct fins_tunnelendpoint_tp *ep );
+static void			ep_forward( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client, const unsigned char *frame, size_t len );
+static bool			ep_local_read( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client, const unsigned char *frame, size_t len );
+static bool			ep_send_hello( struct fins_tunnelendpoint_tp *ep );
+static const uint16_t *		ep_words( struct fins_tunnelendpoint_tp *ep, uint8_t area, uint32_t start, size_t count );
+static uint16_t			get16( const unsigned char *buf );
+static uint32_t			get32( const unsigned char *buf );
+static bool			link_alloc( struct fins_tunnellink_tp *link );
+static void			link_close( struct fins_tunnellink_tp *link );
+static void			link_consume( struct fins_tunnellink_tp *link, size_t len );
+static size_t			link_due_msec( const struct fins_tunnellink_tp *link, uint64_t now, size_t max_msec );
+static void			link_end_frame( struct fins_tunnellink_tp *link, size_t start );
+static int			link_flush( struct fins_tunnellink_tp *link );
+static void			link_free( struct fins_tunnellink_tp *link );
+static void			link_init( struct fins_tunnellink_tp *link );
+static bool			link_next_frame( struct fins_tunnellink_tp *link, uint8_t *type, const unsigned char **payload, size_t *len, int *retval );
+static int			link_receive( struct fins_tunnellink_tp *link );
+static size_t			link_ready( const struct fins_tunnellink_tp *link, uint64_t now );
+static unsigned char *		link_reserve( struct fins_tunnellink_tp *link, size_t len );
+static bool			link_start_frame( struct fins_tunnellink_tp *link, uint8_t type, size_t *start );
+static void			put16( unsigned char *buf, uint32_t value );
+static void			put32( unsigned char *buf, uint32_t value );
+static void			set_socket_options( SOCKET fd, bool nonblocking );
+static int			socket_error( void );
+static SOCKET			tcp_listen( const char *address, uint16_t port, int *retval );
+static bool			would_block( void );
+
+/*
+ * struct fins_tunnelagent_tp *finslib_tunnel_agent_create( struct fins_sys_tp *sys, const char *address, uint16_t port, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val );
+ *
+ * The function finslib_tunnel_agent_create() creates the near side of a
+ * tunnel. The agent polls a list of memory blocks of the PLC on the local
+ * connection sys and sends the changes to the endpoint listening on the given
+ * address and port. The link is established by the agent, so that the PLC
+ * site only needs outgoing connections. On success a pointer to the agent is
+ * returned. Otherwise the return value is NULL and the reason is stored in
+ * the variable pointed to by error_val.
+ */
+
+struct fins_tunnelagent_tp *finslib_tunnel_agent_create( struct fins_sys_tp *sys, const char *address, uint16_t port, const struct fins_mcastblock_tp *block, size_t num_block, int *error_val ) {
+
+	struct fins_tunnelagent_tp *agent;
+	size_t a;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	agent  = NULL;
+
+	if      ( sys     == NULL                         ) retval = FINS_RETVAL_NOT_INITIALIZED;
+	else if ( address == NULL  ||  *address == 0      ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+	else if ( strlen( address ) >= sizeof(agent->address) ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+	else if ( block   == NULL  ||  num_block == 0     ) retval = FINS_RETVAL_NO_DATA_BLOCK;
+	else if ( ( agent = calloc( 1, sizeof(struct fins_tunnelagent_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( agent != NULL ) {
+
+		link_init( & agent->link );
+
+		agent->sys   = sys;
+		agent->port  = ( port != 0 ) ? port : FINS_TUNNEL_DEFAULT_PORT;
+		agent->block = XX_finslib_mcast_create_links( block, num_block, true, & retval );
+
+		strcpy( agent->address, address );
+
+		if ( agent->block != NULL ) agent->num_block = num_block;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS ) retval = XX_finslib_mcast_resolve_links( sys, agent->block, agent->num_block );
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  ( agent->resync = calloc( num_block, sizeof(bool) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+	if ( retval == FINS_RETVAL_SUCCESS  &&  ! link_alloc( & agent->link )                               ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) for (a=0; a<num_block; a++) agent->resync[a] = true;
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_tunnel_agent_free( agent );
+		return NULL;
+	}
+
+	return agent;
+
+}  /* finslib_tunnel_agent_create */
+
+/*
+ * void finslib_tunnel_agent_free( struct fins_tunnelagent_tp *agent );
+ *
+ * The function finslib_tunnel_agent_free() closes the link of an agent and
+ * releases all memory associated with it. The connection with the PLC is not
+ * closed.
+ */
+
+void finslib_tunnel_agent_free( struct fins_tunnelagent_tp *agent ) {
+
+	if ( agent == NULL ) return;
+
+	link_free( & agent->link );
+	XX_finslib_mcast_free_links( agent->block, agent->num_block );
+	free( agent->resync );
+	free( agent );
+
+}  /* finslib_tunnel_agent_free */
+
+/*
+ * int finslib_tunnel_agent_poll( struct fins_tunnelagent_tp *agent, int timeout_msec );
+ *
+ * The function finslib_tunnel_agent_poll() performs one poll cycle of an
+ * agent. If the link is down, a new connection is attempted at most once per
+ * second. Otherwise all blocks are read from the PLC and the changes are sent
+ * to the endpoint in one batch. While the link cannot keep up and a previous
+ * batch is still waiting to be sent, no new batch is made. The changes are
+ * then sent combined in a later batch. The function then handles commands forwarded
+ * by the endpoint until timeout_msec milliseconds have passed since the call,
+ * so that calling the function in a loop gives a fixed poll interval.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_tunnel_agent_poll( struct fins_tunnelagent_tp *agent, int timeout_msec ) {
+
+	fd_set readfds;
+	fd_set writefds;
+	struct timeval tv;
+	const unsigned char *payload;
+	uint64_t deadline;
+	uint64_t now;
+	size_t len;
+	size_t wait_msec;
+	uint8_t type;
+	int retval;
+	int poll_retval;
+
+	if ( agent == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	if ( timeout_msec < 0 ) timeout_msec = 0;
+
+	now         = finslib_monotonic_usec_timer();
+	deadline    = now + 1000 * (uint64_t) timeout_msec;
+	poll_retval = FINS_RETVAL_SUCCESS;
+
+	if ( agent->link.sockfd == INVALID_SOCKET ) {
+
+		if ( now >= agent->next_connect ) poll_retval = agent_connect( agent );
+		else                              poll_retval = FINS_RETVAL_NOT_CONNECTED;
+
+		if ( poll_retval != FINS_RETVAL_SUCCESS ) {
+
+			finslib_milli_second_sleep( timeout_msec );
+			return poll_retval;
+		}
+	}
+
+	if ( agent->synced  &&  agent->link.out_len - agent->link.out_sent < FINS_TUNNEL_MAX_FRAME ) poll_retval = agent_send_batch( agent, false );
+
+	do {
+		if ( ( retval = link_flush( & agent->link ) ) != FINS_RETVAL_SUCCESS ) break;
+
+		now       = finslib_monotonic_usec_timer();
+		wait_msec = ( now < deadline ) ? (size_t) ( ( deadline - now + 999 ) / 1000 ) : 0;
+		wait_msec = link_due_msec( & agent->link, now, wait_msec );
+
+		FD_ZERO( & readfds );
+		FD_ZERO( & writefds );
+		FD_SET( agent->link.sockfd, & readfds );
+
+		if ( link_ready( & agent->link, now ) > agent->link.out_sent ) FD_SET( agent->link.sockfd, & writefds );
+
+		tv.tv_sec  = (long) ( wait_msec / 1000 );
+		tv.tv_usec = (long) ( 1000 * ( wait_msec % 1000 ) );
+
+		retval = select( (int) agent->link.sockfd + 1, & readfds, & writefds, NULL, & tv );
+		if ( retval < 0 ) { retval = socket_error(); break; }
+
+		retval = FINS_RETVAL_SUCCESS;
+
+		if ( ! FD_ISSET( agent->link.sockfd, & readfds ) ) continue;
+
+		if ( ( retval = link_receive( & agent->link ) ) != FINS_RETVAL_SUCCESS ) break;
+
+		while ( link_next_frame( & agent->link, & type, & payload, & len, & retval ) ) {
+
+			if      ( type == TUNNEL_TYPE_HELLO   ) poll_retval = agent_hello( agent, payload, len );
+			else if ( type == TUNNEL_TYPE_REQUEST ) agent_execute( agent, payload, len );
+
+			link_consume( & agent->link, len );
+		}
+
+		if ( retval != FINS_RETVAL_SUCCESS ) break;
+
+	} while ( finslib_monotonic_usec_timer() < deadline );
+
+	if ( retval == FINS_RETVAL_SUCCESS ) retval = link_flush( & agent->link );
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		link_close( & agent->link );
+
+		agent->synced       = false;
+		agent->next_connect = finslib_monotonic_usec_timer() + TUNNEL_RETRY_USEC;
+
+		return retval;
+	}
+
+	return poll_retval;
+
+}  /* finslib_tunnel_agent_poll */
+
+/*
+ * struct fins_tunnelendpoint_tp *finslib_tunnel_endpoint_create( const char *link_address, uint16_t link_port, const char *fins_address, uint16_t fins_port, int *error_val );
+ *
+ * The function finslib_tunnel_endpoint_create() creates the far side of a
+ * tunnel. The endpoint accepts the link from an agent on link_address and
+ * link_port and FINS/TCP clients on fins_address and fins_port. Addresses may
+ * be NULL to listen on all interfaces and ports may be 0 to use the default
+ * ports. The blocks are learned from the agent, so that no configuration is
+ * needed on the far side. On success a pointer to the endpoint is returned.
+ * Otherwise the return value is NULL and the reason is stored in the variable
+ * pointed to by error_val.
+ */
+
+struct fins_tunnelendpoint_tp *finslib_tunnel_endpoint_create( const char *link_address, uint16_t link_port, const char *fins_address, uint16_t fins_port, int *error_val ) {
+
+	struct fins_tunnelendpoint_tp *ep;
+	size_t a;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+
+	if ( ( ep = calloc( 1, sizeof(struct fins_tunnelendpoint_tp) ) ) == NULL ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( ep != NULL ) {
+
+		link_init( & ep->link );
+
+		ep->link_listen  = INVALID_SOCKET;
+		ep->fins_listen  = INVALID_SOCKET;
+		ep->timeout_msec = FINS_TUNNEL_TIMEOUT;
+
+		for (a=0; a<FINS_TUNNEL_MAX_CLIENTS; a++) ep->client[a].sockfd = INVALID_SOCKET;
+	}
+
+	if ( retval == FINS_RETVAL_SUCCESS  &&  ! link_alloc( & ep->link ) ) retval = FINS_RETVAL_OUT_OF_MEMORY;
+
+	if ( retval == FINS_RETVAL_SUCCESS ) ep->link_listen = tcp_listen( link_address, ( link_port != 0 ) ? link_port : FINS_TUNNEL_DEFAULT_PORT, & retval );
+	if ( retval == FINS_RETVAL_SUCCESS ) ep->fins_listen = tcp_listen( fins_address, ( fins_port != 0 ) ? fins_port : FINS_DEFAULT_PORT,        & retval );
+
+	if ( error_val != NULL ) *error_val = retval;
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		finslib_tunnel_endpoint_free( ep );
+		return NULL;
+	}
+
+	return ep;
+
+}  /* finslib_tunnel_endpoint_create */
+
+/*
+ * void finslib_tunnel_endpoint_free( struct fins_tunnelendpoint_tp *ep );
+ *
+ * The function finslib_tunnel_endpoint_free() closes all sockets of an
+ * endpoint and releases all memory associated with it.
+ */
+
+void finslib_tunnel_endpoint_free( struct fins_tunnelendpoint_tp *ep ) {
+
+	size_t a;
+
+	if ( ep == NULL ) return;
+
+	for (a=0; a<FINS_TUNNEL_MAX_CLIENTS; a++) client_close( & ep->client[a] );
+
+	if ( ep->link_listen != INVALID_SOCKET ) closesocket( ep->link_listen );
+	if ( ep->fins_listen != INVALID_SOCKET ) closesocket( ep->fins_listen );
+
+	link_free( & ep->link );
+	XX_finslib_mcast_free_links( ep->block, ep->num_block );
+	free( ep );
+
+}  /* finslib_tunnel_endpoint_free */
+
+/*
+ * int finslib_tunnel_endpoint_poll( struct fins_tunnelendpoint_tp *ep, int timeout_msec );
+ *
+ * The function finslib_tunnel_endpoint_poll() handles all activity on the
+ * sockets of an endpoint for timeout_msec milliseconds. Batches from the
+ * agent are applied to the local copy, reads of valid copied memory are
+ * answered immediately and all other commands are forwarded to the agent.
+ * Forwarded commands which are not answered within the timeout of the
+ * endpoint, or which cannot be forwarded because the link is down, are
+ * answered with the end code for a response timeout.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+int finslib_tunnel_endpoint_poll( struct fins_tunnelendpoint_tp *ep, int timeout_msec ) {
+
+	fd_set readfds;
+	fd_set writefds;
+	struct timeval tv;
+	struct fins_tunnelclient_tp *client;
+	struct fins_tunnelclient_tp *target;
+	const unsigned char *payload;
+	uint64_t deadline;
+	uint64_t now;
+	uint64_t limit;
+	size_t a;
+	size_t len;
+	size_t wait_msec;
+	SOCKET maxfd;
+	uint8_t type;
+	int retval;
+
+	if ( ep == NULL ) return FINS_RETVAL_NOT_INITIALIZED;
+
+	if ( timeout_msec < 0 ) timeout_msec = 0;
+
+	deadline = finslib_monotonic_usec_timer() + 1000 * (uint64_t) timeout_msec;
+
+	do {
+		if ( ep->link.sockfd != INVALID_SOCKET  &&  link_flush( & ep->link ) != FINS_RETVAL_SUCCESS ) {
+
+			link_close( & ep->link );
+			ep_fail_pending( ep );
+		}
+
+		now       = finslib_monotonic_usec_timer();
+		limit     = 1000 * (uint64_t) ep->timeout_msec;
+		wait_msec = ( now < deadline ) ? (size_t) ( ( deadline - now + 999 ) / 1000 ) : 0;
+
+		for (a=0; a<FINS_TUNNEL_MAX_CLIENTS; a++) {
+
+			client = & ep->client[a];
+
+			if ( ! client->pending ) continue;
+
+			if ( now - client->pending_usec >= limit ) {
+
+				client->pending = false;
+				client_respond_endcode( client, client->header, ENDCODE_NO_RESPONSE );
+				client_process( ep, client );
+			}
+
+			else if ( ( client->pending_usec + limit - now ) / 1000 < wait_msec ) wait_msec = (size_t) ( ( client->pending_usec + limit - now + 999 ) / 1000 );
+		}
+
+		FD_ZERO( & readfds );
+		FD_ZERO( & writefds );
+
+		FD_SET( ep->link_listen, & readfds );
+		FD_SET( ep->fins_listen, & readfds );
+
+		maxfd = ( ep->link_listen > ep->fins_listen ) ? ep->link_listen : ep->fins_listen;
+
+		if ( ep->link.sockfd != INVALID_SOCKET ) {
+
+			FD_SET( ep->link.sockfd, & readfds );
+
+			if ( link_ready( & ep->link, now ) > ep->link.out_sent ) FD_SET( ep->link.sockfd, & writefds );
+
+			wait_msec = link_due_msec( & ep->link, now, wait_msec );
+			if ( ep->link.sockfd > maxfd ) maxfd = ep->link.sockfd;
+		}
+
+		for (a=0; a<FINS_TUNNEL_MAX_CLIENTS; a++) {
+
+			client = & ep->client[a];
+
+			if ( client->sockfd == INVALID_SOCKET  ||  client->pending ) continue;
+
+			FD_SET( client->sockfd, & readfds );
+			if ( client->sockfd > maxfd ) maxfd = client->sockfd;
+		}
+
+		tv.tv_sec  = (long) ( wait_msec / 1000 );
+		tv.tv_usec = (long) ( 1000 * ( wait_msec % 1000 ) );
+
+		if ( select( (int) maxfd + 1, & readfds, & writefds, NULL, & tv ) < 0 ) return socket_error();
+
+		if ( FD_ISSET( ep->link_listen, & readfds ) ) ep_accept_link(   ep );
+		if ( FD_ISSET( ep->fins_listen, & readfds ) ) ep_accept_client( ep );
+
+		if ( ep->link.sockfd != INVALID_SOCKET  &&  FD_ISSET( ep->link.sockfd, & readfds ) ) {
+
+			retval = link_receive( & ep->link );
+
+			while ( retval == FINS_RETVAL_SUCCESS  &&  link_next_frame( & ep->link, & type, & payload, & len, & retval ) ) {
+
+				target = NULL;
+
+				if ( type == TUNNEL_TYPE_BATCH ) ep_apply_batch( ep, payload, len );
+
+				else if ( type == TUNNEL_TYPE_RESPONSE  &&  len >= 4 ) {
+
+					target = NULL;
+
+					for (a=0; a<FINS_TUNNEL_MAX_CLIENTS; a++) {
+
+						client = & ep->client[a];
+						if ( client->pending  &&  client->tag == get32( payload ) ) target = client;
+					}
+
+					if ( target != NULL ) {
+
+						target->pending = false;
+						client_respond( target, target->header, payload+4, len-4 );
+					}
+				}
+
+				link_consume( & ep->link, len );
+
+				if ( target != NULL ) client_process( ep, target );
+			}
+
+			if ( retval != FINS_RETVAL_SUCCESS ) {
+
+				link_close( & ep->link );
+				ep_fail_pending( ep );
+			}
+		}
+
+		for (a=0; a<FINS_TUNNEL_MAX_CLIENTS; a++) {
+
+			client = & ep->client[a];
+
+			if ( client->sockfd == INVALID_SOCKET  ||  client->pending  ||  ! FD_ISSET( client->sockfd, & readfds ) ) continue;
+
+			retval = recv( client->sockfd, (recv_tp *) ( client->in + client->in_len ), (int) ( sizeof(client->in) - client->in_len ), 0 );
+
+			if ( retval <= 0 ) { client_close( client ); continue; }
+
+			client->in_len += (size_t) retval;
+
+			client_process( ep, client );
+		}
+
+	} while ( finslib_monotonic_usec_timer() < deadline );
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* finslib_tunnel_endpoint_poll */
+
+/*
+ * static int agent_connect( struct fins_tunnelagent_tp *agent );
+ *
+ * The function agent_connect() establishes the link from an agent to the
+ * endpoint. After the connection is made the agent waits for the HELLO frame
+ * of the endpoint before sending batches. A failed attempt delays the next
+ * attempt by one second.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int agent_connect( struct fins_tunnelagent_tp *agent ) {
+
+	struct sockaddr_in ep_addr;
+	int retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+
+	memset( & ep_addr, 0, sizeof(ep_addr) );
+
+	ep_addr.sin_family = AF_INET;
+	ep_addr.sin_port   = htons( agent->port );
+
+	link_close( & agent->link );
+
+	if ( finslib_inet_pton( AF_INET, agent->address, & ep_addr.sin_addr.s_addr ) != 1 ) retval = FINS_RETVAL_INVALID_IP_ADDRESS;
+	else if ( ( agent->link.sockfd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP ) ) == INVALID_SOCKET ) retval = socket_error();
+	else if ( connect( agent->link.sockfd, (struct sockaddr *) & ep_addr, sizeof(ep_addr) ) < 0 ) retval = socket_error();
+
+	if ( retval != FINS_RETVAL_SUCCESS ) {
+
+		link_close( & agent->link );
+
+		agent->next_connect = finslib_monotonic_usec_timer() + TUNNEL_RETRY_USEC;
+
+		return retval;
+	}
+
+	set_socket_options( agent->link.sockfd, true );
+
+	agent->synced = false;
+	agent->connects++;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* agent_connect */
+
+/*
+ * static int agent_hello( struct fins_tunnelagent_tp *agent, const unsigned char *payload, size_t len );
+ *
+ * The function agent_hello() processes the HELLO frame in which the endpoint
+ * reports the version of each block it holds. Blocks of which the endpoint
+ * has no valid copy of the current version are sent completely in the next
+ * batch, which is sent immediately.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int agent_hello( struct fins_tunnelagent_tp *agent, const unsigned char *payload, size_t len ) {
+
+	const unsigned char *entry;
+	size_t a;
+	size_t b;
+	size_t num;
+
+	for (a=0; a<agent->num_block; a++) agent->resync[a] = true;
+
+	num = ( len >= 2 ) ? get16( payload ) : 0;
+	if ( 2 + 7*num > len ) num = 0;
+
+	for (b=0; b<num; b++) {
+
+		entry = payload + 2 + 7*b;
+
+		for (a=0; a<agent->num_block; a++) {
+
+			if ( agent->block[a].block.id != get16( entry ) ) continue;
+
+			if ( agent->block[a].data_valid  &&  entry[6]  &&  agent->block[a].version == get32( entry+2 ) ) agent->resync[a] = false;
+		}
+	}
+
+	agent->synced = true;
+
+	return agent_send_batch( agent, true );
+
+}  /* agent_hello */
+
+/*
+ * static void agent_execute( struct fins_tunnelagent_tp *agent, const unsigned char *payload, size_t len );
+ *
+ * The function agent_execute() executes a command forwarded by the endpoint
+ * on the local PLC and queues the response body for the endpoint. When no
+ * valid response is received from the PLC, the end code for a response
+ * timeout is returned instead.
+ */
+
+static void agent_execute( struct fins_tunnelagent_tp *agent, const unsigned char *payload, size_t len ) {
+
+	struct fins_command_tp fins_cmnd;
+	unsigned char *buf;
+	size_t bodylen;
+	size_t start;
+	int retval;
+
+	if ( len < 6  ||  len - 6 > FINS_BODY_LEN ) return;
+
+	XX_finslib_init_command( agent->sys, & fins_cmnd, payload[4], payload[5] );
+
+	bodylen = len - 6;
+	memcpy( fins_cmnd.body, payload+6, bodylen );
+
+	retval = XX_finslib_communicate( agent->sys, & fins_cmnd, & bodylen, true );
+
+	agent->forwarded++;
+
+	if ( ( retval >= 0x8000  &&  retval != FINS_RETVAL_SUCCESS_LAST_DATA )  ||  bodylen < 2 ) {
+
+		bodylen           = 2;
+		fins_cmnd.body[0] = ( ENDCODE_NO_RESPONSE >> 8 ) & 0xff;
+		fins_cmnd.body[1] = ( ENDCODE_NO_RESPONSE      ) & 0xff;
+	}
+
+	if ( ! link_start_frame( & agent->link, TUNNEL_TYPE_RESPONSE, & start ) ) return;
+
+	if ( ( buf = link_reserve( & agent->link, 4 + bodylen ) ) == NULL ) {
+
+		agent->link.out_len = start;
+		return;
+	}
+
+	memcpy( buf, payload, 4 );
+	memcpy( buf+4, fins_cmnd.body, bodylen );
+
+	link_end_frame( & agent->link, start );
+
+}  /* agent_execute */
+
+/*
+ * static int agent_send_batch( struct fins_tunnelagent_tp *agent, bool sync );
+ *
+ * The function agent_send_batch() reads all blocks from the PLC and queues
+ * the changes since the previous batch. The flag sync marks the batch which
+ * answers a HELLO frame. Blocks which must be resynchronized
+ * are sent completely and blocks which could not be read are reported as
+ * invalid. Changed words close to each other are merged into one range
+ * because each range carries a fixed overhead. A batch is split over several
+ * frames when it does not fit in one frame. An empty batch is still sent so
+ * that the endpoint can detect lost batches.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int agent_send_batch( struct fins_tunnelagent_tp *agent, bool sync ) {
+
+	struct fins_mcastlink_tp *block;
+	uint16_t *swap;
+	size_t a;
+	size_t b;
+	size_t first;
+	size_t last;
+	size_t frame;
+	size_t num_entries;
+	bool ok;
+	int retval;
+	int read_retval;
+
+	retval = FINS_RETVAL_SUCCESS;
+	ok     = batch_start( agent, & frame, & num_entries, sync );
+
+	for (a=0; ok  &&  a<agent->num_block; a++) {
+
+		block       = & agent->block[a];
+		read_retval = XX_finslib_mcast_read_block( agent->sys, block, & agent->frames_read );
+
+		if ( read_retval != FINS_RETVAL_SUCCESS ) {
+
+			if ( retval == FINS_RETVAL_SUCCESS ) retval = read_retval;
+
+			if ( block->data_valid ) ok = batch_entry( agent, & frame, & num_entries, block, TUNNEL_ENTRY_INVALID, 0, 0 );
+
+			block->data_valid = false;
+			agent->resync[a]  = true;
+
+			continue;
+		}
+
+		block->changed = ( ! block->data_valid  ||  memcmp( block->next, block->data, block->block.num_words * sizeof(uint16_t) ) );
+
+		if ( block->changed ) block->version++;
+
+		swap        = block->data;
+		block->data = block->next;
+		block->next = swap;
+
+		if ( agent->resync[a] ) {
+
+			for (b=0; ok  &&  b<block->block.num_words; b+=TUNNEL_MAX_WORDS) {
+
+				last = b + TUNNEL_MAX_WORDS;
+				if ( last > block->block.num_words ) last = block->block.num_words;
+
+				ok = batch_entry( agent, & frame, & num_entries, block, TUNNEL_ENTRY_FULL, b, last-b );
+			}
+
+			agent->resync[a]  = ! ok;
+			block->data_valid = ok;
+
+			continue;
+		}
+
+		b = 0;
+
+		while ( ok  &&  block->changed  &&  b < block->block.num_words ) {
+
+			if ( block->data[b] == block->next[b] ) { b++; continue; }
+
+			first = b;
+			last  = b;
+
+			for (b=first+1; b<block->block.num_words  &&  b-last <= TUNNEL_MERGE_GAP  &&  b-first < TUNNEL_MAX_WORDS; b++) {
+
+				if ( block->data[b] != block->next[b] ) last = b;
+			}
+
+			ok = batch_entry( agent, & frame, & num_entries, block, TUNNEL_ENTRY_DELTA, first, last-first+1 );
+
+			b = last + 1;
+		}
+	}
+
+	if ( ! ok ) {
+
+		agent->link.out_len = frame;
+
+		for (a=0; a<agent->num_block; a++) agent->resync[a] = true;
+
+		return FINS_RETVAL_OUT_OF_MEMORY;
+	}
+
+	batch_finish( agent, frame, num_entries );
+
+	return retval;
+
+}  /* agent_send_batch */
+
+/*
+ * static bool batch_entry( struct fins_tunnelagent_tp *agent, size_t *frame, size_t *num_entries, const struct fins_mcastlink_tp *block, uint8_t kind, size_t offset, size_t count );
+ *
+ * The function batch_entry() appends one entry to the BATCH frame being
+ * built in the send buffer of the link. When the entry does not fit, the
+ * current frame is finished and a new one is started. Each entry carries the
+ * block ID, version, area, start address and size of the block and the
+ * position of the range of words it contains. All values are in big endian
+ * order. The function returns false if no memory could be allocated.
+ */
+
+static bool batch_entry( struct fins_tunnelagent_tp *agent, size_t *frame, size_t *num_entries, const struct fins_mcastlink_tp *block, uint8_t kind, size_t offset, size_t count ) {
+
+	unsigned char *buf;
+	size_t a;
+
+	if ( *num_entries >= 0xFFFF  ||  agent->link.out_len - *frame + TUNNEL_ENTRY_LEN + 2*count > TUNNEL_HEADER_LEN + FINS_TUNNEL_MAX_FRAME ) {
+
+		batch_finish( agent, *frame, *num_entries );
+
+		if ( ! batch_start( agent, frame, num_entries, false ) ) return false;
+	}
+
+	if ( ( buf = link_reserve( & agent->link, TUNNEL_ENTRY_LEN + 2*count ) ) == NULL ) return false;
+
+	put16( buf,    block->block.id                  );
+	put32( buf+2,  block->version                   );
+	buf[6] = kind;
+	buf[7] = block->area;
+	put32( buf+8,  block->start                     );
+	put16( buf+12, (uint32_t) block->block.num_words );
+	put16( buf+14, (uint32_t) offset                );
+	put16( buf+16, (uint32_t) count                 );
+
+	for (a=0; a<count; a++) put16( buf + TUNNEL_ENTRY_LEN + 2*a, block->data[offset+a] );
+
+	(*num_entries)++;
+
+	return true;
+
+}  /* batch_entry */
+
+/*
+ * static void batch_finish( struct fins_tunnelagent_tp *agent, size_t frame, size_t num_entries );
+ *
+ * The function batch_finish() stores the number of entries in a BATCH frame
+ * and releases the frame for sending.
+ */
+
+static void batch_finish( struct fins_tunnelagent_tp *agent, size_t frame, size_t num_entries ) {
+
+	put16( agent->link.out + frame + TUNNEL_HEADER_LEN + 4, (uint32_t) num_entries );
+
+	link_end_frame( & agent->link, frame );
+
+	agent->sequence++;
+	agent->batches_sent++;
+
+}  /* batch_finish */
+
+/*
+ * static bool batch_start( struct fins_tunnelagent_tp *agent, size_t *frame, size_t *num_entries, bool sync );
+ *
+ * The function batch_start() starts a new BATCH frame with the next sequence
+ * number in the send buffer of the link. The flag sync tells the endpoint
+ * that this frame is the first one sent after its last HELLO frame, so that
+ * frames which were already underway can be ignored. The function returns
+ * false if no memory could be allocated.
+ */
+
+static bool batch_start( struct fins_tunnelagent_tp *agent, size_t *frame, size_t *num_entries, bool sync ) {
+
+	unsigned char *buf;
+
+	*num_entries = 0;
+
+	if ( ! link_start_frame( & agent->link, TUNNEL_TYPE_BATCH, frame ) ) return false;
+
+	if ( ( buf = link_reserve( & agent->link, TUNNEL_BATCH_LEN ) ) == NULL ) return false;
+
+	put32( buf, agent->sequence );
+	put16( buf+4, 0 );
+	buf[6] = sync;
+	buf[7] = 0x00;
+
+	return true;
+
+}  /* batch_start */
+
+/*
+ * static void client_close( struct fins_tunnelclient_tp *client );
+ *
+ * The function client_close() closes the connection with a FINS/TCP client
+ * of an endpoint and frees its slot.
+ */
+
+static void client_close( struct fins_tunnelclient_tp *client ) {
+
+	if ( client->sockfd != INVALID_SOCKET ) closesocket( client->sockfd );
+
+	client->sockfd  = INVALID_SOCKET;
+	client->in_len  = 0;
+	client->pending = false;
+
+}  /* client_close */
+
+/*
+ * static void client_process( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client );
+ *
+ * The function client_process() handles the complete FINS/TCP frames in the
+ * receive buffer of a client. The node address handshake is answered by the
+ * endpoint itself. FINS commands are answered from the local copy when
+ * possible and forwarded to the agent otherwise. Processing stops while a
+ * forwarded command waits for its response, because FINS/TCP clients expect
+ * the responses in the order of their commands.
+ */
+
+static void client_process( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client ) {
+
+	unsigned char buf[24];
+	uint32_t node;
+	size_t len;
+
+	while ( client->sockfd != INVALID_SOCKET  &&  ! client->pending  &&  client->in_len >= FINS_TCP_HEADER_LEN ) {
+
+		len = get32( client->in+4 );
+
+		if ( memcmp( client->in, "FINS", 4 )  ||  len < 8  ||  len + 8 > sizeof(client->in) ) { client_close( client ); return; }
+
+		if ( client->in_len < len + 8 ) return;
+
+		if ( get32( client->in+8 ) == 0 ) {
+
+			node = ( len >= 12 ) ? get32( client->in+16 ) : 0;
+			if ( node == 0  ||  node > 0xFE ) node = (uint32_t) ( client - ep->client ) + 2;
+
+			memcpy( buf, "FINS", 4 );
+			put32( buf+4,  16   );
+			put32( buf+8,  1    );
+			put32( buf+12, 0    );
+			put32( buf+16, node );
+			put32( buf+20, 1    );
+
+			if ( send( client->sockfd, (send_tp *) buf, sizeof(buf), TUNNEL_SEND_FLAGS ) != (int) sizeof(buf) ) { client_close( client ); return; }
+		}
+
+		else if ( get32( client->in+8 ) == 2  &&  len >= 8 + FINS_HEADER_LEN ) {
+
+			if ( ! ep_local_read( ep, client, client->in + FINS_TCP_HEADER_LEN, len - 8 ) ) ep_forward( ep, client, client->in + FINS_TCP_HEADER_LEN, len - 8 );
+			if ( client->sockfd == INVALID_SOCKET ) return;
+		}
+
+		client->in_len -= len + 8;
+		memmove( client->in, client->in + len + 8, client->in_len );
+	}
+
+}  /* client_process */
+
+/*
+ * static void client_respond( struct fins_tunnelclient_tp *client, const unsigned char *header, const unsigned char *body, size_t bodylen );
+ *
+ * The function client_respond() sends a FINS response to a client. The
+ * response header is derived from the header of the command by swapping the
+ * source and destination addresses. A client which cannot receive the
+ * response is disconnected.
+ */
+
+static void client_respond( struct fins_tunnelclient_tp *client, const unsigned char *header, const unsigned char *body, size_t bodylen ) {
+
+	unsigned char buf[FINS_TCP_HEADER_LEN+FINS_HEADER_LEN+FINS_BODY_LEN];
+	size_t len;
+
+	if ( client->sockfd == INVALID_SOCKET ) return;
+
+	if ( bodylen > FINS_BODY_LEN ) bodylen = FINS_BODY_LEN;
+
+	len = FINS_TCP_HEADER_LEN + FINS_HEADER_LEN + bodylen;
+
+	memcpy( buf, "FINS", 4 );
+	put32( buf+4,  (uint32_t) ( len - 8 ) );
+	put32( buf+8,  2 );
+	put32( buf+12, 0 );
+
+	buf[FINS_TCP_HEADER_LEN+FINS_ICF] = header[FINS_ICF] | 0x40;
+	buf[FINS_TCP_HEADER_LEN+FINS_RSV] = 0x00;
+	buf[FINS_TCP_HEADER_LEN+FINS_GCT] = 0x02;
+	buf[FINS_TCP_HEADER_LEN+FINS_DNA] = header[FINS_SNA];
+	buf[FINS_TCP_HEADER_LEN+FINS_DA1] = header[FINS_SA1];
+	buf[FINS_TCP_HEADER_LEN+FINS_DA2] = header[FINS_SA2];
+	buf[FINS_TCP_HEADER_LEN+FINS_SNA] = header[FINS_DNA];
+	buf[FINS_TCP_HEADER_LEN+FINS_SA1] = header[FINS_DA1];
+	buf[FINS_TCP_HEADER_LEN+FINS_SA2] = header[FINS_DA2];
+	buf[FINS_TCP_HEADER_LEN+FINS_SID] = header[FINS_SID];
+	buf[FINS_TCP_HEADER_LEN+FINS_MRC] = header[FINS_MRC];
+	buf[FINS_TCP_HEADER_LEN+FINS_SRC] = header[FINS_SRC];
+
+	memcpy( buf + FINS_TCP_HEADER_LEN + FINS_HEADER_LEN, body, bodylen );
+
+	if ( send( client->sockfd, (send_tp *) buf, (int) len, TUNNEL_SEND_FLAGS ) != (int) len ) client_close( client );
+
+}  /* client_respond */
+
+/*
+ * static void client_respond_endcode( struct fins_tunnelclient_tp *client, const unsigned char *header, uint16_t endcode );
+ *
+ * The function client_respond_endcode() sends a FINS response to a client
+ * which consists only of an end code.
+ */
+
+static void client_respond_endcode( struct fins_tunnelclient_tp *client, const unsigned char *header, uint16_t endcode ) {
+
+	unsigned char body[2];
+
+	body[0] = ( endcode >> 8 ) & 0xff;
+	body[1] = ( endcode      ) & 0xff;
+
+	client_respond( client, header, body, 2 );
+
+}  /* client_respond_endcode */
+
+/*
+ * static void ep_accept_client( struct fins_tunnelendpoint_tp *ep );
+ *
+ * The function ep_accept_client() accepts a new FINS/TCP client of an
+ * endpoint. The connection is closed immediately when all client slots are
+ * in use.
+ */
+
+static void ep_accept_client( struct fins_tunnelendpoint_tp *ep ) {
+
+	SOCKET fd;
+	size_t a;
+
+	if ( ( fd = accept( ep->fins_listen, NULL, NULL ) ) == INVALID_SOCKET ) return;
+
+	for (a=0; a<FINS_TUNNEL_MAX_CLIENTS; a++) {
+
+		if ( ep->client[a].sockfd != INVALID_SOCKET ) continue;
+
+		set_socket_options( fd, false );
+
+		ep->client[a].sockfd  = fd;
+		ep->client[a].in_len  = 0;
+		ep->client[a].pending = false;
+
+		return;
+	}
+
+	closesocket( fd );
+
+}  /* ep_accept_client */
+
+/*
+ * static void ep_accept_link( struct fins_tunnelendpoint_tp *ep );
+ *
+ * The function ep_accept_link() accepts the link from an agent. A new link
+ * replaces an existing one, because an agent which lost its connection
+ * reconnects before the old link times out. The endpoint starts the
+ * synchronization by sending a HELLO frame with the state of its copy.
+ */
+
+static void ep_accept_link( struct fins_tunnelendpoint_tp *ep ) {
+
+	SOCKET fd;
+
+	if ( ( fd = accept( ep->link_listen, NULL, NULL ) ) == INVALID_SOCKET ) return;
+
+	if ( ep->link.sockfd != INVALID_SOCKET ) {
+
+		link_close( & ep->link );
+		ep_fail_pending( ep );
+	}
+
+	set_socket_options( fd, true );
+
+	ep->link.sockfd    = fd;
+	ep->sequence_valid = false;
+
+	if ( ! ep_send_hello( ep ) ) link_close( & ep->link );
+
+}  /* ep_accept_link */
+
+/*
+ * static void ep_apply_batch( struct fins_tunnelendpoint_tp *ep, const unsigned char *payload, size_t len );
+ *
+ * The function ep_apply_batch() applies the entries of a BATCH frame to the
+ * local copy of the blocks. Unknown blocks are added when they are received
+ * completely. A missing batch or a change for a block of which the local
+ * copy is not valid or not of the previous version invalidates the copy and
+ * triggers a new synchronization with a HELLO frame. Until the agent answers
+ * the HELLO frame, batches which were already underway are ignored.
+ */
+
+static void ep_apply_batch( struct fins_tunnelendpoint_tp *ep, const unsigned char *payload, size_t len ) {
+
+	struct fins_mcastlink_tp *block;
+	const unsigned char *entry;
+	uint16_t *data;
+	uint32_t sequence;
+	uint32_t version;
+	size_t a;
+	size_t pos;
+	size_t num;
+	size_t num_words;
+	size_t offset;
+	size_t count;
+	uint8_t kind;
+	bool resync;
+
+	if ( len < TUNNEL_BATCH_LEN ) return;
+
+	if ( ! ep->sequence_valid  &&  ! payload[6] ) return;
+
+	sequence = get32( payload   );
+	num      = get16( payload+4 );
+	resync   = ( ep->sequence_valid  &&  sequence != ep->sequence );
+	pos      = TUNNEL_BATCH_LEN;
+
+	ep->sequence       = sequence + 1;
+	ep->sequence_valid = true;
+
+	while ( ! resync  &&  num-- > 0 ) {
+
+		if ( pos + TUNNEL_ENTRY_LEN > len ) { resync = true; break; }
+
+		entry     = payload + pos;
+		version   = get32( entry+2  );
+		kind      = entry[6];
+		num_words = get16( entry+12 );
+		offset    = get16( entry+14 );
+		count     = get16( entry+16 );
+		pos      += TUNNEL_ENTRY_LEN + 2*count;
+
+		if ( pos > len  ||  offset + count > num_words ) { resync = true; break; }
+
+		if ( ( block = ep_block( ep, get16( entry ), kind == TUNNEL_ENTRY_FULL ) ) == NULL ) {
+
+			if ( kind == TUNNEL_ENTRY_DELTA ) resync = true;
+			continue;
+		}
+
+		if ( kind == TUNNEL_ENTRY_INVALID ) { block->data_valid = false; continue; }
+
+		if ( kind == TUNNEL_ENTRY_FULL ) {
+
+			if ( block->block.num_words != num_words ) {
+
+				block->data_valid = false;
+
+				if ( ( data = realloc( block->data, num_words * sizeof(uint16_t) ) ) == NULL ) continue;
+
+				block->data            = data;
+				block->block.num_words = num_words;
+				block->full_received   = 0;
+			}
+
+			if ( offset == 0 ) {
+
+				block->full_version  = version;
+				block->full_received = 0;
+				block->area          = entry[7];
+				block->start         = get32( entry+8 );
+			}
+
+			if ( block->full_version != version  ||  block->full_received != offset ) { block->data_valid = false; continue; }
+
+			for (a=0; a<count; a++) block->data[offset+a] = get16( entry + TUNNEL_ENTRY_LEN + 2*a );
+
+			block->full_received += count;
+			block->data_valid     = ( block->full_received == num_words );
+
+			if ( block->data_valid ) block->version = version;
+
+			continue;
+		}
+
+		if ( ! block->data_valid  ||  block->block.num_words != num_words  ||  ( version != block->version + 1  &&  version != block->version ) ) {
+
+			block->data_valid = false;
+			resync            = true;
+			continue;
+		}
+
+		for (a=0; a<count; a++) block->data[offset+a] = get16( entry + TUNNEL_ENTRY_LEN + 2*a );
+
+		block->version = version;
+	}
+
+	if ( ! resync ) return;
+
+	for (a=0; a<ep->num_block; a++) ep->block[a].data_valid = false;
+
+	ep->gaps++;
+
+	if ( ! ep_send_hello( ep ) ) {
+
+		link_close( & ep->link );
+		ep_fail_pending( ep );
+	}
+
+}  /* ep_apply_batch */
+
+/*
+ * static struct fins_mcastlink_tp *ep_block( struct fins_tunnelendpoint_tp *ep, uint16_t id, bool create );
+ *
+ * The function ep_block() returns the local copy of a block of an endpoint.
+ * If the block is unknown and create is true, an empty copy is added. NULL is
+ * returned if the block is unknown or no memory could be allocated.
+ */
+
+static struct fins_mcastlink_tp *ep_block( struct fins_tunnelendpoint_tp *ep, uint16_t id, bool create ) {
+
+	struct fins_mcastlink_tp *block;
+	size_t a;
+
+	for (a=0; a<ep->num_block; a++) if ( ep->block[a].block.id == id ) return & ep->block[a];
+
+	if ( ! create ) return NULL;
+
+	block = realloc( ep->block, ( ep->num_block + 1 ) * sizeof(struct fins_mcastlink_tp) );
+	if ( block == NULL ) return NULL;
+
+	ep->block = block;
+	block     = & ep->block[ep->num_block++];
+
+	memset( block, 0, sizeof(struct fins_mcastlink_tp) );
+
+	block->block.id = id;
+
+	return block;
+
+}  /* ep_block */
+
+/*
+ * static void ep_fail_pending( struct fins_tunnelendpoint_tp *ep );
+ *
+ * The function ep_fail_pending() answers all forwarded commands of an
+ * endpoint with the end code for a response timeout after the link was lost,
+ * because their responses can no longer arrive.
+ */
+
+static void ep_fail_pending( struct fins_tunnelendpoint_tp *ep ) {
+
+	size_t a;
+
+	for (a=0; a<FINS_TUNNEL_MAX_CLIENTS; a++) {
+
+		if ( ! ep->client[a].pending ) continue;
+
+		ep->client[a].pending = false;
+		client_respond_endcode( & ep->client[a], ep->client[a].header, ENDCODE_NO_RESPONSE );
+		client_process( ep, & ep->client[a] );
+	}
+
+}  /* ep_fail_pending */
+
+/*
+ * static void ep_forward( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client, const unsigned char *frame, size_t len );
+ *
+ * The function ep_forward() sends a FINS command of a client over the link
+ * to be executed by the agent. The command is tagged so that the response
+ * can be returned to the right client. When the link is down, the command
+ * is answered immediately with the end code for a response timeout.
+ */
+
+static void ep_forward( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client, const unsigned char *frame, size_t len ) {
+
+	unsigned char *buf;
+	size_t start;
+
+	if ( ep->link.sockfd == INVALID_SOCKET  ||  ! link_start_frame( & ep->link, TUNNEL_TYPE_REQUEST, & start ) ) {
+
+		client_respond_endcode( client, frame, ENDCODE_NO_RESPONSE );
+		return;
+	}
+
+	if ( ( buf = link_reserve( & ep->link, 6 + len - FINS_HEADER_LEN ) ) == NULL ) {
+
+		ep->link.out_len = start;
+		client_respond_endcode( client, frame, ENDCODE_NO_RESPONSE );
+		return;
+	}
+
+	put32( buf, ep->next_tag );
+	buf[4] = frame[FINS_MRC];
+	buf[5] = frame[FINS_SRC];
+	memcpy( buf+6, frame + FINS_HEADER_LEN, len - FINS_HEADER_LEN );
+
+	link_end_frame( & ep->link, start );
+
+	memcpy( client->header, frame, FINS_HEADER_LEN );
+
+	client->tag          = ep->next_tag++;
+	client->pending      = true;
+	client->pending_usec = finslib_monotonic_usec_timer();
+
+	ep->forwarded++;
+
+}  /* ep_forward */
+
+/*
+ * static bool ep_local_read( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client, const unsigned char *frame, size_t len );
+ *
+ * The function ep_local_read() answers a word memory area read (01 01) or a
+ * multiple memory area read of words (01 04) from the local copy of the
+ * blocks. The function returns true if the command was answered and false if
+ * the command must be forwarded to the agent because it is another command
+ * or the requested memory is not completely available in a valid copy.
+ */
+
+static bool ep_local_read( struct fins_tunnelendpoint_tp *ep, struct fins_tunnelclient_tp *client, const unsigned char *frame, size_t len ) {
+
+	unsigned char body[FINS_BODY_LEN];
+	const unsigned char *cmd;
+	const uint16_t *words;
+	size_t a;
+	size_t count;
+	size_t num;
+	size_t cmdlen;
+
+	cmd    = frame + FINS_HEADER_LEN;
+	cmdlen = len   - FINS_HEADER_LEN;
+
+	if ( frame[FINS_MRC] != 0x01 ) return false;
+
+	body[0] = 0x00;
+	body[1] = 0x00;
+
+	if ( frame[FINS_SRC] == 0x01 ) {
+
+		if ( cmdlen != 6  ||  cmd[3] != 0 ) return false;
+
+		count = get16( cmd+4 );
+		if ( count == 0  ||  2 + 2*count > FINS_BODY_LEN ) return false;
+
+		if ( ( words = ep_words( ep, cmd[0], get16( cmd+1 ), count ) ) == NULL ) return false;
+
+		for (a=0; a<count; a++) put16( body + 2 + 2*a, words[a] );
+
+		client_respond( client, frame, body, 2 + 2*count );
+		ep->served_local++;
+
+		return true;
+	}
+
+	if ( frame[FINS_SRC] == 0x04 ) {
+
+		num = cmdlen / 4;
+		if ( num == 0  ||  cmdlen % 4 != 0  ||  2 + 3*num > FINS_BODY_LEN ) return false;
+
+		for (a=0; a<num; a++) {
+
+			if ( cmd[4*a+3] != 0 ) return false;
+			if ( ( words = ep_words( ep, cmd[4*a], get16( cmd + 4*a + 1 ), 1 ) ) == NULL ) return false;
+
+			body[2+3*a] = cmd[4*a];
+			put16( body + 3 + 3*a, words[0] );
+		}
+
+		client_respond( client, frame, body, 2 + 3*num );
+		ep->served_local++;
+
+		return true;
+	}
+
+	return false;
+
+}  /* ep_local_read */
+
+/*
+ * static bool ep_send_hello( struct fins_tunnelendpoint_tp *ep );
+ *
+ * The function ep_send_hello() queues a HELLO frame with the ID, version and
+ * validity of each block in the local copy of an endpoint. The agent answers
+ * with a batch in which all blocks of which the endpoint has no valid copy of
+ * the current version are sent completely. The function returns false if no
+ * memory could be allocated.
+ */
+
+static bool ep_send_hello( struct fins_tunnelendpoint_tp *ep ) {
+
+	unsigned char *buf;
+	size_t a;
+	size_t start;
+
+	if ( ! link_start_frame( & ep->link, TUNNEL_TYPE_HELLO, & start ) ) return false;
+
+	if ( ( buf = link_reserve( & ep->link, 2 + 7*ep->num_block ) ) == NULL ) {
+
+		ep->link.out_len = start;
+		return false;
+	}
+
+	put16( buf, (uint32_t) ep->num_block );
+
+	for (a=0; a<ep->num_block; a++) {
+
+		put16( buf + 2 + 7*a, ep->block[a].block.id );
+		put32( buf + 4 + 7*a, ep->block[a].version  );
+		buf[8+7*a] = ep->block[a].data_valid;
+	}
+
+	link_end_frame( & ep->link, start );
+
+	ep->sequence_valid = false;
+
+	return true;
+
+}  /* ep_send_hello */
+
+/*
+ * static const uint16_t *ep_words( struct fins_tunnelendpoint_tp *ep, uint8_t area, uint32_t start, size_t count );
+ *
+ * The function ep_words() returns a pointer to a range of words in the local
+ * copy of an endpoint, or NULL if the range is not completely contained in
+ * one valid block.
+ */
+
+static const uint16_t *ep_words( struct fins_tunnelendpoint_tp *ep, uint8_t area, uint32_t start, size_t count ) {
+
+	const struct fins_mcastlink_tp *block;
+	size_t a;
+
+	for (a=0; a<ep->num_block; a++) {
+
+		block = & ep->block[a];
+
+		if ( ! block->data_valid  ||  block->area != area  ||  start < block->start ) continue;
+
+		if ( start - block->start + count <= block->block.num_words ) return block->data + ( start - block->start );
+	}
+
+	return NULL;
+
+}  /* ep_words */
+
+/*
+ * static uint16_t get16( const unsigned char *buf );
+ *
+ * The function get16() returns a 16 bit big endian value from a buffer.
+ */
+
+static uint16_t get16( const unsigned char *buf ) {
+
+	return (uint16_t) ( ( buf[0] << 8 ) | buf[1] );
+
+}  /* get16 */
+
+/*
+ * static uint32_t get32( const unsigned char *buf );
+ *
+ * The function get32() returns a 32 bit big endian value from a buffer.
+ */
+
+static uint32_t get32( const unsigned char *buf ) {
+
+	return ( (uint32_t) buf[0] << 24 ) | ( (uint32_t) buf[1] << 16 ) | ( (uint32_t) buf[2] << 8 ) | buf[3];
+
+}  /* get32 */
+
+/*
+ * static bool link_alloc( struct fins_tunnellink_tp *link );
+ *
+ * The function link_alloc() allocates the receive buffer of a link, which is
+ * large enough for one frame of the maximum size. The send buffer grows when
+ * needed. The function returns false if no memory could be allocated.
+ */
+
+static bool link_alloc( struct fins_tunnellink_tp *link ) {
+
+	link->in = malloc( TUNNEL_HEADER_LEN + FINS_TUNNEL_MAX_FRAME );
+
+	return ( link->in != NULL );
+
+}  /* link_alloc */
+
+/*
+ * static void link_close( struct fins_tunnellink_tp *link );
+ *
+ * The function link_close() closes the socket of a link and discards all
+ * frames which were not completely sent or received.
+ */
+
+static void link_close( struct fins_tunnellink_tp *link ) {
+
+	if ( link->sockfd != INVALID_SOCKET ) closesocket( link->sockfd );
+
+	link->sockfd   = INVALID_SOCKET;
+	link->in_len   = 0;
+	link->out_len  = 0;
+	link->out_sent = 0;
+	link->num_due  = 0;
+
+}  /* link_close */
+
+/*
+ * static void link_consume( struct fins_tunnellink_tp *link, size_t len );
+ *
+ * The function link_consume() removes the frame with a payload of len bytes
+ * which was returned by link_next_frame() from the receive buffer.
+ */
+
+static void link_consume( struct fins_tunnellink_tp *link, size_t len ) {
+
+	link->in_len -= TUNNEL_HEADER_LEN + len;
+
+	memmove( link->in, link->in + TUNNEL_HEADER_LEN + len, link->in_len );
+
+}  /* link_consume */
+
+/*
+ * static size_t link_due_msec( const struct fins_tunnellink_tp *link, uint64_t now, size_t max_msec );
+ *
+ * The function link_due_msec() returns the number of milliseconds until the
+ * next held back frame of a link may be sent, limited to max_msec.
+ */
+
+static size_t link_due_msec( const struct fins_tunnellink_tp *link, uint64_t now, size_t max_msec ) {
+
+	size_t a;
+	size_t due_msec;
+
+	for (a=0; a<link->num_due; a++) {
+
+		if ( link->due_usec[a] <= now ) continue;
+
+		due_msec = (size_t) ( ( link->due_usec[a] - now + 999 ) / 1000 );
+
+		return ( due_msec < max_msec ) ? due_msec : max_msec;
+	}
+
+	return max_msec;
+
+}  /* link_due_msec */
+
+/*
+ * static void link_end_frame( struct fins_tunnellink_tp *link, size_t start );
+ *
+ * The function link_end_frame() stores the payload length of a frame which
+ * was built in the send buffer of a link and releases it for sending. With
+ * an injected delay the frame is held back until the delay has passed. When
+ * too many frames are held back, the frame is combined with the last one.
+ */
+
+static void link_end_frame( struct fins_tunnellink_tp *link, size_t start ) {
+
+	put32( link->out + start + 4, (uint32_t) ( link->out_len - start - TUNNEL_HEADER_LEN ) );
+
+	link->frames_sent++;
+
+	if ( link->delay_msec == 0 ) return;
+
+	if ( link->num_due >= FINS_TUNNEL_MAX_DELAYED ) { link->due_end[link->num_due-1] = link->out_len; return; }
+
+	link->due_end[link->num_due]  = link->out_len;
+	link->due_usec[link->num_due] = finslib_monotonic_usec_timer() + 1000 * (uint64_t) link->delay_msec;
+	link->num_due++;
+
+}  /* link_end_frame */
+
+/*
+ * static int link_flush( struct fins_tunnellink_tp *link );
+ *
+ * The function link_flush() sends as many queued frames of a link as the
+ * socket accepts without blocking. Frames which are held back for an
+ * injected delay are sent when the delay has passed.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int link_flush( struct fins_tunnellink_tp *link ) {
+
+	size_t a;
+	size_t b;
+	size_t ready;
+	int sent;
+
+	if ( link->sockfd == INVALID_SOCKET ) return FINS_RETVAL_NOT_CONNECTED;
+
+	ready = link_ready( link, finslib_monotonic_usec_timer() );
+
+	while ( link->out_sent < ready ) {
+
+		sent = send( link->sockfd, (send_tp *) ( link->out + link->out_sent ), (int) ( ready - link->out_sent ), TUNNEL_SEND_FLAGS );
+
+		if ( sent < 0 ) {
+
+			if ( would_block() ) break;
+			return socket_error();
+		}
+
+		link->out_sent   += (size_t) sent;
+		link->bytes_sent += (uint64_t) sent;
+	}
+
+	for (a=0; a<link->num_due  &&  link->due_end[a] <= link->out_sent; a++) {}
+
+	if ( a > 0 ) {
+
+		for (b=a; b<link->num_due; b++) {
+
+			link->due_end[b-a]  = link->due_end[b];
+			link->due_usec[b-a] = link->due_usec[b];
+		}
+
+		link->num_due -= a;
+	}
+
+	if ( link->out_sent > 0  &&  link->out_sent >= link->out_len / 2 ) {
+
+		memmove( link->out, link->out + link->out_sent, link->out_len - link->out_sent );
+
+		for (a=0; a<link->num_due; a++) link->due_end[a] -= link->out_sent;
+
+		link->out_len  -= link->out_sent;
+		link->out_sent  = 0;
+	}
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* link_flush */
+
+/*
+ * static void link_free( struct fins_tunnellink_tp *link );
+ *
+ * The function link_free() closes a link and releases its buffers.
+ */
+
+static void link_free( struct fins_tunnellink_tp *link ) {
+
+	link_close( link );
+
+	free( link->in  );
+	free( link->out );
+
+	link->in       = NULL;
+	link->out      = NULL;
+	link->out_size = 0;
+
+}  /* link_free */
+
+/*
+ * static void link_init( struct fins_tunnellink_tp *link );
+ *
+ * The function link_init() initializes a link without socket and buffers.
+ */
+
+static void link_init( struct fins_tunnellink_tp *link ) {
+
+	memset( link, 0, sizeof(struct fins_tunnellink_tp) );
+
+	link->sockfd = INVALID_SOCKET;
+
+}  /* link_init */
+
+/*
+ * static bool link_next_frame( struct fins_tunnellink_tp *link, uint8_t *type, const unsigned char **payload, size_t *len, int *retval );
+ *
+ * The function link_next_frame() returns true if the receive buffer of a
+ * link starts with a complete frame and returns its type, payload and
+ * payload length. The frame must be removed with link_consume() after it has
+ * been handled. A malformed frame header stores an error in the variable
+ * pointed to by retval, after which the link must be closed.
+ */
+
+static bool link_next_frame( struct fins_tunnellink_tp *link, uint8_t *type, const unsigned char **payload, size_t *len, int *retval ) {
+
+	if ( link->in_len < TUNNEL_HEADER_LEN ) return false;
+
+	*len = get32( link->in+4 );
+
+	if ( link->in[0] != 'F'  ||  link->in[1] != 'T'  ||  *len > FINS_TUNNEL_MAX_FRAME ) {
+
+		*retval = FINS_RETVAL_SYNC_ERROR;
+		return false;
+	}
+
+	if ( link->in_len < TUNNEL_HEADER_LEN + *len ) return false;
+
+	*type    = link->in[2];
+	*payload = link->in + TUNNEL_HEADER_LEN;
+
+	link->frames_received++;
+
+	return true;
+
+}  /* link_next_frame */
+
+/*
+ * static int link_receive( struct fins_tunnellink_tp *link );
+ *
+ * The function link_receive() reads the available bytes from the socket of a
+ * link into its receive buffer.
+ *
+ * The function returns a success or error code from the list FINS_RETVAL_...
+ */
+
+static int link_receive( struct fins_tunnellink_tp *link ) {
+
+	int received;
+
+	received = recv( link->sockfd, (recv_tp *) ( link->in + link->in_len ), (int) ( TUNNEL_HEADER_LEN + FINS_TUNNEL_MAX_FRAME - link->in_len ), 0 );
+
+	if ( received == 0 ) return FINS_RETVAL_NOT_CONNECTED;
+
+	if ( received < 0 ) return ( would_block() ) ? FINS_RETVAL_SUCCESS : socket_error();
+
+	link->in_len         += (size_t) received;
+	link->bytes_received += (uint64_t) received;
+
+	return FINS_RETVAL_SUCCESS;
+
+}  /* link_receive */
+
+/*
+ * static size_t link_ready( const struct fins_tunnellink_tp *link, uint64_t now );
+ *
+ * The function link_ready() returns the position in the send buffer of a
+ * link up to which the frames may be sent.
+ */
+
+static size_t link_ready( const struct fins_tunnellink_tp *link, uint64_t now ) {
+
+	size_t a;
+	size_t ready;
+
+	if ( link->delay_msec == 0  ||  link->num_due == 0 ) return link->out_len;
+
+	ready = link->out_sent;
+
+	for (a=0; a<link->num_due  &&  link->due_usec[a] <= now; a++) ready = link->due_end[a];
+
+	return ready;
+
+}  /* link_ready */
+
+/*
+ * static unsigned char *link_reserve( struct fins_tunnellink_tp *link, size_t len );
+ *
+ * The function link_reserve() appends len bytes to the send buffer of a link
+ * and returns a pointer to them, or NULL if no memory could be allocated.
+ */
+
+static unsigned char *link_reserve( struct fins_tunnellink_tp *link, size_t len ) {
+
+	unsigned char *buf;
+	size_t size;
+
+	if ( link->out_len + len > link->out_size ) {
+
+		size = 2 * link->out_size;
+		if ( size < link->out_len + len ) size = link->out_len + len;
+		if ( size < 4096                ) size = 4096;
+
+		if ( ( buf = realloc( link->out, size ) ) == NULL ) return NULL;
+
+		link->out      = buf;
+		link->out_size = size;
+	}
+
+	buf            = link->out + link->out_len;
+	link->out_len += len;
+
+	return buf;
+
+}  /* link_reserve */
+
+/*
+ * static bool link_start_frame( struct fins_tunnellink_tp *link, uint8_t type, size_t *start );
+ *
+ * The function link_start_frame() starts a new frame of the given type in the
+ * send buffer of a link and stores its position in the variable pointed to
+ * by start. The payload is appended with link_reserve() and the frame is
+ * finished with link_end_frame(). The function returns false if no memory
+ * could be allocated.
+ */
+
+static bool link_start_frame( struct fins_tunnellink_tp *link, uint8_t type, size_t *start ) {
+
+	unsigned char *buf;
+
+	*start = link->out_len;
+
+	if ( ( buf = link_reserve( link, TUNNEL_HEADER_LEN ) ) == NULL ) return false;
+
+	buf[0] = 'F';
+	buf[1] = 'T';
+	buf[2] = type;
+	buf[3] = 0x00;
+
+	put32( buf+4, 0 );
+
+	return true;
+
+}  /* link_start_frame */
+
+/*
+ * static void put16( unsigned char *buf, uint32_t value );
+ *
+ * The function put16() stores a 16 bit value in big endian order in a buffer.
+ */
+
+static void put16( unsigned char *buf, uint32_t value ) {
+
+	buf[0] = (unsigned char) ( ( value >> 8 ) & 0xff );
+	buf[1] = (unsigned char) ( ( value      ) & 0xff );
+
+}  /* put16 */
+
+/*
+ * static void put32( unsigned char *buf, uint32_t value );
+ *
+ * The function put32() stores a 32 bit value in big endian order in a buffer.
+ */
+
+static void put32( unsigned char *buf, uint32_t value ) {
+
+	buf[0] = (unsigned char) ( ( value >> 24 ) & 0xff );
+	buf[1] = (unsigned char) ( ( value >> 16 ) & 0xff );
+	buf[2] = (unsigned char) ( ( value >>  8 ) & 0xff );
+	buf[3] = (unsigned char) ( ( value       ) & 0xff );
+
+}  /* put32 */
+
+/*
+ * static void set_socket_options( SOCKET fd, bool nonblocking );
+ *
+ * The function set_socket_options() disables the Nagle algorithm on a TCP
+ * socket, because the tunnel sends complete frames. Link sockets are made
+ * non blocking. Client sockets stay blocking with a send timeout, so that a
+ * client which does not read its responses cannot stall the endpoint.
+ */
+
+static void set_socket_options( SOCKET fd, bool nonblocking ) {
+
+	int no_delay;
+#if defined(_WIN32)
+	u_long mode;
+	DWORD timeout;
+#else  /* defined(_WIN32) */
+	struct timeval timeout;
+#endif  /* defined(_WIN32) */
+
+	no_delay = 1;
+
+	setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, (setsockopt_tp *) & no_delay, sizeof(no_delay) );
+
+	if ( nonblocking ) {
+
+#if defined(_WIN32)
+		mode = 1;
+		ioctlsocket( fd, FIONBIO, & mode );
+#else  /* defined(_WIN32) */
+		fcntl( fd, F_SETFL, fcntl( fd, F_GETFL, 0 ) | O_NONBLOCK );
+#endif  /* defined(_WIN32) */
+
+		return;
+	}
+
+#if defined(_WIN32)
+	timeout = FINS_TUNNEL_TIMEOUT;
+#else  /* defined(_WIN32) */
+	timeout.tv_sec  = FINS_TUNNEL_TIMEOUT / 1000;
+	timeout.tv_usec = 1000 * ( FINS_TUNNEL_TIMEOUT % 1000 );
+#endif  /* defined(_WIN32) */
+
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, (setsockopt_tp *) & timeout, sizeof(timeout) );
+
+}  /* set_socket_options */
+
+/*
+ * static int socket_error( void );
+ *
+ * The function socket_error() translates the error of the last failed socket
+ * call to a FINS_RETVAL_... value.
+ */
+
+static int socket_error( void ) {
+
+#if defined(_WIN32)
+	return XX_finslib_wsa_errorcode_to_fins_retval( WSAGetLastError() );
+#else  /* defined(_WIN32) */
+	return FINS_RETVAL_ERRNO_BASE + errno;
+#endif  /* defined(_WIN32) */
+
+}  /* socket_error */
+
+/*
+ * static SOCKET tcp_listen( const char *address, uint16_t port, int *retval );
+ *
+ * The function tcp_listen() creates a TCP socket which accepts connections
+ * on the given address and port. A NULL address listens on all interfaces.
+ * On failure INVALID_SOCKET is returned and the reason is stored in the
+ * variable pointed to by retval.
+ */
+
+static SOCKET tcp_listen( const char *address, uint16_t port, int *retval ) {
+
+	struct sockaddr_in local_addr;
+	SOCKET fd;
+	int reuse;
+
+	reuse = 1;
+
+	memset( & local_addr, 0, sizeof(local_addr) );
+
+	local_addr.sin_family      = AF_INET;
+	local_addr.sin_addr.s_addr = htonl( INADDR_ANY );
+	local_addr.sin_port        = htons( port );
+
+	if ( address != NULL  &&  finslib_inet_pton( AF_INET, address, & local_addr.sin_addr.s_addr ) != 1 ) { *retval = FINS_RETVAL_INVALID_IP_ADDRESS; return INVALID_SOCKET; }
+
+	if ( ( fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP ) ) == INVALID_SOCKET ) { *retval = socket_error(); return INVALID_SOCKET; }
+
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, (setsockopt_tp *) & reuse, sizeof(reuse) );
+
+	if ( bind( fd, (struct sockaddr *) & local_addr, sizeof(local_addr) ) < 0  ||  listen( fd, 8 ) < 0 ) {
+
+		*retval = socket_error();
+		closesocket( fd );
+
+		return INVALID_SOCKET;
+	}
+
+	return fd;
+
+}  /* tcp_listen */
+
+/*
+ * static bool would_block( void );
+ *
+ * The function would_block() returns true if the last failed socket call on
+ * a non blocking socket failed only because it would have to wait.
+ */
+
+static bool would_block( void ) {
+
+#if defined(_WIN32)
+	return ( WSAGetLastError() == WSAEWOULDBLOCK );
+#else  /* defined(_WIN32) */
+	return ( errno == EAGAIN  ||  errno == EWOULDBLOCK  ||  errno == EINTR );
+#endif  /* defined(_WIN32) */
+
+}  /* would_block */
@@ -507,6 +507,78 @@ time_t finslib_monotonic_sec_timer( void ) {
 
 }  /* finslib_monotonic_sec_timer */
 
+/*
+ * uint64_t finslib_monotonic_usec_timer( void );
+ *
+ * The function finslib_monotonic_usec_timer() returns the value of a
+ * microseconds timer which is guaranteed to be monotonic, but has no
+ * connection with the wall clock. It is used to measure short intervals.
+ */
+
+uint64_t finslib_monotonic_usec_timer( void ) {
+
+#if defined(_WIN32)
+
+	LARGE_INTEGER performance_counter;
+	LARGE_INTEGER performance_frequency;
+	uint64_t counter_value;
+	uint64_t frequency_value;
+
+	QueryPerformanceCounter(   & performance_counter   );
+	QueryPerformanceFrequency( & performance_frequency );
+
+	counter_value   = performance_counter.QuadPart;
+	frequency_value = performance_frequency.QuadPart;
+
+	if ( frequency_value == 0 ) return counter_value;
+
+	return ( counter_value / frequency_value ) * 1000000 + ( ( counter_value % frequency_value ) * 1000000 ) / frequency_value;
+
+#else  /* defined(_WIN32) */
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, & ts );
+	return ((uint64_t) ts.tv_sec) * 1000000 + ((uint64_t) ts.tv_nsec) / 1000;
+
+#endif  /* defined(_WIN32) */
+
+}  /* finslib_monotonic_usec_timer */
+
+/*
+ * uint64_t finslib_epoch_usec_timer( void );
+ *
+ * The function finslib_epoch_usec_timer() returns the wall clock time as the
+ * number of microseconds since 1 January 1970 UTC. It is used to timestamp
+ * events detected in PLC data.
+ */
+
+uint64_t finslib_epoch_usec_timer( void ) {
+
+#if defined(_WIN32)
+
+	FILETIME file_time;
+	uint64_t value;
+
+	GetSystemTimeAsFileTime( & file_time );
+
+	value   = file_time.dwHighDateTime;
+	value <<= 32;
+	value  += file_time.dwLowDateTime;
+
+	return ( value - 116444736000000000ULL ) / 10;
+
+#else  /* defined(_WIN32) */
+
+	struct timespec ts;
+
+	clock_gettime( CLOCK_REALTIME, & ts );
+	return ((uint64_t) ts.tv_sec) * 1000000 + ((uint64_t) ts.tv_nsec) / 1000;
+
+#endif  /* defined(_WIN32) */
+
+}  /* finslib_epoch_usec_timer */
+
 /*
  * void finslib_milli_second_sleep( int msec );
  *